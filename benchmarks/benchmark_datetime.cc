@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include <regex>                    // for std::regex
+#include <string>                   // for std::string
+#include <vector>                   // for std::vector
+
+#include "datetime.h"               // for Datetime
+
+
+// The regular expression Datetime used to match dates not in strict ISO 8601
+// (before having a hand written matcher), kept as the reference grammar.
+static const std::regex date_re(R"(([0-9]{4})([-/ ]?)(0[1-9]|1[0-2])\2(0[0-9]|[12][0-9]|3[01])([T ]?([01]?[0-9]|2[0-3]):([0-5][0-9])(:([0-5][0-9])([.,]([0-9]+))?)?([ ]*[+-]([01]?[0-9]|2[0-3]):([0-5][0-9])|Z)?)?([ ]*\|\|[ ]*([+-/\dyMwdhms]+))?)", std::regex::optimize);
+
+
+static bool
+regex_isDatetime(std::string_view datetime)
+{
+	switch (Datetime::Iso8601Parser(datetime)) {
+		case Datetime::Format::VALID:
+			return true;
+		case Datetime::Format::INVALID: {
+			std::cmatch m;
+			return std::regex_match(datetime.begin(), datetime.end(), m, date_re);
+		}
+		default:
+			return false;
+	}
+}
+
+
+static const std::vector<std::string> datetimes = {
+	"2015-08-10",
+	"20150810",
+	"2015/08/10 10:12:12.123+05:30",
+	"2015 08 10T1:02:03,5 -2:30 || +1d/M",
+	"2015-08-10T23:59Z",
+	"2015-08-1012:30||//y",
+	"2015-08-10 ||+1y-2M/d",
+	"2015-01-31T10:10:10.999999 +10:00",
+	"20150810T10:12:12|| /w+2w/M+3M/M-3M+2M/M-2M//M+1w",
+	"Back to the Future",
+	"Robert Zemeckis",
+	"$19 million",
+};
+
+
+static void BM_DatetimeMatchRegex(benchmark::State& state) {
+	while (state.KeepRunning()) {
+		for (const auto& datetime : datetimes) {
+			benchmark::DoNotOptimize(regex_isDatetime(datetime));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * datetimes.size());
+}
+BENCHMARK(BM_DatetimeMatchRegex);
+
+
+static void BM_DatetimeMatch(benchmark::State& state) {
+	while (state.KeepRunning()) {
+		for (const auto& datetime : datetimes) {
+			benchmark::DoNotOptimize(Datetime::isDatetime(datetime));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * datetimes.size());
+}
+BENCHMARK(BM_DatetimeMatch);
+
+
+static void BM_DatetimeParser(benchmark::State& state) {
+	std::vector<std::string> valid;
+	for (const auto& datetime : datetimes) {
+		if (Datetime::isDatetime(datetime)) {
+			valid.push_back(datetime);
+		}
+	}
+	while (state.KeepRunning()) {
+		for (const auto& datetime : valid) {
+			benchmark::DoNotOptimize(Datetime::DatetimeParser(datetime));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * valid.size());
+}
+BENCHMARK(BM_DatetimeParser);
+
+
+BENCHMARK_MAIN();
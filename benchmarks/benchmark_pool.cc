@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include <atomic>                   // for std::atomic_size_t
+#include <string>                   // for std::string
+#include <vector>                   // for std::vector
+
+#include "database/flags.h"         // for DB_OPEN
+#include "database/pool.h"          // for DatabasePool
+#include "endpoint.h"               // for Endpoint
+#include "string.hh"                // for string::format
+
+
+#define BENCHMARK_POOL_SIZE     1000
+#define BENCHMARK_POOL_READERS  16
+
+
+static DatabasePool&
+benchmark_pool()
+{
+	static DatabasePool database_pool(BENCHMARK_POOL_SIZE, BENCHMARK_POOL_READERS);
+	return database_pool;
+}
+
+
+// Readable checkout/checkin pairs per second, with every thread cycling
+// through range(0) endpoints (1 endpoint means all threads contend on it).
+static void BM_PoolCheckout(benchmark::State& state) {
+	auto& database_pool = benchmark_pool();
+	std::vector<Endpoint> endpoints;
+	for (int64_t i = 0; i < state.range(0); ++i) {
+		endpoints.emplace_back(string::format("/tmp/benchmark_pool.{}", i));
+	}
+	static std::atomic_size_t threads;
+	size_t next = threads++;  // threads start at different endpoints
+	while (state.KeepRunning()) {
+		auto shard = database_pool.checkout(endpoints[next++ % endpoints.size()], DB_OPEN);
+		database_pool.checkin(shard);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PoolCheckout)->ArgNames({"endpoints"})->Arg(1)->Arg(64)->Threads(1)->Threads(4)->Threads(16)->UseRealTime();
+
+BENCHMARK_MAIN();
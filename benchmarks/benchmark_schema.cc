@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include <fstream>                  // for std::ifstream
+#include <memory>                   // for std::shared_ptr
+#include <random>                   // for std::mt19937
+#include <sstream>                  // for std::stringstream
+#include <string>                   // for std::string
+#include <vector>                   // for std::vector
+
+#include "database/data.h"          // for Data
+#include "database/handler.h"       // for DatabaseHandler
+#include "database/schema.h"        // for Schema
+#include "database/utils.h"         // for json_load
+#include "msgpack.h"                // for MsgPack
+#include "msgpack_view.h"           // for MsgPackView
+#include "reserved/fields.h"        // for ID_FIELD_NAME
+#include "reserved/schema.h"        // for RESERVED_OP_TYPE
+#include "rapidjson/document.h"     // for rapidjson::Document
+
+
+#define BENCHMARK_SCHEMA_EXAMPLES  "/../oldtests/examples/json/"
+#define BENCHMARK_SCHEMA_TEXTS     100
+#define BENCHMARK_SCHEMA_WORDS     200
+#define BENCHMARK_SCHEMA_BULK      10
+
+
+static std::vector<MsgPack>
+schema_examples()
+{
+	static const char* names[] = {
+		"example_1.txt", "example_2.txt",
+		"geo_1.txt", "geo_2.txt", "geo_3.txt", "geo_4.txt",
+		"geo_5.txt", "geo_6.txt", "geo_7.txt", "geo_8.txt",
+	};
+	std::string path(__FILE__);
+	path = path.substr(0, path.find_last_of('/')) + BENCHMARK_SCHEMA_EXAMPLES;
+	std::vector<MsgPack> examples;
+	for (const auto& name : names) {
+		std::ifstream in(path + name);
+		std::stringstream buffer;
+		buffer << in.rdbuf();
+		rapidjson::Document rdoc;
+		json_load(rdoc, buffer.str());
+		examples.emplace_back(rdoc);
+	}
+	return examples;
+}
+
+
+// Index the examples against a schema which already knows all of their
+// fields, so every document takes the compiled (cached specification) path.
+static void BM_SchemaIndexCompiled(benchmark::State& state) {
+	auto examples = schema_examples();
+	DatabaseHandler db_handler;
+	Data data;
+
+	std::shared_ptr<const MsgPack> schema = Schema::get_initial_schema();
+	for (const auto& example : examples) {
+		Schema warmup(schema, nullptr, "");
+		warmup.index(example, MsgPack("1"), db_handler, data);
+		auto modified = warmup.get_modified_schema();
+		if (modified) {
+			schema = modified;
+		}
+	}
+
+	while (state.KeepRunning()) {
+		Schema s(schema, nullptr, "");
+		for (const auto& example : examples) {
+			benchmark::DoNotOptimize(s.index(example, MsgPack("1"), db_handler, data));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * examples.size());
+}
+BENCHMARK(BM_SchemaIndexCompiled);
+
+
+// Index the examples against a brand new schema every time, so all of
+// their fields are detected dynamically and written to the schema.
+static void BM_SchemaIndexDynamic(benchmark::State& state) {
+	auto examples = schema_examples();
+	DatabaseHandler db_handler;
+	Data data;
+
+	while (state.KeepRunning()) {
+		for (const auto& example : examples) {
+			Schema s(Schema::get_initial_schema(), nullptr, "");
+			benchmark::DoNotOptimize(s.index(example, MsgPack("1"), db_handler, data));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * examples.size());
+}
+BENCHMARK(BM_SchemaIndexDynamic);
+
+
+// Text heavy documents (stemmed english text fields) from a small,
+// repetitive vocabulary.
+static std::vector<MsgPack>
+schema_texts()
+{
+	static const char* words[] = {
+		"running", "jumped", "houses", "quickly", "national", "engineering",
+		"searching", "indexes", "documents", "fields", "languages", "stemmers",
+		"generators", "threads", "caches", "values", "schemas", "databases",
+		"queries", "results", "sorting", "relevance", "computing", "networks",
+	};
+	std::mt19937 rng(0);
+	std::vector<MsgPack> texts;
+	for (size_t i = 0; i < BENCHMARK_SCHEMA_TEXTS; ++i) {
+		auto text = MsgPack::MAP();
+		for (auto field : { "title", "summary", "body", "notes", "comments" }) {
+			std::string value;
+			for (size_t w = 0; w < BENCHMARK_SCHEMA_WORDS; ++w) {
+				value.append(words[rng() % (sizeof(words) / sizeof(words[0]))]).push_back(' ');
+			}
+			text[field] = MsgPack({
+				{ "_type", "text" },
+				{ "_language", "english" },
+				{ "_value", value },
+			});
+		}
+		texts.push_back(std::move(text));
+	}
+	return texts;
+}
+
+
+static void BM_SchemaIndexText(benchmark::State& state) {
+	auto texts = schema_texts();
+	DatabaseHandler db_handler;
+	Data data;
+
+	std::shared_ptr<const MsgPack> schema = Schema::get_initial_schema();
+	{
+		Schema warmup(schema, nullptr, "");
+		warmup.index(texts.front(), MsgPack("1"), db_handler, data);
+		auto modified = warmup.get_modified_schema();
+		if (modified) {
+			schema = modified;
+		}
+	}
+
+	while (state.KeepRunning()) {
+		Schema s(schema, nullptr, "");
+		for (const auto& text : texts) {
+			benchmark::DoNotOptimize(s.index(text, MsgPack("1"), db_handler, data));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * texts.size());
+}
+BENCHMARK(BM_SchemaIndexText);
+
+
+// Look up the reserved fields of freshly unpacked documents, as the ingest
+// path does before indexing them.
+static std::vector<std::string>
+schema_serialised_examples()
+{
+	std::vector<std::string> serialised;
+	for (const auto& example : schema_examples()) {
+		serialised.push_back(example.serialise());
+	}
+	return serialised;
+}
+
+
+static void BM_DocumentLookupMsgPack(benchmark::State& state) {
+	auto serialised = schema_serialised_examples();
+
+	while (state.KeepRunning()) {
+		for (const auto& example : serialised) {
+			auto obj = MsgPack::unserialise(example);
+			benchmark::DoNotOptimize(obj.find("_id") != obj.end());
+			benchmark::DoNotOptimize(obj.find("_data") != obj.end());
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * serialised.size());
+}
+BENCHMARK(BM_DocumentLookupMsgPack);
+
+
+static void BM_DocumentLookupMsgPackView(benchmark::State& state) {
+	auto serialised = schema_serialised_examples();
+
+	while (state.KeepRunning()) {
+		for (const auto& example : serialised) {
+			auto obj = MsgPack::unserialise(example);
+			MsgPackView view(obj);
+			benchmark::DoNotOptimize(view.find("_id") != view.end());
+			benchmark::DoNotOptimize(view.find("_data") != view.end());
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * serialised.size());
+}
+BENCHMARK(BM_DocumentLookupMsgPackView);
+
+
+// The ingest path end to end, as DocIndexer and prepare_document() run it
+// for every element of a bulk: unpack the bulk, move each element out, read
+// its reserved fields, index it and serialise its data. The lookups are
+// done through the MsgPack or through a view over it.
+template <typename Lookup>
+static void
+document_prepare_index(benchmark::State& state, Lookup&& lookup)
+{
+	auto examples = schema_examples();
+	DatabaseHandler db_handler;
+
+	auto bulk = MsgPack::ARRAY();
+	for (size_t i = 0; i < BENCHMARK_SCHEMA_BULK; ++i) {
+		for (const auto& example : examples) {
+			bulk.push_back(example);
+		}
+	}
+	auto serialised = bulk.serialise();
+
+	std::shared_ptr<const MsgPack> schema = Schema::get_initial_schema();
+	for (const auto& example : examples) {
+		Data data;
+		Schema warmup(schema, nullptr, "");
+		warmup.index(example, MsgPack("1"), db_handler, data);
+		auto modified = warmup.get_modified_schema();
+		if (modified) {
+			schema = modified;
+		}
+	}
+
+	while (state.KeepRunning()) {
+		auto objs = MsgPack::unserialise(serialised);
+		Schema s(schema, nullptr, "");
+		for (auto& o : objs) {
+			auto obj = std::move(o);
+			auto document_id = lookup(obj);
+			Data data;
+			auto prepared = s.index(obj, document_id ? document_id : MsgPack("1"), db_handler, data);
+			data.set_obj(std::get<2>(prepared));
+			data.flush();
+			benchmark::DoNotOptimize(data.serialise());
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * examples.size() * BENCHMARK_SCHEMA_BULK);
+}
+
+
+static void BM_DocumentPrepareIndexMsgPack(benchmark::State& state) {
+	document_prepare_index(state, [](MsgPack& obj) {
+		MsgPack document_id;
+		auto it = obj.find(ID_FIELD_NAME);
+		if (it != obj.end()) {
+			document_id = it.value();
+		}
+		it = obj.find(RESERVED_OP_TYPE);
+		if (it != obj.end()) {
+			obj.erase(RESERVED_OP_TYPE);
+		}
+		return document_id;
+	});
+}
+BENCHMARK(BM_DocumentPrepareIndexMsgPack);
+
+
+static void BM_DocumentPrepareIndexMsgPackView(benchmark::State& state) {
+	document_prepare_index(state, [](MsgPack& obj) {
+		MsgPack document_id;
+		MsgPackView view(obj);
+		auto it = view.find(ID_FIELD_NAME);
+		if (it != view.end()) {
+			document_id = it.value().to_msgpack();
+		}
+		it = view.find(RESERVED_OP_TYPE);
+		if (it != view.end()) {
+			obj.erase(RESERVED_OP_TYPE);
+		}
+		return document_id;
+	});
+}
+BENCHMARK(BM_DocumentPrepareIndexMsgPackView);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include <cstdlib>                  // for mkdtemp
+#include <string>                   // for std::string
+
+#include "opts.h"                   // for opts
+#include "storage.h"                // for Storage, STORAGE_*
+
+
+#define BENCHMARK_STORAGE_VOLUME  "storage.0"
+
+
+using BenchmarkStorage = Storage<StorageHeader, StorageBinHeader, StorageBinFooter>;
+
+
+// Commits per second writing range(1) bins (of 1 KiB) per commit, with
+// the sync engine (range(0) == 0) or the io_uring engine (range(0) == 1).
+static void BM_StorageCommit(benchmark::State& state) {
+	opts.io_uring = state.range(0) != 0;
+	char tmpl[] = "/tmp/benchmark_storage.XXXXXX";
+	std::string base_path = mkdtemp(tmpl);
+	std::string data(1024, 'x');
+	BenchmarkStorage storage(base_path, nullptr);
+	storage.open(BENCHMARK_STORAGE_VOLUME, STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE);
+	while (state.KeepRunning()) {
+		for (int64_t i = 0; i < state.range(1); ++i) {
+			try {
+				storage.write(data);
+			} catch (const StorageEOF&) {
+				storage.close();
+				io::unlink((base_path + "/" BENCHMARK_STORAGE_VOLUME).c_str());
+				storage.open(BENCHMARK_STORAGE_VOLUME, STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE);
+			}
+		}
+		storage.commit();
+	}
+	storage.close();
+	io::unlink((base_path + "/" BENCHMARK_STORAGE_VOLUME).c_str());
+	state.SetItemsProcessed(state.iterations());
+	opts.io_uring = false;
+}
+BENCHMARK(BM_StorageCommit)->ArgNames({"io_uring", "writes"})->Args({0, 1})->Args({1, 1})->Args({0, 16})->Args({1, 16})->UseRealTime();
+
+BENCHMARK_MAIN();
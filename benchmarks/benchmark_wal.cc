@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2015-2018 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include <cstdlib>                  // for mkdtemp
+#include <deque>                    // for std::deque
+#include <future>                   // for std::future
+#include <string>                   // for std::string
+#include <vector>                   // for std::vector
+
+#include "compressor_lz4.h"         // for compress_lz4
+#include "database/wal.h"           // for DatabaseWAL
+#include "length.h"                 // for serialise_length, unserialise_length
+#include "storage.h"                // for Storage, STORAGE_*
+#include "threadpool.hh"            // for ThreadPool
+#include "utype.hh"                 // for toUType
+#include "xapian.h"                 // for Xapian::Document
+
+
+#define BENCHMARK_WAL_LINES   1000
+#define BENCHMARK_WAL_WINDOW  1024
+#define BENCHMARK_WAL_VOLUME  "wal.0"
+
+
+static std::vector<std::string>
+wal_lines()
+{
+	std::vector<std::string> lines;
+	lines.reserve(BENCHMARK_WAL_LINES);
+	for (Xapian::docid did = 1; did <= BENCHMARK_WAL_LINES; ++did) {
+		Xapian::Document doc;
+		doc.set_data(std::string(512, 'a' + static_cast<char>(did % 26)));
+		for (int term = 0; term < 50; ++term) {
+			doc.add_term("Zterm" + std::to_string(did * term), 1);
+		}
+		doc.add_value(0, std::to_string(did));
+		std::string data;
+		data.append(serialise_length(did));
+		data.append(doc.serialise());
+		std::string line;
+		line.append(serialise_length(did));
+		line.append(serialise_length(toUType(DatabaseWAL::Type::REPLACE_DOCUMENT)));
+		line.append(compress_lz4(data));
+		lines.push_back(std::move(line));
+	}
+	return lines;
+}
+
+
+static void BM_WALDecodeSerial(benchmark::State& state) {
+	auto lines = wal_lines();
+	while (state.KeepRunning()) {
+		for (const auto& line : lines) {
+			benchmark::DoNotOptimize(DatabaseWAL::decode_line(line));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * lines.size());
+}
+BENCHMARK(BM_WALDecodeSerial)->UseRealTime();
+
+
+static void BM_WALDecodeParallel(benchmark::State& state) {
+	auto lines = wal_lines();
+	ThreadPool<> decoders("WR{:02}", state.range(0));
+	while (state.KeepRunning()) {
+		std::deque<std::future<DatabaseWAL::Line>> pending;
+		for (const auto& line : lines) {
+			if (pending.size() >= BENCHMARK_WAL_WINDOW) {
+				benchmark::DoNotOptimize(pending.front().get());
+				pending.pop_front();
+			}
+			pending.push_back(decoders.async([&line] {
+				return DatabaseWAL::decode_line(line);
+			}));
+		}
+		while (!pending.empty()) {
+			benchmark::DoNotOptimize(pending.front().get());
+			pending.pop_front();
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * lines.size());
+}
+BENCHMARK(BM_WALDecodeParallel)->RangeMultiplier(2)->Range(1, 8)->UseRealTime();
+
+
+using BenchmarkStorage = Storage<StorageHeader, StorageBinHeader, StorageBinFooter>;
+
+
+static std::string_view
+wal_line_data(std::string_view line)
+{
+	const char *p = line.data();
+	const char *p_end = p + line.size();
+	unserialise_length(&p, p_end);  // revision
+	unserialise_length(&p, p_end);  // type
+	return std::string_view(p, p_end - p);
+}
+
+
+static std::string
+wal_volume()
+{
+	static std::string base_path = [] {
+		char tmpl[] = "/tmp/benchmark_wal.XXXXXX";
+		std::string path = mkdtemp(tmpl);
+		BenchmarkStorage storage(path, nullptr);
+		storage.open(BENCHMARK_WAL_VOLUME, STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE | STORAGE_NO_SYNC);
+		for (const auto& line : wal_lines()) {
+			storage.write(line);
+		}
+		storage.close();
+		return path;
+	}();
+	return base_path;
+}
+
+
+static void BM_WALReadPread(benchmark::State& state) {
+	BenchmarkStorage storage(wal_volume(), nullptr);
+	size_t lines = 0;
+	while (state.KeepRunning()) {
+		storage.open(BENCHMARK_WAL_VOLUME, STORAGE_OPEN);
+		try {
+			while (true) {
+				auto line = storage.read();
+				benchmark::DoNotOptimize(decompress_lz4(wal_line_data(line)));
+				++lines;
+			}
+		} catch (const StorageEOF&) { }
+		storage.close();
+	}
+	state.SetItemsProcessed(lines);
+}
+BENCHMARK(BM_WALReadPread);
+
+
+static void BM_WALReadMmap(benchmark::State& state) {
+	BenchmarkStorage storage(wal_volume(), nullptr);
+	size_t lines = 0;
+	while (state.KeepRunning()) {
+		storage.open(BENCHMARK_WAL_VOLUME, STORAGE_OPEN | STORAGE_MMAP);
+		try {
+			while (true) {
+				auto line = storage.read_view();
+				benchmark::DoNotOptimize(decompress_lz4(wal_line_data(line)));
+				++lines;
+			}
+		} catch (const StorageEOF&) { }
+		storage.close();
+	}
+	state.SetItemsProcessed(lines);
+}
+BENCHMARK(BM_WALReadMmap);
+
+BENCHMARK_MAIN();
@@ -32,6 +32,36 @@ TEST(WALTest, Working) {
 }
 
 
+TEST(WALTest, ReplaceDocumentTerm) {
+	EXPECT_EQ(replace_document_term_wal(), 0);
+}
+
+
+TEST(WALTest, BadAsyncDocument) {
+	EXPECT_EQ(bad_async_document_wal(), 0);
+}
+
+
+TEST(WALTest, ReplaceDocumentDelta) {
+	EXPECT_EQ(replace_document_delta_wal(), 0);
+}
+
+
+TEST(WALTest, IdsFilter) {
+	EXPECT_EQ(ids_filter_wal(), 0);
+}
+
+
+TEST(WALTest, Dictionary) {
+	EXPECT_EQ(dictionary_wal(), 0);
+}
+
+
+TEST(WALTest, GroupCommitRollover) {
+	EXPECT_EQ(group_commit_rollover_wal(), 0);
+}
+
+
 int main(int argc, char **argv) {
 	auto initializer = Initializer::create();
 	::testing::InitGoogleTest(&argc, argv);
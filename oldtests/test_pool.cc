@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "test_pool.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "../src/database/flags.h"
+#include "../src/database/pool.h"
+#include "../src/database/shard.h"
+#include "../src/fs.hh"
+
+
+const std::string test_pool_db(".test_pool.db");
+
+
+int pool_checkout_concurrency() {
+	INIT_LOG
+	const size_t max_readers = 4;
+	const int readers = 16;
+	const int iterations = 2000;
+	try {
+		delete_files(test_pool_db);
+		DatabasePool database_pool(16, max_readers);
+		auto endpoint = create_endpoint(test_pool_db);
+
+		auto writable = database_pool.checkout(endpoint, DB_WRITABLE | DB_CREATE_OR_OPEN);
+		auto& shard_endpoint = writable->endpoint;
+		database_pool.checkin(writable);
+
+		std::mutex in_use_mtx;
+		std::unordered_set<Shard*> in_use;
+		std::atomic_size_t checkouts(0);
+		std::atomic_size_t double_issued(0);
+		std::atomic_bool running(true);
+
+		/* Readable checkouts and checkins (mostly through the idle slots) */
+		std::vector<std::thread> threads;
+		for (int t = 0; t < readers; ++t) {
+			threads.emplace_back([&] {
+				for (int i = 0; i < iterations; ++i) {
+					std::shared_ptr<Shard> shard;
+					try {
+						shard = database_pool.checkout(endpoint, DB_OPEN, 1.0);
+					} catch (const Xapian::DatabaseNotAvailableError&) {
+						continue;  // locked for too long
+					}
+					{
+						std::lock_guard<std::mutex> lk(in_use_mtx);
+						if (!in_use.insert(shard.get()).second) {
+							++double_issued;
+						}
+					}
+					++checkouts;
+					std::this_thread::yield();
+					{
+						std::lock_guard<std::mutex> lk(in_use_mtx);
+						in_use.erase(shard.get());
+					}
+					database_pool.checkin(shard);
+				}
+			});
+		}
+
+		/* Racing with exclusive locks and clears */
+		std::thread locker([&] {
+			while (running) {
+				auto shard = database_pool.checkout(endpoint, DB_WRITABLE);
+				database_pool.lock(shard);
+				database_pool.unlock(shard);
+				database_pool.checkin(shard);
+			}
+		});
+		std::thread clearer([&] {
+			while (running) {
+				shard_endpoint.clear();
+				std::this_thread::yield();
+			}
+		});
+
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		running = false;
+		locker.join();
+		clearer.join();
+
+		if (double_issued) {
+			L_ERR("ERROR: {} readable shards were handed out while checked out", double_issued.load());
+			RETURN(1);
+		}
+		if (!checkouts) {
+			L_ERR("ERROR: No readable shard was ever checked out");
+			RETURN(1);
+		}
+
+		/* Every readable is checked in, and available */
+		auto count = shard_endpoint.count();
+		if (count.second > max_readers || shard_endpoint.count_available() != count.second) {
+			L_ERR("ERROR: {} readables available out of {} (at most {})", shard_endpoint.count_available(), count.second, max_readers);
+			RETURN(1);
+		}
+
+		/* None was lost: all readers can be checked out at once */
+		std::vector<std::shared_ptr<Shard>> shards;
+		std::unordered_set<Shard*> distinct;
+		for (size_t i = 0; i < max_readers; ++i) {
+			shards.push_back(database_pool.checkout(endpoint, DB_OPEN, 1.0));
+			distinct.insert(shards.back().get());
+		}
+		if (distinct.size() != max_readers || shard_endpoint.count_available() != shard_endpoint.count().second - max_readers) {
+			L_ERR("ERROR: {} distinct readables checked out of {}", distinct.size(), max_readers);
+			RETURN(1);
+		}
+		for (auto& shard : shards) {
+			database_pool.checkin(shard);
+		}
+		if (shard_endpoint.count_available() != shard_endpoint.count().second) {
+			L_ERR("ERROR: {} readables available out of {} after checking them in", shard_endpoint.count_available(), shard_endpoint.count().second);
+			RETURN(1);
+		}
+
+		shard_endpoint.clear();
+		delete_files(test_pool_db);
+		RETURN(0);
+	} catch (const Xapian::Error& exc) {
+		L_EXC("ERROR: {}", exc.get_description());
+	} catch (const std::exception& exc) {
+		L_EXC("ERROR: {}", exc.what());
+	}
+	delete_files(test_pool_db);
+	RETURN(1);
+}
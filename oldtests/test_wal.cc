@@ -24,6 +24,13 @@
 
 #include "../src/database.h"
 #include "../src/database_wal.h"
+#include "../src/database/data.h"
+#include "../src/database/lock.h"
+#include "../src/database/shard.h"
+#include "../src/database/wal.h"
+#include "../src/fs.hh"
+#include "../src/length.h"
+#include "../src/string.hh"
 
 
 const std::string test_db(".test_wal.db");
@@ -172,3 +179,680 @@ int restore_database() {
 #endif
 	RETURN(1);
 }
+
+
+static bool has_term(Shard& shard, const std::string& term) {
+	try {
+		shard.get_docid_term(term);
+		return true;
+	} catch (const Xapian::DocNotFoundError&) {
+		return false;
+	}
+}
+
+
+int replace_document_term_wal() {
+	INIT_LOG
+#if XAPIAND_DATABASE_WAL
+	const std::string term("QKdocument");
+	try {
+		delete_files(test_db);
+		delete_files(restored_db);
+		Xapian::rev revision;
+		{
+			lock_shard lk_shard(create_endpoint(test_db), DB_WRITABLE | DB_CREATE_OR_OPEN | DB_SYNCHRONOUS_WAL);
+			auto shard = lk_shard.locked();
+
+			Xapian::Document doc;
+			doc.add_term(term);
+			doc.add_term("Tdeferred");
+			auto deferred = shard->defer_document_term(term, std::move(doc));
+			deferred.second.get();
+			revision = deferred.first;
+
+			/* Not in the shard yet, only in the WAL */
+			if (has_term(*shard, "Tdeferred")) {
+				L_ERR("ERROR: Deferred document was applied before the commit");
+				RETURN(1);
+			}
+
+			/* Encoded and decoded back */
+			DatabaseWAL wal(test_db);
+			int lines = 0;
+			for (auto it = wal.find(revision - 1); it != wal.end(); ++it) {
+				auto line = DatabaseWAL::decode_line(*it);
+				if (line.type == DatabaseWAL::Type::REPLACE_DOCUMENT_TERM) {
+					if (line.revision != revision - 1 || line.data != term || line.document.termlist_count() != 2) {
+						L_ERR("ERROR: REPLACE_DOCUMENT_TERM line was not decoded back");
+						RETURN(1);
+					}
+					++lines;
+				}
+			}
+			if (lines != 1) {
+				L_ERR("ERROR: Expected one REPLACE_DOCUMENT_TERM line, got {}", lines);
+				RETURN(1);
+			}
+
+			/* A crash before the commit leaves the document only in the WAL */
+			if (copy_file(test_db, restored_db) == -1) {
+				L_ERR("ERROR: Could not copy the dir {} to dir {}", test_db, restored_db);
+				RETURN(1);
+			}
+
+			/* Replayed by the commit */
+			shard->commit();
+			if (shard->db()->get_revision() != revision || !has_term(*shard, "Tdeferred")) {
+				L_ERR("ERROR: Deferred document was not applied by the commit");
+				RETURN(1);
+			}
+
+			/* A later synchronous write supersedes the deferred one */
+			Xapian::Document deferred_doc;
+			deferred_doc.add_term(term);
+			deferred_doc.add_term("Tstale");
+			shard->defer_document_term(term, std::move(deferred_doc)).second.get();
+			Xapian::Document synced_doc;
+			synced_doc.add_term(term);
+			synced_doc.add_term("Tsynced");
+			shard->replace_document_term(term, std::move(synced_doc));
+			shard->commit();
+			if (has_term(*shard, "Tstale") || !has_term(*shard, "Tsynced")) {
+				L_ERR("ERROR: Deferred document overwrote a later synchronous write");
+				RETURN(1);
+			}
+		}
+
+		/* Reopening the crashed copy replays the uncommitted WAL line */
+		{
+			lock_shard lk_shard(create_endpoint(restored_db), DB_WRITABLE);
+			auto shard = lk_shard.locked();
+			shard->commit();
+			if (shard->db()->get_revision() != revision || !has_term(*shard, "Tdeferred")) {
+				L_ERR("ERROR: Deferred document was not replayed from the WAL");
+				delete_files(restored_db);
+				RETURN(1);
+			}
+		}
+		delete_files(restored_db);
+		RETURN(0);
+	} catch (const Xapian::Error& exc) {
+		L_EXC("ERROR: {}", exc.get_description());
+	} catch (const std::exception& exc) {
+		L_EXC("ERROR: {}", exc.what());
+	}
+	delete_files(restored_db);
+#else
+	L_ERR("XAPIAND_DATABASE_WAL is not activated");
+#endif
+	RETURN(1);
+}
+
+
+int bad_async_document_wal() {
+	INIT_LOG
+#if XAPIAND_DATABASE_WAL
+	const std::string term("QKdocument");
+	const std::string bad_term("QK" + std::string(300, 'x'));
+	try {
+		delete_files(test_db);
+		delete_files(restored_db);
+		Xapian::rev revision;
+		UUID uuid;
+		{
+			lock_shard lk_shard(create_endpoint(test_db), DB_WRITABLE | DB_CREATE_OR_OPEN | DB_SYNCHRONOUS_WAL);
+			auto shard = lk_shard.locked();
+
+			/* Rejected before it's acknowledged (or written to the WAL) */
+			Xapian::Document bad_doc;
+			bad_doc.add_term(bad_term);
+			try {
+				shard->defer_document_term(bad_term, std::move(bad_doc));
+				L_ERR("ERROR: Asynchronous document that can't be applied was accepted");
+				RETURN(1);
+			} catch (const InvalidArgumentError&) { }
+
+			Xapian::Document doc;
+			doc.add_term(term);
+			doc.add_term("Tgood");
+			revision = shard->defer_document_term(term, std::move(doc)).first;
+			shard->commit();
+			if (shard->db()->get_revision() != revision || !has_term(*shard, "Tgood")) {
+				L_ERR("ERROR: Commit after a rejected asynchronous document failed");
+				RETURN(1);
+			}
+			uuid = UUID(shard->db()->get_uuid());
+		}
+
+		/* A bad line already in the uncommitted tail (written before
+		 * documents were validated), followed by a good one; written to
+		 * a copy, so the WAL writer of the original doesn't overwrite them */
+		if (copy_file(test_db, restored_db) == -1) {
+			L_ERR("ERROR: Could not copy the dir {} to dir {}", test_db, restored_db);
+			RETURN(1);
+		}
+		{
+			DatabaseWAL wal(restored_db);
+			Xapian::Document tail_bad_doc;
+			tail_bad_doc.add_term(bad_term);
+			wal.write_line(uuid, revision, DatabaseWAL::Type::REPLACE_DOCUMENT_TERM, serialise_string(bad_term) + tail_bad_doc.serialise(), false);
+			Xapian::Document tail_doc;
+			tail_doc.add_term(term);
+			tail_doc.add_term("Ttail");
+			wal.write_line(uuid, revision, DatabaseWAL::Type::REPLACE_DOCUMENT_TERM, serialise_string(term) + tail_doc.serialise(), false);
+			wal.sync();
+		}
+
+		/* Reopening skips the bad line, and the good one is still committed */
+		{
+			lock_shard lk_shard(create_endpoint(restored_db), DB_WRITABLE);
+			auto shard = lk_shard.locked();
+			shard->commit();
+			if (shard->db()->get_revision() != revision + 1 || !has_term(*shard, "Ttail") || has_term(*shard, bad_term)) {
+				L_ERR("ERROR: Reopening did not skip the bad uncommitted WAL line");
+				delete_files(restored_db);
+				RETURN(1);
+			}
+		}
+
+		/* And the shard reopens again after that */
+		{
+			lock_shard lk_shard(create_endpoint(restored_db), DB_WRITABLE);
+			auto shard = lk_shard.locked();
+			if (shard->db()->get_revision() != revision + 1 || !has_term(*shard, "Ttail")) {
+				L_ERR("ERROR: Shard did not reopen after skipping a bad WAL line");
+				delete_files(restored_db);
+				RETURN(1);
+			}
+		}
+		delete_files(restored_db);
+		RETURN(0);
+	} catch (const Xapian::Error& exc) {
+		L_EXC("ERROR: {}", exc.get_description());
+	} catch (const std::exception& exc) {
+		L_EXC("ERROR: {}", exc.what());
+	}
+	delete_files(restored_db);
+#else
+	L_ERR("XAPIAND_DATABASE_WAL is not activated");
+#endif
+	RETURN(1);
+}
+
+
+static Xapian::Document delta_document(const std::string& term, int version, int changed) {
+	// Forty terms (some with positions) and a few values, of which the
+	// first `changed` terms and a value depend on the version.
+	Xapian::Document doc;
+	doc.add_term(term);
+	for (int i = 0; i < 40; ++i) {
+		auto name = i < changed ? string::format("T{}v{}", i, version) : string::format("T{}", i);
+		if (i % 4 == 0) {
+			doc.add_posting(name, i + 1);
+			doc.add_posting(name, i + 10);
+		} else {
+			doc.add_term(name, i % 3 + 1);
+		}
+	}
+	doc.add_value(10, "constant");
+	doc.add_value(11, string::format("value {}", version));
+	if (version % 2) {
+		doc.add_value(12, "odd");
+	}
+	doc.set_data(string::format("data {}", version));
+	return doc;
+}
+
+
+int replace_document_delta_wal() {
+	INIT_LOG
+#if XAPIAND_DATABASE_WAL
+	const std::string term("QKdelta");
+	const std::string whole_term("QKwhole");
+	try {
+		delete_files(test_db);
+		delete_files(restored_db);
+		std::string expected, whole_expected, delta;
+		{
+			lock_shard lk_shard(create_endpoint(test_db), DB_WRITABLE | DB_CREATE_OR_OPEN | DB_SYNCHRONOUS_WAL);
+			auto shard = lk_shard.locked();
+
+			/* A base document and several deltas on top of it */
+			for (int version = 0; version <= 5; ++version) {
+				shard->replace_document_term(term, delta_document(term, version, version ? 2 : 0));
+				shard->commit();
+			}
+			auto did = shard->get_docid_term(term);
+			expected = shard->get_document(did, true).serialise();
+
+			/* Small documents, and those that change too much, are not diffed */
+			Xapian::Document small;
+			small.add_term(term);
+			if (!DatabaseWAL::document_delta(*shard->db(), did, small).empty()) {
+				L_ERR("ERROR: Delta built for a document with few terms");
+				RETURN(1);
+			}
+			if (!DatabaseWAL::document_delta(*shard->db(), did, delta_document(term, 6, 40)).empty()) {
+				L_ERR("ERROR: Delta built for a document that changed too much");
+				RETURN(1);
+			}
+			delta = DatabaseWAL::document_delta(*shard->db(), did, delta_document(term, 6, 2));
+			if (delta.empty()) {
+				L_ERR("ERROR: No delta built for a document that barely changed");
+				RETURN(1);
+			}
+
+			shard->replace_document_term(whole_term, delta_document(whole_term, 0, 0));
+			shard->commit();
+			shard->replace_document_term(whole_term, delta_document(whole_term, 1, 40));
+			shard->commit();
+			whole_expected = shard->get_document(shard->get_docid_term(whole_term), true).serialise();
+
+			/* Base documents and the one that changed too much are whole */
+			DatabaseWAL wal(test_db);
+			int whole = 0, deltas = 0;
+			for (auto it = wal.find(0); it != wal.end(); ++it) {
+				auto line = DatabaseWAL::decode_line(*it);
+				if (line.type == DatabaseWAL::Type::REPLACE_DOCUMENT) {
+					++whole;
+				} else if (line.type == DatabaseWAL::Type::REPLACE_DOCUMENT_DELTA) {
+					++deltas;
+				}
+			}
+			if (whole != 3 || deltas != 5) {
+				L_ERR("ERROR: Expected 3 REPLACE_DOCUMENT and 5 REPLACE_DOCUMENT_DELTA lines, got {} and {}", whole, deltas);
+				RETURN(1);
+			}
+		}
+
+		/* A fresh shard rebuilt from the WAL alone gets the same documents */
+		if (copy_file(test_db, restored_db, true, "wal.0") == -1) {
+			L_ERR("ERROR: Could not copy the file {} to dir {}", "wal.0", restored_db);
+			RETURN(1);
+		}
+		{
+			lock_shard lk_shard(create_endpoint(restored_db), DB_WRITABLE);
+			auto shard = lk_shard.locked();
+			if (shard->get_document(shard->get_docid_term(term), true).serialise() != expected) {
+				L_ERR("ERROR: Document replayed from deltas differs");
+				delete_files(restored_db);
+				RETURN(1);
+			}
+			if (shard->get_document(shard->get_docid_term(whole_term), true).serialise() != whole_expected) {
+				L_ERR("ERROR: Document replayed whole differs");
+				delete_files(restored_db);
+				RETURN(1);
+			}
+
+			/* A delta without its base document is refused, even unsafely */
+			DatabaseWAL wal(shard.get());
+			DatabaseWAL::Line line;
+			line.revision = shard->db()->get_revision();
+			line.type = DatabaseWAL::Type::REPLACE_DOCUMENT_DELTA;
+			line.did = shard->db()->get_lastdocid() + 1;
+			line.data = serialise_string("data") + delta;
+			try {
+				wal.apply_line(line, false, false, true);
+				L_ERR("ERROR: Delta without a base document was applied");
+				delete_files(restored_db);
+				RETURN(1);
+			} catch (const StorageCorruptVolume&) { }
+		}
+		delete_files(restored_db);
+		RETURN(0);
+	} catch (const Xapian::Error& exc) {
+		L_EXC("ERROR: {}", exc.get_description());
+	} catch (const std::exception& exc) {
+		L_EXC("ERROR: {}", exc.what());
+	}
+	delete_files(restored_db);
+#else
+	L_ERR("XAPIAND_DATABASE_WAL is not activated");
+#endif
+	RETURN(1);
+}
+
+
+static void put_id(Shard& shard, int id, int version) {
+	auto term = string::format("QK{}", id);
+	Xapian::Document doc;
+	doc.add_term(term);
+	doc.add_term(string::format("Tv{}", version));
+	shard.replace_document_term(term, std::move(doc));
+}
+
+
+static bool has_id(Shard& shard, int id, int version) {
+	try {
+		auto did = shard.get_docid_term(string::format("QK{}", id));
+		auto doc = shard.get_document(did, true);
+		auto term = string::format("Tv{}", version);
+		auto it = doc.termlist_begin();
+		it.skip_to(term);
+		return it != doc.termlist_end() && *it == term;
+	} catch (const Xapian::DocNotFoundError&) {
+		return false;
+	}
+}
+
+
+int ids_filter_wal() {
+	INIT_LOG
+#if XAPIAND_DATABASE_WAL
+	// Ids the filter is sized for when the shard is opened
+	// (IDS_FILTER_MIN_CAPACITY), writing more makes it rebuild
+	const int capacity = 65536;
+	try {
+		delete_files(test_db);
+		delete_files(restored_db);
+		{
+			lock_shard lk_shard(create_endpoint(test_db), DB_WRITABLE | DB_CREATE_OR_OPEN | DB_SYNCHRONOUS_WAL);
+			auto shard = lk_shard.locked();
+
+			/* New ids, then re-put ones replace their documents */
+			for (int id = 0; id < 100; ++id) {
+				put_id(*shard, id, 0);
+			}
+			shard->commit();
+			for (int id = 0; id < 10; ++id) {
+				put_id(*shard, id, 1);
+			}
+			if (shard->db()->get_doccount() != 100 || !has_id(*shard, 0, 1) || has_id(*shard, 0, 0)) {
+				L_ERR("ERROR: Re-put ids were added instead of replaced");
+				RETURN(1);
+			}
+
+			/* Deleted ids are put again once, then replaced */
+			for (int id = 10; id < 20; ++id) {
+				shard->delete_document_term(string::format("QK{}", id));
+			}
+			shard->commit();
+			for (int id = 10; id < 20; ++id) {
+				put_id(*shard, id, 1);
+				put_id(*shard, id, 2);
+			}
+			if (shard->db()->get_doccount() != 100 || !has_id(*shard, 10, 2)) {
+				L_ERR("ERROR: Deleted ids were not put back once");
+				RETURN(1);
+			}
+			shard->commit();
+
+			/* Uncommitted writes, only in the WAL of the copy */
+			for (int id = 100; id < 110; ++id) {
+				put_id(*shard, id, 0);
+			}
+			put_id(*shard, 30, 1);
+			if (copy_file(test_db, restored_db) == -1) {
+				L_ERR("ERROR: Could not copy the dir {} to dir {}", test_db, restored_db);
+				RETURN(1);
+			}
+		}
+
+		{
+			/* Ids replayed from the WAL are known to the rebuilt filter */
+			lock_shard lk_shard(create_endpoint(restored_db), DB_WRITABLE);
+			auto shard = lk_shard.locked();
+			shard->commit();
+			if (shard->db()->get_doccount() != 110 || !has_id(*shard, 105, 0) || !has_id(*shard, 30, 1)) {
+				L_ERR("ERROR: Uncommitted ids were not replayed from the WAL");
+				delete_files(restored_db);
+				RETURN(1);
+			}
+			for (int id = 100; id < 110; ++id) {
+				put_id(*shard, id, 1);
+			}
+			put_id(*shard, 30, 2);
+			shard->commit();
+			if (shard->db()->get_doccount() != 110 || !has_id(*shard, 105, 1) || !has_id(*shard, 30, 2)) {
+				L_ERR("ERROR: Ids replayed from the WAL were added instead of replaced");
+				delete_files(restored_db);
+				RETURN(1);
+			}
+
+			/* Filled past its capacity, the filter is rebuilt */
+			for (int id = 1000; id < 1000 + capacity; ++id) {
+				put_id(*shard, id, 0);
+				if (id % 10000 == 0) {
+					shard->commit();
+				}
+			}
+			shard->commit();
+			for (int id = 0; id < 1000 + capacity; id += 997) {
+				if (id >= 110 && id < 1000) {
+					continue;
+				}
+				put_id(*shard, id, 3);
+			}
+			put_id(*shard, 999 + capacity, 3);
+			shard->commit();
+			if (shard->db()->get_doccount() != static_cast<Xapian::doccount>(110 + capacity) || !has_id(*shard, 0, 3) || !has_id(*shard, 1994, 3) || !has_id(*shard, 999 + capacity, 3)) {
+				L_ERR("ERROR: Ids were added instead of replaced after the filter was rebuilt");
+				delete_files(restored_db);
+				RETURN(1);
+			}
+		}
+		delete_files(restored_db);
+		RETURN(0);
+	} catch (const Xapian::Error& exc) {
+		L_EXC("ERROR: {}", exc.get_description());
+	} catch (const std::exception& exc) {
+		L_EXC("ERROR: {}", exc.what());
+	}
+	delete_files(restored_db);
+#else
+	L_ERR("XAPIAND_DATABASE_WAL is not activated");
+#endif
+	RETURN(1);
+}
+
+
+static std::string dictionary_text(int id) {
+	// Long and repetitive enough to be stored compressed
+	return string::format("{{\"id\":{},\"name\":\"document {}\",\"tags\":[\"alpha\",\"beta\",\"gamma\"],\"description\":\"{}\"}}", id, id * 7 % 13, string::join(std::vector<std::string>(4, "A document with the same fields as every other one"), " "));
+}
+
+
+static void put_data(Shard& shard, int id) {
+	auto term = string::format("QK{}", id);
+	Data data;
+	data.update(ct_type_t("application/json"), dictionary_text(id));
+	data.flush();
+	Xapian::Document doc;
+	doc.add_term(term);
+	doc.set_data(data.serialise());
+	shard.replace_document_term(term, std::move(doc));
+}
+
+
+static uint32_t data_dictionary(Shard& shard, int id) {
+	// Returns the dictionary the document data was compressed with,
+	// or -1 if it doesn't read back.
+	auto doc = shard.get_document(shard.get_docid_term(string::format("QK{}", id)), true);
+	auto data = Data(doc.get_data());
+	auto locator = data.get(ct_type_t("application/json"));
+	if (!locator || locator->data() != dictionary_text(id)) {
+		return -1;
+	}
+	return LZ4Dictionary::used_by(locator->raw);
+}
+
+
+int dictionary_wal() {
+	INIT_LOG
+#if XAPIAND_DATABASE_WAL
+	const int count = 200;
+	try {
+		delete_files(test_db);
+		delete_files(restored_db);
+		uint32_t dictionary_id;
+		{
+			lock_shard lk_shard(create_endpoint(test_db), DB_WRITABLE | DB_CREATE_OR_OPEN | DB_SYNCHRONOUS_WAL);
+			auto shard = lk_shard.locked();
+
+			/* Data written before there's a dictionary */
+			for (int id = 0; id < count; ++id) {
+				put_data(*shard, id);
+			}
+			shard->commit();
+
+			auto trained = Shard::train_dictionary(*shard->db());
+			if (trained.empty()) {
+				L_ERR("ERROR: No compression dictionary was trained");
+				RETURN(1);
+			}
+			shard->add_dictionary(trained, shard->db()->get_doccount());
+			if (!shard->get_dictionary()) {
+				L_ERR("ERROR: Compression dictionary was not loaded");
+				RETURN(1);
+			}
+			dictionary_id = shard->get_dictionary()->id();
+
+			/* Data written after it */
+			for (int id = count; id < 2 * count; ++id) {
+				put_data(*shard, id);
+			}
+			shard->commit();
+		}
+
+		/* A fresh shard rebuilt from the WAL alone */
+		if (copy_file(test_db, restored_db, true, "wal.0") == -1) {
+			L_ERR("ERROR: Could not copy the file {} to dir {}", "wal.0", restored_db);
+			RETURN(1);
+		}
+
+		/* Both read back after reopening, old data still without a dictionary */
+		for (const auto& path : { test_db, restored_db }) {
+			lock_shard lk_shard(create_endpoint(path), DB_WRITABLE);
+			auto shard = lk_shard.locked();
+			if (!shard->get_dictionary() || shard->get_dictionary()->id() != dictionary_id) {
+				L_ERR("ERROR: Compression dictionary was not reloaded in {}", path);
+				delete_files(restored_db);
+				RETURN(1);
+			}
+			for (int id = 0; id < 2 * count; ++id) {
+				auto used = data_dictionary(*shard, id);
+				if (used != (id < count ? 0 : dictionary_id)) {
+					L_ERR("ERROR: Data of document {} in {} did not read back (dictionary {})", id, path, used);
+					delete_files(restored_db);
+					RETURN(1);
+				}
+			}
+		}
+		delete_files(restored_db);
+		RETURN(0);
+	} catch (const Xapian::Error& exc) {
+		L_EXC("ERROR: {}", exc.get_description());
+	} catch (const std::exception& exc) {
+		L_EXC("ERROR: {}", exc.what());
+	}
+	delete_files(restored_db);
+#else
+	L_ERR("XAPIAND_DATABASE_WAL is not activated");
+#endif
+	RETURN(1);
+}
+
+
+int group_commit_rollover_wal() {
+	INIT_LOG
+#if XAPIAND_DATABASE_WAL
+	const Xapian::rev count = WAL_SLOTS + 10;
+	try {
+		delete_files(test_db);
+		delete_files(restored_db);
+		Xapian::rev revision;
+		UUID uuid;
+		{
+			lock_shard lk_shard(create_endpoint(test_db), DB_WRITABLE | DB_CREATE_OR_OPEN | DB_SYNCHRONOUS_WAL);
+			auto shard = lk_shard.locked();
+			Xapian::Document doc;
+			doc.add_term("QKbase");
+			shard->replace_document_term("QKbase", std::move(doc));
+			shard->commit();
+			revision = shard->db()->get_revision();
+			uuid = UUID(shard->db()->get_uuid());
+		}
+
+		/* Written to a copy, so the WAL writer of the original doesn't
+		 * overwrite the lines */
+		if (copy_file(test_db, restored_db) == -1) {
+			L_ERR("ERROR: Could not copy the dir {} to dir {}", test_db, restored_db);
+			RETURN(1);
+		}
+
+		/* A single batch, grouped the way DatabaseWALWriterThread::write_batch()
+		 * does, whose commits fill the volume and roll over into a new one */
+		{
+			DatabaseWAL wal(restored_db);
+			if (!wal.begin_group_commit()) {
+				L_ERR("ERROR: Group commit was already active");
+				RETURN(1);
+			}
+			for (Xapian::rev rev = revision; rev < revision + count; ++rev) {
+				auto term = string::format("QK{}", rev);
+				Xapian::Document doc;
+				doc.add_term(term);
+				doc.add_term(string::format("Tbatch{}", rev));
+				wal.write_line(uuid, rev, DatabaseWAL::Type::REPLACE_DOCUMENT_TERM, serialise_string(term) + doc.serialise(), false);
+				wal.write_line(uuid, rev, DatabaseWAL::Type::COMMIT, "", false);
+			}
+			wal.end_group_commit();
+		}
+		if (!exists(string::format("{}/wal.{}", restored_db, WAL_SLOTS))) {
+			L_ERR("ERROR: Batch did not roll over into a new WAL volume");
+			delete_files(restored_db);
+			RETURN(1);
+		}
+
+		/* Every line is there, on both volumes */
+		{
+			DatabaseWAL wal(restored_db);
+			Xapian::rev lines = 0;
+			for (auto it = wal.find(revision); it != wal.end(); ++it) {
+				auto line = DatabaseWAL::decode_line(*it);
+				if (line.type == DatabaseWAL::Type::REPLACE_DOCUMENT_TERM) {
+					if (line.revision != revision + lines) {
+						L_ERR("ERROR: Expected a line for revision {}, got {}", revision + lines, line.revision);
+						delete_files(restored_db);
+						RETURN(1);
+					}
+					++lines;
+				}
+			}
+			if (lines != count) {
+				L_ERR("ERROR: Expected {} REPLACE_DOCUMENT_TERM lines, got {}", count, lines);
+				delete_files(restored_db);
+				RETURN(1);
+			}
+		}
+
+		/* And every line is replayed after reopening */
+		{
+			lock_shard lk_shard(create_endpoint(restored_db), DB_WRITABLE);
+			auto shard = lk_shard.locked();
+			if (shard->db()->get_revision() != revision + count || shard->db()->get_doccount() != count + 1) {
+				L_ERR("ERROR: Reopening replayed up to revision {} ({} documents), expected {} ({} documents)", shard->db()->get_revision(), shard->db()->get_doccount(), revision + count, count + 1);
+				delete_files(restored_db);
+				RETURN(1);
+			}
+			for (Xapian::rev rev = revision; rev < revision + count; ++rev) {
+				if (!has_term(*shard, string::format("Tbatch{}", rev))) {
+					L_ERR("ERROR: Document of revision {} was not replayed", rev);
+					delete_files(restored_db);
+					RETURN(1);
+				}
+			}
+		}
+		delete_files(restored_db);
+		RETURN(0);
+	} catch (const Xapian::Error& exc) {
+		L_EXC("ERROR: {}", exc.get_description());
+	} catch (const std::exception& exc) {
+		L_EXC("ERROR: {}", exc.what());
+	}
+	delete_files(restored_db);
+#else
+	L_ERR("XAPIAND_DATABASE_WAL is not activated");
+#endif
+	RETURN(1);
+}
@@ -29,3 +29,9 @@ uint32_t get_checksum(int fd);
 bool dir_compare(const std::string& dir1, const std::string& dir2);
 int create_db_wal();
 int restore_database();
+int replace_document_term_wal();
+int bad_async_document_wal();
+int replace_document_delta_wal();
+int ids_filter_wal();
+int dictionary_wal();
+int group_commit_rollover_wal();
@@ -23,7 +23,9 @@
 #pragma once
 
 #include <bitset>         // for std::bitset
+#include <cstdint>        // for uint64_t
 #include <utility>        // for std::make_pair
+#include <vector>         // for std::vector
 
 #include "cassert.h"      // for ASSERT
 #include "hashes.hh"      // for xxh64::hash, fnv1ah64::hash
@@ -81,3 +83,74 @@ public:
 		return true;
 	}
 };
+
+
+class DynamicBloomFilter {
+	// Bloom filter for sets growing at runtime: it's sized for a capacity
+	// given on construction and is to be rebuilt bigger once it's full.
+	// P = 0.01
+	// k = -ln(P) / ln(2)
+	// k = 4.605170186 / 0.6931471806
+	// k = 6.64385619
+	// k = 7
+	// m = N * k / ln(2)
+	// m = N * 9.585058
+	// m = N * 10
+	static constexpr size_t k = 7;
+	static constexpr size_t bits_per_item = 10;
+	std::vector<uint64_t> words;
+	size_t m;
+	size_t _capacity;
+	size_t _size;
+
+	auto hash(const char* data, size_t len) const {
+		return std::make_pair(
+			xxh64::hash(data, len),
+			fnv1ah64::hash(data, len) | 1
+		);
+	}
+
+public:
+	explicit DynamicBloomFilter(size_t capacity = 0) :
+		words((capacity * bits_per_item + 63) / 64),
+		m(words.size() * 64),
+		_capacity(capacity),
+		_size(0) { }
+
+	void add(const char* data, size_t len) {
+		ASSERT(m);
+		auto hashes = hash(data, len);
+		for (auto n = k; n; --n) {
+			auto bit = (hashes.first + n * hashes.second) % m;
+			words[bit / 64] |= 1ULL << (bit % 64);
+		}
+		++_size;
+	}
+
+	bool contains(const char* data, size_t len) const {
+		if (!m) {
+			// Not sized yet, so it can't tell
+			return true;
+		}
+		auto hashes = hash(data, len);
+		for (auto n = k; n; --n) {
+			auto bit = (hashes.first + n * hashes.second) % m;
+			if (!(words[bit / 64] & (1ULL << (bit % 64)))) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	size_t size() const {
+		return _size;
+	}
+
+	size_t capacity() const {
+		return _capacity;
+	}
+
+	bool full() const {
+		return _size >= _capacity;
+	}
+};
@@ -24,11 +24,19 @@
 
 #include <cstdio>                // for SEEK_SET
 #include <cstring>               // for size_t, memcpy
+#include <mutex>                 // for std::mutex, std::lock_guard
+#include <queue>                 // for std::priority_queue
+#include <unordered_map>         // for std::unordered_map
+#include <unordered_set>         // for std::unordered_set
 
 #include "cassert.h"             // for ASSERT
 #include "likely.h"              // for likely, unlikely
 
 
+#define LZ4_DICTIONARY_KMER      8    // Bytes in the substrings counted while training
+#define LZ4_DICTIONARY_SEGMENT   64   // Bytes in the pieces of samples the dictionary is made of
+
+
 static void read_uint16(const void* blockStream, uint16_t* i) {
 	memcpy(i, blockStream, sizeof(uint16_t));
 }
@@ -49,10 +57,150 @@ static void read_partial_bin(const void* blockStream, void* array, size_t arrayB
 }
 
 
-LZ4CompressData::LZ4CompressData(const char* data_, size_t data_size_, int seed_)
+static std::mutex lz4_dictionaries_mtx;
+static std::unordered_map<uint32_t, std::shared_ptr<const LZ4Dictionary>> lz4_dictionaries;
+
+
+LZ4Dictionary::LZ4Dictionary(std::string&& data)
+	: _id(hash(data)),
+	  _data(std::move(data)),
+	  _stream(LZ4_createStream())
+{
+	LZ4_loadDict(_stream, _data.data(), static_cast<int>(_data.size()));
+}
+
+
+LZ4Dictionary::~LZ4Dictionary()
+{
+	LZ4_freeStream(_stream);
+}
+
+
+uint32_t
+LZ4Dictionary::hash(std::string_view data)
+{
+	auto id = XXH32(data.data(), data.size(), 0);
+	return id ? id : 1;  // zero means no dictionary
+}
+
+
+std::shared_ptr<const LZ4Dictionary>
+LZ4Dictionary::add(std::string&& data)
+{
+	auto id = hash(data);
+	std::lock_guard<std::mutex> lk(lz4_dictionaries_mtx);
+	auto& dictionary = lz4_dictionaries[id];
+	if (!dictionary) {
+		dictionary = std::make_shared<const LZ4Dictionary>(std::move(data));
+	}
+	return dictionary;
+}
+
+
+std::shared_ptr<const LZ4Dictionary>
+LZ4Dictionary::get(uint32_t id)
+{
+	std::lock_guard<std::mutex> lk(lz4_dictionaries_mtx);
+	auto it = lz4_dictionaries.find(id);
+	if (it == lz4_dictionaries.end()) {
+		THROW(LZ4DictionaryNotFound, "Unknown compression dictionary: {}", id);
+	}
+	return it->second;
+}
+
+
+uint32_t
+LZ4Dictionary::used_by(std::string_view compressed)
+{
+	if (compressed.size() < LZ4_DICTIONARY_MARKER) {
+		return 0;
+	}
+	uint16_t cmpBytes = 0;
+	read_uint16(compressed.data(), &cmpBytes);
+	if (cmpBytes != 0) {
+		return 0;
+	}
+	uint32_t id = 0;
+	memcpy(&id, compressed.data() + sizeof(uint16_t), sizeof(uint32_t));
+	return id;
+}
+
+
+std::string
+LZ4Dictionary::train(const std::vector<std::string>& samples, size_t size)
+{
+	// Substrings of LZ4_DICTIONARY_KMER bytes are counted once per sample,
+	// then segments of the samples are greedily picked by the number of
+	// samples sharing the substrings they (still) don't have covered.
+
+	std::unordered_map<uint64_t, uint32_t> frequencies;
+	for (const auto& sample : samples) {
+		std::unordered_set<uint64_t> seen;
+		for (size_t pos = 0; pos + LZ4_DICTIONARY_KMER <= sample.size(); ++pos) {
+			uint64_t kmer;
+			memcpy(&kmer, sample.data() + pos, sizeof(kmer));
+			if (seen.insert(kmer).second) {
+				++frequencies[kmer];
+			}
+		}
+	}
+
+	auto score = [&](std::string_view segment) {
+		uint64_t total = 0;
+		for (size_t pos = 0; pos + LZ4_DICTIONARY_KMER <= segment.size(); ++pos) {
+			uint64_t kmer;
+			memcpy(&kmer, segment.data() + pos, sizeof(kmer));
+			auto it = frequencies.find(kmer);
+			if (it != frequencies.end() && it->second > 1) {
+				total += it->second;
+			}
+		}
+		return total;
+	};
+
+	using Candidate = std::pair<uint64_t, std::string_view>;
+	auto compare = [](const Candidate& a, const Candidate& b) { return a.first < b.first; };
+	std::priority_queue<Candidate, std::vector<Candidate>, decltype(compare)> candidates(compare);
+	for (const auto& sample : samples) {
+		for (size_t pos = 0; pos < sample.size(); pos += LZ4_DICTIONARY_SEGMENT) {
+			auto segment = std::string_view(sample).substr(pos, LZ4_DICTIONARY_SEGMENT);
+			auto segment_score = score(segment);
+			if (segment_score) {
+				candidates.emplace(segment_score, segment);
+			}
+		}
+	}
+
+	std::string dictionary;
+	while (!candidates.empty() && dictionary.size() < size) {
+		auto candidate = candidates.top();
+		candidates.pop();
+		auto current_score = score(candidate.second);
+		if (!current_score) {
+			continue;
+		}
+		if (!candidates.empty() && current_score < candidates.top().first) {
+			// Part of it is already covered, re-queue with the current score
+			candidates.emplace(current_score, candidate.second);
+			continue;
+		}
+		dictionary.append(candidate.second.substr(0, size - dictionary.size()));
+		for (size_t pos = 0; pos + LZ4_DICTIONARY_KMER <= candidate.second.size(); ++pos) {
+			uint64_t kmer;
+			memcpy(&kmer, candidate.second.data() + pos, sizeof(kmer));
+			frequencies.erase(kmer);
+		}
+	}
+
+	return dictionary;
+}
+
+
+LZ4CompressData::LZ4CompressData(const char* data_, size_t data_size_, int seed_, const LZ4Dictionary* dictionary_)
 	: LZ4Data(data_, data_size_),
 	  LZ4BlockStreaming(seed_),
-	  lz4Stream(LZ4_createStream()) { }
+	  lz4Stream(LZ4_createStream()),
+	  dictionary(dictionary_) { }
 
 
 LZ4CompressData::~LZ4CompressData()
@@ -71,6 +219,19 @@ LZ4CompressData::init()
 	if (!buffer) {
 		buffer = std::make_unique<char[]>(buffer_size);
 	}
+	if (dictionary) {
+		// Start from the preloaded dictionary and mark the data as using it.
+		memcpy(lz4Stream, dictionary->stream(), sizeof(LZ4_stream_t));
+		uint16_t marker = 0;
+		uint32_t id = dictionary->id();
+		std::string result;
+		result.reserve(LZ4_DICTIONARY_MARKER + cmpBuf_size);
+		result.append(reinterpret_cast<const char*>(&marker), sizeof(uint16_t));
+		result.append(reinterpret_cast<const char*>(&id), sizeof(uint32_t));
+		_size += LZ4_DICTIONARY_MARKER;
+		result.append(next());
+		return result;
+	}
 	return next();
 }
 
@@ -145,6 +306,15 @@ LZ4DecompressData::init()
 	if (!buffer) {
 		buffer = std::make_unique<char[]>(buffer_size);
 	}
+	auto id = LZ4Dictionary::used_by(std::string_view(data, data_size));
+	if (id) {
+		dictionary = LZ4Dictionary::get(id);
+		data_offset = LZ4_DICTIONARY_MARKER;
+		LZ4_setStreamDecode(lz4StreamDecode, dictionary->data().data(), static_cast<int>(dictionary->data().size()));
+	} else {
+		dictionary.reset();
+		LZ4_setStreamDecode(lz4StreamDecode, nullptr, 0);
+	}
 	return next();
 }
 
@@ -313,6 +483,15 @@ LZ4DecompressFile::init()
 	if (!buffer) {
 		buffer = std::make_unique<char[]>(buffer_size);
 	}
+	auto id = LZ4Dictionary::used_by(std::string_view(data, data_size));
+	if (id) {
+		dictionary = LZ4Dictionary::get(id);
+		data_offset = LZ4_DICTIONARY_MARKER;
+		LZ4_setStreamDecode(lz4StreamDecode, dictionary->data().data(), static_cast<int>(dictionary->data().size()));
+	} else {
+		dictionary.reset();
+		LZ4_setStreamDecode(lz4StreamDecode, nullptr, 0);
+	}
 	return next();
 }
 
@@ -29,6 +29,7 @@
 #include <functional>       // for function, __base
 #include <iostream>
 #include <iterator>         // for input_iterator_tag, iterator
+#include <memory>           // for std::shared_ptr
 #include <stdlib.h>         // for malloc, free
 #include <string.h>
 #include <string>           // for string
@@ -37,6 +38,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>      // for off_t, uint16_t, ssize_t, uint32_t
 #include <type_traits>      // for forward
+#include <vector>           // for std::vector
 
 #include "exception.h"      // for Error
 #include "io.hh"            // for close, open
@@ -49,6 +51,8 @@
 constexpr size_t LZ4_BLOCK_SIZE        = 1024 * 2;
 constexpr size_t LZ4_MAX_CMP_SIZE      = sizeof(uint16_t) + LZ4_COMPRESSBOUND(LZ4_BLOCK_SIZE);
 constexpr size_t LZ4_RING_BUFFER_BYTES = 1024 * 256 + LZ4_BLOCK_SIZE;
+constexpr size_t LZ4_DICTIONARY_SIZE   = 1024 * 32;
+constexpr size_t LZ4_DICTIONARY_MARKER = sizeof(uint16_t) + sizeof(uint32_t);
 
 
 class LZ4Exception : public Error {
@@ -72,6 +76,58 @@ public:
 };
 
 
+class LZ4DictionaryNotFound : public LZ4Exception {
+public:
+	template<typename... Args>
+	LZ4DictionaryNotFound(Args&&... args) : LZ4Exception(std::forward<Args>(args)...) { }
+};
+
+
+/*
+ * Compression dictionary.
+ *
+ * Data compressed with a dictionary starts with a zero block size (which
+ * never happens otherwise) followed by the dictionary id, so data
+ * compressed without one stays readable. Dictionaries are registered
+ * process-wide by id, which is the hash of their contents, so that
+ * decompressors can find them.
+ */
+class LZ4Dictionary {
+	uint32_t _id;
+	std::string _data;
+	LZ4_stream_t* const _stream;  // preloaded stream, copied into compressors
+
+public:
+	explicit LZ4Dictionary(std::string&& data);
+
+	~LZ4Dictionary();
+
+	LZ4Dictionary(const LZ4Dictionary&) = delete;
+	LZ4Dictionary& operator=(const LZ4Dictionary&) = delete;
+
+	uint32_t id() const noexcept {
+		return _id;
+	}
+
+	const std::string& data() const noexcept {
+		return _data;
+	}
+
+	const LZ4_stream_t* stream() const noexcept {
+		return _stream;
+	}
+
+	static uint32_t hash(std::string_view data);
+	static std::string train(const std::vector<std::string>& samples, size_t size = LZ4_DICTIONARY_SIZE);
+
+	static std::shared_ptr<const LZ4Dictionary> add(std::string&& data);
+	static std::shared_ptr<const LZ4Dictionary> get(uint32_t id);
+
+	// Returns the id of the dictionary the compressed data uses (0 = none).
+	static uint32_t used_by(std::string_view compressed);
+};
+
+
 template<typename Impl>
 class LZ4BlockStreaming {
 protected:
@@ -222,6 +278,7 @@ public:
  */
 class LZ4CompressData : public LZ4Data, public LZ4BlockStreaming<LZ4CompressData> {
 	LZ4_stream_t* const lz4Stream;
+	const LZ4Dictionary* dictionary;
 
 	std::string init();
 	std::string next();
@@ -229,13 +286,14 @@ class LZ4CompressData : public LZ4Data, public LZ4BlockStreaming<LZ4CompressData
 	friend class LZ4BlockStreaming<LZ4CompressData>;
 
 public:
-	LZ4CompressData(const char* data_=nullptr, size_t data_size_=0, int seed_=0);
+	LZ4CompressData(const char* data_=nullptr, size_t data_size_=0, int seed_=0, const LZ4Dictionary* dictionary_=nullptr);
 
 	~LZ4CompressData();
 
-	void reset(const char* data_, size_t data_size_, int seed=0) {
+	void reset(const char* data_, size_t data_size_, int seed=0, const LZ4Dictionary* dictionary_=nullptr) {
 		_reset(seed);
 		add_data(data_, data_size_);
+		dictionary = dictionary_;
 		LZ4_resetStream(lz4Stream);
 	}
 };
@@ -246,6 +304,7 @@ public:
  */
 class LZ4DecompressData : public LZ4Data, public LZ4BlockStreaming<LZ4DecompressData> {
 	LZ4_streamDecode_t* const lz4StreamDecode;
+	std::shared_ptr<const LZ4Dictionary> dictionary;
 
 	std::string init();
 	std::string next();
@@ -383,6 +442,7 @@ public:
  */
 class LZ4DecompressFile : public LZ4File, public LZ4BlockStreaming<LZ4DecompressFile> {
 	LZ4_streamDecode_t* const lz4StreamDecode;
+	std::shared_ptr<const LZ4Dictionary> dictionary;
 
 	char* const data;
 	ssize_t data_size;
@@ -413,10 +473,10 @@ public:
 
 
 inline std::string
-compress_lz4(std::string_view uncompressed)
+compress_lz4(std::string_view uncompressed, const LZ4Dictionary* dictionary = nullptr)
 {
 	std::string compressed;
-	LZ4CompressData compressor(uncompressed.data(), uncompressed.size());
+	LZ4CompressData compressor(uncompressed.data(), uncompressed.size(), 0, dictionary);
 	for (auto it = compressor.begin(); it; ++it) {
 		compressed.append(*it);
 	}
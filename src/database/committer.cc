@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "database/committer.h"
+
+#include <algorithm>                         // for std::min, std::max
+#include <utility>                           // for std::move
+
+#include "database/handler.h"                // for committer_commit
+#include "log.h"                             // for L_CALL, L_DEBUG_HOOK
+#include "metrics.h"                         // for Metrics::metrics
+#include "opts.h"                            // for opts::*
+#include "repr.hh"                           // for repr
+#include "time_point.hh"                     // for time_point_to_ullong
+
+
+#define COMMITTER_MIN_DELAY      0.01             // Minimum seconds waiting for more changes
+#define COMMITTER_IDLE_INTERVALS 2                // Intervals without changes before committing
+#define COMMITTER_COST_RATIO     10               // Time between commits is at least this many commit costs
+#define COMMITTER_SMOOTHING      0.2              // Weight of new samples in moving averages
+
+
+Committer::Committer(std::string name, const char* format, size_t num_threads) :
+	ThreadedScheduler<CommitterTask, ThreadPolicyType::committers>(name, format, num_threads)
+{
+}
+
+
+void
+Committer::schedule(const Endpoint& endpoint, std::weak_ptr<Shard> weak_shard, size_t uncommitted)
+{
+	L_CALL("Committer::schedule({}, <weak_shard>, {})", repr(endpoint.to_string()), uncommitted);
+
+	std::shared_ptr<CommitterTask> task;
+	std::chrono::duration<double> delay;
+
+	{
+		auto now = clock::now();
+		auto freshness = std::chrono::duration_cast<clock::duration>(std::chrono::milliseconds(opts.commit_freshness));
+		auto flush_threshold = static_cast<size_t>(opts.flush_threshold);
+
+		std::lock_guard<std::mutex> statuses_lk(statuses_mtx);
+		auto& status = statuses[endpoint];
+
+		// Measure the write rate (changes are counted by the shard and
+		// reset when committed):
+		auto changes = uncommitted >= status.last_uncommitted ? uncommitted - status.last_uncommitted : uncommitted;
+		status.last_uncommitted = uncommitted;
+		if (changes && status.last_change != clock::time_point{}) {
+			std::chrono::duration<double> elapsed = std::min(now - status.last_change, freshness);
+			auto interval = elapsed.count() / changes;
+			status.interval = status.interval ? status.interval * (1 - COMMITTER_SMOOTHING) + interval * COMMITTER_SMOOTHING : interval;
+		}
+		status.last_change = now;
+
+		if (status.deadline == clock::time_point{}) {
+			status.deadline = now + freshness;
+		}
+
+		clock::time_point wakeup;
+		if (uncommitted >= flush_threshold) {
+			// Xapian would be flushing anyway, commit now:
+			wakeup = now;
+		} else {
+			// Wait for a pause in the writes, but not longer than it takes
+			// them to reach the flush threshold (there is no rate to go by
+			// for the first change, so that one only waits for the pause):
+			auto idle = std::max(status.interval * COMMITTER_IDLE_INTERVALS, COMMITTER_MIN_DELAY);
+			auto fill = status.interval ? status.interval * (flush_threshold - uncommitted) : idle;
+			wakeup = now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(std::min(idle, fill)));
+			// Expensive commits shouldn't take most of the time:
+			wakeup = std::max(wakeup, status.last_commit + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(status.cost * COMMITTER_COST_RATIO)));
+			// ...and changes must become visible within the freshness target:
+			wakeup = std::min(wakeup, status.deadline);
+		}
+		auto wakeup_time = time_point_to_ullong(wakeup);
+
+		if (status.task && *status.task) {
+			// if the task is already waking up about then, do nothing:
+			if (wakeup_time >= status.task->wakeup_time && wakeup - time_point_from_ullong(status.task->wakeup_time) < std::chrono::duration<double>(COMMITTER_MIN_DELAY)) {
+				return;
+			}
+			status.task->clear();
+		}
+		task = std::make_shared<CommitterTask>(*this, endpoint, std::move(weak_shard));
+		task->wakeup_time = wakeup_time;
+		status.task = task;
+		delay = wakeup - now;
+	}
+
+	Metrics::metrics().xapiand_commit_delay.Observe(delay.count());
+
+	this->add(task);
+}
+
+
+void
+Committer::commit(const Endpoint& endpoint, const std::weak_ptr<Shard>& weak_shard)
+{
+	L_CALL("Committer::commit({}, <weak_shard>)", repr(endpoint.to_string()));
+
+	{
+		std::lock_guard<std::mutex> statuses_lk(statuses_mtx);
+		auto it = statuses.find(endpoint);
+		if (it != statuses.end()) {
+			// Changes from now on get committed by the next commit:
+			auto& status = it->second;
+			status.deadline = clock::time_point{};
+			status.last_uncommitted = 0;
+		}
+	}
+
+	auto start = clock::now();
+	bool committed = committer_commit(weak_shard);
+	auto end = clock::now();
+
+	std::chrono::duration<double> cost = end - start;
+	if (committed) {
+		Metrics::metrics().xapiand_commit_duration.Observe(cost.count());
+	}
+
+	{
+		std::lock_guard<std::mutex> statuses_lk(statuses_mtx);
+		auto it = statuses.find(endpoint);
+		if (it != statuses.end()) {
+			auto& status = it->second;
+			if (!status.task || !*status.task) {
+				// No changes since, the endpoint starts over with its next change:
+				statuses.erase(it);
+			} else if (committed) {
+				status.cost = status.cost ? status.cost * (1 - COMMITTER_SMOOTHING) + cost.count() * COMMITTER_SMOOTHING : cost.count();
+				status.last_commit = end;
+			}
+		}
+	}
+}
+
+
+CommitterTask::CommitterTask(Committer& committer, const Endpoint& endpoint, std::weak_ptr<Shard> weak_shard) :
+	committer(committer),
+	endpoint(endpoint),
+	weak_shard(std::move(weak_shard))
+{
+}
+
+
+void
+CommitterTask::operator()()
+{
+	L_CALL("CommitterTask::operator()()");
+	L_DEBUG_HOOK("CommitterTask::operator()", "CommitterTask::operator()()");
+
+	committer.commit(endpoint, weak_shard);
+}
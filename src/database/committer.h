@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <chrono>                            // for std::chrono
+#include <memory>                            // for std::shared_ptr, std::weak_ptr
+#include <mutex>                             // for std::mutex
+#include <stddef.h>                          // for size_t
+#include <string>                            // for std::string
+#include <unordered_map>                     // for std::unordered_map
+
+#include "endpoint.h"                        // for Endpoint
+#include "scheduler.h"                       // for ScheduledTask, ThreadedScheduler
+#include "thread.hh"                         // for ThreadPolicyType::*
+
+
+class Shard;
+class CommitterTask;
+
+
+// Schedules autocommits of modified shards. Rather than using fixed delays,
+// the next commit of each endpoint is chosen from the rate at which it's
+// being changed, the number of uncommitted changes and what its commits cost,
+// so bursts of writes are grouped into a single commit while changes still
+// become visible within the freshness target (opts.commit_freshness).
+class Committer : public ThreadedScheduler<CommitterTask, ThreadPolicyType::committers> {
+	friend CommitterTask;
+
+	using clock = std::chrono::system_clock;
+
+	struct Status {
+		std::shared_ptr<CommitterTask> task;
+		clock::time_point deadline;      // latest commit for the pending changes
+		clock::time_point last_change;
+		clock::time_point last_commit;
+		size_t last_uncommitted;
+		double interval;                 // seconds between changes (moving average)
+		double cost;                     // seconds per commit (moving average)
+	};
+
+	std::mutex statuses_mtx;
+	std::unordered_map<Endpoint, Status> statuses;
+
+	void commit(const Endpoint& endpoint, const std::weak_ptr<Shard>& weak_shard);
+
+public:
+	Committer(std::string name, const char* format, size_t num_threads);
+
+	void schedule(const Endpoint& endpoint, std::weak_ptr<Shard> weak_shard, size_t uncommitted);
+};
+
+
+class CommitterTask : public ScheduledTask<ThreadedScheduler<CommitterTask, ThreadPolicyType::committers>, CommitterTask, ThreadPolicyType::committers> {
+	friend Committer;
+
+	Committer& committer;
+	Endpoint endpoint;
+	std::weak_ptr<Shard> weak_shard;
+
+public:
+	CommitterTask(Committer& committer, const Endpoint& endpoint, std::weak_ptr<Shard> weak_shard);
+
+	void operator()();
+};
@@ -110,13 +110,13 @@ Accept::Accept(int position, double priority, ct_type_t ct_type, int indent)
 
 
 void
-Locator::data(std::string_view new_data)
+Locator::data(std::string_view new_data, const LZ4Dictionary* dictionary)
 {
 	size = new_data.size();
 	switch (type) {
 		case Type::compressed_inplace:
 			if (size >= 128) {
-				_raw_holder = compress_lz4(new_data);
+				_raw_holder = compress_lz4(new_data, dictionary);
 				if (_raw_holder.size() < new_data.size()) {
 					raw = _raw_holder;
 					break;
@@ -129,7 +129,7 @@ Locator::data(std::string_view new_data)
 			break;
 		case Type::compressed_stored:
 			if (size >= 128) {
-				_raw_holder = compress_lz4(new_data);
+				_raw_holder = compress_lz4(new_data, dictionary);
 				if (_raw_holder.size() < new_data.size()) {
 					raw = _raw_holder;
 					break;
@@ -145,13 +145,13 @@ Locator::data(std::string_view new_data)
 
 
 void
-Locator::data(std::string&& new_data)
+Locator::data(std::string&& new_data, const LZ4Dictionary* dictionary)
 {
 	size = new_data.size();
 	switch (type) {
 		case Type::compressed_inplace:
 			if (size >= 128) {
-				_raw_holder = compress_lz4(new_data);
+				_raw_holder = compress_lz4(new_data, dictionary);
 				if (_raw_holder.size() < new_data.size()) {
 					raw = _raw_holder;
 					break;
@@ -165,7 +165,7 @@ Locator::data(std::string&& new_data)
 			break;
 		case Type::compressed_stored:
 			if (size >= 128) {
-				_raw_holder = compress_lz4(new_data);
+				_raw_holder = compress_lz4(new_data, dictionary);
 				if (_raw_holder.size() < new_data.size()) {
 					raw = _raw_holder;
 					break;
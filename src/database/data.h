@@ -29,6 +29,7 @@
 
 
 class MsgPack;
+class LZ4Dictionary;
 
 
 constexpr int STORED_CONTENT_TYPE  = 0;
@@ -153,9 +154,9 @@ public:
 		offset(volume == -1 ? 0 : offset),
 		size(volume == -1 ? 0 : size) { }
 
-	void data(std::string_view new_data);
+	void data(std::string_view new_data, const LZ4Dictionary* dictionary = nullptr);
 
-	void data(std::string&& new_data);
+	void data(std::string&& new_data, const LZ4Dictionary* dictionary = nullptr);
 
 	std::string_view data() const;
 
@@ -204,6 +205,12 @@ public:
 		locator.data(std::forward<S>(data));
 	}
 
+	template <typename C, typename S>
+	void update(C&& ct_type, S&& data, const LZ4Dictionary* dictionary) {
+		auto& locator = pending.emplace_back(std::forward<C>(ct_type));
+		locator.data(std::forward<S>(data), dictionary);
+	}
+
 	template <typename C>
 	void update(C&& ct_type, ssize_t volume, size_t offset, size_t size) {
 		pending.emplace_back(std::forward<C>(ct_type), volume, offset, size);
@@ -25,8 +25,14 @@
 #include <algorithm>                        // for min, move
 #include <array>                            // for std::array
 #include <cctype>                           // for tolower
+#include <climits>                          // for PATH_MAX
+#include <cstring>                          // for strncpy
 #include <exception>                        // for std::exception
+#include <future>                           // for std::future
+#include <thread>                           // for std::this_thread
+#include <unordered_map>                    // for std::unordered_map
 #include <utility>                          // for std::move
+#include <sys/stat.h>                       // for stat
 
 #include "cassert.h"                        // for ASSERT
 #include "cast.h"                           // for Cast
@@ -37,12 +43,16 @@
 #include "database/shard.h"                 // for Shard
 #include "database/utils.h"                 // for split_path_id
 #include "database/wal.h"                   // for DatabaseWAL
+#include "error.hh"                         // for error:name, error::description
 #include "exception.h"                      // for ClientError
+#include "fs.hh"                            // for delete_files, move_files, files_size
 #include "hash/sha256.h"                    // for SHA256
 #include "io.hh"                            // for io::write (for MsgPack::serialise)
 #include "length.h"                         // for serialise_string, unserialise_string
 #include "log.h"                            // for L_CALL
+#include "metrics.h"                        // for Metrics::metrics
 #include "msgpack.h"                        // for MsgPack
+#include "msgpack_view.h"                   // for MsgPackView
 #include "msgpack_patcher.h"                // for apply_patch
 #include "nameof.hh"                        // for NAMEOF_ENUM
 #include "aggregations/aggregations.h"      // for AggregationMatchSpy
@@ -75,6 +85,8 @@
 constexpr int SCHEMA_RETRIES   = 10;   // Number of tries for schema operations
 constexpr int CONFLICT_RETRIES = 10;   // Number of tries for resolving version conflicts
 
+constexpr int SHARD_COMPACTION_RETRIES = 3;  // Number of tries for compacting a snapshot of a shard
+
 constexpr size_t NON_STORED_SIZE_LIMIT = 1024 * 1024;
 
 const std::string dump_documents_header("xapiand-dump-docs");
@@ -99,13 +111,13 @@ to_docid(std::string_view document_id)
 
 
 static void
-inject_blob(Data& data, const MsgPack& obj)
+inject_blob(Data& data, MsgPackView obj)
 {
 	auto blob_it = obj.find(RESERVED_BLOB);
 	if (blob_it == obj.end()) {
 		THROW(ClientError, "Data inconsistency, objects in '{}' must contain '{}'", RESERVED_DATA, RESERVED_BLOB);
 	}
-	auto& blob_value = blob_it.value();
+	auto blob_value = blob_it.value();
 	if (!blob_value.is_string()) {
 		THROW(ClientError, "Data inconsistency, '{}' must be a string", RESERVED_BLOB);
 	}
@@ -114,7 +126,7 @@ inject_blob(Data& data, const MsgPack& obj)
 	if (content_type_it == obj.end()) {
 		THROW(ClientError, "Data inconsistency, objects in '{}' must contain '{}'", RESERVED_DATA, RESERVED_CONTENT_TYPE);
 	}
-	auto& content_type_value = content_type_it.value();
+	auto content_type_value = content_type_it.value();
 	auto ct_type = ct_type_t(content_type_value.is_string() ? content_type_value.str_view() : "");
 	if (ct_type.empty()) {
 		THROW(ClientError, "Data inconsistency, '{}' must be a valid content type string", RESERVED_CONTENT_TYPE);
@@ -125,7 +137,7 @@ inject_blob(Data& data, const MsgPack& obj)
 	if (type_it == obj.end()) {
 		type = "inplace";
 	} else {
-		auto& type_value = type_it.value();
+		auto type_value = type_it.value();
 		if (!type_value.is_string()) {
 			THROW(ClientError, "Data inconsistency, '{}' must be either \"inplace\" or \"stored\"", RESERVED_TYPE);
 		}
@@ -147,11 +159,11 @@ inject_blob(Data& data, const MsgPack& obj)
 
 
 static void
-inject_data(Data& data, const MsgPack& obj)
+inject_data(Data& data, MsgPackView obj)
 {
 	auto data_it = obj.find(RESERVED_DATA);
 	if (data_it != obj.end()) {
-		auto& _data = data_it.value();
+		auto _data = data_it.value();
 		switch (_data.get_type()) {
 			case MsgPack::Type::STR: {
 				auto blob = _data.str_view();
@@ -169,7 +181,7 @@ inject_data(Data& data, const MsgPack& obj)
 				inject_blob(data, _data);
 				break;
 			case MsgPack::Type::ARRAY:
-				for (auto& blob : _data) {
+				for (auto blob : _data) {
 					inject_blob(data, blob);
 				}
 				break;
@@ -386,6 +398,415 @@ DatabaseHandler::check()
 }
 
 
+class ShardCompactor : public Xapian::Compactor {
+	const Endpoint& endpoint;
+
+	std::chrono::time_point<std::chrono::system_clock> start;
+	size_t written;
+	size_t reported;
+
+public:
+	ShardCompactor(const Endpoint& endpoint_) :
+		endpoint(endpoint_),
+		start(std::chrono::system_clock::now()),
+		written(0),
+		reported(0) { }
+
+	void set_status([[maybe_unused]] const std::string& table, const std::string& status) override {
+		if (!status.empty()) {
+			L_DEBUG("Compaction of {} {}: {} ({} written)", repr(endpoint.to_string()), table, status, string::from_bytes(written));
+		}
+	}
+
+	void progress(size_t size) override {
+		written += size;
+		if (written - reported >= 1024 * 1024) {
+			Metrics::metrics().xapiand_shard_compaction_written.Increment(written - reported);
+			reported = written;
+			if (opts.shard_compaction_rate) {
+				// Throttle compaction to the configured rate
+				auto expected = std::chrono::duration<double>(static_cast<double>(written) / (opts.shard_compaction_rate * 1024 * 1024));
+				auto elapsed = std::chrono::system_clock::now() - start;
+				if (expected > elapsed) {
+					std::this_thread::sleep_for(expected - elapsed);
+				}
+			}
+		}
+	}
+
+	size_t get_written() {
+		Metrics::metrics().xapiand_shard_compaction_written.Increment(written - reported);
+		reported = written;
+		return written;
+	}
+};
+
+
+static MsgPack
+compact_shard(const Endpoint& endpoint)
+{
+	L_CALL("compact_shard({})", repr(endpoint.to_string()));
+
+	if (!endpoint.is_local()) {
+		THROW(ClientError, "Shard {} is not local", repr(endpoint.to_string()));
+	}
+
+	auto start = std::chrono::system_clock::now();
+
+	{
+		// Commit pending changes, so the snapshot is as recent as possible
+		lock_shard lk_shard(endpoint, DB_WRITABLE);
+		lk_shard->commit();
+	}
+
+	auto compact_template = endpoint.path + "/.compact.XXXXXX";
+	char path[PATH_MAX + 1];
+	strncpy(path, compact_template.c_str(), PATH_MAX);
+	path[PATH_MAX] = '\0';
+	if (io::mkdtemp(path) == nullptr) {
+		THROW(Error, "Directory {} not created: {} ({}): {}", compact_template, error::name(errno), errno, error::description(errno));
+	}
+	std::string compact_path(path);
+
+	ShardCompactor compactor(endpoint);
+	Xapian::rev revision = 0;
+	size_t before = 0;
+	size_t after = 0;
+
+	try {
+		for (int t = SHARD_COMPACTION_RETRIES; ; --t) {
+			try {
+				// Compact a snapshot of the shard, writers go on meanwhile.
+				// The output keeps the UUID, revision and document ids of the
+				// snapshot, so the WAL (and replicas) can carry on from it.
+				Xapian::Database snapshot(endpoint.path, Xapian::DB_OPEN);
+				revision = snapshot.get_revision();
+				snapshot.compact(compact_path, Xapian::DBCOMPACT_KEEP_REVISION | Xapian::DBCOMPACT_NO_RENUMBER, 0, compactor);
+			} catch (const Xapian::DatabaseModifiedError&) {
+				// The writer reused blocks of the snapshot, start over
+				// (compact() creates the directory again)
+				delete_files(compact_path);
+				if (t == 0) {
+					throw;
+				}
+				continue;
+			}
+			after = files_size(compact_path, {"*glass"});
+
+			lock_shard lk_shard(endpoint, DB_WRITABLE);
+			auto shard = lk_shard.locked();
+
+			// Commit what's pending, so the revision is final
+			shard->commit();
+			auto current = shard->db()->get_revision();
+			if (current != revision) {
+				if (t > 0) {
+					// Swap a more recent snapshot instead
+					L_DEBUG("Shard {} changed while being compacted ({} -> {})", repr(endpoint.to_string()), revision, current);
+					delete_files(compact_path);
+					continue;
+				}
+#if XAPIAND_DATABASE_WAL
+				// Still changing, the commits since the snapshot get replayed
+				// from the WAL when the shard is reopened; make sure they are
+				// all there before removing anything.
+				if (!shard->is_wal_active()) {
+					THROW(Error, "Shard {} changed while being compacted ({} -> {})", repr(endpoint.to_string()), revision, current);
+				}
+				XapiandManager::wal_writer()->write_flush(*shard);
+				DatabaseWAL wal(endpoint.path);
+				if (wal.locate_revision(revision).first == DatabaseWAL::max_rev || wal.locate_revision(current - 1).first == DatabaseWAL::max_rev) {
+					THROW(Error, "Shard {} changed while being compacted and the WAL doesn't cover revisions {} to {}", repr(endpoint.to_string()), revision, current);
+				}
+#else
+				THROW(Error, "Shard {} changed while being compacted ({} -> {})", repr(endpoint.to_string()), revision, current);
+#endif
+			}
+
+			// Close internal databases
+			shard->do_close(true, false, shard->transaction);
+
+			// Get exclusive lock, so no readers are using the shard while
+			// swapping the files
+			XapiandManager::database_pool()->lock(shard);
+
+			before = files_size(endpoint.path, {"*glass"});
+			delete_files(endpoint.path, {"*glass"});
+			move_files(compact_path, endpoint.path);
+
+			XapiandManager::database_pool()->unlock(shard);
+
+			// Reopening replays the WAL since the snapshot revision
+			[[maybe_unused]] auto db = shard->db();
+			L_DEBUG("Compacted shard {} reopened {{db:{}, rev:{}}}", repr(endpoint.to_string()), db->get_uuid(), db->get_revision());
+			break;
+		}
+	} catch (...) {
+		delete_files(compact_path);
+		throw;
+	}
+
+	auto end = std::chrono::system_clock::now();
+
+	auto reclaimed = before > after ? before - after : 0;
+	Metrics::metrics().xapiand_shard_compaction_reclaimed.Increment(reclaimed);
+
+	L_INFO("Compaction of {} succeeded after {} ({} -> {}, {} reclaimed)", repr(endpoint.to_string()), string::from_delta(start, end), string::from_bytes(before), string::from_bytes(after), string::from_bytes(reclaimed));
+
+	return {
+		{"revision", revision},
+		{"written", compactor.get_written()},
+		{"before", before},
+		{"after", after},
+		{"reclaimed", reclaimed},
+		{RESPONSE_TOOK, string::from_delta(start, end)},
+	};
+}
+
+
+MsgPack
+DatabaseHandler::compact()
+{
+	L_CALL("DatabaseHandler::compact()");
+
+	MsgPack shards = MsgPack::MAP();
+	for (auto& endpoint : endpoints) {
+		try {
+			shards[endpoint.path] = compact_shard(endpoint);
+		} catch (const Exception& exc) {
+			shards[endpoint.path] = {
+				{"error", exc.get_message()},
+			};
+		} catch (const Xapian::Error& exc) {
+			shards[endpoint.path] = {
+				{"error", exc.get_description()},
+			};
+		}
+	}
+	return {
+		{"shards", shards},
+	};
+}
+
+
+static MsgPack
+open_bulk_load_shard(const Endpoint& endpoint)
+{
+	L_CALL("open_bulk_load_shard({})", repr(endpoint.to_string()));
+
+	if (!endpoint.is_local()) {
+		THROW(ClientError, "Shard {} is not local", repr(endpoint.to_string()));
+	}
+
+	lock_shard lk_shard(endpoint, DB_WRITABLE | DB_CREATE_OR_OPEN);
+	auto shard = lk_shard.locked();
+
+	shard->begin_bulk_load();
+
+	return {
+		{"revision", shard->db()->get_revision()},
+	};
+}
+
+
+static MsgPack
+close_bulk_load_shard(const Endpoint& endpoint)
+{
+	L_CALL("close_bulk_load_shard({})", repr(endpoint.to_string()));
+
+	if (!endpoint.is_local()) {
+		THROW(ClientError, "Shard {} is not local", repr(endpoint.to_string()));
+	}
+
+	auto start = std::chrono::system_clock::now();
+
+	lock_shard lk_shard(endpoint, DB_WRITABLE);
+	auto shard = lk_shard.locked();
+
+	if (!shard->endpoint.is_bulk_loading()) {
+		THROW(ClientError, "Shard {} is not being bulk loaded", repr(endpoint.to_string()));
+	}
+	shard->end_bulk_load();
+
+	auto end = std::chrono::system_clock::now();
+
+	return {
+		{"revision", shard->db()->get_revision()},
+		{RESPONSE_TOOK, string::from_delta(start, end)},
+	};
+}
+
+
+MsgPack
+DatabaseHandler::open_bulk_load()
+{
+	L_CALL("DatabaseHandler::open_bulk_load()");
+
+	MsgPack shards = MsgPack::MAP();
+	for (auto& endpoint : endpoints) {
+		try {
+			shards[endpoint.path] = open_bulk_load_shard(endpoint);
+		} catch (const Exception& exc) {
+			shards[endpoint.path] = {
+				{"error", exc.get_message()},
+			};
+		} catch (const Xapian::Error& exc) {
+			shards[endpoint.path] = {
+				{"error", exc.get_description()},
+			};
+		}
+	}
+	return {
+		{"shards", shards},
+	};
+}
+
+
+MsgPack
+DatabaseHandler::close_bulk_load()
+{
+	L_CALL("DatabaseHandler::close_bulk_load()");
+
+	MsgPack shards = MsgPack::MAP();
+	for (auto& endpoint : endpoints) {
+		try {
+			shards[endpoint.path] = close_bulk_load_shard(endpoint);
+		} catch (const Exception& exc) {
+			shards[endpoint.path] = {
+				{"error", exc.get_message()},
+			};
+		} catch (const Xapian::Error& exc) {
+			shards[endpoint.path] = {
+				{"error", exc.get_description()},
+			};
+		}
+	}
+	return {
+		{"shards", shards},
+	};
+}
+
+
+void
+freezer_freeze(Endpoint endpoint)
+{
+	L_CALL("freezer_freeze({})", repr(endpoint.to_string()));
+
+	// Frozen shards keep their glass files, readers use a read-only copy
+	// in the honey format (denser and cheaper to search) until the next
+	// commit thaws the shard (see Shard::commit).
+	if (!opts.shard_freeze_idle || !endpoint.is_local()) {
+		return;
+	}
+
+	auto frozen_path = endpoint.path + "/" FROZEN_SHARD_DIR;
+	if (exists(frozen_path + "/iamhoney")) {
+		return;
+	}
+
+	// The version file gets replaced by every commit
+	struct stat info;
+	if (::stat((endpoint.path + "/iamglass").c_str(), &info) != 0) {
+		return;
+	}
+	auto freeze_idle = std::chrono::seconds(opts.shard_freeze_idle);
+	auto idle = std::chrono::system_clock::now() - std::chrono::system_clock::from_time_t(info.st_mtime);
+	if (idle < freeze_idle) {
+		freezer()->delayed_debounce(std::chrono::duration_cast<std::chrono::milliseconds>(freeze_idle - idle), endpoint, endpoint);
+		return;
+	}
+
+	auto start = std::chrono::system_clock::now();
+
+	auto freeze_template = endpoint.path + "/" FROZEN_SHARD_DIR ".XXXXXX";
+	char path[PATH_MAX + 1];
+	strncpy(path, freeze_template.c_str(), PATH_MAX);
+	path[PATH_MAX] = '\0';
+	if (io::mkdtemp(path) == nullptr) {
+		L_ERR("Directory {} not created: {} ({}): {}", freeze_template, error::name(errno), errno, error::description(errno));
+		return;
+	}
+	std::string freeze_path(path);
+	auto discard = [&]() {
+		delete_files(freeze_path);
+		::rmdir(freeze_path.c_str());
+	};
+
+	std::string message;
+
+	ShardCompactor compactor(endpoint);
+	try {
+		Xapian::Database snapshot(endpoint.path, Xapian::DB_OPEN);
+		auto revision = snapshot.get_revision();
+		snapshot.compact(freeze_path, Xapian::DB_BACKEND_HONEY | Xapian::DBCOMPACT_KEEP_REVISION | Xapian::DBCOMPACT_NO_RENUMBER, 0, compactor);
+
+		lock_shard lk_shard(endpoint, DB_WRITABLE);
+		auto shard = lk_shard.locked();
+
+		if (shard->is_modified() || shard->db()->get_revision() != revision) {
+			// Not that cold after all, try again later
+			L_DEBUG("Shard {} changed while being frozen", repr(endpoint.to_string()));
+			discard();
+			freezer()->delayed_debounce(freeze_idle, endpoint, endpoint);
+			return;
+		}
+
+		// Get exclusive lock, so readers get reopened using the frozen copy
+		shard->do_close(true, false, shard->transaction);
+		XapiandManager::database_pool()->lock(shard);
+		if (::rename(freeze_path.c_str(), frozen_path.c_str()) != 0) {
+			XapiandManager::database_pool()->unlock(shard);
+			THROW(Error, "Cannot rename {} to {}: {} ({}): {}", freeze_path, frozen_path, error::name(errno), errno, error::description(errno));
+		}
+		XapiandManager::database_pool()->unlock(shard);
+	} catch (const Xapian::DatabaseModifiedError&) {
+		// The writer reused blocks of the snapshot, it wasn't cold
+		discard();
+		freezer()->delayed_debounce(freeze_idle, endpoint, endpoint);
+		return;
+	} catch (const Exception& exc) {
+		message = exc.get_message();
+	} catch (const Xapian::Error& exc) {
+		message = exc.get_description();
+	}
+
+	auto end = std::chrono::system_clock::now();
+
+	if (!message.empty()) {
+		discard();
+		L_WARNING("Freezing of {} failed after {}: {}", repr(endpoint.to_string()), string::from_delta(start, end), message);
+		return;
+	}
+
+	L_INFO("Shard {} frozen after {} ({} -> {})", repr(endpoint.to_string()), string::from_delta(start, end), string::from_bytes(files_size(endpoint.path, {"*glass"})), string::from_bytes(files_size(frozen_path, {"*.honey"})));
+}
+
+
+void
+trainer_train(Endpoint endpoint)
+{
+	L_CALL("trainer_train({})", repr(endpoint.to_string()));
+
+	// Samples are taken from a snapshot, so commits are not held back
+	// while the dictionary is trained; only adding it takes the shard.
+	try {
+		Xapian::Database snapshot(endpoint.path, Xapian::DB_OPEN);
+		auto doccount = snapshot.get_doccount();
+		auto trained = Shard::train_dictionary(snapshot);
+
+		lock_shard lk_shard(endpoint, DB_WRITABLE);
+		auto shard = lk_shard.locked();
+		if (shard->wants_dictionary(doccount)) {
+			shard->add_dictionary(trained, doccount);
+		}
+	} catch (const Exception& exc) {
+		L_WARNING("Training of compression dictionary for {} failed: {}", repr(endpoint.to_string()), exc.get_message());
+	} catch (const Xapian::Error& exc) {
+		L_WARNING("Training of compression dictionary for {} failed: {}", repr(endpoint.to_string()), exc.get_description());
+	}
+}
+
+
 Document
 DatabaseHandler::get_document_term(const std::string& term_id)
 {
@@ -579,6 +1000,63 @@ DatabaseHandler::index(const MsgPack& document_id, Xapian::rev document_ver, boo
 }
 
 
+std::tuple<Xapian::rev, Xapian::docid, MsgPack>
+DatabaseHandler::index_async(const MsgPack& document_id, bool stored, const MsgPack& body, const ct_type_t& ct_type)
+{
+	L_CALL("DatabaseHandler::index_async({}, {}, {}, {}/{})", repr(document_id.to_string()), stored, repr(body.to_string()), ct_type.first, ct_type.second);
+
+	// The document is validated and prepared here, but it's only written
+	// to the WAL; it's applied to the shard later (before its next commit).
+	// Returns the revision the document will be visible at, or (when the
+	// shard can't defer it) the docid of the document indexed right away.
+
+	auto prepared = prepare(document_id, 0, stored, body, ct_type);
+	auto& term_id = std::get<0>(prepared);
+	auto& doc = std::get<1>(prepared);
+	auto& data_obj = std::get<2>(prepared);
+
+	ASSERT(!endpoints.empty());
+	size_t n_shards = endpoints.size();
+	size_t shard_num = get_shard_num(term_id, n_shards);
+	if (shard_num == n_shards) {
+		shard_num = get_least_used_shard();
+	}
+	auto& endpoint = endpoints[shard_num];
+
+	Xapian::rev revision = 0;
+	Xapian::docid did = 0;
+	std::future<void> written;
+	{
+		lock_shard lk_shard(endpoint, flags);
+		auto& shard = *lk_shard;
+#if XAPIAND_DATABASE_WAL
+		// New documents without an id get it assigned when they're applied.
+		if (term_id != "QN\x80" && shard.is_wal_active()) {
+			if (n_shards > 1 && term_id[0] == 'Q' && term_id[1] == 'N') {
+				doc.add_value(DB_SLOT_SHARDS, serialise_length(shard_num) + serialise_length(n_shards));
+			}
+			std::tie(revision, written) = shard.defer_document_term(term_id, std::move(doc));
+		} else
+#endif
+		{
+			did = replace_document_term(shard, shard_num, n_shards, term_id, std::move(doc), false);
+		}
+	}
+
+	if (written.valid()) {
+		// The shard is released before waiting for the WAL line to be durable
+		written.get();
+	}
+
+	auto it = data_obj.find(ID_FIELD_NAME);
+	if (it != data_obj.end() && term_id == "QN\x80") {
+		data_obj.erase(it);
+	}
+
+	return std::make_tuple(revision, did, std::move(data_obj));
+}
+
+
 DataType
 DatabaseHandler::patch(const MsgPack& document_id, Xapian::rev document_ver, const MsgPack& patches, bool commit)
 {
@@ -1032,25 +1510,28 @@ DatabaseHandler::prepare_document(MsgPack& body)
 
 	MsgPack document_id;
 
-	auto f_it = body.find(ID_FIELD_NAME);
-	if (f_it != body.end()) {
-		const auto& field = f_it.value();
+	// Read the reserved fields through a view, so the document is not
+	// expanded into MsgPack nodes before Schema::index needs them.
+	MsgPackView view(body);
+
+	auto f_it = view.find(ID_FIELD_NAME);
+	if (f_it != view.end()) {
+		auto field = f_it.value();
 		if (field.is_map()) {
-			auto f_it_end = field.end();
 			auto fv_it = field.find(RESERVED_VALUE);
-			if (fv_it != f_it_end) {
-				document_id = fv_it.value();
+			if (fv_it != field.end()) {
+				document_id = fv_it.value().to_msgpack();
 			}
 		} else {
-			document_id = field;
+			document_id = field.to_msgpack();
 		}
 	}
 
 	std::string op_type = "index";
-	f_it = body.find(RESERVED_OP_TYPE);
-	if (f_it != body.end()) {
+	f_it = view.find(RESERVED_OP_TYPE);
+	if (f_it != view.end()) {
 		op_type = f_it.value().as_str();
-		body.erase(f_it);
+		body.erase(RESERVED_OP_TYPE);
 	}
 
 	if (op_type == "index") {
@@ -1585,6 +2066,32 @@ DatabaseHandler::get_docid(std::string_view document_id)
 }
 
 
+void
+DatabaseHandler::wait_revision(std::string_view document_id, Xapian::rev revision)
+{
+	L_CALL("DatabaseHandler::wait_revision({}, {})", repr(document_id), revision);
+
+	// Read your writes: waits for the shard holding the document to reach
+	// the revision returned by an asynchronous write.
+
+	ASSERT(!endpoints.empty());
+	size_t n_shards = endpoints.size();
+	size_t shard_num = 0;
+	if (n_shards > 1) {
+		auto did = to_docid(document_id);
+		if (did != 0u) {
+			shard_num = (did - 1) % n_shards;  // docid in the multi-db to shard number
+		} else {
+			shard_num = get_shard_num(get_prefixed_term_id(document_id), n_shards);
+			if (shard_num == n_shards) {
+				shard_num = 0;
+			}
+		}
+	}
+	XapiandManager::database_pool()->wait_revision(endpoints[shard_num], revision);
+}
+
+
 Xapian::docid
 DatabaseHandler::get_docid_term(const std::string& term)
 {
@@ -1667,26 +2174,7 @@ DatabaseHandler::add_document(Xapian::Document&& doc, bool commit, bool wal, boo
 
 	ASSERT(!endpoints.empty());
 	size_t n_shards = endpoints.size();
-	size_t shard_num = 0;
-	if (n_shards > 1) {
-		// Try getting a new ID which can currently be indexed (active node)
-		// Get the least used shard:
-		auto min_doccount = std::numeric_limits<Xapian::doccount>::max();
-		for (size_t n = 0; n < n_shards; ++n) {
-			auto& endpoint = endpoints[n];
-			lock_shard lk_shard(endpoint, flags);
-			auto node = lk_shard->node();
-			if (node && node->is_active()) {
-				try {
-					auto doccount = lk_shard->db()->get_doccount();
-					if (min_doccount > doccount) {
-						min_doccount = doccount;
-						shard_num = n;
-					}
-				} catch (...) {}
-			}
-		}
-	}
+	size_t shard_num = get_least_used_shard();
 	auto& endpoint = endpoints[shard_num];
 	lock_shard lk_shard(endpoint, flags);
 	auto shard_did = lk_shard->add_document(std::move(doc), commit, wal, version);
@@ -1718,6 +2206,66 @@ DatabaseHandler::replace_document_term(const std::string& term, Xapian::Document
 
 	ASSERT(!endpoints.empty());
 	size_t n_shards = endpoints.size();
+	size_t shard_num = get_shard_num(term, n_shards);
+	if (shard_num == n_shards) {
+		shard_num = get_least_used_shard();
+	}
+	auto& endpoint = endpoints[shard_num];
+	lock_shard lk_shard(endpoint, flags);
+	return replace_document_term(*lk_shard, shard_num, n_shards, term, std::move(doc), commit, wal, version);
+}
+
+
+Xapian::docid
+DatabaseHandler::replace_document_term(Shard& shard, size_t shard_num, size_t n_shards, const std::string& term, Xapian::Document&& doc, bool commit, bool wal, bool version)
+{
+	L_CALL("DatabaseHandler::replace_document_term(<shard>, {}, {}, {}, <doc>, {}, {})", shard_num, n_shards, repr(term), commit, wal);
+
+	if (n_shards > 1 && term[0] == 'Q' && term[1] == 'N') {
+		doc.add_value(DB_SLOT_SHARDS, serialise_length(shard_num) + serialise_length(n_shards));
+	}
+	auto shard_did = shard.replace_document_term(term, std::move(doc), commit, wal, version);
+	auto did = (shard_did - 1) * n_shards + shard_num + 1;  // shard number and shard docid to docid in multi-db
+	return did;
+}
+
+
+size_t
+DatabaseHandler::get_least_used_shard()
+{
+	L_CALL("DatabaseHandler::get_least_used_shard()");
+
+	// Try getting a new ID which can currently be indexed (active node)
+	// Get the least used shard (document counts are kept by the database
+	// pool, so shards don't get checked out):
+	size_t n_shards = endpoints.size();
+	size_t shard_num = 0;
+	if (n_shards > 1) {
+		auto min_doccount = std::numeric_limits<Xapian::doccount>::max();
+		for (size_t n = 0; n < n_shards; ++n) {
+			auto& endpoint = endpoints[n];
+			auto node = endpoint.node();
+			if (node && node->is_active()) {
+				try {
+					auto doccount = XapiandManager::database_pool()->get_doccount(endpoint, flags);
+					if (min_doccount > doccount) {
+						min_doccount = doccount;
+						shard_num = n;
+					}
+				} catch (...) {}
+			}
+		}
+	}
+	return shard_num;
+}
+
+
+size_t
+DatabaseHandler::get_shard_num(const std::string& term, size_t n_shards)
+{
+	L_CALL("DatabaseHandler::get_shard_num({}, {})", repr(term), n_shards);
+
+	// Returns n_shards for new documents, which can go to any shard.
 	size_t shard_num = 0;
 	if (n_shards > 1) {
 		ASSERT(term.size() > 2);
@@ -1725,36 +2273,15 @@ DatabaseHandler::replace_document_term(const std::string& term, Xapian::Document
 			auto did_serialised = term.substr(2);
 			Xapian::docid did = sortable_unserialise(did_serialised);
 			if (did == 0u) {
-				// Try getting a new ID which can currently be indexed (active node)
-				// Get the least used shard:
-				auto min_doccount = std::numeric_limits<Xapian::doccount>::max();
-				for (size_t n = 0; n < n_shards; ++n) {
-					auto& endpoint = endpoints[n];
-					lock_shard lk_shard(endpoint, flags);
-					auto node = lk_shard->node();
-					if (node && node->is_active()) {
-						try {
-							auto doccount = lk_shard->db()->get_doccount();
-							if (min_doccount > doccount) {
-								min_doccount = doccount;
-								shard_num = n;
-							}
-						} catch (...) {}
-					}
-				}
+				shard_num = n_shards;
 			} else {
 				shard_num = (did - 1) % n_shards;  // docid in the multi-db to shard number
 			}
-			doc.add_value(DB_SLOT_SHARDS, serialise_length(shard_num) + serialise_length(n_shards));
 		} else {
 			shard_num = fnv1ah64::hash(term) % n_shards;
 		}
 	}
-	auto& endpoint = endpoints[shard_num];
-	lock_shard lk_shard(endpoint, flags);
-	auto shard_did = lk_shard->replace_document_term(term, std::move(doc), commit, wal, version);
-	auto did = (shard_did - 1) * n_shards + shard_num + 1;  // shard number and shard docid to docid in multi-db
-	return did;
+	return shard_num;
 }
 
 
@@ -1974,11 +2501,11 @@ DocPreparer::operator()()
 		auto http_errors = catch_http_errors([&]{
 			DatabaseHandler db_handler(indexer->endpoints, indexer->flags);
 			auto prepared = db_handler.prepare_document(obj);
-			indexer->ready_queue.enqueue(std::make_tuple(std::move(std::get<0>(prepared)), std::move(std::get<1>(prepared)), std::move(std::get<2>(prepared)), idx));
+			indexer->_enqueue(std::make_tuple(std::move(std::get<0>(prepared)), std::move(std::get<1>(prepared)), std::move(std::get<2>(prepared)), idx));
 			return 0;
 		});
 		if (http_errors.error_code != HTTP_STATUS_OK) {
-			indexer->ready_queue.enqueue(std::make_tuple(std::string{}, Xapian::Document{}, indexer->comments ? MsgPack{
+			indexer->_enqueue(std::make_tuple(std::string{}, Xapian::Document{}, indexer->comments ? MsgPack{
 				{ RESPONSE_xSTATUS, static_cast<unsigned>(http_errors.error_code) },
 				{ RESPONSE_xMESSAGE, string::split(http_errors.error, '\n') }
 			} : MsgPack::MAP(), idx));
@@ -1987,35 +2514,114 @@ DocPreparer::operator()()
 }
 
 
+size_t
+DocIndexer::_route(const std::string& term_id, size_t idx)
+{
+	L_CALL("DocIndexer::_route({}, {})", repr(term_id), idx);
+
+	size_t n_shards = endpoints.size();
+	if (term_id.empty()) {
+		// Failed documents only need their result written
+		return idx % n_shards;
+	}
+
+	auto shard_num = DatabaseHandler::get_shard_num(term_id, n_shards);
+	if (shard_num == n_shards) {
+		// New documents go to the least used shard which can currently be
+		// indexed (active node), counting the documents already routed to it:
+		std::call_once(doccounts_flag, [&]{
+			for (size_t n = 0; n < n_shards; ++n) {
+				auto& shard_queue = *shard_queues[n];
+				auto& endpoint = endpoints[n];
+				auto node = endpoint.node();
+				if (node && node->is_active()) {
+					try {
+						shard_queue.doccount = XapiandManager::database_pool()->get_doccount(endpoint, flags);
+						shard_queue.active = true;
+					} catch (...) {}
+				}
+			}
+		});
+		shard_num = 0;
+		auto min_doccount = std::numeric_limits<size_t>::max();
+		for (size_t n = 0; n < n_shards; ++n) {
+			auto& shard_queue = *shard_queues[n];
+			if (shard_queue.active) {
+				auto doccount = shard_queue.doccount + shard_queue.routed.load(std::memory_order_relaxed);
+				if (min_doccount > doccount) {
+					min_doccount = doccount;
+					shard_num = n;
+				}
+			}
+		}
+	}
+	shard_queues[shard_num]->routed.fetch_add(1, std::memory_order_relaxed);
+	return shard_num;
+}
+
+
 void
-DocIndexer::operator()()
+DocIndexer::_enqueue(Prepared&& prepared)
 {
-	L_CALL("DocIndexer::operator()()");
+	L_CALL("DocIndexer::_enqueue(<prepared>)");
 
-	DatabaseHandler db_handler(endpoints, flags);
-	bool ready_ = false;
-	while (running) {
-		std::tuple<std::string, Xapian::Document, MsgPack, size_t> prepared;
-		auto valid = ready_queue.wait_dequeue_timed(prepared, 100000);  // wait 100ms
+	auto shard_num = _route(std::get<0>(prepared), std::get<3>(prepared));
+	auto& shard_queue = *shard_queues[shard_num];
+	if (shard_queue.queue.enqueue(std::move(prepared))) {
+		// The shard has no running writer, start one:
+		pending_writers.enqueue(shard_num);
+		XapiandManager::doc_indexer_pool()->enqueue(shared_from_this());
+	}
+}
 
-		if (!ready_) {
-			ready_ = ready.load(std::memory_order_relaxed);
-		}
 
-		size_t processed_;
-		if (valid) {
-			processed_ = _processed.fetch_add(1, std::memory_order_acquire) + 1;
+void
+DocIndexer::_write(size_t shard_num, std::vector<Prepared>& batch, size_t count, DatabaseHandler& db_handler)
+{
+	L_CALL("DocIndexer::_write({}, <batch>, {}, <db_handler>)", shard_num, count);
 
-			auto& term_id = std::get<0>(prepared);
-			auto& doc = std::get<1>(prepared);
-			auto& data_obj = std::get<2>(prepared);
-			auto& idx = std::get<3>(prepared);
+	size_t n_shards = endpoints.size();
 
-			MsgPack obj;
+	std::vector<Xapian::docid> dids(count, 0);
+	std::vector<http_errors_t> errors(count);
+
+	// Write the whole batch with the shard checked out once:
+	size_t written = 0;
+	auto http_errors = catch_http_errors([&]{
+		lock_shard lk_shard(endpoints[shard_num], flags, false);
+		for (; written < count; ++written) {
+			auto& term_id = std::get<0>(batch[written]);
 			if (!term_id.empty()) {
-				auto http_errors = catch_http_errors([&]{
-					auto did = db_handler.replace_document_term(term_id, std::move(doc), false);
+				if (!lk_shard.locked()) {
+					lk_shard.lock();
+				}
+				errors[written] = catch_http_errors([&]{
+					dids[written] = DatabaseHandler::replace_document_term(*lk_shard, shard_num, n_shards, term_id, std::move(std::get<1>(batch[written])), false);
+					return 0;
+				});
+			}
+		}
+		return 0;
+	});
+	for (; written < count; ++written) {
+		// Documents left unwritten when checking out the shard failed
+		errors[written] = http_errors;
+	}
+
+	// Build the results once the shard is checked in again (documents
+	// are read through the handler):
+	for (size_t i = 0; i < count; ++i) {
+		auto processed_ = _processed.fetch_add(1) + 1;
 
+		auto& term_id = std::get<0>(batch[i]);
+		auto& data_obj = std::get<2>(batch[i]);
+		auto& idx = std::get<3>(batch[i]);
+
+		MsgPack obj;
+		if (!term_id.empty()) {
+			auto did = dids[i];
+			if (errors[i].error_code == HTTP_STATUS_OK) {
+				errors[i] = catch_http_errors([&]{
 					Document document(did, &db_handler);
 
 					auto it_id = data_obj.find(ID_FIELD_NAME);
@@ -2059,9 +2665,6 @@ DocIndexer::operator()()
 
 						if (comments) {
 							obj[RESPONSE_xDOCID] = did;
-
-							size_t n_shards = endpoints.size();
-							size_t shard_num = (did - 1) % n_shards;
 							obj[RESPONSE_xSHARD] = shard_num + 1;
 							// obj[RESPONSE_xENDPOINT] = endpoints[shard_num].to_string();
 						}
@@ -2070,33 +2673,71 @@ DocIndexer::operator()()
 					++_indexed;
 					return 0;
 				});
-				if (http_errors.error_code != HTTP_STATUS_OK) {
-					if (comments) {
-						obj[RESPONSE_xSTATUS] = static_cast<unsigned>(http_errors.error_code);
-						obj[RESPONSE_xMESSAGE] = string::split(http_errors.error, '\n');
-					}
+			}
+			if (errors[i].error_code != HTTP_STATUS_OK) {
+				if (comments) {
+					obj[RESPONSE_xSTATUS] = static_cast<unsigned>(errors[i].error_code);
+					obj[RESPONSE_xMESSAGE] = string::split(errors[i].error, '\n');
 				}
-			} else if (!data_obj.is_undefined()) {
-				obj = std::move(data_obj);
 			}
+		} else if (!data_obj.is_undefined()) {
+			obj = std::move(data_obj);
+		}
+
+		{
+			// Results keep the order of the request, whichever shard wrote them
 			std::lock_guard<std::mutex> lk(_results_mtx);
 			if (_idx > _results.size()) {
 				_results.resize(_idx, MsgPack::MAP());
 			}
 			_results[idx] = std::move(obj);
-		} else {
-			processed_ = _processed.load(std::memory_order_acquire);
 		}
 
-		if (ready_) {
-			if (processed_ >= _total) {
-				done.signal();
+		if (processed_ % (limit_signal * 32) == 0) {
+			limit.signal(limit_signal);
+		}
+	}
+
+	_check_done();
+}
+
+
+void
+DocIndexer::_check_done()
+{
+	L_CALL("DocIndexer::_check_done()");
+
+	if (ready.load() && _processed.load() >= _total) {
+		if (!_done.exchange(true)) {
+			done.signal();
+		}
+	}
+}
+
+
+void
+DocIndexer::operator()()
+{
+	L_CALL("DocIndexer::operator()()");
+
+	// Each run is the writer of a single shard, started when the shard got
+	// documents queued while it had no writer, and which keeps writing
+	// until the shard's queue is empty.
+	size_t shard_num;
+	if (!pending_writers.try_dequeue(shard_num)) {
+		return;
+	}
+	auto& shard_queue = *shard_queues[shard_num];
+
+	DatabaseHandler db_handler(endpoints, flags);
+	std::vector<Prepared> batch(batch_size);
+	while (running) {
+		auto count = shard_queue.queue.dequeue(batch.begin(), batch.size(), writer_wait);
+		if (count) {
+			_write(shard_num, batch, count, db_handler);
+			if (shard_queue.queue.written(count)) {
 				break;
 			}
-		} else {
-			if (processed_ % (limit_signal * 32) == 0) {
-				limit.signal(limit_signal);
-			}
 		}
 	}
 }
@@ -2119,9 +2760,6 @@ DocIndexer::_prepare(MsgPack&& obj)
 			_total -= bulk_cnt;
 			L_ERR("Ignored {} documents: cannot enqueue tasks!", bulk_cnt);
 		}
-		if (_total == bulk_cnt) {
-			XapiandManager::doc_indexer_pool()->enqueue(shared_from_this());
-		}
 		bulk_cnt = 0;
 		limit.wait();  // throttle the prepare
 	}
@@ -2154,14 +2792,9 @@ DocIndexer::wait(double timeout)
 			_total -= bulk_cnt;
 			L_ERR("Ignored {} documents: cannot enqueue tasks!", bulk_cnt);
 		}
-		if (_total == bulk_cnt) {
-			XapiandManager::doc_indexer_pool()->enqueue(shared_from_this());
-		}
 		bulk_cnt = 0;
 	}
 
-	ready.store(true, std::memory_order_release);
-
 	{
 		std::lock_guard<std::mutex> lk(_results_mtx);
 		if (_idx > _results.size()) {
@@ -2169,6 +2802,9 @@ DocIndexer::wait(double timeout)
 		}
 	}
 
+	ready.store(true);
+	_check_done();
+
 	if (_total && timeout) {
 		if (timeout > 0.0) {
 			return done.wait(timeout * 1e6);
@@ -2187,7 +2823,6 @@ DocIndexer::finish()
 	L_CALL("DocIndexer::finish()");
 
 	running = false;
-	ready_queue.enqueue(std::make_tuple(std::string{}, Xapian::Document{}, MsgPack{}, 0));
 }
 
 
@@ -2654,7 +3289,7 @@ Document::hash()
 }
 
 
-void
+bool
 committer_commit(std::weak_ptr<Shard> weak_shard) {
 	if (auto shard = weak_shard.lock()) {
 		auto start = std::chrono::system_clock::now();
@@ -2677,5 +3312,105 @@ committer_commit(std::weak_ptr<Shard> weak_shard) {
 		} else {
 			L_WARNING("Autocommit of {} falied after {}: {}", repr(shard->to_string()), string::from_delta(start, end), error);
 		}
+		return true;
+	}
+	return false;
+}
+
+
+void
+compactor_compact([[maybe_unused]] Endpoint endpoint, [[maybe_unused]] bool scan) {
+#ifdef XAPIAND_DATA_STORAGE
+	// The shard is only locked for a batch of documents at a time, so
+	// writers can go on while volumes are being compacted. Documents
+	// replaced between batches get their blobs written elsewhere anyway.
+	auto start = std::chrono::system_clock::now();
+
+	auto& metrics = Metrics::metrics();
+	size_t pending = 0;
+	size_t relocated = 0;
+	bool retiring = false;
+
+	std::string error;
+
+	try {
+		{
+			lock_shard lk_shard(endpoint, DB_WRITABLE);
+			retiring = lk_shard->storage_retire_volumes();
+		}
+
+		if (scan) {
+			std::unordered_map<ssize_t, size_t> live;
+			Xapian::docid did = 1;
+			do {
+				lock_shard lk_shard(endpoint, DB_WRITABLE);
+				did = lk_shard->storage_live_data(did, live);
+			} while (did);
+
+			std::unordered_map<ssize_t, size_t> sparse;
+			{
+				lock_shard lk_shard(endpoint, DB_WRITABLE);
+				sparse = lk_shard->storage_sparse_volumes(live, opts.storage_compaction_threshold);
+			}
+
+			if (!sparse.empty()) {
+				for (const auto& volume : sparse) {
+					pending += volume.second;
+				}
+				metrics.xapiand_storage_compaction_pending.Increment(pending);
+
+				did = 1;
+				do {
+					size_t batch_relocated = 0;
+					{
+						lock_shard lk_shard(endpoint, DB_WRITABLE);
+						did = lk_shard->storage_relocate(did, sparse, batch_relocated);
+						lk_shard->commit();
+						if (!did) {
+							std::vector<ssize_t> volumes;
+							for (const auto& volume : sparse) {
+								volumes.push_back(volume.first);
+							}
+							lk_shard->storage_retire(std::move(volumes));
+							retiring = lk_shard->storage_retire_volumes();
+						}
+					}
+					relocated += batch_relocated;
+					metrics.xapiand_storage_compaction_relocated.Increment(batch_relocated);
+					auto step = std::min(pending, batch_relocated);
+					metrics.xapiand_storage_compaction_pending.Decrement(step);
+					pending -= step;
+
+					if (did && opts.storage_compaction_rate) {
+						// Throttle relocation to the configured rate
+						auto expected = std::chrono::duration<double>(static_cast<double>(relocated) / (opts.storage_compaction_rate * 1024 * 1024));
+						auto elapsed = std::chrono::system_clock::now() - start;
+						if (expected > elapsed) {
+							std::this_thread::sleep_for(expected - elapsed);
+						}
+					}
+				} while (did);
+			}
+		}
+	} catch (const Exception& exc) {
+		error = exc.get_message();
+	} catch (const Xapian::Error& exc) {
+		error = exc.get_description();
+	}
+
+	metrics.xapiand_storage_compaction_pending.Decrement(pending);
+
+	if (retiring) {
+		// Some volumes are waiting for readers, try again later
+		compactor()->debounce(endpoint, endpoint, false);
+	}
+
+	auto end = std::chrono::system_clock::now();
+
+	if (error.empty()) {
+		L_DEBUG("Compaction of {} succeeded after {} ({} relocated)", repr(endpoint.to_string()), string::from_delta(start, end), string::from_bytes(relocated));
+	} else {
+		L_WARNING("Compaction of {} failed after {}: {}", repr(endpoint.to_string()), string::from_delta(start, end), error);
 	}
+#endif  // XAPIAND_DATA_STORAGE
 }
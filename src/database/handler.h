@@ -24,16 +24,20 @@
 
 #include "config.h"
 
+#include <atomic>                            // for std::atomic_bool, std::atomic_size_t
 #include <condition_variable>                // for std::condition_variable
 #include <memory>                            // for std::shared_ptr, std::make_shared
+#include <mutex>                             // for std::mutex, std::once_flag
 #include <stddef.h>                          // for size_t
 #include <string>                            // for std::string
 #include <string_view>                       // for std::string_view
+#include <tuple>                             // for std::tuple
 #include <unordered_map>                     // for std::unordered_map
 #include <utility>                           // for std::pair
 #include <vector>                            // for std::vector
 
 #include "blocking_concurrent_queue.h"       // for BlockingConcurrentQueue
+#include "database/committer.h"              // for Committer
 #include "database/flags.h"                  // for DB_*
 #include "debouncer.h"                       // for make_debouncer
 #include "endpoint.h"                        // for Endpoints
@@ -41,6 +45,7 @@
 #include "msgpack.h"                         // for MsgPack
 #include "opts.h"                            // for opts::*
 #include "thread.hh"                         // for ThreadPolicyType::*
+#include "writer_queue.h"                    // for WriterQueue
 #include "xapian.h"                          // for Document, docid, MSet
 
 
@@ -210,10 +215,15 @@ public:
 #endif
 
 	MsgPack check();
+	MsgPack compact();
+
+	MsgPack open_bulk_load();
+	MsgPack close_bulk_load();
 
 	std::tuple<std::string, Xapian::Document, MsgPack> prepare(const MsgPack& document_id, Xapian::rev document_ver, bool stored, const MsgPack& body, const ct_type_t& ct_type);
 
 	DataType index(const MsgPack& document_id, Xapian::rev document_ver, bool stored, const MsgPack& body, bool commit, const ct_type_t& ct_type);
+	std::tuple<Xapian::rev, Xapian::docid, MsgPack> index_async(const MsgPack& document_id, bool stored, const MsgPack& body, const ct_type_t& ct_type);
 	DataType patch(const MsgPack& document_id, Xapian::rev document_ver, const MsgPack& patches, bool commit);
 	DataType update(const MsgPack& document_id, Xapian::rev document_ver, bool stored, const MsgPack& body, bool commit, const ct_type_t& ct_type);
 
@@ -247,6 +257,8 @@ public:
 	Xapian::docid get_docid(std::string_view document_id);
 	Xapian::docid get_docid_term(const std::string& term);
 
+	void wait_revision(std::string_view document_id, Xapian::rev revision);
+
 	void delete_document(Xapian::docid did, bool commit = false, bool wal = true, bool version = true);
 	void delete_document(std::string_view document_id, bool commit = false, bool wal = true, bool version = true);
 	void delete_document_term(const std::string& term, bool commit = false, bool wal = true, bool version = true);
@@ -255,6 +267,9 @@ public:
 	Xapian::docid replace_document(Xapian::docid did, Xapian::Document&& doc, bool commit = false, bool wal = true, bool version = true);
 	Xapian::docid replace_document(std::string_view document_id, Xapian::Document&& doc, bool commit = false, bool wal = true, bool version = true);
 	Xapian::docid replace_document_term(const std::string& term, Xapian::Document&& doc, bool commit = false, bool wal = true, bool version = true);
+	static Xapian::docid replace_document_term(Shard& shard, size_t shard_num, size_t n_shards, const std::string& term, Xapian::Document&& doc, bool commit = false, bool wal = true, bool version = true);
+	static size_t get_shard_num(const std::string& term, size_t n_shards);
+	size_t get_least_used_shard();
 
 	MsgPack get_document_info(std::string_view document_id, bool raw_data, bool human);
 	MsgPack get_database_info();
@@ -303,6 +318,24 @@ class DocIndexer : public std::enable_shared_from_this<DocIndexer> {
 
 	static constexpr size_t limit_max = 16;
 	static constexpr size_t limit_signal = 8;
+	static constexpr size_t batch_size = 64;
+	static constexpr int64_t writer_wait = 100000;  // microseconds a writer waits for counted documents
+
+	using Prepared = std::tuple<std::string, Xapian::Document, MsgPack, size_t>;
+
+	// Prepared documents of a shard, written by a single writer which keeps
+	// the shard checked out for a batch of documents at a time.
+	struct ShardQueue {
+		WriterQueue<Prepared> queue;
+		std::atomic_size_t routed;
+		Xapian::doccount doccount;
+		bool active;
+
+		ShardQueue() :
+			routed{0},
+			doccount{0},
+			active{false} { }
+	};
 
 	std::atomic_bool running;
 	std::atomic_bool ready;
@@ -317,12 +350,16 @@ class DocIndexer : public std::enable_shared_from_this<DocIndexer> {
 	std::atomic_size_t _indexed;
 	std::atomic_size_t _total;
 	std::atomic_size_t _idx;
+	std::atomic_bool _done;
 	LightweightSemaphore limit;
 	LightweightSemaphore done;
 
 	std::mutex _results_mtx;
 	std::vector<MsgPack> _results;
-	BlockingConcurrentQueue<std::tuple<std::string, Xapian::Document, MsgPack, size_t>> ready_queue;
+
+	std::vector<std::unique_ptr<ShardQueue>> shard_queues;
+	std::once_flag doccounts_flag;
+	BlockingConcurrentQueue<size_t> pending_writers;
 
 	std::array<std::unique_ptr<DocPreparer>, ConcurrentQueueDefaultTraits::BLOCK_SIZE> bulk;
 	size_t bulk_cnt;
@@ -338,10 +375,20 @@ class DocIndexer : public std::enable_shared_from_this<DocIndexer> {
 		_indexed{0},
 		_total{0},
 		_idx{0},
+		_done{false},
 		limit{limit_max},
-		bulk_cnt{0} { }
+		bulk_cnt{0}
+	{
+		for (size_t n = 0; n < endpoints.size(); ++n) {
+			shard_queues.push_back(std::make_unique<ShardQueue>());
+		}
+	}
 
 	void _prepare(MsgPack&& obj);
+	size_t _route(const std::string& term_id, size_t idx);
+	void _enqueue(Prepared&& prepared);
+	void _write(size_t shard_num, std::vector<Prepared>& batch, size_t count, DatabaseHandler& db_handler);
+	void _check_done();
 
 public:
 	template <typename... Args>
@@ -413,11 +460,41 @@ public:
 };
 
 
-void committer_commit(std::weak_ptr<Shard> weak_shard);
+bool committer_commit(std::weak_ptr<Shard> weak_shard);
 
 
 inline auto& committer(bool create = true) {
-	static auto committer = create ? make_unique_debouncer<Endpoint, 1000, 100, 500, 5000, ThreadPolicyType::committers>("AC--", "AC{:02}", opts.num_committers, committer_commit) : nullptr;
+	static auto committer = create ? std::make_unique<Committer>("AC--", "AC{:02}", opts.num_committers) : nullptr;
 	ASSERT(!create || committer);
 	return committer;
 }
+
+
+void compactor_compact(Endpoint endpoint, bool scan);
+
+
+inline auto& compactor(bool create = true) {
+	static auto compactor = create ? make_unique_debouncer<Endpoint, 60000, 10000, 10000, 60000>("SC--", "SC{:02}", 1, compactor_compact) : nullptr;
+	ASSERT(!create || compactor);
+	return compactor;
+}
+
+
+void freezer_freeze(Endpoint endpoint);
+
+
+inline auto& freezer(bool create = true) {
+	static auto freezer = create ? make_unique_debouncer<Endpoint, 60000, 10000, 10000, 60000>("SF--", "SF{:02}", 1, freezer_freeze) : nullptr;
+	ASSERT(!create || freezer);
+	return freezer;
+}
+
+
+void trainer_train(Endpoint endpoint);
+
+
+inline auto& trainer(bool create = true) {
+	static auto trainer = create ? make_unique_debouncer<Endpoint, 60000, 10000, 10000, 60000>("SD--", "SD{:02}", 1, trainer_train) : nullptr;
+	ASSERT(!create || trainer);
+	return trainer;
+}
@@ -27,9 +27,10 @@
 #include "cassert.h"              // for ASSERT
 #include "database/flags.h"       // for readable_flags
 #include "database/shard.h"       // for Shard
-#include "exception.h"            // for THROW, Error, MSG_Error, Exception, DocNot...
+#include "exception.h"            // for THROW, Error, ClientError, MSG_Error, Exception, DocNot...
 #include "log.h"                  // for L_CALL
 #include "logger.h"               // for Logging (database->log)
+#include "time_point.hh"          // for time_point_to_ullong, time_point_from_ullong
 
 #define L_POOL_TIMED L_NOTHING
 #define L_POOL_TIMED_CLEAR L_NOTHING
@@ -128,9 +129,17 @@ ShardEndpoint::ShardEndpoint(DatabasePool& database_pool, const Endpoint& endpoi
 	finished(false),
 	locked(false),
 	local_revision(0),
+	bulk_loading(false),
 	renew_time(std::chrono::system_clock::now()),
-	readables_available(0)
+	doccount(0),
+	doccount_known(false),
+	doccount_time(0),
+	readables_available(0),
+	readables_waiting(0)
 {
+	for (auto& slot : idle) {
+		slot = nullptr;
+	}
 }
 
 
@@ -140,6 +149,148 @@ ShardEndpoint::~ShardEndpoint()
 }
 
 
+std::shared_ptr<Shard>
+ShardEndpoint::_idle_checkout()
+{
+	L_CALL("ShardEndpoint::_idle_checkout()");
+
+	for (auto& slot : idle) {
+		if (slot.load(std::memory_order_relaxed)) {
+			auto shard = slot.exchange(nullptr);
+			if (shard) {
+				// Parked shards are still busy, nobody else could have released them
+				--readables_available;
+				return shard->shared_from_this();
+			}
+		}
+	}
+	return nullptr;
+}
+
+
+bool
+ShardEndpoint::_idle_checkin(std::shared_ptr<Shard>& shard)
+{
+	L_CALL("ShardEndpoint::_idle_checkin({})", shard ? shard->__repr__() : "null");
+
+	if (readables_waiting || database_pool.locks || is_finished() || shard->is_closed()) {
+		return false;
+	}
+
+	++readables_available;
+	for (auto& slot : idle) {
+		Shard* expected = nullptr;
+		if (slot.compare_exchange_strong(expected, shard.get())) {
+			if (database_pool.locks) {
+				// Raced with an exclusive lock, it needs to see this shard released
+				expected = shard.get();
+				if (slot.compare_exchange_strong(expected, nullptr)) {
+					--readables_available;
+					return false;
+				}
+			}
+			if (readables_waiting) {
+				// Raced with a checkout about to wait for readables
+				{
+					std::lock_guard<std::mutex> lk(mtx);
+				}
+				readables_cond.notify_one();
+			}
+			return true;
+		}
+	}
+	--readables_available;
+	return false;
+}
+
+
+void
+ShardEndpoint::_idle_clear()
+{
+	L_CALL("ShardEndpoint::_idle_clear()");
+
+	for (auto& slot : idle) {
+		auto shard = slot.exchange(nullptr);
+		if (shard) {
+			shard->busy.store(false);
+		}
+	}
+}
+
+
+void
+ShardEndpoint::_doccount_set(Xapian::doccount count)
+{
+	L_CALL("ShardEndpoint::_doccount_set({})", count);
+
+	doccount.store(count, std::memory_order_relaxed);
+	doccount_time.store(time_point_to_ullong(std::chrono::system_clock::now()), std::memory_order_relaxed);
+	doccount_known.store(true, std::memory_order_release);
+}
+
+
+bool
+ShardEndpoint::doccount_expired() const
+{
+	if (is_local()) {
+		// Kept updated by the writable shard
+		return false;
+	}
+	auto age = std::chrono::system_clock::now() - time_point_from_ullong(doccount_time.load(std::memory_order_relaxed));
+	return age >= std::chrono::seconds(REMOTE_DATABASE_UPDATE_TIME);
+}
+
+
+void
+ShardEndpoint::_local_revision_set(Xapian::rev revision)
+{
+	L_CALL("ShardEndpoint::_local_revision_set({})", revision);
+
+	{
+		std::lock_guard<std::mutex> lk(revision_mtx);
+		local_revision.store(revision);
+	}
+	revision_cond.notify_all();
+}
+
+
+bool
+ShardEndpoint::wait_revision(Xapian::rev revision, double timeout)
+{
+	L_CALL("ShardEndpoint::wait_revision({}, {})", revision, timeout);
+
+	auto wait_pred = [&]() {
+		return is_finished() || local_revision.load() >= revision;
+	};
+	std::unique_lock<std::mutex> lk(revision_mtx);
+	if (timeout > 0.0) {
+		auto timeout_tp = std::chrono::system_clock::now() + std::chrono::duration<double>(timeout);
+		return revision_cond.wait_until(lk, timeout_tp, wait_pred);
+	}
+	revision_cond.wait(lk, wait_pred);
+	return true;
+}
+
+
+void
+ShardEndpoint::_doccount_add()
+{
+	L_CALL("ShardEndpoint::_doccount_add()");
+
+	doccount.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void
+ShardEndpoint::_doccount_sub()
+{
+	L_CALL("ShardEndpoint::_doccount_sub()");
+
+	auto count = doccount.load(std::memory_order_relaxed);
+	while (count && !doccount.compare_exchange_weak(count, count - 1, std::memory_order_relaxed)) { }
+}
+
+
 std::shared_ptr<Shard>&
 ShardEndpoint::_writable_checkout(int flags, double timeout, std::packaged_task<void()>* callback, const std::chrono::time_point<std::chrono::system_clock>& now, std::unique_lock<std::mutex>& lk)
 {
@@ -152,6 +303,9 @@ ShardEndpoint::_writable_checkout(int flags, double timeout, std::packaged_task<
 			}
 			throw Xapian::DatabaseNotAvailableError("Shard is not available");
 		}
+		if (is_bulk_loading()) {
+			flags |= DB_DISABLE_WAL;
+		}
 		if (!writable) {
 			writable = std::make_shared<Shard>(*this, flags);
 		}
@@ -186,7 +340,7 @@ ShardEndpoint::_writable_checkout(int flags, double timeout, std::packaged_task<
 }
 
 
-std::shared_ptr<Shard>&
+std::shared_ptr<Shard>
 ShardEndpoint::_readable_checkout(int flags, double timeout, std::packaged_task<void()>* callback, const std::chrono::time_point<std::chrono::system_clock>& now, std::unique_lock<std::mutex>& lk)
 {
 	L_CALL("ShardEndpoint::_readable_checkout(({}), {}, {})", readable_flags(flags), timeout, callback ? "<callback>" : "null");
@@ -199,6 +353,11 @@ ShardEndpoint::_readable_checkout(int flags, double timeout, std::packaged_task<
 			throw Xapian::DatabaseNotAvailableError("Shard is not available");
 		}
 		if (readables_available > 0) {
+			auto shard = _idle_checkout();
+			if (shard) {
+				shard->flags = flags;  // update shard flags
+				return shard;
+			}
 			for (auto& readable : readables) {
 				if (!readable) {
 					readable = std::make_shared<Shard>(*this, flags);
@@ -223,25 +382,25 @@ ShardEndpoint::_readable_checkout(int flags, double timeout, std::packaged_task<
 		auto wait_pred = [&]() {
 			return is_finished() || ((readables_available > 0 || readables.size() < database_pool.max_database_readers) && !is_locked() && !database_pool.is_locked(*this));
 		};
+		// Waiters keep checkins from parking shards where they wouldn't be notified
+		++readables_waiting;
+		bool available = true;
 		if (timeout) {
 			if (timeout > 0.0) {
 				auto timeout_tp = now + std::chrono::duration<double>(timeout);
-				if (!readables_cond.wait_until(lk, timeout_tp, wait_pred)) {
-					if (callback) {
-						callbacks.enqueue(std::move(*callback));
-					}
-					throw Xapian::DatabaseNotAvailableError("Shard is not available");
-				}
+				available = readables_cond.wait_until(lk, timeout_tp, wait_pred);
 			} else {
 				while (!readables_cond.wait_for(lk, 1s, wait_pred)) {}
 			}
 		} else {
-			if (!wait_pred()) {
-				if (callback) {
-					callbacks.enqueue(std::move(*callback));
-				}
-				throw Xapian::DatabaseNotAvailableError("Shard is not available");
+			available = wait_pred();
+		}
+		--readables_waiting;
+		if (!available) {
+			if (callback) {
+				callbacks.enqueue(std::move(*callback));
 			}
+			throw Xapian::DatabaseNotAvailableError("Shard is not available");
 		}
 	} while (true);
 }
@@ -254,13 +413,21 @@ ShardEndpoint::checkout(int flags, double timeout, std::packaged_task<void()>* c
 
 	auto now = std::chrono::system_clock::now();
 
-	std::unique_lock<std::mutex> lk(mtx);
-
 	if ((flags & DB_WRITABLE) == DB_WRITABLE) {
+		std::unique_lock<std::mutex> lk(mtx);
 		return _writable_checkout(flags, timeout, callback, now, lk);
 	} else {
-		auto& shard = _readable_checkout(flags, timeout, callback, now, lk);
-		lk.unlock();
+		// Idle readables are handed out without locking
+		std::shared_ptr<Shard> shard;
+		if (!is_locked() && !is_finished()) {
+			shard = _idle_checkout();
+		}
+		if (shard) {
+			shard->flags = flags;  // update shard flags
+		} else {
+			std::unique_lock<std::mutex> lk(mtx);
+			shard = _readable_checkout(flags, timeout, callback, now, lk);
+		}
 		try {
 			// Reopening of old/outdated (readable) databases:
 			bool reopen = false;
@@ -270,14 +437,10 @@ ShardEndpoint::checkout(int flags, double timeout, std::packaged_task<void()>* c
 				reopen = true;
 			} else {
 				if (shard->is_local()) {
-					auto referenced_database_endpoint = database_pool.get(*this);
-					if (referenced_database_endpoint) {
-						auto revision = referenced_database_endpoint->local_revision.load();
-						referenced_database_endpoint.reset();
-						if (revision && revision != shard->db()->get_revision()) {
-							L_DATABASE("Local writable shard has changed revision");
-							reopen = true;
-						}
+					auto revision = local_revision.load();
+					if (revision && revision != shard->db()->get_revision()) {
+						L_DATABASE("Local writable shard has changed revision");
+						reopen = true;
 					}
 				} else {
 					if (reopen_age >= REMOTE_DATABASE_UPDATE_TIME) {
@@ -290,8 +453,12 @@ ShardEndpoint::checkout(int flags, double timeout, std::packaged_task<void()>* c
 				// Create a new shard and discard old one
 				auto new_database = std::make_shared<Shard>(*this, flags);
 				new_database->busy.store(true);
-				lk.lock();
-				shard = new_database;
+				std::lock_guard<std::mutex> lk(mtx);
+				auto it = std::find(readables.begin(), readables.end(), shard);
+				if (it != readables.end()) {
+					*it = new_database;
+					shard = new_database;
+				}
 			}
 		} catch (...) {
 			L_WARNING("WARNING: Readable shard reopening failed: {}", to_string());
@@ -310,6 +477,13 @@ ShardEndpoint::checkin(std::shared_ptr<Shard>& shard) noexcept
 	ASSERT(shard->is_busy());
 	ASSERT(&shard->endpoint == this);
 
+	if (!shard->is_writable() && _idle_checkin(shard)) {
+		L_POOL_TIMED_CLEAR();
+		shard.reset();
+		while (callbacks.call()) {};
+		return;
+	}
+
 	TaskQueue<void()> pending_callbacks;
 	{
 		std::lock_guard<std::mutex> lk(mtx);
@@ -357,6 +531,7 @@ ShardEndpoint::finish()
 	finished = true;
 	writable_cond.notify_all();
 	readables_cond.notify_all();
+	revision_cond.notify_all();
 }
 
 
@@ -367,6 +542,8 @@ ShardEndpoint::clear()
 
 	std::unique_lock<std::mutex> lk(mtx);
 
+	_idle_clear();
+
 	if (writable) {
 		if (!writable->busy.exchange(true)) {
 			lk.unlock();
@@ -457,6 +634,7 @@ ShardEndpoint::is_used() const
 	return (
 		refs != 0 ||
 		is_locked() ||
+		is_bulk_loading() ||
 		writable ||
 		!readables.empty()
 	);
@@ -466,10 +644,11 @@ ShardEndpoint::is_used() const
 std::string
 ShardEndpoint::__repr__() const
 {
-	return string::format("<ShardEndpoint {{refs:{}}} {}{}{}>",
+	return string::format("<ShardEndpoint {{refs:{}}} {}{}{}{}>",
 		refs.load(),
 		repr(to_string()),
 		is_locked() ? " (locked)" : "",
+		is_bulk_loading() ? " (bulk loading)" : "",
 		is_finished() ? " (finished)" : "");
 }
 
@@ -510,10 +689,21 @@ ShardEndpoint::dump_databases(int level) const
  */
 
 DatabasePool::DatabasePool(size_t database_pool_size, size_t max_database_readers) :
-	LRU(database_pool_size),
 	locks(0),
 	max_database_readers(max_database_readers)
 {
+	auto segment_size = (database_pool_size + DATABASE_POOL_SEGMENTS - 1) / DATABASE_POOL_SEGMENTS;
+	segments.reserve(DATABASE_POOL_SEGMENTS);
+	for (size_t i = 0; i < DATABASE_POOL_SEGMENTS; ++i) {
+		segments.push_back(std::make_unique<Segment>(segment_size ? segment_size : 1));
+	}
+}
+
+
+DatabasePool::Segment&
+DatabasePool::segment(const Endpoint& endpoint) const
+{
+	return *segments[std::hash<Endpoint>{}(endpoint) % segments.size()];
 }
 
 
@@ -522,10 +712,12 @@ DatabasePool::endpoints() const
 {
 	std::vector<ReferencedShardEndpoint> database_endpoints;
 
-	std::lock_guard<std::mutex> lk(mtx);
-	database_endpoints.reserve(size());
-	for (auto& database_endpoint : *this) {
-		database_endpoints.emplace_back(database_endpoint.second.get());
+	for (auto& segment : segments) {
+		std::lock_guard<std::mutex> lk(segment->mtx);
+		database_endpoints.reserve(database_endpoints.size() + segment->size());
+		for (auto& database_endpoint : *segment) {
+			database_endpoints.emplace_back(database_endpoint.second.get());
+		}
 	}
 	return database_endpoints;
 }
@@ -551,7 +743,7 @@ DatabasePool::lock(const std::shared_ptr<Shard>& shard, double timeout)
 		THROW(Error, "Cannot grant exclusive lock shard");
 	}
 
-	std::unique_lock<std::mutex> lk(mtx);
+	std::unique_lock<std::mutex> lk(segment(shard->endpoint).mtx);
 
 	auto is_ready_to_lock = [&] {
 		bool is_ready = true;
@@ -612,10 +804,11 @@ DatabasePool::notify_lockable(const Endpoint& endpoint)
 	bool locked = false;
 
 	if (locks) {
-		std::lock_guard<std::mutex> lk(mtx);
+		auto& segment = this->segment(endpoint);
+		std::lock_guard<std::mutex> lk(segment.mtx);
 
-		auto it = find_and_leave(endpoint);
-		if (it != end()) {
+		auto it = segment.find_and_leave(endpoint);
+		if (it != segment.end()) {
 			auto& database_endpoint = it->second;
 			if (database_endpoint->is_locked()) {
 				database_endpoint->lockable_cond.notify_one();
@@ -634,10 +827,11 @@ DatabasePool::is_locked(const Endpoint& endpoint) const
 	L_CALL("DatabasePool::is_locked({})", repr(endpoint.to_string()));
 
 	if (locks) {
-		std::lock_guard<std::mutex> lk(mtx);
+		auto& segment = this->segment(endpoint);
+		std::lock_guard<std::mutex> lk(segment.mtx);
 
-		auto it = find_and_leave(endpoint);
-		if (it != end()) {
+		auto it = segment.find_and_leave(endpoint);
+		if (it != segment.end()) {
 			if (it->second->is_locked()) {
 				return true;
 			}
@@ -648,21 +842,67 @@ DatabasePool::is_locked(const Endpoint& endpoint) const
 }
 
 
+Xapian::doccount
+DatabasePool::get_doccount(const Endpoint& endpoint, int flags, double timeout)
+{
+	L_CALL("DatabasePool::get_doccount({}, ({}), {})", repr(endpoint.to_string()), readable_flags(flags), timeout);
+
+	auto shard_endpoint = spawn(endpoint);
+	if (!shard_endpoint->has_doccount() || shard_endpoint->doccount_expired()) {
+		// Not known yet (or remote and too old), opening a shard gets it
+		// and checking out a readable reopens it if it's outdated:
+		auto shard = shard_endpoint->checkout(flags, timeout);
+		ASSERT(shard);
+		try {
+			shard_endpoint->_doccount_set(shard->db()->get_doccount());
+		} catch (...) {
+			shard_endpoint->checkin(shard);
+			throw;
+		}
+		shard_endpoint->checkin(shard);
+	}
+	return shard_endpoint->get_doccount();
+}
+
+
+void
+DatabasePool::wait_revision(const Endpoint& endpoint, Xapian::rev revision, double timeout)
+{
+	L_CALL("DatabasePool::wait_revision({}, {}, {})", repr(endpoint.to_string()), revision, timeout);
+
+	if (!endpoint.is_local()) {
+		// Revisions are only tracked for local shards
+		THROW(ClientError, "Revisions can only be waited for on local shards, {} is remote", repr(endpoint.to_string()));
+	}
+
+	auto shard_endpoint = spawn(endpoint);
+	if (!shard_endpoint->local_revision.load()) {
+		// Not known yet, opening the writable shard gets it:
+		auto shard = shard_endpoint->checkout(DB_WRITABLE | DB_CREATE_OR_OPEN, timeout);
+		ASSERT(shard);
+		shard_endpoint->checkin(shard);
+	}
+	if (!shard_endpoint->wait_revision(revision, timeout)) {
+		throw Xapian::DatabaseNotAvailableError("Revision is not available");
+	}
+}
+
+
 ReferencedShardEndpoint
-DatabasePool::_spawn(const Endpoint& endpoint)
+DatabasePool::_spawn(Segment& segment, const Endpoint& endpoint)
 {
-	L_CALL("DatabasePool::_spawn({})", repr(endpoint.to_string()));
+	L_CALL("DatabasePool::_spawn(<segment>, {})", repr(endpoint.to_string()));
 
 	ShardEndpoint* database_endpoint;
 
 	// Find or spawn the shard endpoint
-	auto it = find_and([&](const std::unique_ptr<ShardEndpoint>& database_endpoint) {
+	auto it = segment.find_and([&](const std::unique_ptr<ShardEndpoint>& database_endpoint) {
 		ASSERT(database_endpoint);
 		database_endpoint->renew_time = std::chrono::system_clock::now();
 		return lru::GetAction::renew;
 	}, endpoint);
-	if (it == end()) {
-		auto emplaced = emplace_and([&](const std::unique_ptr<ShardEndpoint>&, ssize_t, ssize_t) {
+	if (it == segment.end()) {
+		auto emplaced = segment.emplace_and([&](const std::unique_ptr<ShardEndpoint>&, ssize_t, ssize_t) {
 			return lru::DropAction::stop;
 		}, endpoint, std::make_unique<ShardEndpoint>(*this, endpoint));
 		database_endpoint = emplaced.first->second.get();
@@ -680,20 +920,21 @@ DatabasePool::spawn(const Endpoint& endpoint)
 {
 	L_CALL("DatabasePool::spawn({})", repr(endpoint.to_string()));
 
-	std::lock_guard<std::mutex> lk(mtx);
-	return _spawn(endpoint);
+	auto& segment = this->segment(endpoint);
+	std::lock_guard<std::mutex> lk(segment.mtx);
+	return _spawn(segment, endpoint);
 }
 
 
 ReferencedShardEndpoint
-DatabasePool::_get(const Endpoint& endpoint) const
+DatabasePool::_get(const Segment& segment, const Endpoint& endpoint) const
 {
-	L_CALL("DatabasePool::_get({})", repr(endpoint.to_string()));
+	L_CALL("DatabasePool::_get(<segment>, {})", repr(endpoint.to_string()));
 
 	ShardEndpoint* database_endpoint = nullptr;
 
-	auto it = find_and_leave(endpoint);
-	if (it != end()) {
+	auto it = segment.find_and_leave(endpoint);
+	if (it != segment.end()) {
 		database_endpoint = it->second.get();
 	}
 
@@ -707,8 +948,9 @@ DatabasePool::get(const Endpoint& endpoint) const
 {
 	L_CALL("DatabasePool::get({})", repr(endpoint.to_string()));
 
-	std::lock_guard<std::mutex> lk(mtx);
-	return _get(endpoint);
+	auto& segment = this->segment(endpoint);
+	std::lock_guard<std::mutex> lk(segment.mtx);
+	return _get(segment, endpoint);
 }
 
 
@@ -791,10 +1033,11 @@ DatabasePool::finish()
 {
 	L_CALL("DatabasePool::finish()");
 
-	std::lock_guard<std::mutex> lk(mtx);
-
-	for (auto& database_endpoint : *this) {
-		database_endpoint.second->finish();
+	for (auto& segment : segments) {
+		std::lock_guard<std::mutex> lk(segment->mtx);
+		for (auto& database_endpoint : *segment) {
+			database_endpoint.second->finish();
+		}
 	}
 }
 
@@ -828,7 +1071,18 @@ DatabasePool::cleanup(bool immediate)
 
 	auto now = std::chrono::system_clock::now();
 
-	std::unique_lock<std::mutex> lk(mtx);
+	for (auto& segment : segments) {
+		cleanup(*segment, immediate, now);
+	}
+}
+
+
+void
+DatabasePool::cleanup(Segment& segment, bool immediate, const std::chrono::time_point<std::chrono::system_clock>& now)
+{
+	L_CALL("DatabasePool::cleanup(<segment>)");
+
+	std::unique_lock<std::mutex> lk(segment.mtx);
 
 	const auto on_drop = [&](const std::unique_ptr<ShardEndpoint>& database_endpoint, ssize_t size, ssize_t max_size) {
 		ASSERT(database_endpoint);
@@ -865,7 +1119,7 @@ DatabasePool::cleanup(bool immediate)
 		L_DATABASE("Stop at endpoint: {}", repr(database_endpoint->to_string()));
 		return lru::DropAction::stop;
 	};
-	trim(on_drop);
+	segment.trim(on_drop);
 }
 
 
@@ -888,17 +1142,25 @@ DatabasePool::clear()
 		return false;
 	}
 
-	// Now lock to double-check and really clear the LRU:
-	std::lock_guard<std::mutex> lk(mtx);
+	// Now lock (all segments, always in the same order) to double-check and really clear the LRUs:
+	std::vector<std::unique_lock<std::mutex>> lks;
+	lks.reserve(segments.size());
+	for (auto& segment : segments) {
+		lks.emplace_back(segment->mtx);
+	}
 
-	for (auto& database_endpoint : *this) {
-		auto count = database_endpoint.second->count();
-		if (count.first || count.second) {
-			return false;
+	for (auto& segment : segments) {
+		for (auto& database_endpoint : *segment) {
+			auto count = database_endpoint.second->count();
+			if (count.first || count.second) {
+				return false;
+			}
 		}
 	}
 
-	LRU::clear();
+	for (auto& segment : segments) {
+		segment->clear();
+	}
 	return true;
 }
 
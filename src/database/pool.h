@@ -24,6 +24,7 @@
 
 #include "config.h"             // for XAPIAND_REMOTE_SERVERPORT
 
+#include <array>                // for std::array
 #include <atomic>               // for std::atomic_bool
 #include <chrono>               // for std::chrono, std::chrono::system_clock
 #include <cstring>              // for size_t
@@ -38,7 +39,7 @@
 #include "threadpool.hh"        // for TaskQueue
 #include "endpoint.h"           // for Endpoints, Endpoint
 #include "lru.h"                // for LRU, DropAction, LRU<>::iterator, DropAc...
-#include "xapian.h"             // for Xapian::rev
+#include "xapian.h"             // for Xapian::rev, Xapian::doccount
 
 
 using namespace std::chrono_literals;
@@ -46,6 +47,9 @@ using namespace std::chrono_literals;
 
 constexpr double DB_TIMEOUT = 60.0;
 
+constexpr size_t DATABASE_POOL_SEGMENTS = 16;
+constexpr size_t SHARD_ENDPOINT_IDLE_SLOTS = 8;
+
 class Shard;
 class Database;
 class DatabasePool;
@@ -77,12 +81,34 @@ class ShardEndpoint : public Endpoint
 
 	std::atomic_bool locked;
 	std::atomic<Xapian::rev> local_revision;
+
+	// Readers waiting for the writable shard to reach a revision
+	std::mutex revision_mtx;
+	std::condition_variable revision_cond;
+
+	void _local_revision_set(Xapian::rev revision);
+
+	// Bulk loading skips the WAL, autocommits and replication until
+	// the session is closed (see DatabaseHandler::open_bulk_load).
+	std::atomic_bool bulk_loading;
 	std::chrono::time_point<std::chrono::system_clock> renew_time;
 
+	// Approximate document count, read when shards are opened or committed
+	// and updated as documents get added or deleted. Counts of remote shards
+	// are read again once they are older than REMOTE_DATABASE_UPDATE_TIME.
+	std::atomic<Xapian::doccount> doccount;
+	std::atomic_bool doccount_known;
+	std::atomic_ullong doccount_time;
+
+	void _doccount_set(Xapian::doccount count);
+	void _doccount_add();
+	void _doccount_sub();
+
 	std::shared_ptr<Shard> writable;
 	std::list<std::shared_ptr<Shard>> readables;
 
 	std::atomic_size_t readables_available;
+	std::atomic_size_t readables_waiting;
 	std::condition_variable writable_cond;
 	std::condition_variable readables_cond;
 
@@ -90,8 +116,16 @@ class ShardEndpoint : public Endpoint
 
 	TaskQueue<void()> callbacks;  // callbacks waiting for database to be ready
 
+	// Idle readables parked (still busy) by checkin, so they can be
+	// handed out again by checkout without taking the mutex.
+	std::array<std::atomic<Shard*>, SHARD_ENDPOINT_IDLE_SLOTS> idle;
+
+	std::shared_ptr<Shard> _idle_checkout();
+	bool _idle_checkin(std::shared_ptr<Shard>& shard);
+	void _idle_clear();
+
 	std::shared_ptr<Shard>& _writable_checkout(int flags, double timeout, std::packaged_task<void()>* callback, const std::chrono::time_point<std::chrono::system_clock>& now, std::unique_lock<std::mutex>& lk);
-	std::shared_ptr<Shard>& _readable_checkout(int flags, double timeout, std::packaged_task<void()>* callback, const std::chrono::time_point<std::chrono::system_clock>& now, std::unique_lock<std::mutex>& lk);
+	std::shared_ptr<Shard> _readable_checkout(int flags, double timeout, std::packaged_task<void()>* callback, const std::chrono::time_point<std::chrono::system_clock>& now, std::unique_lock<std::mutex>& lk);
 
 public:
 	ShardEndpoint(DatabasePool& database_pool, const Endpoint& endpoint);
@@ -108,6 +142,10 @@ public:
 
 	std::pair<size_t, size_t> count();
 
+	size_t count_available() const {
+		return readables_available.load(std::memory_order_relaxed);
+	}
+
 	bool is_locked() const {
 		return locked.load(std::memory_order_relaxed);
 	}
@@ -116,6 +154,26 @@ public:
 		return finished.load(std::memory_order_relaxed);
 	}
 
+	bool is_bulk_loading() const {
+		return bulk_loading.load(std::memory_order_relaxed);
+	}
+
+	void set_bulk_loading(bool bulk_loading_) {
+		bulk_loading.store(bulk_loading_, std::memory_order_relaxed);
+	}
+
+	bool wait_revision(Xapian::rev revision, double timeout);
+
+	bool has_doccount() const {
+		return doccount_known.load(std::memory_order_acquire);
+	}
+
+	Xapian::doccount get_doccount() const {
+		return doccount.load(std::memory_order_relaxed);
+	}
+
+	bool doccount_expired() const;
+
 	bool is_used() const;
 
 	std::string __repr__() const;
@@ -132,9 +190,19 @@ public:
  *
  */
 
-class DatabasePool : lru::LRU<Endpoint, std::unique_ptr<ShardEndpoint>> {
+class DatabasePool {
 	friend ShardEndpoint;
 
+	// Endpoints are spread (by hash) across segments, each one with
+	// its own LRU and mutex, so unrelated endpoints don't contend.
+	struct Segment : lru::LRU<Endpoint, std::unique_ptr<ShardEndpoint>> {
+		mutable std::mutex mtx;
+
+		explicit Segment(size_t size) : LRU(size) { }
+	};
+
+	std::vector<std::unique_ptr<Segment>> segments;
+
 	mutable std::mutex mtx;
 
 	std::atomic_int locks;
@@ -143,14 +211,18 @@ class DatabasePool : lru::LRU<Endpoint, std::unique_ptr<ShardEndpoint>> {
 
 	size_t max_database_readers;
 
-	ReferencedShardEndpoint _spawn(const Endpoint& endpoint);
+	Segment& segment(const Endpoint& endpoint) const;
+
+	ReferencedShardEndpoint _spawn(Segment& segment, const Endpoint& endpoint);
 	ReferencedShardEndpoint spawn(const Endpoint& endpoint);
 
-	ReferencedShardEndpoint _get(const Endpoint& endpoint) const;
+	ReferencedShardEndpoint _get(const Segment& segment, const Endpoint& endpoint) const;
 	ReferencedShardEndpoint get(const Endpoint& endpoint) const;
 
 	bool notify_lockable(const Endpoint& endpoint);
 
+	void cleanup(Segment& segment, bool immediate, const std::chrono::time_point<std::chrono::system_clock>& now);
+
 public:
 	DatabasePool(size_t database_pool_size, size_t max_database_readers);
 
@@ -166,6 +238,10 @@ public:
 
 	bool is_locked(const Endpoint& endpoint) const;
 
+	Xapian::doccount get_doccount(const Endpoint& endpoint, int flags, double timeout = DB_TIMEOUT);
+
+	void wait_revision(const Endpoint& endpoint, Xapian::rev revision, double timeout = DB_TIMEOUT);
+
 	template <typename Func>
 	std::shared_ptr<Shard> checkout(const Endpoint& endpoint, int flags, double timeout, Func&& func) {
 		std::packaged_task<void()> callback(std::forward<Func>(func));
@@ -28,7 +28,6 @@
 #include <cstring>                                // for size_t, strlen
 #include <cctype>                                 // for tolower
 #include <functional>                             // for ref, reference_wrapper
-#include <limits>                                 // for std::numeric_limits
 #include <mutex>                                  // for std::mutex
 #include <ostream>                                // for operator<<, basic_ostream
 #include <set>                                    // for std::set
@@ -41,7 +40,6 @@
 #include "cast.h"                                 // for Cast
 #include "cuuid/uuid.h"                           // for UUIDGenerator
 #include "database/handler.h"                     // for DatabaseHandler
-#include "database/lock.h"                        // for lock_shard
 #include "database/shard.h"                       // for Shard
 #include "datetime.h"                             // for isDate, isDatetime, tm_t
 #include "exception.h"                            // for ClientError
@@ -55,6 +53,7 @@
 #include "serialise_list.h"                       // for StringList
 #include "split.h"                                // for Split
 #include "static_string.hh"                       // for static_string
+#include "stemmer.h"                              // for getStemmer
 #include "stopper.h"                              // for getStopper
 #include "string.hh"                              // for string::format, string::inplace_lower
 
@@ -2701,11 +2700,11 @@ Schema::feed_subproperties(T& properties, std::string_view meta_name)
 	const auto data = std::static_pointer_cast<const FedSpecification>(properties->get_data());
 	if (data) {
 		// This is the feed cache
-		auto local_prefix_uuid = specification.local_prefix.uuid;
-		auto prefix = specification.prefix;
+		auto local_prefix_uuid = std::move(specification.local_prefix.uuid);
+		auto prefix = std::move(specification.prefix);
 		specification = data->specification;
-		specification.prefix = prefix;
-		specification.local_prefix.uuid = local_prefix_uuid;
+		specification.prefix = std::move(prefix);
+		specification.local_prefix.uuid = std::move(local_prefix_uuid);
 		return true;
 	}
 
@@ -2731,6 +2730,56 @@ Schema::feed_subproperties(T& properties, std::string_view meta_name)
 }
 
 
+template <typename T>
+inline bool
+Schema::restart_subproperties(T& properties, std::string_view meta_name)
+{
+	L_CALL("Schema::restart_subproperties({}, {})", repr(properties->to_string()), repr(meta_name));
+
+	auto it = properties->find(meta_name);
+	if (it != properties->end()) {
+		const auto data = std::static_pointer_cast<const FedSpecification>(it.value().get_data());
+		if (data) {
+			// Compiled path: the fed specification already overrides everything
+			// restart_specification() would reset, except for the inherited
+			// prefix and the (restarted) local prefix uuid.
+			properties = &it.value();
+			auto prefix = std::move(specification.prefix);
+			specification = data->specification;
+			specification.prefix = std::move(prefix);
+			specification.local_prefix.uuid = default_spc.local_prefix.uuid;
+			return true;
+		}
+	}
+
+	restart_specification();
+	return feed_subproperties(properties, meta_name);
+}
+
+
+inline void
+Schema::feed_root_properties(const MsgPack& properties)
+{
+	L_CALL("Schema::feed_root_properties({})", repr(properties.to_string()));
+
+	if (mut_schema) {
+		// Schema is being modified, root properties can't be compiled.
+		dispatch_feed_properties(properties);
+		return;
+	}
+
+	const auto data = std::static_pointer_cast<const FedSpecification>(properties.get_data());
+	if (data) {
+		specification = data->specification;
+		return;
+	}
+
+	dispatch_feed_properties(properties);
+
+	properties.set_data(std::make_shared<const FedSpecification>(specification));
+}
+
+
 /*  _____ _____ _____ _____ _____ _____ _____ _____
  * |_____|_____|_____|_____|_____|_____|_____|_____|
  *      ___           _
@@ -2762,14 +2811,14 @@ Schema::index(const MsgPack& object, MsgPack document_id, DatabaseHandler& db_ha
 		auto properties = &get_newest_properties();
 
 		if (object.empty()) {
-			dispatch_feed_properties(*properties);
+			feed_root_properties(*properties);
 		} else if (properties->empty()) {  // new schemas have empty properties
 			specification.flags.field_found = false;
 			auto mut_properties = &get_mutable_properties();
 			dispatch_write_properties(*mut_properties, object, fields, &id_field);
 			properties = &*mut_properties;
 		} else {
-			dispatch_feed_properties(*properties);
+			feed_root_properties(*properties);
 			dispatch_process_properties(object, fields, &id_field);
 		}
 
@@ -2792,24 +2841,7 @@ Schema::index(const MsgPack& object, MsgPack document_id, DatabaseHandler& db_ha
 				[[fallthrough]];
 				case FieldType::uuid: {
 					size_t n_shards = db_handler.endpoints.size();
-					size_t shard_num = 0;
-					// Try getting a new ID which can currently be indexed (active node)
-					// Get the least used shard:
-					auto min_doccount = std::numeric_limits<Xapian::doccount>::max();
-					for (size_t n = 0; n < n_shards; ++n) {
-						auto& endpoint = db_handler.endpoints[n];
-						auto node = endpoint.node();
-						if (node && node->is_active()) {
-							try {
-								lock_shard lk_shard(endpoint, db_handler.flags);
-								auto doccount = lk_shard->db()->get_doccount();
-								if (min_doccount > doccount) {
-									min_doccount = doccount;
-									shard_num = n;
-								}
-							} catch (...) {}
-						}
-					}
+					size_t shard_num = db_handler.get_least_used_shard();
 					// Figure out a term which goes into the least used shard:
 					for (int t = 10; t >= 0; --t) {
 						auto tmp_unprefixed_term_id = generator(opts.uuid_compact).serialise();
@@ -2847,24 +2879,7 @@ Schema::index(const MsgPack& object, MsgPack document_id, DatabaseHandler& db_ha
 				case FieldType::string:
 				case FieldType::keyword: {
 					size_t n_shards = db_handler.endpoints.size();
-					size_t shard_num = 0;
-					// Try getting a new ID which can currently be indexed (active node)
-					// Get the least used shard:
-					auto min_doccount = std::numeric_limits<Xapian::doccount>::max();
-					for (size_t n = 0; n < n_shards; ++n) {
-						auto& endpoint = db_handler.endpoints[n];
-						auto node = endpoint.node();
-						if (node && node->is_active()) {
-							try {
-								lock_shard lk_shard(endpoint, db_handler.flags);
-								auto doccount = lk_shard->db()->get_doccount();
-								if (min_doccount > doccount) {
-									min_doccount = doccount;
-									shard_num = n;
-								}
-							} catch (...) {}
-						}
-					}
+					size_t shard_num = db_handler.get_least_used_shard();
 					// Figure out a term which goes into the least used shard:
 					for (int t = 10; t >= 0; --t) {
 						auto tmp_document_id = Base64::rfc4648url_unpadded().encode(generator(true).serialise());
@@ -3027,8 +3042,7 @@ Schema::index_subproperties(const MsgPack*& properties, MsgPack*& data, std::str
 			if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 				THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 			}
-			restart_specification();
-			if (feed_subproperties(properties, field_name)) {
+			if (restart_subproperties(properties, field_name)) {
 				update_prefixes();
 				if (specification.flags.store) {
 					auto inserted = data->insert(field_name);
@@ -3089,8 +3103,7 @@ Schema::index_subproperties(const MsgPack*& properties, MsgPack*& data, std::str
 		if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 			THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 		}
-		restart_specification();
-		if (feed_subproperties(properties, field_name)) {
+		if (restart_subproperties(properties, field_name)) {
 			dispatch_process_properties(object, fields);
 			update_prefixes();
 			if (specification.flags.store) {
@@ -3172,8 +3185,7 @@ Schema::index_subproperties(const MsgPack*& properties, MsgPack*& data, std::str
 			if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 				THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 			}
-			restart_specification();
-			if (feed_subproperties(properties, field_name)) {
+			if (restart_subproperties(properties, field_name)) {
 				update_prefixes();
 				if (specification.flags.store) {
 					auto inserted = data->insert(field_name);
@@ -3234,8 +3246,7 @@ Schema::index_subproperties(const MsgPack*& properties, MsgPack*& data, std::str
 		if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 			THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 		}
-		restart_specification();
-		if (feed_subproperties(properties, field_name)) {
+		if (restart_subproperties(properties, field_name)) {
 			update_prefixes();
 			if (specification.flags.store) {
 				auto inserted = data->insert(field_name);
@@ -3683,7 +3694,7 @@ Schema::update(const MsgPack& object)
 				dispatch_write_properties(*mut_properties, schema_obj, fields);
 				properties = &*mut_properties;
 			} else {
-				dispatch_feed_properties(*properties);
+				feed_root_properties(*properties);
 				dispatch_process_properties(schema_obj, fields);
 			}
 
@@ -3738,8 +3749,7 @@ Schema::update_subproperties(const MsgPack*& properties, std::string_view name,
 			if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 				THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 			}
-			restart_specification();
-			if (feed_subproperties(properties, field_name)) {
+			if (restart_subproperties(properties, field_name)) {
 				update_prefixes();
 			} else {
 				detect_dynamic(field_name);
@@ -3777,8 +3787,7 @@ Schema::update_subproperties(const MsgPack*& properties, std::string_view name,
 		if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 			THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 		}
-		restart_specification();
-		if (feed_subproperties(properties, field_name)) {
+		if (restart_subproperties(properties, field_name)) {
 			dispatch_process_properties(object, fields);
 			update_prefixes();
 		} else {
@@ -3828,8 +3837,7 @@ Schema::update_subproperties(const MsgPack*& properties, std::string_view name)
 			if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 				THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 			}
-			restart_specification();
-			if (feed_subproperties(properties, field_name)) {
+			if (restart_subproperties(properties, field_name)) {
 				update_prefixes();
 			} else {
 				detect_dynamic(field_name);
@@ -3867,8 +3875,7 @@ Schema::update_subproperties(const MsgPack*& properties, std::string_view name)
 		if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 			THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 		}
-		restart_specification();
-		if (feed_subproperties(properties, field_name)) {
+		if (restart_subproperties(properties, field_name)) {
 			update_prefixes();
 		} else {
 			detect_dynamic(field_name);
@@ -4183,8 +4190,7 @@ Schema::write_subproperties(MsgPack*& mut_properties, std::string_view name, con
 			if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 				THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 			}
-			restart_specification();
-			if (feed_subproperties(mut_properties, field_name)) {
+			if (restart_subproperties(mut_properties, field_name)) {
 				update_prefixes();
 			} else {
 				verify_dynamic(field_name);
@@ -4221,8 +4227,7 @@ Schema::write_subproperties(MsgPack*& mut_properties, std::string_view name, con
 		if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 			THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 		}
-		restart_specification();
-		if (feed_subproperties(mut_properties, field_name)) {
+		if (restart_subproperties(mut_properties, field_name)) {
 			dispatch_write_properties(*mut_properties, object, fields);
 			update_prefixes();
 		} else {
@@ -4271,8 +4276,7 @@ Schema::write_subproperties(MsgPack*& mut_properties, std::string_view name)
 			if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 				THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 			}
-			restart_specification();
-			if (feed_subproperties(mut_properties, field_name)) {
+			if (restart_subproperties(mut_properties, field_name)) {
 				update_prefixes();
 			} else {
 				verify_dynamic(field_name);
@@ -4309,8 +4313,7 @@ Schema::write_subproperties(MsgPack*& mut_properties, std::string_view name)
 		if (!is_valid(field_name) && !(specification.full_meta_name.empty() && has_dispatch_set_default_spc(hh(field_name)))) {
 			THROW(ClientError, "Field {} in {} is not valid", repr_field(name, field_name), specification.full_meta_name.empty() ? "<root>" : repr(specification.full_meta_name));
 		}
-		restart_specification();
-		if (feed_subproperties(mut_properties, field_name)) {
+		if (restart_subproperties(mut_properties, field_name)) {
 			update_prefixes();
 		} else {
 			verify_dynamic(field_name);
@@ -5170,27 +5173,28 @@ Schema::guess_field_type(const MsgPack& item_doc)
 			break;
 		case MsgPack::Type::STR: {
 			const auto str_value = item_doc.str_view();
-			if (specification.flags.uuid_detection && Serialise::isUUID(str_value)) {
+			const auto candidates = Serialise::str_candidates(str_value);
+			if (specification.flags.uuid_detection && (candidates & Serialise::STR_UUID) && Serialise::isUUID(str_value)) {
 				specification.sep_types[SPC_CONCRETE_TYPE] = FieldType::uuid;
 				return;
 			}
-			if (specification.flags.date_detection && Datetime::isDate(str_value)) {
+			if (specification.flags.date_detection && (candidates & Serialise::STR_DATE) && Datetime::isDate(str_value)) {
 				specification.sep_types[SPC_CONCRETE_TYPE] = FieldType::date;
 				return;
 			}
-			if (specification.flags.datetime_detection && Datetime::isDatetime(str_value)) {
+			if (specification.flags.datetime_detection && (candidates & Serialise::STR_DATETIME) && Datetime::isDatetime(str_value)) {
 				specification.sep_types[SPC_CONCRETE_TYPE] = FieldType::datetime;
 				return;
 			}
-			if (specification.flags.time_detection && Datetime::isTime(str_value)) {
+			if (specification.flags.time_detection && (candidates & Serialise::STR_TIME) && Datetime::isTime(str_value)) {
 				specification.sep_types[SPC_CONCRETE_TYPE] = FieldType::time;
 				return;
 			}
-			if (specification.flags.timedelta_detection && Datetime::isTimedelta(str_value)) {
+			if (specification.flags.timedelta_detection && (candidates & Serialise::STR_TIMEDELTA) && Datetime::isTimedelta(str_value)) {
 				specification.sep_types[SPC_CONCRETE_TYPE] = FieldType::timedelta;
 				return;
 			}
-			if (specification.flags.geo_detection && EWKT::isEWKT(str_value)) {
+			if (specification.flags.geo_detection && (candidates & Serialise::STR_GEO) && EWKT::isEWKT(str_value)) {
 				specification.sep_types[SPC_CONCRETE_TYPE] = FieldType::geo;
 				return;
 			}
@@ -5565,6 +5569,36 @@ Schema::_index_item(Xapian::Document& doc, T&& values, size_t pos)
 }
 
 
+/*
+ * Term generators are reused by each thread, one per stop and stem languages.
+ */
+static Xapian::TermGenerator&
+get_term_generator(const specification_t& field_spc)
+{
+	static thread_local std::unordered_map<uint64_t, Xapian::TermGenerator> term_generators;
+	auto key = static_cast<uint64_t>(hh(field_spc.language)) << 32 | hh(field_spc.stem_language);
+	auto it = term_generators.find(key);
+	if (it == term_generators.end()) {
+		Xapian::TermGenerator term_generator;
+		if (!field_spc.language.empty()) {
+			term_generator.set_stopper(getStopper(field_spc.language).get());
+		}
+		if (!field_spc.stem_language.empty()) {
+			term_generator.set_stemmer(getStemmer(field_spc.stem_language));
+		}
+		it = term_generators.emplace(key, std::move(term_generator)).first;
+	}
+	auto& term_generator = it->second;
+	if (!field_spc.language.empty()) {
+		term_generator.set_stopper_strategy(getGeneratorStopStrategy(field_spc.stop_strategy));
+	}
+	if (!field_spc.stem_language.empty()) {
+		term_generator.set_stemming_strategy(getGeneratorStemStrategy(field_spc.stem_strategy));
+	}
+	return term_generator;
+}
+
+
 void
 Schema::index_term(Xapian::Document& doc, std::string serialise_val, const specification_t& field_spc, size_t pos)
 {
@@ -5573,22 +5607,22 @@ Schema::index_term(Xapian::Document& doc, std::string serialise_val, const speci
 	switch (field_spc.sep_types[SPC_CONCRETE_TYPE]) {
 		case FieldType::string:
 		case FieldType::text: {
-			Xapian::TermGenerator term_generator;
+			static thread_local const Xapian::Document no_document;
+			auto& term_generator = get_term_generator(field_spc);
 			term_generator.set_document(doc);
-			if (!field_spc.language.empty()) {
-				term_generator.set_stopper(getStopper(field_spc.language).get());
-				term_generator.set_stopper_strategy(getGeneratorStopStrategy(field_spc.stop_strategy));
-			}
-			if (!field_spc.stem_language.empty()) {
-				term_generator.set_stemmer(Xapian::Stem(field_spc.stem_language));
-				term_generator.set_stemming_strategy(getGeneratorStemStrategy(field_spc.stem_strategy));
-			}
 			const bool positions = field_spc.positions[getPos(pos, field_spc.positions.size())];
-			if (positions) {
-				term_generator.index_text(serialise_val, field_spc.weight[getPos(pos, field_spc.weight.size())], field_spc.prefix.field + field_spc.get_ctype());
-			} else {
-				term_generator.index_text_without_positions(serialise_val, field_spc.weight[getPos(pos, field_spc.weight.size())], field_spc.prefix.field + field_spc.get_ctype());
+			try {
+				if (positions) {
+					term_generator.index_text(serialise_val, field_spc.weight[getPos(pos, field_spc.weight.size())], field_spc.prefix.field + field_spc.get_ctype());
+				} else {
+					term_generator.index_text_without_positions(serialise_val, field_spc.weight[getPos(pos, field_spc.weight.size())], field_spc.prefix.field + field_spc.get_ctype());
+				}
+			} catch (...) {
+				term_generator.set_document(no_document);
+				throw;
 			}
+			// Don't keep the document alive in the reused term generator.
+			term_generator.set_document(no_document);
 			L_INDEX("Field Text to Index [{}] => {}:{} [Positions: {}]", pos, repr(field_spc.prefix.field), serialise_val, positions);
 			break;
 		}
@@ -635,6 +635,20 @@ class Schema {
 	template <typename T>
 	bool feed_subproperties(T& properties, std::string_view meta_name);
 
+	/*
+	 * Restarts the specification and gets the properties of meta name,
+	 * using the compiled specification if the schema already has one.
+	 */
+
+	template <typename T>
+	bool restart_subproperties(T& properties, std::string_view meta_name);
+
+	/*
+	 * Feeds the root specification, compiling it once per schema version.
+	 */
+
+	void feed_root_properties(const MsgPack& properties);
+
 	/*
 	 * Main functions to index objects and arrays
 	 */
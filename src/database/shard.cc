@@ -22,27 +22,31 @@
 
 #include "database/shard.h"
 
-#include <algorithm>              // for std::move
+#include <algorithm>              // for std::move, std::remove_if
+#include <mutex>                  // for std::mutex, std::lock_guard
 #include <sys/types.h>            // for uint32_t, uint8_t, ssize_t
 
 #include "cassert.h"              // for ASSERT
+#include "compressor_lz4.h"       // for LZ4Dictionary
 #include "database/data.h"        // for Locator
 #include "database/flags.h"       // for readable_flags, DB_*
 #include "database/pool.h"        // for ShardEndpoint
-#include "database/handler.h"     // for committer
-#include "database/utils.h"       // for DB_SLOT_VERSION
+#include "database/handler.h"     // for committer, compactor, freezer
+#include "database/utils.h"       // for DB_SLOT_VERSION, DOCUMENT_ID_TERM_PREFIX
 #include "database/wal.h"         // for DatabaseWAL
 #include "exception.h"            // for THROW, Error, MSG_Error, Exception, DocNot...
-#include "fs.hh"                  // for build_path_index
+#include "fs.hh"                  // for build_path_index, exists, delete_files
 #include "length.h"               // for serialise_string
 #include "log.h"                  // for L_CALL
 #include "manager.h"              // for XapiandManager, trigger_replication
+#include "metrics.h"              // for Metrics::metrics
 #include "msgpack.h"              // for MsgPack
+#include "opts.h"                 // for opts
 #include "random.hh"              // for random_int
 #include "repr.hh"                // for repr
 #include "reserved/fields.h"      // for ID_FIELD_NAME
 #include "storage.h"              // for STORAGE_BLOCK_SIZE, StorageCorruptVolume...
-#include "string.hh"              // for string::from_delta, string::format
+#include "string.hh"              // for string::from_delta, string::format, string::startswith
 
 #ifdef XAPIAND_RANDOM_ERRORS
 #include "random.hh"                // for random_real
@@ -59,12 +63,16 @@
 #endif
 
 
+#define L_DATABASE_NOW(name)
+
 // #undef L_DEBUG
 // #define L_DEBUG L_GREY
 // #undef L_CALL
 // #define L_CALL L_STACKED_DIM_GREY
 // #undef L_DATABASE
 // #define L_DATABASE L_SLATE_BLUE
+// #undef L_DATABASE_NOW
+// #define L_DATABASE_NOW(name) auto name = std::chrono::system_clock::now()
 // #undef L_DATABASE_WRAP_BEGIN
 // #define L_DATABASE_WRAP_BEGIN L_DELAYED_100
 // #undef L_DATABASE_WRAP_END
@@ -75,6 +83,21 @@
 
 #define DATA_STORAGE_PATH "docdata."
 
+#define DATA_STORAGE_VOLUME_SIZE (256 * 1024 * 1024)  // Writes move on to a new volume past this size, so volumes can be compacted
+#define DATA_STORAGE_COMPACTION_BATCH 1000  // Documents walked by the compactor each time it locks the shard
+#define DATA_STORAGE_OPEN_VOLUMES 8  // Read-only volume handles kept open by each shard
+
+#define BULK_LOAD_METADATA_KEY "_bulk_loading"  // Set while a bulk loading session is open
+
+#define DICTIONARIES_METADATA_KEY "_dictionaries"
+#define DICTIONARY_SAMPLES 1000
+#define DICTIONARY_RETRAIN_FACTOR 10  // Retrain once the shard has grown this many times
+
+#define MAX_TERM_SIZE 245  // Longest term Xapian takes
+
+#define IDS_CACHE_SIZE 16384  // Recently written documents with their id term and version cached
+#define IDS_FILTER_MIN_CAPACITY 65536  // Document ids the ids filter is sized for (or twice the documents)
+
 #ifdef XAPIAND_DATABASE_WAL
 #define XAPIAN_DB_SYNC_MODE  Xapian::DB_NO_SYNC
 #else
@@ -161,6 +184,22 @@ public:
 	DataStorage(std::string_view base_path_, void* param_, int flags);
 
 	bool open(std::string_view relative_path);
+
+	size_t used() const {
+		return static_cast<size_t>(header.head.offset - STORAGE_START_BLOCK_OFFSET) * STORAGE_ALIGNMENT;
+	}
+
+	bool full() const {
+		return static_cast<size_t>(header.head.offset) * STORAGE_ALIGNMENT >= DATA_STORAGE_VOLUME_SIZE;
+	}
+
+	bool contains(uint32_t offset) const {
+		return offset < header.head.offset;
+	}
+
+	void retire(ssize_t volume_) {
+		storage_retire_volume(base_path, string::format(DATA_STORAGE_PATH "{}", volume_));
+	}
 };
 
 
@@ -202,6 +241,56 @@ DataStorage::open(std::string_view relative_path)
 {
 	return Storage<DataHeader, DataBinHeader, DataBinFooter>::open(relative_path, flags);
 }
+
+
+class StoredLRU : private lru::LRU<std::string, std::shared_ptr<const std::string>> {
+	std::mutex mtx;
+	size_t size;
+	size_t max_size;
+
+public:
+	explicit StoredLRU(size_t max_size)
+		: size(0),
+		  max_size(max_size) { }
+
+	std::shared_ptr<const std::string> lookup(const std::string& key) {
+		std::lock_guard<std::mutex> lk(mtx);
+		auto it = LRU::find(key);
+		if (it == LRU::end()) {
+			return nullptr;
+		}
+		return it->second;
+	}
+
+	void insert(std::string key, std::shared_ptr<const std::string> stored) {
+		auto stored_size = key.size() + stored->size();
+		if (stored_size > max_size / 16) {
+			// Big blobs would flush most of the cache
+			return;
+		}
+		std::lock_guard<std::mutex> lk(mtx);
+		if (_items_map.count(key)) {
+			return;
+		}
+		while (size + stored_size > max_size) {
+			auto& last = _items_list.back();
+			size -= last.first.size() + last.second->size();
+			_items_map.erase(last.first);
+			_items_list.pop_back();
+		}
+		LRU::emplace(std::move(key), std::move(stored));
+		size += stored_size;
+	}
+};
+
+
+// Decompressed stored blobs, shared by all shards
+static StoredLRU&
+stored_lru()
+{
+	static StoredLRU stored_lru(opts.stored_cache_size * 1024 * 1024);
+	return stored_lru;
+}
 #endif  // XAPIAND_DATA_STORAGE
 
 
@@ -220,7 +309,16 @@ Shard::Shard(ShardEndpoint& endpoint_, int flags_)
 	  _local(false),
 	  _closed(false),
 	  _modified(false),
+	  _uncommitted(0),
 	  _incomplete(false),
+#ifdef XAPIAND_DATA_STORAGE
+	  storages(DATA_STORAGE_OPEN_VOLUMES),
+	  _storage_rolled(false),
+#endif  // XAPIAND_DATA_STORAGE
+	  ids(IDS_CACHE_SIZE),
+	  versions(IDS_CACHE_SIZE),
+	  dictionary_doccount(0),
+	  dictionaries_size(0),
 	  transaction(Transaction::none),
 	  endpoint(endpoint_),
 	  flags(flags_)
@@ -311,7 +409,7 @@ Shard::reopen_writable()
 	_local.store(local, std::memory_order_relaxed);
 	if (local) {
 		reopen_revision = new_database->get_revision();
-		endpoint.local_revision = reopen_revision;
+		endpoint._local_revision_set(reopen_revision);
 	}
 
 	if (transaction != Transaction::none) {
@@ -321,24 +419,46 @@ Shard::reopen_writable()
 
 #ifdef XAPIAND_DATA_STORAGE
 	if (local) {
-		writable_storage = std::make_unique<DataStorage>(endpoint.path, this, STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE | STORAGE_COMPRESS | STORAGE_SYNC_MODE);
-		storage = std::make_unique<DataStorage>(endpoint.path, this, STORAGE_OPEN);
+		writable_storage = std::make_unique<DataStorage>(endpoint.path, this, STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE | STORAGE_COMPRESS | STORAGE_PREALLOCATE | STORAGE_SYNC_MODE);
 	} else {
 		writable_storage = std::unique_ptr<DataStorage>(nullptr);
-		storage = std::unique_ptr<DataStorage>(nullptr);
 	}
+	storages.clear();
 #endif  // XAPIAND_DATA_STORAGE
 
 	database = std::move(new_database);
 	reopen_time = std::chrono::system_clock::now();
 
+	endpoint._doccount_set(database->get_doccount());
+
+	load_dictionaries(database->get_metadata(DICTIONARIES_METADATA_KEY));
+
+	ids_rebuild();
+
+	if (!database->get_metadata(BULK_LOAD_METADATA_KEY).empty()) {
+		// Restarted during a bulk loading session, it goes on until it's
+		// closed. The WAL missed the revisions of the session, so it's
+		// checkpointed (and not replayed).
+		L_DATABASE("Shard {} is being bulk loaded", repr(endpoint.to_string()));
+#ifdef XAPIAND_DATABASE_WAL
+		if (is_wal_active()) {
+			XapiandManager::wal_writer()->write_checkpoint(*this);
+		}
+#endif  // XAPIAND_DATABASE_WAL
+		endpoint.set_bulk_loading(true);
+		flags |= DB_DISABLE_WAL;
+	}
+
 #ifdef XAPIAND_DATABASE_WAL
 	// If reopen_revision is not available WAL work as a log for the operations
 	if (is_wal_active()) {
 		// WAL wasn't already active for the requested endpoint
 		DatabaseWAL wal(this);
-		if (wal.execute(true)) {
+		// Uncommitted lines are replayed too, asynchronous writes were
+		// acknowledged as soon as they were in the WAL.
+		if (wal.execute(false)) {
 			_modified.store(true, std::memory_order_relaxed);
+			_uncommitted.fetch_add(1, std::memory_order_relaxed);
 		}
 	}
 #endif  // XAPIAND_DATABASE_WAL
@@ -424,20 +544,37 @@ Shard::reopen_readable()
 #endif  // XAPIAND_CLUSTERING
 	{
 		L_DATABASE("Opening local shard {}", repr(endpoint.to_string()));
-		try {
-			RANDOM_ERRORS_DB_THROW(Xapian::DatabaseOpeningError, "Random Error");
-			rsdb = Xapian::Database(endpoint.path, Xapian::DB_OPEN);
-		} catch (const Xapian::DatabaseNotFoundError& exc) {
-			if ((flags & DB_CREATE_OR_OPEN) != DB_CREATE_OR_OPEN)  {
-				throw;
+		bool frozen = false;
+		auto frozen_path = endpoint.path + "/" FROZEN_SHARD_DIR;
+		if (exists(frozen_path + "/iamhoney")) {
+			try {
+				// The frozen copy has the same UUID and revision as the shard
+				rsdb = Xapian::Database(frozen_path, Xapian::DB_OPEN);
+				frozen = true;
+			} catch (const Xapian::DatabaseError& exc) {
+				// Thawed meanwhile (its files can be half gone, so
+				// any error opening it falls back to the glass shard)
 			}
-			build_path_index(endpoint.path);
-			RANDOM_ERRORS_DB_THROW(Xapian::DatabaseOpeningError, "Random Error");
-			Xapian::WritableDatabase(endpoint.path, Xapian::DB_CREATE);
-			created = true;
+		}
+		if (!frozen) {
+			try {
+				RANDOM_ERRORS_DB_THROW(Xapian::DatabaseOpeningError, "Random Error");
+				rsdb = Xapian::Database(endpoint.path, Xapian::DB_OPEN);
+			} catch (const Xapian::DatabaseNotFoundError& exc) {
+				if ((flags & DB_CREATE_OR_OPEN) != DB_CREATE_OR_OPEN)  {
+					throw;
+				}
+				build_path_index(endpoint.path);
+				RANDOM_ERRORS_DB_THROW(Xapian::DatabaseOpeningError, "Random Error");
+				Xapian::WritableDatabase(endpoint.path, Xapian::DB_CREATE);
+				created = true;
 
-			RANDOM_ERRORS_DB_THROW(Xapian::DatabaseOpeningError, "Random Error");
-			rsdb = Xapian::Database(endpoint.path, Xapian::DB_OPEN);
+				RANDOM_ERRORS_DB_THROW(Xapian::DatabaseOpeningError, "Random Error");
+				rsdb = Xapian::Database(endpoint.path, Xapian::DB_OPEN);
+			}
+			if (opts.shard_freeze_idle) {
+				freezer()->delayed_debounce(std::chrono::seconds(opts.shard_freeze_idle), endpoint, Endpoint{endpoint});
+			}
 		}
 		local = true;
 	}
@@ -450,16 +587,20 @@ Shard::reopen_readable()
 	}
 
 #ifdef XAPIAND_DATA_STORAGE
-	if (local) {
-		// WAL required on a local database, open it.
-		storage = std::make_unique<DataStorage>(endpoint.path, this, STORAGE_OPEN);
-	} else {
-		storage = std::unique_ptr<DataStorage>(nullptr);
-	}
+	// Volumes get opened as they are read
+	storages.clear();
 #endif  // XAPIAND_DATA_STORAGE
 
 	database = std::move(new_database);
 	reopen_time = std::chrono::system_clock::now();
+
+	if (!local || !endpoint.has_doccount()) {
+		// Remote counts can only be refreshed by reopened readables
+		endpoint._doccount_set(database->get_doccount());
+	}
+
+	load_dictionaries(database->get_metadata(DICTIONARIES_METADATA_KEY));
+
 	// Ends Readable DB
 	////////////////////////////////////////////////////////////////
 
@@ -481,6 +622,11 @@ Shard::reopen()
 			for (int t = DB_RETRIES; t >= 0; --t) {
 				try {
 					bool ret = database->reopen();
+					if (ret && !is_writable()) {
+						// Data compressed with dictionaries trained since the
+						// shard was opened needs them to be decompressed
+						load_dictionaries(database->get_metadata(DICTIONARIES_METADATA_KEY));
+					}
 					return ret;
 				} catch (const Xapian::DatabaseModifiedError& exc) {
 					if (t == 0) { throw; }
@@ -554,10 +700,18 @@ Shard::reset() noexcept
 	_local.store(false, std::memory_order_relaxed);
 	_closed.store(false, std::memory_order_relaxed);
 	_modified.store(false, std::memory_order_relaxed);
+	_uncommitted.store(0, std::memory_order_relaxed);
 	_incomplete.store(false, std::memory_order_relaxed);
+	dictionary.reset();
+	dictionary_doccount = 0;
+	dictionaries_size = 0;
+	ids_filter = DynamicBloomFilter();
+	ids.clear();
+	versions.clear();
+	pending.clear();
 #ifdef XAPIAND_DATA_STORAGE
 	try {
-		storage.reset();
+		storages.clear();
 	} catch(...) {}
 	try {
 		writable_storage.reset();
@@ -637,10 +791,11 @@ Shard::autocommit(const std::shared_ptr<Shard>& shard)
 		!shard->is_closed() &&
 		shard->is_modified() &&
 		shard->is_writable() &&
-		shard->is_local()
+		shard->is_local() &&
+		!shard->endpoint.is_bulk_loading()
 	) {
 		// Auto commit only on modified writable databases
-		committer()->debounce(shard->endpoint, std::weak_ptr<Shard>(shard));
+		committer()->schedule(shard->endpoint, std::weak_ptr<Shard>(shard), shard->uncommitted());
 	}
 }
 
@@ -652,6 +807,8 @@ Shard::commit([[maybe_unused]] bool wal_, bool send_update)
 
 	ASSERT(is_writable());
 
+	apply_pending();
+
 	if (!is_modified()) {
 		L_DATABASE("Commit on shard {} was discarded, because there are not changes", repr(endpoint.to_string()));
 		return false;
@@ -683,6 +840,8 @@ Shard::commit([[maybe_unused]] bool wal_, bool send_update)
 				wdb->commit();
 			}
 			_modified.store(false, std::memory_order_relaxed);
+			_uncommitted.store(0, std::memory_order_relaxed);
+			endpoint._doccount_set(wdb->get_doccount());
 			if (local) {
 				auto prior_revision = endpoint.local_revision.load();
 				auto current_revision = wdb->get_revision();
@@ -692,7 +851,8 @@ Shard::commit([[maybe_unused]] bool wal_, bool send_update)
 				}
 				ASSERT(current_revision == prior_revision + 1);
 				L_DATABASE("Commit on shard {}: {} -> {}", repr(endpoint.to_string()), prior_revision, current_revision);
-				endpoint.local_revision = current_revision;
+				thaw();
+				endpoint._local_revision_set(current_revision);
 			}
 			break;
 		} catch (const Xapian::DatabaseOpeningError& exc) {
@@ -717,9 +877,93 @@ Shard::commit([[maybe_unused]] bool wal_, bool send_update)
 	if (wal_ && is_wal_active()) { XapiandManager::wal_writer()->write_commit(*this, send_update); }
 #endif
 
+#ifdef XAPIAND_DATA_STORAGE
+	if (send_update && opts.storage_compaction_threshold > 0 && _storage_rolled.exchange(false, std::memory_order_relaxed)) {
+		// Writes moved on to a new volume, older volumes might be worth compacting
+		compactor()->debounce(endpoint, Endpoint{endpoint}, true);
+	}
+#endif  // XAPIAND_DATA_STORAGE
+
+	if (wal_ && send_update && is_local() && wants_dictionary(wdb->get_doccount())) {
+		// Replayed and replicated commits get their dictionaries
+		// from the WAL (SET_METADATA), only the master trains them.
+		trainer()->debounce(endpoint, Endpoint{endpoint});
+	}
+
+	if (opts.shard_freeze_idle && is_local()) {
+		freezer()->delayed_debounce(std::chrono::seconds(opts.shard_freeze_idle), endpoint, Endpoint{endpoint});
+	}
+
 	return true;
 }
 
+
+void
+Shard::thaw()
+{
+	L_CALL("Shard::thaw()");
+
+	// The frozen copy is stale after a commit, readers notice the new
+	// revision and reopen the glass shard.
+	auto frozen_path = endpoint.path + "/" FROZEN_SHARD_DIR;
+	if (exists(frozen_path)) {
+		L_DATABASE("Thawing shard {}", repr(endpoint.to_string()));
+		delete_files(frozen_path);
+		::rmdir(frozen_path.c_str());
+	}
+}
+
+void
+Shard::begin_bulk_load()
+{
+	L_CALL("Shard::begin_bulk_load()");
+
+	ASSERT(is_writable());
+	ASSERT(is_local());
+
+	// Start the session from a committed revision
+	commit();
+
+#ifdef XAPIAND_DATABASE_WAL
+	if (is_wal_active()) {
+		// The WAL is going to miss the revisions of the session
+		XapiandManager::wal_writer()->write_checkpoint(*this);
+	}
+#endif  // XAPIAND_DATABASE_WAL
+
+	endpoint.set_bulk_loading(true);
+	flags |= DB_DISABLE_WAL;
+
+	// The session is stored in the shard, so it survives restarts
+	set_metadata(BULK_LOAD_METADATA_KEY, "1", true, false);
+}
+
+
+void
+Shard::end_bulk_load()
+{
+	L_CALL("Shard::end_bulk_load()");
+
+	ASSERT(is_writable());
+	ASSERT(is_local());
+
+	endpoint.set_bulk_loading(false);
+	flags &= ~DB_DISABLE_WAL;
+
+	set_metadata(BULK_LOAD_METADATA_KEY, "", false, false);
+
+#ifdef XAPIAND_DATABASE_WAL
+	if (is_wal_active()) {
+		// The WAL is missing the revisions of the session
+		XapiandManager::wal_writer()->write_checkpoint(*this);
+	}
+#endif  // XAPIAND_DATABASE_WAL
+
+	// The final commit (through the WAL) also lets replicas catch up
+	commit();
+}
+
+
 void
 Shard::begin_transaction(bool flushed)
 {
@@ -767,6 +1011,10 @@ Shard::cancel_transaction()
 		auto *wdb = static_cast<Xapian::WritableDatabase *>(db());
 		wdb->cancel_transaction();
 		transaction = Transaction::none;
+
+		// Cached versions could be of the cancelled changes
+		ids.clear();
+		versions.clear();
 	}
 }
 
@@ -778,6 +1026,12 @@ Shard::delete_document(Xapian::docid shard_did, bool commit_, bool wal_, bool ve
 
 	ASSERT(is_writable());
 
+	if (!pending.empty()) {
+		try {
+			drop_pending(db()->get_document(shard_did));
+		} catch (const Xapian::DocNotFoundError&) { }
+	}
+
 	RANDOM_ERRORS_DB_THROW(Xapian::DatabaseError, "Random Error");
 
 	L_DATABASE_WRAP_BEGIN("Shard::delete_document:BEGIN {{endpoint:{}, flags:({})}}", repr(to_string()), readable_flags(flags));
@@ -814,6 +1068,7 @@ Shard::delete_document(Xapian::docid shard_did, bool commit_, bool wal_, bool ve
 			}
 			wdb->delete_document(shard_did);
 			_modified.store(commit_ || local, std::memory_order_relaxed);
+			_uncommitted.fetch_add(1, std::memory_order_relaxed);
 			break;
 		} catch (const Xapian::DatabaseOpeningError& exc) {
 			if (t == 0) { do_close(true, true, transaction, false); throw; }
@@ -833,6 +1088,9 @@ Shard::delete_document(Xapian::docid shard_did, bool commit_, bool wal_, bool ve
 		L_DATABASE_WRAP_END("Shard::delete_document:END {{endpoint:{}, flags:({})}} ({} retries)", repr(to_string()), readable_flags(flags), DB_RETRIES - t);
 	}
 
+	ids_deleted(shard_did);
+	endpoint._doccount_sub();
+
 #if XAPIAND_DATABASE_WAL
 	if (wal_ && is_wal_active()) { XapiandManager::wal_writer()->write_delete_document(*this, shard_did); }
 #endif
@@ -850,6 +1108,8 @@ Shard::delete_document_term(const std::string& term, bool commit_, bool wal_, bo
 
 	ASSERT(is_writable());
 
+	drop_pending(term);
+
 	RANDOM_ERRORS_DB_THROW(Xapian::DatabaseError, "Random Error");
 
 	L_DATABASE_WRAP_BEGIN("Shard::delete_document_term:BEGIN {{endpoint:{}, flags:({})}}", repr(to_string()), readable_flags(flags));
@@ -898,6 +1158,7 @@ Shard::delete_document_term(const std::string& term, bool commit_, bool wal_, bo
 				wdb->delete_document(term);
 			}
 			_modified.store(commit_ || local, std::memory_order_relaxed);
+			_uncommitted.fetch_add(1, std::memory_order_relaxed);
 			break;
 		} catch (const Xapian::DatabaseOpeningError& exc) {
 			if (t == 0) { do_close(true, true, transaction, false); throw; }
@@ -917,6 +1178,10 @@ Shard::delete_document_term(const std::string& term, bool commit_, bool wal_, bo
 		L_DATABASE_WRAP_END("Shard::delete_document_term:END {{endpoint:{}, flags:({})}} ({} retries)", repr(to_string()), readable_flags(flags), DB_RETRIES - t);
 	}
 
+	ids.erase(term);
+	ids_deleted(shard_did);
+	endpoint._doccount_sub();
+
 #if XAPIAND_DATABASE_WAL
 	if (wal_ && is_wal_active()) { XapiandManager::wal_writer()->write_delete_document(*this, shard_did); }
 #endif
@@ -936,17 +1201,70 @@ Shard::storage_get_stored(const Locator& locator)
 	ASSERT(locator.type == Locator::Type::stored || locator.type == Locator::Type::compressed_stored);
 	ASSERT(locator.volume != -1);
 
-	if (storage) {
-		storage->open(string::format(DATA_STORAGE_PATH "{}", locator.volume));
-		storage->seek(static_cast<uint32_t>(locator.offset));
-		return storage->read();
-	}
-
 	std::string locator_key;
 	locator_key.push_back('\x00');
 	locator_key.append(serialise_length(locator.volume));
 	locator_key.append(serialise_length(locator.offset));
-	return get_metadata(locator_key);
+
+	// The database UUID keeps blobs of recreated indexes apart
+	auto key = db()->get_uuid();
+	key.append(locator_key);
+
+	auto& metrics = Metrics::metrics();
+	auto& lru = stored_lru();
+	if (auto cached = lru.lookup(key)) {
+		metrics.xapiand_storage_stored_cache_hits.Increment();
+		return *cached;
+	}
+	metrics.xapiand_storage_stored_cache_misses.Increment();
+
+	auto stored = std::make_shared<const std::string>(is_local() ? storage_read(locator.volume, locator.offset) : get_metadata(locator_key));
+	lru.insert(std::move(key), stored);
+	return *stored;
+}
+
+
+DataStorage&
+Shard::storage_volume(ssize_t volume, uint32_t offset)
+{
+	L_CALL("Shard::storage_volume({}, {})", volume, offset);
+
+	ASSERT(is_local());
+
+	auto it = storages.find(volume);
+	if (it != storages.end()) {
+		Metrics::metrics().xapiand_storage_volumes_cache_hits.Increment();
+		auto& volume_storage = *it->second;
+		if (!volume_storage.contains(offset)) {
+			// The volume has grown since its header was read
+			volume_storage.reopen();
+		}
+		return volume_storage;
+	}
+	Metrics::metrics().xapiand_storage_volumes_cache_misses.Increment();
+
+	auto volume_storage = std::make_unique<DataStorage>(endpoint.path, this, STORAGE_OPEN);
+	volume_storage->open(string::format(DATA_STORAGE_PATH "{}", volume));
+	return *storages.emplace(volume, std::move(volume_storage)).first->second;
+}
+
+
+std::string
+Shard::storage_read(ssize_t volume, size_t offset)
+{
+	L_CALL("Shard::storage_read({}, {})", volume, offset);
+
+	auto& volume_storage = storage_volume(volume, static_cast<uint32_t>(offset));
+	try {
+		volume_storage.seek(static_cast<uint32_t>(offset));
+		return volume_storage.read();
+	} catch (const StorageEOF&) {
+		throw;
+	} catch (...) {
+		// Don't keep handles in an unknown state
+		storages.erase(volume);
+		throw;
+	}
 }
 
 
@@ -968,6 +1286,10 @@ Shard::storage_push_blobs(std::string&& doc_data)
 			if (locator.size == 0) {
 				data.erase(locator.ct_type);
 			}
+			if (locator.type == Locator::Type::compressed_inplace && dictionary && LZ4Dictionary::used_by(locator.raw) != dictionary->id()) {
+				// Recompress in-place data using the shard's dictionary
+				data.update(locator.ct_type, std::string(locator.data()), dictionary.get());
+			}
 			if (locator.type == Locator::Type::stored || locator.type == Locator::Type::compressed_stored) {
 				if (!locator.raw.empty()) {
 					uint32_t offset;
@@ -977,12 +1299,15 @@ Shard::storage_push_blobs(std::string&& doc_data)
 								writable_storage->volume = writable_storage->get_volumes_range(DATA_STORAGE_PATH).second;
 								writable_storage->open(string::format(DATA_STORAGE_PATH "{}", writable_storage->volume));
 							}
-							offset = writable_storage->write(serialise_strings({ locator.ct_type.to_string(), locator.raw }));
-							break;
-						} catch (StorageEOF) {
-							++writable_storage->volume;
-							writable_storage->open(string::format(DATA_STORAGE_PATH "{}", writable_storage->volume));
-						}
+							if (!writable_storage->full()) {
+								offset = writable_storage->write(serialise_strings({ locator.ct_type.to_string(), locator.raw }));
+								break;
+							}
+						} catch (StorageEOF) { }
+						// Move on to a new volume
+						++writable_storage->volume;
+						writable_storage->open(string::format(DATA_STORAGE_PATH "{}", writable_storage->volume));
+						_storage_rolled.store(true, std::memory_order_relaxed);
 					}
 					data.update(locator.ct_type, writable_storage->volume, offset, locator.size);
 				}
@@ -1005,7 +1330,433 @@ Shard::storage_commit()
 		writable_storage->commit();
 	}
 }
+
+
+ssize_t
+Shard::storage_active_volume()
+{
+	L_CALL("Shard::storage_active_volume()");
+
+	ASSERT(writable_storage);
+
+	if (writable_storage->closed()) {
+		// Writes continue on the last volume once it gets opened
+		return writable_storage->get_volumes_range(DATA_STORAGE_PATH).second;
+	}
+	return writable_storage->volume;
+}
+
+
+Xapian::docid
+Shard::storage_live_data(Xapian::docid shard_did, std::unordered_map<ssize_t, size_t>& live)
+{
+	L_CALL("Shard::storage_live_data({}, <live>)", shard_did);
+
+	ASSERT(is_writable());
+
+	if (!writable_storage) {
+		return 0;
+	}
+
+	// Bins in the active volume might not be committed yet (and it's never compacted)
+	auto active_volume = storage_active_volume();
+
+	auto *wdb = static_cast<Xapian::WritableDatabase *>(db());
+	auto it = wdb->postlist_begin("");
+	auto it_e = wdb->postlist_end("");
+	it.skip_to(shard_did);
+	for (size_t walked = 0; it != it_e; ++it, ++walked) {
+		if (walked == DATA_STORAGE_COMPACTION_BATCH) {
+			return *it;
+		}
+		auto data = Data(wdb->get_document(*it).get_data());
+		for (auto& locator : data) {
+			if (locator.type == Locator::Type::stored || locator.type == Locator::Type::compressed_stored) {
+				if (locator.volume != -1 && locator.volume != active_volume) {
+					auto offset = static_cast<uint32_t>(locator.offset);
+					live[locator.volume] += storage_volume(locator.volume, offset).bin_space(offset);
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+
+std::unordered_map<ssize_t, size_t>
+Shard::storage_sparse_volumes(const std::unordered_map<ssize_t, size_t>& live, double threshold)
+{
+	L_CALL("Shard::storage_sparse_volumes(<live>, {})", threshold);
+
+	ASSERT(is_writable());
+
+	std::unordered_map<ssize_t, size_t> sparse;
+
+	if (!writable_storage) {
+		return sparse;
+	}
+
+	auto active_volume = storage_active_volume();
+
+	for (auto volume : writable_storage->get_volumes(DATA_STORAGE_PATH)) {
+		if (static_cast<ssize_t>(volume) >= active_volume) {
+			continue;
+		}
+		bool retiring = false;
+		for (const auto& retiring_volume : retiring_volumes) {
+			auto& volumes = retiring_volume.second;
+			if (std::find(volumes.begin(), volumes.end(), static_cast<ssize_t>(volume)) != volumes.end()) {
+				retiring = true;
+				break;
+			}
+		}
+		if (retiring) {
+			continue;
+		}
+		auto& volume_storage = storage_volume(volume, 0);
+		volume_storage.reopen();  // it could have been opened while it was active
+		auto used = volume_storage.used();
+		auto it = live.find(volume);
+		auto live_size = it == live.end() ? 0 : it->second;
+		if (live_size < used * threshold) {
+			L_DATABASE("Data storage volume {} of {} is sparse: {} live of {} used", volume, repr(endpoint.to_string()), string::from_bytes(live_size), string::from_bytes(used));
+			sparse[volume] = live_size;
+		}
+	}
+
+	return sparse;
+}
+
+
+Xapian::docid
+Shard::storage_relocate(Xapian::docid shard_did, const std::unordered_map<ssize_t, size_t>& volumes, size_t& relocated)
+{
+	L_CALL("Shard::storage_relocate({}, <volumes>, <relocated>)", shard_did);
+
+	ASSERT(is_writable());
+
+	if (!writable_storage) {
+		return 0;
+	}
+
+	auto *wdb = static_cast<Xapian::WritableDatabase *>(db());
+	auto it = wdb->postlist_begin("");
+	auto it_e = wdb->postlist_end("");
+	it.skip_to(shard_did);
+	for (size_t walked = 0; it != it_e; ++it, ++walked) {
+		if (walked == DATA_STORAGE_COMPACTION_BATCH) {
+			return *it;
+		}
+		auto did = *it;
+		auto doc = wdb->get_document(did);
+		auto data = Data(doc.get_data());
+		bool relocate = false;
+		for (auto& locator : data) {
+			if (locator.type == Locator::Type::stored || locator.type == Locator::Type::compressed_stored) {
+				if (volumes.count(locator.volume)) {
+					// Pushed again as a new blob, written to the active volume
+					auto stored = storage_read(locator.volume, locator.offset);
+					relocated += stored.size();
+					data.update(locator.ct_type, -1, 0, 0, std::string(unserialise_string_at(STORED_BLOB, stored)));
+					relocate = true;
+				}
+			}
+		}
+		if (!relocate) {
+			continue;
+		}
+		data.flush();
+
+		// Documents are replaced as they are (keeping their version)
+		auto pushed = storage_push_blobs(std::string(data.serialise()));
+		doc.set_data(pushed.first);
+		wdb->replace_document(did, doc);
+		_modified.store(true, std::memory_order_relaxed);
+		_uncommitted.fetch_add(1, std::memory_order_relaxed);
+
+#if XAPIAND_DATABASE_WAL
+		if (is_wal_active()) {
+			doc.set_data(pushed.second);  // restore data with blobs
+			XapiandManager::wal_writer()->write_replace_document(*this, did, std::move(doc));
+		}
+#endif  // XAPIAND_DATABASE_WAL
+	}
+	return 0;
+}
+
+
+void
+Shard::storage_retire(std::vector<ssize_t>&& volumes)
+{
+	L_CALL("Shard::storage_retire(<volumes>)");
+
+	ASSERT(is_writable());
+
+	if (!volumes.empty()) {
+		// Readers of earlier revisions could still reference these volumes
+		retiring_volumes.emplace_back(endpoint.local_revision.load(), std::move(volumes));
+	}
+}
+
+
+bool
+Shard::storage_retire_volumes()
+{
+	L_CALL("Shard::storage_retire_volumes()");
+
+	ASSERT(is_writable());
+
+	if (!writable_storage || retiring_volumes.empty()) {
+		return false;
+	}
+
+	// Idle readables get reopened at checkout when the revision changes,
+	// so only the ones checked out can still be reading older revisions.
+	auto oldest_revision = endpoint.local_revision.load();
+	{
+		std::lock_guard<std::mutex> lk(endpoint.mtx);
+		for (auto& readable : endpoint.readables) {
+			if (readable && readable->is_busy() && readable->is_local() && readable->reopen_revision < oldest_revision) {
+				oldest_revision = readable->reopen_revision;
+			}
+		}
+	}
+
+	auto& metrics = Metrics::metrics();
+	auto it = retiring_volumes.begin();
+	for (; it != retiring_volumes.end() && it->first <= oldest_revision; ++it) {
+		for (auto volume : it->second) {
+			size_t used = 0;
+			try {
+				auto& volume_storage = storage_volume(volume, 0);
+				volume_storage.reopen();
+				used = STORAGE_BLOCK_SIZE + volume_storage.used();
+			} catch (const StorageException&) { }
+			storages.erase(volume);
+			L_DATABASE("Retiring data storage volume {} of {}", volume, repr(endpoint.to_string()));
+			writable_storage->retire(volume);
+			metrics.xapiand_storage_compaction_reclaimed.Increment(used);
+		}
+	}
+	retiring_volumes.erase(retiring_volumes.begin(), it);
+
+	return !retiring_volumes.empty();
+}
+#endif  // XAPIAND_DATA_STORAGE
+
+
+void
+Shard::load_dictionaries(std::string_view serialised)
+{
+	L_CALL("Shard::load_dictionaries(<serialised>)");
+
+	// Every version is registered, so data compressed with older
+	// dictionaries stays readable, the last one is used for new data.
+	// Versions are only ever appended, so unchanged sizes are skipped.
+	if (serialised.size() != dictionaries_size) {
+		dictionaries_size = serialised.size();
+		const char *p = serialised.data();
+		const char *p_end = p + serialised.size();
+		while (p != p_end) {
+			dictionary_doccount = static_cast<Xapian::doccount>(unserialise_length(&p, p_end));
+			dictionary = LZ4Dictionary::add(std::string(unserialise_string(&p, p_end)));
+		}
+	}
+
+#ifdef XAPIAND_DATA_STORAGE
+	if (writable_storage) {
+		writable_storage->set_dictionary(dictionary);
+	}
 #endif  // XAPIAND_DATA_STORAGE
+}
+
+
+bool
+Shard::wants_dictionary(Xapian::doccount doccount) const
+{
+	return doccount >= (dictionary_doccount ? dictionary_doccount * DICTIONARY_RETRAIN_FACTOR : DICTIONARY_SAMPLES);
+}
+
+
+void
+Shard::add_dictionary(std::string_view trained, Xapian::doccount doccount)
+{
+	L_CALL("Shard::add_dictionary(<trained>, {})", doccount);
+
+	if (trained.empty()) {
+		// Nothing worth a dictionary, wait for the shard to grow
+		dictionary_doccount = doccount;
+		return;
+	}
+
+	auto serialised = get_metadata(DICTIONARIES_METADATA_KEY);
+	serialised.append(serialise_length(doccount));
+	serialised.append(serialise_string(trained));
+	set_metadata(DICTIONARIES_METADATA_KEY, serialised, true, true);  // also loads it
+}
+
+
+std::string
+Shard::train_dictionary(Xapian::Database& database)
+{
+	L_CALL("Shard::train_dictionary(<database>)");
+
+	L_DATABASE_NOW(start);
+
+	// Sample documents evenly across the docids, both their data
+	// and the whole serialised document (as it goes to the WAL).
+	std::vector<std::string> samples;
+	auto step = std::max<Xapian::docid>(database.get_lastdocid() / DICTIONARY_SAMPLES, 1);
+	auto it = database.postlist_begin("");
+	auto it_e = database.postlist_end("");
+	for (Xapian::docid did = 1; samples.size() < DICTIONARY_SAMPLES * 2; did = *it + step) {
+		it.skip_to(did);
+		if (it == it_e) {
+			break;
+		}
+		auto doc = database.get_document(*it);
+		auto data = Data(doc.get_data());
+		for (auto& locator : data) {
+			if (locator.type == Locator::Type::inplace || locator.type == Locator::Type::compressed_inplace) {
+				samples.emplace_back(locator.data());
+			}
+		}
+		samples.push_back(doc.serialise());
+	}
+
+	auto trained = LZ4Dictionary::train(samples);
+
+	L_DATABASE_NOW(end);
+	L_DATABASE("Compression dictionary trained from {} samples ({} bytes) in {}", samples.size(), trained.size(), string::from_delta(start, end));
+
+	return trained;
+}
+
+
+void
+Shard::ids_rebuild()
+{
+	L_CALL("Shard::ids_rebuild()");
+
+	ids_filter = DynamicBloomFilter();
+	ids.clear();
+	versions.clear();
+
+	if (!is_writable() || !is_local()) {
+		return;
+	}
+
+	try {
+		// The filter is sized for twice the documents the shard has, so it
+		// gets rebuilt (bigger) after the shard has doubled its size.
+		auto *wdb = static_cast<Xapian::WritableDatabase *>(database.get());
+		DynamicBloomFilter filter(std::max<size_t>(IDS_FILTER_MIN_CAPACITY, 2 * wdb->get_doccount()));
+		auto t_end = wdb->allterms_end(DOCUMENT_ID_TERM_PREFIX);
+		for (auto tit = wdb->allterms_begin(DOCUMENT_ID_TERM_PREFIX); tit != t_end; ++tit) {
+			std::string term = *tit;
+			filter.add(term.data(), term.size());
+		}
+		ids_filter = std::move(filter);
+	} catch (const Xapian::Error& exc) {
+		// Leave the filter unsized, so ids always get looked up
+		L_WARNING("Cannot build the document ids filter for {}: {}", repr(endpoint.to_string()), exc.get_description());
+	}
+}
+
+
+bool
+Shard::ids_lookup(const std::string& term, Xapian::docid& shard_did, Xapian::rev& version)
+{
+	L_CALL("Shard::ids_lookup({})", repr(term));
+
+	auto it = ids.find(term);
+	if (it == ids.end()) {
+		return false;
+	}
+	auto v_it = versions.find(it->second);
+	if (v_it == versions.end() || v_it->second.second != term) {
+		// The document was since written with another id
+		ids.erase(term);
+		return false;
+	}
+	shard_did = it->second;
+	version = v_it->second.first;
+	return true;
+}
+
+
+bool
+Shard::ids_version(Xapian::docid shard_did, Xapian::rev& version)
+{
+	L_CALL("Shard::ids_version({})", shard_did);
+
+	auto it = versions.find(shard_did);
+	if (it == versions.end()) {
+		return false;
+	}
+	version = it->second.first;
+	return true;
+}
+
+
+void
+Shard::ids_written(const std::string& term, const Xapian::Document& doc, Xapian::docid shard_did, Xapian::rev version)
+{
+	L_CALL("Shard::ids_written({}, <doc>, {}, {})", repr(term), shard_did, version);
+
+	if (!version || !is_local()) {
+		return;
+	}
+
+	// Every id term written goes to the filter (rebuilding it when full)
+	std::string id_term = term;
+	auto add = [&](const std::string& t) {
+		if (!ids_filter.contains(t.data(), t.size())) {
+			if (ids_filter.full()) {
+				ids_rebuild();
+			} else {
+				ids_filter.add(t.data(), t.size());
+			}
+		}
+	};
+	if (!term.empty()) {
+		add(term);
+	}
+	auto t_end = doc.termlist_end();
+	auto tit = doc.termlist_begin();
+	for (tit.skip_to(DOCUMENT_ID_TERM_PREFIX); tit != t_end; ++tit) {
+		std::string t = *tit;
+		if (!string::startswith(t, DOCUMENT_ID_TERM_PREFIX)) {
+			break;
+		}
+		if (id_term.empty()) {
+			id_term = t;
+		}
+		add(t);
+	}
+
+	auto it = versions.find(shard_did);
+	if (it != versions.end() && it->second.second != id_term) {
+		ids.erase(it->second.second);
+	}
+	versions.insert(std::make_pair(shard_did, std::make_pair(version, id_term)));
+	if (!id_term.empty()) {
+		ids.insert(std::make_pair(id_term, shard_did));
+	}
+}
+
+
+void
+Shard::ids_deleted(Xapian::docid shard_did)
+{
+	L_CALL("Shard::ids_deleted({})", shard_did);
+
+	auto it = versions.find(shard_did);
+	if (it != versions.end()) {
+		ids.erase(it->second.second);
+		versions.erase(shard_did);
+	}
+}
 
 
 Xapian::docid
@@ -1053,6 +1804,7 @@ Shard::add_document(Xapian::Document&& doc, bool commit_, bool wal_, bool)
 				shard_did = wdb->add_document(doc);
 			}
 			_modified.store(commit_ || local, std::memory_order_relaxed);
+			_uncommitted.fetch_add(1, std::memory_order_relaxed);
 			break;
 		} catch (const Xapian::DatabaseOpeningError& exc) {
 			if (t == 0) { do_close(true, true, transaction, false); throw; }
@@ -1072,6 +1824,11 @@ Shard::add_document(Xapian::Document&& doc, bool commit_, bool wal_, bool)
 		L_DATABASE_WRAP_END("Shard::add_document_term:END {{endpoint:{}, flags:({})}} ({} retries)", repr(to_string()), readable_flags(flags), DB_RETRIES - t);
 	}
 
+	ids_written(std::string(), doc, shard_did, version);
+	if (version == 1) {
+		endpoint._doccount_add();
+	}
+
 #if XAPIAND_DATABASE_WAL
 	if (wal_ && is_wal_active()) {
 #ifdef XAPIAND_DATA_STORAGE
@@ -1098,6 +1855,8 @@ Shard::replace_document(Xapian::docid shard_did, Xapian::Document&& doc, bool co
 
 	ASSERT(is_writable());
 
+	drop_pending(doc);
+
 	RANDOM_ERRORS_DB_THROW(Xapian::DatabaseError, "Random Error");
 
 	L_DATABASE_WRAP_BEGIN("Shard::replace_document:BEGIN {{endpoint:{}, flags:({})}}", repr(to_string()), readable_flags(flags));
@@ -1114,6 +1873,9 @@ Shard::replace_document(Xapian::docid shard_did, Xapian::Document&& doc, bool co
 
 	Xapian::rev version = 0;
 	auto ver = doc.get_value(DB_SLOT_VERSION);
+#if XAPIAND_DATABASE_WAL
+	std::string delta;
+#endif  // XAPIAND_DATABASE_WAL
 
 	for (int t = DB_RETRIES; t >= 0; --t) {
 		// L_DATABASE("Replacing: {}  t: {}", shard_did, t);
@@ -1123,27 +1885,39 @@ Shard::replace_document(Xapian::docid shard_did, Xapian::Document&& doc, bool co
 			auto local = is_local();
 			if (local) {
 				auto ver_prefix = "V" + serialise_length(shard_did);
-				auto ver_prefix_size = ver_prefix.size();
-				auto t_end = wdb->allterms_end(ver_prefix);
-				for (auto tit = wdb->allterms_begin(ver_prefix); tit != t_end; ++tit) {
-					std::string current_term = *tit;
-					std::string_view current_ver(current_term);
-					current_ver.remove_prefix(ver_prefix_size);
-					if (!current_ver.empty()) {
-						if (version_ && !ver.empty() && ver != current_ver) {
-							// Throw error about wrong version!
-							throw Xapian::DocVersionConflictError("Version mismatch!");
+				if (ids_version(shard_did, version)) {
+					if (version_ && !ver.empty() && ver != sortable_serialise(version)) {
+						// Throw error about wrong version!
+						throw Xapian::DocVersionConflictError("Version mismatch!");
+					}
+				} else {
+					auto ver_prefix_size = ver_prefix.size();
+					auto t_end = wdb->allterms_end(ver_prefix);
+					for (auto tit = wdb->allterms_begin(ver_prefix); tit != t_end; ++tit) {
+						std::string current_term = *tit;
+						std::string_view current_ver(current_term);
+						current_ver.remove_prefix(ver_prefix_size);
+						if (!current_ver.empty()) {
+							if (version_ && !ver.empty() && ver != current_ver) {
+								// Throw error about wrong version!
+								throw Xapian::DocVersionConflictError("Version mismatch!");
+							}
+							version = sortable_unserialise(current_ver);
+							break;
 						}
-						version = sortable_unserialise(current_ver);
-						break;
 					}
 				}
 				ver = sortable_serialise(++version);
 				doc.add_term(ver_prefix + ver);
 				doc.add_value(DB_SLOT_VERSION, ver);  // Update version
 			}
+#if XAPIAND_DATABASE_WAL
+			// Documents with a previous version are written to the WAL as a delta
+			delta = (wal_ && version > 1 && is_wal_active()) ? DatabaseWAL::document_delta(*wdb, shard_did, doc) : "";
+#endif  // XAPIAND_DATABASE_WAL
 			wdb->replace_document(shard_did, doc);
 			_modified.store(commit_ || local, std::memory_order_relaxed);
+			_uncommitted.fetch_add(1, std::memory_order_relaxed);
 			break;
 		} catch (const Xapian::DatabaseOpeningError& exc) {
 			if (t == 0) { do_close(true, true, transaction, false); throw; }
@@ -1163,6 +1937,11 @@ Shard::replace_document(Xapian::docid shard_did, Xapian::Document&& doc, bool co
 		L_DATABASE_WRAP_END("Shard::replace_document:END {{endpoint:{}, flags:({})}} ({} retries)", repr(to_string()), readable_flags(flags), DB_RETRIES - t);
 	}
 
+	ids_written(std::string(), doc, shard_did, version);
+	if (version == 1) {
+		endpoint._doccount_add();
+	}
+
 #if XAPIAND_DATABASE_WAL
 	if (wal_ && is_wal_active()) {
 #ifdef XAPIAND_DATA_STORAGE
@@ -1170,7 +1949,7 @@ Shard::replace_document(Xapian::docid shard_did, Xapian::Document&& doc, bool co
 			doc.set_data(pushed.second);  // restore data with blobs
 		}
 #endif  // XAPIAND_DATA_STORAGE
-		XapiandManager::wal_writer()->write_replace_document(*this, shard_did, std::move(doc));
+		XapiandManager::wal_writer()->write_replace_document(*this, shard_did, std::move(doc), std::move(delta));
 	}
 #endif  // XAPIAND_DATABASE_WAL
 
@@ -1189,6 +1968,8 @@ Shard::replace_document_term(const std::string& term, Xapian::Document&& doc, bo
 
 	ASSERT(is_writable());
 
+	drop_pending(term);
+
 	RANDOM_ERRORS_DB_THROW(Xapian::DatabaseError, "Random Error");
 
 	L_DATABASE_WRAP_BEGIN("Shard::replace_document_term:BEGIN {{endpoint:{}, flags:({})}}", repr(to_string()), readable_flags(flags));
@@ -1208,6 +1989,9 @@ Shard::replace_document_term(const std::string& term, Xapian::Document&& doc, bo
 	Xapian::docid shard_did = 0;
 	auto ver = doc.get_value(DB_SLOT_VERSION);
 	auto n_shards_ser = doc.get_value(DB_SLOT_SHARDS);
+#if XAPIAND_DATABASE_WAL
+	std::string delta;
+#endif  // XAPIAND_DATABASE_WAL
 
 	for (int t = DB_RETRIES; t >= 0; --t) {
 		// L_DATABASE("Replacing: '{}'  t: {}", term, t);
@@ -1260,22 +2044,39 @@ Shard::replace_document_term(const std::string& term, Xapian::Document&& doc, bo
 					} else {
 						shard_did = (did - 1) / n_shards + 1;  // docid in the multi-db to the docid in the shard
 						ver_prefix = "V" + serialise_length(shard_did);
-						auto ver_prefix_size = ver_prefix.size();
-						auto t_end = wdb->allterms_end(ver_prefix);
-						for (auto tit = wdb->allterms_begin(ver_prefix); tit != t_end; ++tit) {
-							std::string current_term = *tit;
-							std::string_view current_ver(current_term);
-							current_ver.remove_prefix(ver_prefix_size);
-							if (!current_ver.empty()) {
-								if (version_ && !ver.empty() && ver != current_ver) {
-									// Throw error about wrong version!
-									throw Xapian::DocVersionConflictError("Version mismatch!");
+						if (ids_version(shard_did, version)) {
+							if (version_ && !ver.empty() && ver != sortable_serialise(version)) {
+								// Throw error about wrong version!
+								throw Xapian::DocVersionConflictError("Version mismatch!");
+							}
+						} else {
+							auto ver_prefix_size = ver_prefix.size();
+							auto t_end = wdb->allterms_end(ver_prefix);
+							for (auto tit = wdb->allterms_begin(ver_prefix); tit != t_end; ++tit) {
+								std::string current_term = *tit;
+								std::string_view current_ver(current_term);
+								current_ver.remove_prefix(ver_prefix_size);
+								if (!current_ver.empty()) {
+									if (version_ && !ver.empty() && ver != current_ver) {
+										// Throw error about wrong version!
+										throw Xapian::DocVersionConflictError("Version mismatch!");
+									}
+									version = sortable_unserialise(current_ver);
+									break;
 								}
-								version = sortable_unserialise(current_ver);
-								break;
 							}
 						}
 					}
+				} else if (!ids_filter.contains(term.data(), term.size())) {
+					// Unknown id, it's a new document
+					shard_did = wdb->get_lastdocid() + 1;
+					ver_prefix = "V" + serialise_length(shard_did);
+				} else if (ids_lookup(term, shard_did, version)) {
+					ver_prefix = "V" + serialise_length(shard_did);
+					if (version_ && !ver.empty() && ver != sortable_serialise(version)) {
+						// Throw error about wrong version!
+						throw Xapian::DocVersionConflictError("Version mismatch!");
+					}
 				} else {
 					auto it = wdb->postlist_begin(term);
 					if (it == wdb->postlist_end(term)) {
@@ -1306,12 +2107,17 @@ Shard::replace_document_term(const std::string& term, Xapian::Document&& doc, bo
 				doc.add_value(DB_SLOT_VERSION, ver);  // Update version
 				doc.add_value(DB_SLOT_SHARDS, "");  // remove shards slot
 			}
+#if XAPIAND_DATABASE_WAL
+			// Documents with a previous version are written to the WAL as a delta
+			delta = (wal_ && version > 1 && is_wal_active()) ? DatabaseWAL::document_delta(*wdb, shard_did, doc) : "";
+#endif  // XAPIAND_DATABASE_WAL
 			if (shard_did) {
 				wdb->replace_document(shard_did, doc);
 			} else {
 				shard_did = wdb->replace_document(term, doc);
 			}
 			_modified.store(commit_ || local, std::memory_order_relaxed);
+			_uncommitted.fetch_add(1, std::memory_order_relaxed);
 			break;
 		} catch (const Xapian::DatabaseOpeningError& exc) {
 			if (t == 0) { do_close(true, true, transaction, false); throw; }
@@ -1331,6 +2137,11 @@ Shard::replace_document_term(const std::string& term, Xapian::Document&& doc, bo
 		L_DATABASE_WRAP_END("Shard::replace_document_term:END {{endpoint:{}, flags:({})}} ({} retries)", repr(to_string()), readable_flags(flags), DB_RETRIES - t);
 	}
 
+	ids_written(new_term.empty() ? term : new_term, doc, shard_did, version);
+	if (version == 1) {
+		endpoint._doccount_add();
+	}
+
 #if XAPIAND_DATABASE_WAL
 	if (wal_ && is_wal_active()) {
 #ifdef XAPIAND_DATA_STORAGE
@@ -1338,7 +2149,7 @@ Shard::replace_document_term(const std::string& term, Xapian::Document&& doc, bo
 			doc.set_data(pushed.second);  // restore data with blobs
 		}
 #endif  // XAPIAND_DATA_STORAGE
-		XapiandManager::wal_writer()->write_replace_document(*this, shard_did, std::move(doc));
+		XapiandManager::wal_writer()->write_replace_document(*this, shard_did, std::move(doc), std::move(delta));
 	}
 #endif
 
@@ -1349,6 +2160,124 @@ Shard::replace_document_term(const std::string& term, Xapian::Document&& doc, bo
 	return shard_did;
 }
 
+std::pair<Xapian::rev, std::future<void>>
+Shard::defer_document_term(const std::string& term, Xapian::Document&& doc, [[maybe_unused]] bool wal_)
+{
+	L_CALL("Shard::defer_document_term({}, <doc>, {})", repr(term), wal_);
+
+	ASSERT(is_writable());
+
+	// The document is only written to the WAL, it gets applied to the
+	// shard by the commit ending the current revision, so it's visible
+	// from the next revision on. The returned future is ready once the
+	// WAL line is durable.
+	validate_document(term, doc);
+
+	auto revision = db()->get_revision();
+	std::future<void> written;
+#if XAPIAND_DATABASE_WAL
+	if (wal_ && is_wal_active()) {
+		written = XapiandManager::wal_writer()->write_replace_document_term(*this, term, doc);
+	}
+#endif
+	pending.emplace_back(term, std::move(doc));
+	_modified.store(true, std::memory_order_relaxed);
+	_uncommitted.fetch_add(1, std::memory_order_relaxed);
+
+	return std::make_pair(revision + 1, std::move(written));
+}
+
+
+void
+Shard::apply_pending()
+{
+	L_CALL("Shard::apply_pending()");
+
+	if (pending.empty()) {
+		return;
+	}
+
+	// Documents are already in the WAL, they are applied without writing
+	// them again. A document that can't be applied (it passed validation,
+	// but it's still rejected) is dropped, as replaying it would fail the
+	// same way. On any other error the shard is reset, so its reopening
+	// replays them all (in order) from the WAL.
+	auto documents = std::move(pending);
+	pending.clear();
+	try {
+		while (!documents.empty()) {
+			auto& document = documents.front();
+			try {
+				replace_document_term(document.first, std::move(document.second), false, false, false);
+			} catch (const Xapian::InvalidArgumentError& exc) {
+				L_ERR("Asynchronous write of {} to {} was dropped: {}", repr(document.first), repr(to_string()), exc.get_description());
+			} catch (const Xapian::SerialisationError& exc) {
+				L_ERR("Asynchronous write of {} to {} was dropped: {}", repr(document.first), repr(to_string()), exc.get_description());
+			}
+			documents.pop_front();
+		}
+	} catch (...) {
+		L_WARNING("Asynchronous writes to {} could not be applied, reopening the shard", repr(to_string()));
+		reset();
+		throw;
+	}
+}
+
+
+void
+Shard::validate_document(const std::string& term, const Xapian::Document& doc)
+{
+	L_CALL("Shard::validate_document({}, <doc>)", repr(term));
+
+	// Asynchronous writes are acknowledged before they're applied, so
+	// whatever would make applying them fail is checked beforehand.
+	if (term.size() > MAX_TERM_SIZE) {
+		THROW(InvalidArgumentError, "Document id term is too long ({} > {})", term.size(), MAX_TERM_SIZE);
+	}
+	for (auto it = doc.termlist_begin(); it != doc.termlist_end(); ++it) {
+		if ((*it).size() > MAX_TERM_SIZE) {
+			THROW(InvalidArgumentError, "Term is too long ({} > {})", (*it).size(), MAX_TERM_SIZE);
+		}
+	}
+	auto data = Data(doc.get_data());
+	for (auto& locator : data) {
+		if (locator.type == Locator::Type::compressed_inplace) {
+			// In-place data gets recompressed with the shard's dictionary
+			try {
+				locator.data();
+			} catch (const LZ4Exception& exc) {
+				THROW(SerialisationError, "Bad compressed data: {}", exc.get_message());
+			}
+		}
+	}
+}
+
+
+void
+Shard::drop_pending(const std::string& term)
+{
+	L_CALL("Shard::drop_pending({})", repr(term));
+
+	// A later synchronous write to the document wins over the asynchronous
+	// writes still pending for it (replaying the WAL does the same)
+	pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const auto& document) {
+		return document.first == term;
+	}), pending.end());
+}
+
+
+void
+Shard::drop_pending(const Xapian::Document& doc)
+{
+	L_CALL("Shard::drop_pending(<doc>)");
+
+	pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const auto& document) {
+		auto it = doc.termlist_begin();
+		it.skip_to(document.first);
+		return it != doc.termlist_end() && *it == document.first;
+	}), pending.end());
+}
+
 
 void
 Shard::add_spelling(const std::string& word, Xapian::termcount freqinc, bool commit_, bool wal_)
@@ -1369,6 +2298,7 @@ Shard::add_spelling(const std::string& word, Xapian::termcount freqinc, bool com
 			auto local = is_local();
 			wdb->add_spelling(word, freqinc);
 			_modified.store(commit_ || local, std::memory_order_relaxed);
+			_uncommitted.fetch_add(1, std::memory_order_relaxed);
 			break;
 		} catch (const Xapian::DatabaseOpeningError& exc) {
 			if (t == 0) { do_close(true, true, transaction, false); throw; }
@@ -1419,6 +2349,7 @@ Shard::remove_spelling(const std::string& word, Xapian::termcount freqdec, bool
 			auto local = is_local();
 			result = wdb->remove_spelling(word, freqdec);
 			_modified.store(commit_ || local, std::memory_order_relaxed);
+			_uncommitted.fetch_add(1, std::memory_order_relaxed);
 			break;
 		} catch (const Xapian::DatabaseOpeningError& exc) {
 			if (t == 0) { do_close(true, true, transaction, false); throw; }
@@ -1561,13 +2492,11 @@ Shard::get_metadata(const std::string& key)
 	const char *p = key.data();
 	const char *p_end = p + key.size();
 	if (*p == '\x00') {
-		if (storage) {
+		if (is_local()) {
 			++p;
 			ssize_t volume = unserialise_length(&p, p_end);
 			size_t offset = unserialise_length(&p, p_end);
-			storage->open(string::format(DATA_STORAGE_PATH "{}", volume));
-			storage->seek(static_cast<uint32_t>(offset));
-			return storage->read();
+			return storage_read(volume, offset);
 		}
 	}
 
@@ -1672,6 +2601,7 @@ Shard::set_metadata(const std::string& key, const std::string& value, bool commi
 			auto local = is_local();
 			wdb->set_metadata(key, value);
 			_modified.store(commit_ || local, std::memory_order_relaxed);
+			_uncommitted.fetch_add(1, std::memory_order_relaxed);
 			break;
 		} catch (const Xapian::DatabaseOpeningError& exc) {
 			if (t == 0) { do_close(true, true, transaction, false); throw; }
@@ -1695,6 +2625,10 @@ Shard::set_metadata(const std::string& key, const std::string& value, bool commi
 	if (wal_ && is_wal_active()) { XapiandManager::wal_writer()->write_set_metadata(*this, key, value); }
 #endif
 
+	if (key == DICTIONARIES_METADATA_KEY) {
+		load_dictionaries(value);
+	}
+
 	if (commit_) {
 		commit(wal_);
 	}
@@ -26,13 +26,19 @@
 
 #include <atomic>                 // for std::atomic_bool
 #include <chrono>                 // for std::chrono
+#include <deque>                  // for std::deque
+#include <future>                 // for std::future
 #include <memory>                 // for std::shared_ptr
 #include <string>                 // for std::string
+#include <string_view>            // for std::string_view
+#include <unordered_map>          // for std::unordered_map
 #include <utility>                // for std::pair
 #include <vector>                 // for std::vector
 
+#include "bloom_filter.hh"        // for DynamicBloomFilter
 #include "cuuid/uuid.h"           // for UUID, UUID_LENGTH
 #include "database/flags.h"       // for DB_*
+#include "lru.h"                  // for lru::LRU
 #include "xapian.h"               // for Xapian::docid, Xapian::termcount, Xapian::Document
 
 
@@ -40,16 +46,21 @@ class Node;
 class Locator;
 class Logging;
 class DataStorage;
+class LZ4Dictionary;
 class ShardEndpoint;
 
 
+// Read-only copy (honey backend) of idle shards, kept inside the shard
+#define FROZEN_SHARD_DIR ".honey"
+
+
 //   ____  _                   _
 //  / ___|| |__   __ _ _ __ __| |
 //  \___ \| '_ \ / _` | '__/ _` |
 //   ___) | | | | (_| | | | (_| |
 //  |____/|_| |_|\__,_|_|  \__,_|
 //
-class Shard {
+class Shard : public std::enable_shared_from_this<Shard> {
 	friend class ShardEndpoint;
 	friend class DatabasePool;
 	friend class DatabaseWAL;
@@ -69,20 +80,59 @@ private:
 	std::atomic_bool _local;
 	std::atomic_bool _closed;
 	std::atomic_bool _modified;
+	std::atomic_size_t _uncommitted;
 	std::atomic_bool _incomplete;
 
 	std::unique_ptr<Xapian::Database> database;
 
 #ifdef XAPIAND_DATA_STORAGE
 	std::unique_ptr<DataStorage> writable_storage;
-	std::unique_ptr<DataStorage> storage;
+	// Read-only handles of the most recently used data storage volumes
+	lru::LRU<ssize_t, std::unique_ptr<DataStorage>> storages;
+
+	// Set when writes move on to a new data storage volume, so compaction gets triggered
+	std::atomic_bool _storage_rolled;
+	// Compacted volumes waiting for readers to move past the revision that stopped using them
+	std::vector<std::pair<Xapian::rev, std::vector<ssize_t>>> retiring_volumes;
 #endif /* XAPIAND_DATA_STORAGE */
 
 	std::shared_ptr<Logging> log;
 
+	// Document id terms in the writable shard (so new documents skip looking
+	// them up) and the version and id term of recently written documents
+	DynamicBloomFilter ids_filter;
+	lru::LRU<std::string, Xapian::docid> ids;
+	lru::LRU<Xapian::docid, std::pair<Xapian::rev, std::string>> versions;
+
+	void ids_rebuild();
+	bool ids_lookup(const std::string& term, Xapian::docid& shard_did, Xapian::rev& version);
+	bool ids_version(Xapian::docid shard_did, Xapian::rev& version);
+	void ids_written(const std::string& term, const Xapian::Document& doc, Xapian::docid shard_did, Xapian::rev version);
+	void ids_deleted(Xapian::docid shard_did);
+
+	// Compression dictionary for new data (and the document count it was trained at)
+	std::shared_ptr<const LZ4Dictionary> dictionary;
+	Xapian::doccount dictionary_doccount;
+
+	size_t dictionaries_size;
+
+	void load_dictionaries(std::string_view serialised);
+
+	// Documents of asynchronous writes, already in the WAL but not yet
+	// in the shard; the commit ending the revision applies them
+	std::deque<std::pair<std::string, Xapian::Document>> pending;
+
+	void apply_pending();
+	void validate_document(const std::string& term, const Xapian::Document& doc);
+	void drop_pending(const std::string& term);
+	void drop_pending(const Xapian::Document& doc);
+
 #ifdef XAPIAND_DATA_STORAGE
 	std::pair<std::string, std::string> storage_push_blobs(std::string&& doc_data);
 	void storage_commit();
+	ssize_t storage_active_volume();
+	DataStorage& storage_volume(ssize_t volume, uint32_t offset);
+	std::string storage_read(ssize_t volume, size_t offset);
 #endif /* XAPIAND_DATA_STORAGE */
 
 	bool reopen_writable();
@@ -106,6 +156,10 @@ public:
 		return _modified.load(std::memory_order_relaxed);
 	}
 
+	size_t uncommitted() const {
+		return _uncommitted.load(std::memory_order_relaxed);
+	}
+
 	bool is_incomplete() const {
 		return _incomplete.load(std::memory_order_relaxed);
 	}
@@ -122,11 +176,27 @@ public:
 		return busy.load(std::memory_order_relaxed);
 	}
 
+	const std::shared_ptr<const LZ4Dictionary>& get_dictionary() const {
+		return dictionary;
+	}
+
+	// Compression dictionaries are trained in the background (see trainer_train)
+	bool wants_dictionary(Xapian::doccount doccount) const;
+	void add_dictionary(std::string_view trained, Xapian::doccount doccount);
+	static std::string train_dictionary(Xapian::Database& database);
+
 	Shard(ShardEndpoint& endpoint_, int flags);
 	~Shard() noexcept;
 
 #ifdef XAPIAND_DATA_STORAGE
 	std::string storage_get_stored(const Locator& locator);
+
+	// Data storage compaction (driven in batches by compactor_compact)
+	Xapian::docid storage_live_data(Xapian::docid shard_did, std::unordered_map<ssize_t, size_t>& live);
+	std::unordered_map<ssize_t, size_t> storage_sparse_volumes(const std::unordered_map<ssize_t, size_t>& live, double threshold);
+	Xapian::docid storage_relocate(Xapian::docid shard_did, const std::unordered_map<ssize_t, size_t>& volumes, size_t& relocated);
+	void storage_retire(std::vector<ssize_t>&& volumes);
+	bool storage_retire_volumes();
 #endif /* XAPIAND_DATA_STORAGE */
 
 	bool reopen();
@@ -140,6 +210,12 @@ public:
 	void do_close(bool commit_, bool closed_, Transaction transaction_, bool throw_exceptions = true);
 	void close();
 
+	void thaw();
+
+	// Bulk loading sessions (see DatabaseHandler::open_bulk_load)
+	void begin_bulk_load();
+	void end_bulk_load();
+
 	static void autocommit(const std::shared_ptr<Shard>& shard);
 	bool commit(bool wal_ = true, bool send_update = true);
 
@@ -153,6 +229,7 @@ public:
 	Xapian::docid add_document(Xapian::Document&& doc, bool commit_ = false, bool wal_ = true, bool version_ = true);
 	Xapian::docid replace_document(Xapian::docid shard_did, Xapian::Document&& doc, bool commit_ = false, bool wal_ = true, bool version_ = true);
 	Xapian::docid replace_document_term(const std::string& term, Xapian::Document&& doc, bool commit_ = false, bool wal_ = true, bool version_ = true);
+	std::pair<Xapian::rev, std::future<void>> defer_document_term(const std::string& term, Xapian::Document&& doc, bool wal_ = true);
 
 	void add_spelling(const std::string& word, Xapian::termcount freqinc, bool commit_ = false, bool wal_ = true);
 	Xapian::termcount remove_spelling(const std::string& word, Xapian::termcount freqdec, bool commit_ = false, bool wal_ = true);
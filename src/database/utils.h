@@ -80,6 +80,7 @@ struct similar_field_t {
 
 struct query_field_t {
 	unsigned version;
+	unsigned revision;
 	unsigned offset;
 	unsigned limit;
 	unsigned check_at_least;
@@ -88,6 +89,7 @@ struct query_field_t {
 	bool spelling;
 	bool synonyms;
 	bool commit;
+	bool async;
 	bool unique_doc;
 	bool is_fuzzy;
 	bool is_nearest;
@@ -106,9 +108,9 @@ struct query_field_t {
 	bool icase;
 
 	query_field_t()
-		: version(0), offset(0), limit(10), check_at_least(0),
+		: version(0), revision(0), offset(0), limit(10), check_at_least(0),
 		  writable(false), primary(false), spelling(true), synonyms(false),
-		  commit(false), unique_doc(false), is_fuzzy(false), is_nearest(false),
+		  commit(false), async(false), unique_doc(false), is_fuzzy(false), is_nearest(false),
 		  collapse_max(1), icase(false) { }
 };
 
@@ -24,10 +24,17 @@
 
 #if XAPIAND_DATABASE_WAL
 
+#include <algorithm>                // for std::max
 #include <array>                    // for std::array
+#include <chrono>                   // for std::chrono
+#include <deque>                    // for std::deque
 #include <errno.h>                  // for errno
 #include <fcntl.h>                  // for O_CREAT, O_WRONLY, O_EXCL
+#include <future>                   // for std::future
 #include <limits>                   // for std::numeric_limits
+#include <mutex>                    // for std::mutex, std::lock_guard
+#include <set>                      // for std::multiset
+#include <unordered_map>            // for std::unordered_map
 #include <utility>                  // for std::make_pair
 
 #include "cassert.h"                // for ASSERT
@@ -48,6 +55,7 @@
 #include "repr.hh"                  // for repr
 #include "server/discovery.h"       // for db_updater
 #include "string.hh"                // for string::format
+#include "threadpool.hh"            // for ThreadPool
 #include "utype.hh"                 // for toUType
 
 #define L_DATABASE_NOW(name)
@@ -67,6 +75,10 @@
 #define WAL_STORAGE_PATH "wal."
 #define WAL_SYNC_MODE     STORAGE_ASYNC_SYNC
 
+#define WAL_REPLAY_WINDOW 1024  // Maximum number of lines read ahead of the replay applier
+
+#define WAL_DELTA_MIN_TERMS 16  // Documents with fewer terms are always written whole
+
 
 /*
  *  ____        _        _                  __        ___    _
@@ -112,6 +124,9 @@ WalHeader::validate(void* param, void* /*unused*/)
 DatabaseWAL::DatabaseWAL(std::string_view base_path_)
 	: Storage<WalHeader, WalBinHeader, WalBinFooter>(base_path_, this),
 	  validate_uuid(false),
+	  group_commit(false),
+	  group_commit_update(false),
+	  _retained(DatabaseWAL::max_rev),
 	  _revision(0),
 	  _shard(nullptr)
 {
@@ -127,6 +142,9 @@ DatabaseWAL::DatabaseWAL(std::string_view base_path_)
 DatabaseWAL::DatabaseWAL(Shard* shard)
 	: Storage<WalHeader, WalBinHeader, WalBinFooter>(shard->endpoint.path, this),
 	  validate_uuid(true),
+	  group_commit(false),
+	  group_commit_update(false),
+	  _retained(DatabaseWAL::max_rev),
 	  _revision(0),
 	  _shard(shard)
 {
@@ -139,6 +157,60 @@ DatabaseWAL::DatabaseWAL(Shard* shard)
 }
 
 
+DatabaseWAL::~DatabaseWAL() noexcept
+{
+	try {
+		retain(DatabaseWAL::max_rev);
+	} catch (...) {
+		L_EXC("Unhandled exception in destructor");
+	}
+}
+
+
+static std::mutex retained_mtx;
+static std::unordered_map<std::string, std::multiset<Xapian::rev>> retained_revisions;
+
+
+void
+DatabaseWAL::retain(Xapian::rev revision)
+{
+	L_CALL("DatabaseWAL::retain({})", revision);
+
+	// Volumes holding revisions from `revision` on are not retired while
+	// they're retained (i.e. while a replica is catching up from them),
+	// DatabaseWAL::max_rev releases them.
+	if (revision == _retained) {
+		return;
+	}
+	std::lock_guard<std::mutex> lk(retained_mtx);
+	if (_retained != DatabaseWAL::max_rev) {
+		auto& revisions = retained_revisions[base_path];
+		revisions.erase(revisions.find(_retained));
+		if (revisions.empty()) {
+			retained_revisions.erase(base_path);
+		}
+	}
+	_retained = revision;
+	if (_retained != DatabaseWAL::max_rev) {
+		retained_revisions[base_path].insert(_retained);
+	}
+}
+
+
+Xapian::rev
+DatabaseWAL::oldest_retained(const std::string& base_path)
+{
+	L_CALL("DatabaseWAL::oldest_retained({})", repr(base_path));
+
+	std::lock_guard<std::mutex> lk(retained_mtx);
+	auto it = retained_revisions.find(base_path);
+	if (it == retained_revisions.end()) {
+		return DatabaseWAL::max_rev;
+	}
+	return *it->second.begin();
+}
+
+
 const UUID&
 DatabaseWAL::get_uuid() const
 {
@@ -164,6 +236,81 @@ DatabaseWAL::get_revision() const
 }
 
 
+static auto&
+wal_replayers()
+{
+	static ThreadPool<> replayers("WR{:02}", opts.num_wal_replayers);
+	return replayers;
+}
+
+
+/*
+ * WAL replay pipeline: lines read from the volumes are decompressed and
+ * unserialised in parallel by the pool of replayers, while the applier
+ * applies the decoded lines to the shard strictly in order, up to
+ * WAL_REPLAY_WINDOW lines behind the reader.
+ */
+class DatabaseWALReplay {
+	DatabaseWAL& wal;
+	bool unsafe;
+	bool failed;
+	bool modified;
+	std::deque<std::pair<std::future<DatabaseWAL::Line>, bool>> pending;
+
+	void apply() {
+		auto future = std::move(pending.front().first);
+		auto uncommitted = pending.front().second;
+		pending.pop_front();
+		try {
+			auto line = future.get();
+			try {
+				modified = wal.apply_line(line, false, false, unsafe);
+			} catch (const StorageException&) {
+				throw;
+			} catch (const BaseException& exc) {
+				// Uncommitted lines were never applied to the shard, one
+				// that can't be is dropped rather than failing the reopen
+				if (!uncommitted) {
+					throw;
+				}
+				L_WARNING("WAL line {} for revision {} could not be applied, it's skipped: {}", NAMEOF_ENUM(line.type), line.revision, exc.get_message());
+			} catch (const Xapian::Error& exc) {
+				if (!uncommitted) {
+					throw;
+				}
+				L_WARNING("WAL line {} for revision {} could not be applied, it's skipped: {}", NAMEOF_ENUM(line.type), line.revision, exc.get_description());
+			}
+		} catch (...) {
+			failed = true;
+			throw;
+		}
+	}
+
+public:
+	DatabaseWALReplay(DatabaseWAL& wal_, bool unsafe_) :
+		wal(wal_),
+		unsafe(unsafe_),
+		failed(false),
+		modified(false) { }
+
+	void push(std::string&& line, bool uncommitted) {
+		if (pending.size() >= WAL_REPLAY_WINDOW) {
+			apply();
+		}
+		pending.emplace_back(wal_replayers().async([line = std::move(line)] {
+			return DatabaseWAL::decode_line(line);
+		}), uncommitted);
+	}
+
+	bool finish() {
+		while (!failed && !pending.empty()) {
+			apply();
+		}
+		return modified;
+	}
+};
+
+
 bool
 DatabaseWAL::execute(bool only_committed, bool unsafe)
 {
@@ -179,12 +326,14 @@ DatabaseWAL::execute(bool only_committed, bool unsafe)
 
 	bool modified = false;
 
+	DatabaseWALReplay replay(*this, unsafe);
+
 	try {
 		bool end = false;
 		Xapian::rev end_rev;
 		for (end_rev = volumes.first; end_rev <= volumes.second && !end; ++end_rev) {
 			try {
-				open(string::format(WAL_STORAGE_PATH "{}", end_rev), STORAGE_OPEN);
+				open(string::format(WAL_STORAGE_PATH "{}", end_rev), STORAGE_OPEN | STORAGE_MMAP);
 				if (header.head.revision != end_rev) {
 					if (!unsafe) {
 						L_DEBUG("Mismatch in WAL revision {}: {} volume {}", header.head.revision, repr(base_path), end_rev);
@@ -279,15 +428,23 @@ DatabaseWAL::execute(bool only_committed, bool unsafe)
 				L_INFO("Read and execute operations WAL file ({} volume {}) from [{}..{}] revision", repr(base_path), file_rev, begin_rev, end_rev);
 			}
 
+			// Lines after the last commit in the last volume are uncommitted
+			auto uncommitted_off = end_off;
+			if (end && !only_committed) {
+				uncommitted_off = high_slot ? std::max(header.slot[high_slot - 1], start_off) : start_off;
+			}
+
 			seek(start_off);
 			try {
 				while (true) {
-					std::string line = read(end_off);
-					modified = execute_line(line, false, false, unsafe);
+					auto uncommitted = tell() >= uncommitted_off;
+					replay.push(std::string(read_view(end_off)), uncommitted);
 				}
 			} catch (const StorageEOF& exc) { }
 		}
 
+		modified = replay.finish();
+
 		if (volumes.first <= volumes.second) {
 			if (end_rev < revision) {
 				if (!unsafe) {
@@ -302,6 +459,15 @@ DatabaseWAL::execute(bool only_committed, bool unsafe)
 		Metrics::metrics()
 			.xapiand_wal_errors
 			.Increment();
+		// Lines read before the error are still applied
+		try {
+			modified = replay.finish();
+		} catch (const StorageException& exc) {
+			L_ERR("WAL ERROR in {}: {}", repr(base_path), exc.get_message());
+			Metrics::metrics()
+				.xapiand_wal_errors
+				.Increment();
+		}
 	}
 
 	return modified;
@@ -413,6 +579,17 @@ DatabaseWAL::to_string_line(std::string_view line, bool unserialised)
 			repr["term"] = std::string(p, p_end - p);
 			repr["freq"] = unserialise_length(&p, p_end);
 			break;
+		case Type::REPLACE_DOCUMENT_DELTA:
+			repr["op"] = "REPLACE_DOCUMENT_DELTA";
+			repr["docid"] = unserialise_length(&p, p_end);
+			repr["delta"] = std::string(p, p_end - p);
+			break;
+		case Type::REPLACE_DOCUMENT_TERM:
+			repr["op"] = "REPLACE_DOCUMENT_TERM";
+			size = unserialise_length(&p, p_end, true);
+			repr["term"] = std::string(p, size);
+			repr["document"] = to_string_document(std::string_view(p + size, p_end - p - size), unserialised);
+			break;
 		default:
 			THROW(Error, "Invalid WAL message!");
 	}
@@ -438,7 +615,7 @@ DatabaseWAL::to_string(Xapian::rev start_revision, Xapian::rev end_revision, boo
 	Xapian::rev end_rev;
 	for (end_rev = volumes.first; end_rev <= volumes.second && !end; ++end_rev) {
 		try {
-			open(string::format(WAL_STORAGE_PATH "{}", end_rev), STORAGE_OPEN);
+			open(string::format(WAL_STORAGE_PATH "{}", end_rev), STORAGE_OPEN | STORAGE_MMAP);
 			if (header.head.revision != end_rev) {
 				L_WARNING("Mismatch in WAL revision {}: {} volume {}", header.head.revision, repr(base_path), end_rev);
 				header.head.revision = end_rev;
@@ -505,7 +682,7 @@ DatabaseWAL::to_string(Xapian::rev start_revision, Xapian::rev end_revision, boo
 		seek(start_off);
 		try {
 			while (true) {
-				std::string line = read(end_off);
+				auto line = read_view(end_off);
 				result.push_back(to_string_line(line, unserialised));
 			}
 		} catch (const StorageEOF& exc) { }
@@ -546,38 +723,98 @@ DatabaseWAL::execute_line(std::string_view line, bool wal_, bool send_update, bo
 		THROW(Error, "Database is not defined");
 	}
 
-	auto db_revision = _shard->db()->get_revision();
+	auto decoded = decode_line(line);
+	return apply_line(decoded, wal_, send_update, unsafe);
+}
+
+
+DatabaseWAL::Line
+DatabaseWAL::decode_line(std::string_view line)
+{
+	L_CALL("DatabaseWAL::decode_line(<line>)");
+
+	// Decoding doesn't touch the shard, so lines can be decoded in parallel
+	// and later applied (in order) by apply_line().
 
 	const char *p = line.data();
 	const char *p_end = p + line.size();
 
-	auto revision = unserialise_length(&p, p_end);
-	auto type = static_cast<Type>(unserialise_length(&p, p_end));
+	Line decoded;
+	decoded.revision = static_cast<Xapian::rev>(unserialise_length(&p, p_end));
+	decoded.type = static_cast<Type>(unserialise_length(&p, p_end));
+	decoded.did = 0;
+	try {
+		decoded.data = decompress_lz4(std::string_view(p, p_end - p));
+	} catch (const LZ4DictionaryNotFound&) {
+		// The dictionary is set by an earlier line which hasn't been
+		// applied yet, so it's left for apply_line() to decode.
+		decoded.raw = line;
+		return decoded;
+	}
+
+	if (decoded.type == Type::REPLACE_DOCUMENT) {
+		p = decoded.data.data();
+		p_end = p + decoded.data.size();
+		decoded.did = static_cast<Xapian::docid>(unserialise_length(&p, p_end));
+		decoded.document = Xapian::Document::unserialise(std::string(p, p_end - p));
+		decoded.data.clear();
+	} else if (decoded.type == Type::REPLACE_DOCUMENT_DELTA) {
+		// The delta can only be applied on top of the current document,
+		// so it's left for apply_line() to patch.
+		p = decoded.data.data();
+		p_end = p + decoded.data.size();
+		decoded.did = static_cast<Xapian::docid>(unserialise_length(&p, p_end));
+		decoded.data.erase(0, p - decoded.data.data());
+	} else if (decoded.type == Type::REPLACE_DOCUMENT_TERM) {
+		p = decoded.data.data();
+		p_end = p + decoded.data.size();
+		auto term = unserialise_string(&p, p_end);
+		decoded.document = Xapian::Document::unserialise(std::string(p, p_end - p));
+		decoded.data = std::string(term);
+	}
+
+	return decoded;
+}
+
+
+bool
+DatabaseWAL::apply_line(Line& line, bool wal_, bool send_update, bool unsafe)
+{
+	L_CALL("DatabaseWAL::apply_line(<line>, {}, {}, {})", wal_, send_update, unsafe);
+
+	if (!_shard) {
+		THROW(Error, "Database is not defined");
+	}
+
+	if (!line.raw.empty()) {
+		line = decode_line(line.raw);
+		if (!line.raw.empty()) {
+			THROW(StorageCorruptVolume, "WAL line uses an unknown compression dictionary");
+		}
+	}
+
+	auto db_revision = _shard->db()->get_revision();
 
-	L_REPLICATION("EXECUTE LINE: {} ({})", revision, NAMEOF_ENUM(type));
+	L_REPLICATION("EXECUTE LINE: {} ({})", line.revision, NAMEOF_ENUM(line.type));
 
-	if (revision != db_revision) {
+	if (line.revision != db_revision) {
 		if (!unsafe) {
-			L_DEBUG("WAL revision mismatch for {}: Expected {}, got {} ({})", repr(base_path), db_revision, revision, NAMEOF_ENUM(type));
+			L_DEBUG("WAL revision mismatch for {}: Expected {}, got {} ({})", repr(base_path), db_revision, line.revision, NAMEOF_ENUM(line.type));
 			THROW(StorageCorruptVolume, "WAL revision mismatch!");
 		}
-		// L_WARNING("WAL revision mismatch for {}: Expected {}, got {} ({})", repr(base_path), db_revision, revision, NAMEOF_ENUM(type));
+		// L_WARNING("WAL revision mismatch for {}: Expected {}, got {} ({})", repr(base_path), db_revision, line.revision, NAMEOF_ENUM(line.type));
 	}
 
-	auto data = decompress_lz4(std::string_view(p, p_end - p));
-
 	Xapian::docid did;
-	std::string document;
 	Xapian::termcount freq;
-	std::string term;
 	std::size_t size;
 
-	p = data.data();
-	p_end = p + data.size();
+	const char *p = line.data.data();
+	const char *p_end = p + line.data.size();
 
 	bool modified = true;
 
-	switch (type) {
+	switch (line.type) {
 		case Type::COMMIT:
 			if (!_shard->commit(wal_, send_update)) {
 				L_WARNING("WAL commit did nothing ({})", db_revision);
@@ -585,9 +822,7 @@ DatabaseWAL::execute_line(std::string_view line, bool wal_, bool send_update, bo
 			modified = false;
 			break;
 		case Type::REPLACE_DOCUMENT:
-			did = static_cast<Xapian::docid>(unserialise_length(&p, p_end));
-			document = std::string(p, p_end - p);
-			_shard->replace_document(did, Xapian::Document::unserialise(document), false, wal_, false);
+			_shard->replace_document(line.did, std::move(line.document), false, wal_, false);
 			break;
 		case Type::DELETE_DOCUMENT:
 			try {
@@ -617,6 +852,13 @@ DatabaseWAL::execute_line(std::string_view line, bool wal_, bool send_update, bo
 			freq = static_cast<Xapian::termcount>(unserialise_length(&p, p_end));
 			_shard->remove_spelling(std::string(p, p_end - p), freq, false, wal_);
 			break;
+		case Type::REPLACE_DOCUMENT_DELTA:
+			_shard->replace_document(line.did, patch_document(line.did, line.data), false, wal_, false);
+			break;
+		case Type::REPLACE_DOCUMENT_TERM:
+			// Deferred again, so it's applied by the commit, as it was
+			_shard->defer_document_term(line.data, std::move(line.document), wal_);
+			break;
 		default:
 			THROW(Error, "Invalid WAL message!");
 	}
@@ -625,6 +867,193 @@ DatabaseWAL::execute_line(std::string_view line, bool wal_, bool send_update, bo
 }
 
 
+static bool
+same_positions(Xapian::PositionIterator a, Xapian::PositionIterator a_end, Xapian::PositionIterator b, Xapian::PositionIterator b_end)
+{
+	for (; a != a_end && b != b_end; ++a, ++b) {
+		if (*a != *b) {
+			return false;
+		}
+	}
+	return a == a_end && b == b_end;
+}
+
+
+std::string
+DatabaseWAL::document_delta(Xapian::Database& db, Xapian::docid did, const Xapian::Document& doc)
+{
+	L_CALL("DatabaseWAL::document_delta(<db>, {}, <doc>)", did);
+
+	// Serialises the terms and values that differ between the document
+	// currently stored as `did` in the database and `doc`. Returns an empty
+	// string if there is no current document to build the delta against,
+	// or as soon as the delta changes so much of the document that the
+	// full document would be written instead.
+
+	auto termlist_count = doc.termlist_count();
+	if (termlist_count < WAL_DELTA_MIN_TERMS) {
+		return "";
+	}
+	size_t limit = (termlist_count + doc.values_count()) / 2;
+
+	Xapian::Document old;
+	try {
+		old = db.get_document(did);
+	} catch (const Xapian::DocNotFoundError&) {
+		return "";
+	}
+
+	std::string removed_terms;
+	std::string set_terms;
+	size_t removed_terms_count = 0;
+	size_t set_terms_count = 0;
+
+	auto set_term = [&](const Xapian::TermIterator& it) {
+		set_terms.append(serialise_string(*it));
+		set_terms.append(serialise_length(it.get_wdf()));
+		set_terms.append(serialise_length(it.positionlist_count()));
+		Xapian::termpos last = 0;
+		for (auto pit = it.positionlist_begin(); pit != it.positionlist_end(); ++pit) {
+			set_terms.append(serialise_length(*pit - last));
+			last = *pit;
+		}
+		++set_terms_count;
+	};
+
+	auto old_it = old.termlist_begin();
+	auto old_end = old.termlist_end();
+	auto new_it = doc.termlist_begin();
+	auto new_end = doc.termlist_end();
+	while (old_it != old_end || new_it != new_end) {
+		if (removed_terms_count + set_terms_count > limit) {
+			return "";
+		}
+		if (new_it == new_end || (old_it != old_end && *old_it < *new_it)) {
+			removed_terms.append(serialise_string(*old_it));
+			++removed_terms_count;
+			++old_it;
+		} else if (old_it == old_end || *new_it < *old_it) {
+			set_term(new_it);
+			++new_it;
+		} else {
+			if (old_it.get_wdf() != new_it.get_wdf() ||
+				!same_positions(old_it.positionlist_begin(), old_it.positionlist_end(), new_it.positionlist_begin(), new_it.positionlist_end())) {
+				set_term(new_it);
+			}
+			++old_it;
+			++new_it;
+		}
+	}
+
+	std::string removed_values;
+	std::string set_values;
+	size_t removed_values_count = 0;
+	size_t set_values_count = 0;
+
+	auto old_vit = old.values_begin();
+	auto old_vend = old.values_end();
+	auto new_vit = doc.values_begin();
+	auto new_vend = doc.values_end();
+	while (old_vit != old_vend || new_vit != new_vend) {
+		if (removed_terms_count + set_terms_count + removed_values_count + set_values_count > limit) {
+			return "";
+		}
+		if (new_vit == new_vend || (old_vit != old_vend && old_vit.get_valueno() < new_vit.get_valueno())) {
+			removed_values.append(serialise_length(old_vit.get_valueno()));
+			++removed_values_count;
+			++old_vit;
+		} else if (old_vit == old_vend || new_vit.get_valueno() < old_vit.get_valueno()) {
+			set_values.append(serialise_length(new_vit.get_valueno()));
+			set_values.append(serialise_string(*new_vit));
+			++set_values_count;
+			++new_vit;
+		} else {
+			if (*old_vit != *new_vit) {
+				set_values.append(serialise_length(new_vit.get_valueno()));
+				set_values.append(serialise_string(*new_vit));
+				++set_values_count;
+			}
+			++old_vit;
+			++new_vit;
+		}
+	}
+
+	std::string delta;
+	delta.append(serialise_length(removed_terms_count));
+	delta.append(removed_terms);
+	delta.append(serialise_length(set_terms_count));
+	delta.append(set_terms);
+	delta.append(serialise_length(removed_values_count));
+	delta.append(removed_values);
+	delta.append(serialise_length(set_values_count));
+	delta.append(set_values);
+	return delta;
+}
+
+
+Xapian::Document
+DatabaseWAL::patch_document(Xapian::docid did, std::string_view delta)
+{
+	L_CALL("DatabaseWAL::patch_document({}, <delta>)", did);
+
+	if (!_shard) {
+		THROW(Error, "Database is not defined");
+	}
+
+	// A delta without the document it was built against cannot be turned
+	// back into the full document, not even when replaying unsafely.
+	Xapian::Document doc;
+	try {
+		doc = _shard->db()->get_document(did);
+	} catch (const Xapian::DocNotFoundError& exc) {
+		L_WARNING("Error during REPLACE_DOCUMENT_DELTA: {}", exc.get_msg());
+		THROW(StorageCorruptVolume, "WAL delta for document {} has no base document", did);
+	}
+
+	const char *p = delta.data();
+	const char *p_end = p + delta.size();
+
+	doc.set_data(std::string(unserialise_string(&p, p_end)));
+
+	auto removed_terms_count = unserialise_length(&p, p_end);
+	for (size_t i = 0; i < removed_terms_count; ++i) {
+		auto term = std::string(unserialise_string(&p, p_end));
+		try {
+			doc.remove_term(term);
+		} catch (const Xapian::InvalidArgumentError&) { }
+	}
+
+	auto set_terms_count = unserialise_length(&p, p_end);
+	for (size_t i = 0; i < set_terms_count; ++i) {
+		auto term = std::string(unserialise_string(&p, p_end));
+		auto wdf = static_cast<Xapian::termcount>(unserialise_length(&p, p_end));
+		auto positions_count = unserialise_length(&p, p_end);
+		try {
+			doc.remove_term(term);
+		} catch (const Xapian::InvalidArgumentError&) { }
+		Xapian::termpos pos = 0;
+		for (size_t j = 0; j < positions_count; ++j) {
+			pos += static_cast<Xapian::termpos>(unserialise_length(&p, p_end));
+			doc.add_posting(term, pos, 0);
+		}
+		doc.add_term(term, wdf);
+	}
+
+	auto removed_values_count = unserialise_length(&p, p_end);
+	for (size_t i = 0; i < removed_values_count; ++i) {
+		doc.remove_value(static_cast<Xapian::valueno>(unserialise_length(&p, p_end)));
+	}
+
+	auto set_values_count = unserialise_length(&p, p_end);
+	for (size_t i = 0; i < set_values_count; ++i) {
+		auto slot = static_cast<Xapian::valueno>(unserialise_length(&p, p_end));
+		doc.add_value(slot, std::string(unserialise_string(&p, p_end)));
+	}
+
+	return doc;
+}
+
+
 bool
 DatabaseWAL::init_database()
 {
@@ -697,9 +1126,9 @@ DatabaseWAL::init_database()
 
 
 void
-DatabaseWAL::write_line(const UUID& uuid, Xapian::rev revision, Type type, std::string_view data, [[maybe_unused]] bool send_update)
+DatabaseWAL::write_line(const UUID& uuid, Xapian::rev revision, Type type, std::string_view data, [[maybe_unused]] bool send_update, const LZ4Dictionary* dictionary)
 {
-	L_CALL("DatabaseWAL::write_line({}, {}, Type::{}, <data>, {})", repr(uuid.to_string()), revision, NAMEOF_ENUM(type), send_update);
+	L_CALL("DatabaseWAL::write_line({}, {}, Type::{}, <data>, {}, <dictionary>)", repr(uuid.to_string()), revision, NAMEOF_ENUM(type), send_update);
 
 	_uuid = uuid;
 	_uuid_le = UUID(uuid.get_bytes(), true);
@@ -710,14 +1139,14 @@ DatabaseWAL::write_line(const UUID& uuid, Xapian::rev revision, Type type, std::
 		std::string line;
 		line.append(serialise_length(revision));
 		line.append(serialise_length(toUType(type)));
-		line.append(compress_lz4(data));
+		line.append(compress_lz4(data, dictionary));
 
 		L_DATABASE_WAL("{} on {}: '{}'", NAMEOF_ENUM(type), base_path, repr(line, quote));
 
 		if (closed()) {
 			auto volumes = get_volumes_range(WAL_STORAGE_PATH, revision, revision);
 			auto volume = (volumes.first <= volumes.second) ? volumes.second : revision;
-			open(string::format(WAL_STORAGE_PATH "{}", volume), STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE | WAL_SYNC_MODE);
+			open(string::format(WAL_STORAGE_PATH "{}", volume), STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE | STORAGE_DEFERRED_WRITE | STORAGE_PREALLOCATE | WAL_SYNC_MODE);
 			if (header.head.revision != volume) {
 				L_DEBUG("Mismatch in WAL revision {}: {} volume {}", header.head.revision, repr(base_path), volume);
 				THROW(StorageCorruptVolume, "Mismatch in WAL revision");
@@ -733,12 +1162,15 @@ DatabaseWAL::write_line(const UUID& uuid, Xapian::rev revision, Type type, std::
 
 		if (slot >= WAL_SLOTS) {
 			// We need a new volume, the old one is full
-			open(string::format(WAL_STORAGE_PATH "{}", revision), STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE | WAL_SYNC_MODE);
+			bool created = open(string::format(WAL_STORAGE_PATH "{}", revision), STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE | STORAGE_DEFERRED_WRITE | STORAGE_PREALLOCATE | WAL_SYNC_MODE);
 			if (header.head.revision != revision) {
 				L_DEBUG("Mismatch in WAL revision {}: {} volume {}", header.head.revision, repr(base_path), revision);
 				THROW(StorageCorruptVolume, "Mismatch in WAL revision");
 			}
 			slot = revision - header.head.revision;
+			if (created) {
+				retire_volumes();
+			}
 		}
 
 		ASSERT(slot >= 0 && slot < WAL_SLOTS);
@@ -757,25 +1189,109 @@ DatabaseWAL::write_line(const UUID& uuid, Xapian::rev revision, Type type, std::
 			if (slot + 1 < WAL_SLOTS) {
 				header.slot[slot + 1] = header.slot[slot];
 			} else {
-				open(string::format(WAL_STORAGE_PATH "{}", revision + 1), STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE | WAL_SYNC_MODE);
+				bool created = open(string::format(WAL_STORAGE_PATH "{}", revision + 1), STORAGE_OPEN | STORAGE_WRITABLE | STORAGE_CREATE | STORAGE_DEFERRED_WRITE | STORAGE_PREALLOCATE | WAL_SYNC_MODE);
 				if (header.head.revision != revision + 1) {
 					L_DEBUG("Mismatch in WAL revision {}: {} volume {}", header.head.revision, repr(base_path), revision + 1);
 					THROW(StorageCorruptVolume, "Mismatch in WAL revision");
 				}
+				if (created) {
+					retire_volumes();
+				}
 			}
 		}
 
-		commit();
+		if (group_commit) {
+			// Lines in a group are committed together by end_group_commit()
+			group_commit_update = group_commit_update || send_update;
+		} else {
+			commit_line(send_update);
+		}
 
-#ifdef XAPIAND_CLUSTERING
-		if (!opts.solo) {
-			// On COMMIT, let the updaters do their job
-			if (send_update) {
-				db_updater()->debounce(base_path, base_path);
+	} catch (const StorageException& exc) {
+		L_ERR("WAL ERROR in {}: {}", repr(base_path), exc.get_message());
+		Metrics::metrics()
+			.xapiand_wal_errors
+			.Increment();
+	}
+}
+
+
+void
+DatabaseWAL::retire_volumes()
+{
+	L_CALL("DatabaseWAL::retire_volumes()");
+
+	if (!opts.wal_retained_volumes) {
+		return;
+	}
+
+	// Volumes older than the current one only hold revisions the database
+	// has already committed, but replicas catching up may still need them:
+	// only volumes whose revisions are all below the oldest revision still
+	// retained are recycled as spare volumes (and never the last retained
+	// volumes, kept for replicas which aren't connected right now).
+	auto oldest = std::min(header.head.revision, oldest_retained(base_path));
+	auto volumes = get_volumes(WAL_STORAGE_PATH);
+	if (volumes.size() > opts.wal_retained_volumes) {
+		auto retirable = volumes.size() - opts.wal_retained_volumes;
+		for (size_t idx = 0; idx < retirable; ++idx) {
+			// A volume ends where the next one starts
+			if (volumes[idx + 1] > oldest) {
+				break;
 			}
+			L_DATABASE_WAL("Retiring WAL volume {}: {}", volumes[idx], repr(base_path));
+			storage_retire_volume(base_path, string::format(WAL_STORAGE_PATH "{}", volumes[idx]));
 		}
+	}
+}
+
+
+void
+DatabaseWAL::commit_line([[maybe_unused]] bool send_update)
+{
+	L_CALL("DatabaseWAL::commit_line({})", send_update);
+
+	commit();
+
+#ifdef XAPIAND_CLUSTERING
+	if (!opts.solo) {
+		// On COMMIT, let the updaters do their job
+		if (send_update) {
+			db_updater()->debounce(base_path, base_path);
+		}
+	}
 #endif
+}
+
+
+bool
+DatabaseWAL::begin_group_commit()
+{
+	L_CALL("DatabaseWAL::begin_group_commit()");
+
+	if (group_commit) {
+		return false;
+	}
+	group_commit = true;
+	return true;
+}
+
+
+void
+DatabaseWAL::end_group_commit()
+{
+	L_CALL("DatabaseWAL::end_group_commit()");
 
+	if (!group_commit) {
+		return;
+	}
+	group_commit = false;
+
+	auto send_update = group_commit_update;
+	group_commit_update = false;
+
+	try {
+		commit_line(send_update);
 	} catch (const StorageException& exc) {
 		L_ERR("WAL ERROR in {}: {}", repr(base_path), exc.get_message());
 		Metrics::metrics()
@@ -785,6 +1301,35 @@ DatabaseWAL::write_line(const UUID& uuid, Xapian::rev revision, Type type, std::
 }
 
 
+void
+DatabaseWAL::checkpoint()
+{
+	L_CALL("DatabaseWAL::checkpoint()");
+
+	// Revisions committed while the WAL was skipped are missing, so lines
+	// before the checkpoint can't be followed by the ones after it: all
+	// volumes are retired, replicas behind get a whole copy instead.
+	// Volumes are only recycled when no replication reader is using them,
+	// otherwise they are just unlinked (readers keep what they opened).
+	end_group_commit();
+	close();
+	bool recycle = oldest_retained(base_path) == DatabaseWAL::max_rev;
+	for (auto volume : get_volumes(WAL_STORAGE_PATH)) {
+		L_DATABASE_WAL("Retiring WAL volume {}: {}", volume, repr(base_path));
+		storage_retire_volume(base_path, string::format(WAL_STORAGE_PATH "{}", volume), recycle);
+	}
+}
+
+
+void
+DatabaseWAL::sync()
+{
+	L_CALL("DatabaseWAL::sync()");
+
+	Storage<WalHeader, WalBinHeader, WalBinFooter>::sync();
+}
+
+
 std::pair<Xapian::rev, uint32_t>
 DatabaseWAL::locate_revision(Xapian::rev revision)
 {
@@ -792,7 +1337,7 @@ DatabaseWAL::locate_revision(Xapian::rev revision)
 
 	auto volumes = get_volumes_range(WAL_STORAGE_PATH, 0, revision);
 	if (volumes.first <= volumes.second && revision - volumes.second < WAL_SLOTS) {
-		open(string::format(WAL_STORAGE_PATH "{}", volumes.second), STORAGE_OPEN);
+		open(string::format(WAL_STORAGE_PATH "{}", volumes.second), STORAGE_OPEN | STORAGE_MMAP);
 		if (header.head.revision != volumes.second) {
 			L_DEBUG("Mismatch in WAL revision {}: {} volume {}", header.head.revision, repr(base_path), volumes.second);
 			THROW(StorageCorruptVolume, "Mismatch in WAL revision");
@@ -833,13 +1378,14 @@ DatabaseWAL::find(Xapian::rev revision)
 }
 
 
-std::string
+std::string_view
 DatabaseWAL::get_current_line(uint32_t end_off)
 {
 	L_CALL("DatabaseWAL::get_current_line(...)");
 
+	// Lines point straight into the memory mapped volume
 	try {
-		return read(end_off);
+		return read_view(end_off);
 	}  catch (const StorageEOF& exc) { }
 
 	return "";
@@ -856,14 +1402,16 @@ DatabaseWAL::get_current_line(uint32_t end_off)
  */
 
 DatabaseWALWriterThread::DatabaseWALWriterThread() noexcept :
-	_wal_writer(nullptr)
+	_wal_writer(nullptr),
+	_batching(false)
 {
 }
 
 
 DatabaseWALWriterThread::DatabaseWALWriterThread(size_t idx, DatabaseWALWriter* wal_writer) noexcept :
 	_wal_writer(wal_writer),
-	_name(string::format(wal_writer->_format, idx))
+	_name(string::format(wal_writer->_format, idx)),
+	_batching(false)
 {
 }
 
@@ -894,15 +1442,35 @@ DatabaseWALWriterThread::operator()()
 {
 	L_CALL("DatabaseWALWriterThread::operator()()");
 
+	auto batch_size = std::max(opts.wal_batch_size, std::size_t{1});
+	auto batch_linger = std::chrono::microseconds(opts.wal_batch_linger);
+
 	_wal_writer->_workers.fetch_add(1, std::memory_order_relaxed);
 	while (!_wal_writer->_finished.load(std::memory_order_acquire)) {
 		DatabaseWALWriterTask task;
 		_queue.wait_dequeue(task);
 		if likely(task) {
-			try {
-				task(*this);
-			} catch (...) {
-				L_EXC("ERROR: Task died with an unhandled exception");
+			// Group commit: take every task already queued (or arriving
+			// during the linger time) and write them all as one batch.
+			auto deadline = std::chrono::steady_clock::now() + batch_linger;
+			bool sentinel = false;
+			_batch.push_back(std::move(task));
+			while (_batch.size() < batch_size) {
+				if (!_queue.try_dequeue(task)) {
+					auto timeout = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+					if (timeout <= 0 || !_queue.wait_dequeue_timed(task, timeout)) {
+						break;
+					}
+				}
+				if (!task) {
+					sentinel = true;
+					break;
+				}
+				_batch.push_back(std::move(task));
+			}
+			write_batch();
+			if (sentinel && _wal_writer->_ending.load(std::memory_order_acquire)) {
+				break;
 			}
 		} else if (_wal_writer->_ending.load(std::memory_order_acquire)) {
 			break;
@@ -912,6 +1480,63 @@ DatabaseWALWriterThread::operator()()
 }
 
 
+void
+DatabaseWALWriterThread::write_batch()
+{
+	L_CALL("DatabaseWALWriterThread::write_batch()");
+
+	Metrics::metrics()
+		.xapiand_wal_batch_size
+		.Observe(_batch.size());
+
+	// Every WAL touched by the batch defers its commit (a single write of
+	// the pending block, a single header update and a single fsync) until
+	// all the lines in the batch have been written.
+	_batching = true;
+	for (auto& task : _batch) {
+		try {
+			task(*this);
+		} catch (...) {
+			L_EXC("ERROR: Task died with an unhandled exception");
+			if (task.durable) {
+				task.durable->set_exception(std::current_exception());
+				task.durable.reset();
+			}
+		}
+	}
+	_batching = false;
+
+	for (auto wal : _batch_wals) {
+		wal->end_group_commit();
+	}
+	_batch_wals.clear();
+
+	for (auto& task : _batch) {
+		if (task.durable) {
+			sync(task);
+		}
+	}
+	_batch.clear();
+}
+
+
+void
+DatabaseWALWriterThread::sync(DatabaseWALWriterTask& task)
+{
+	L_CALL("DatabaseWALWriterThread::sync()");
+
+	// The writer waiting for the task is only released once the
+	// line (and the WAL header pointing past it) is on disk.
+	try {
+		wal(task.path).sync();
+		task.durable->set_value();
+	} catch (...) {
+		task.durable->set_exception(std::current_exception());
+	}
+	task.durable.reset();
+}
+
+
 void
 DatabaseWALWriterThread::clear()
 {
@@ -931,7 +1556,11 @@ DatabaseWALWriterThread::wal(const std::string& path)
 	if (it == lru.end()) {
 		it = lru.emplace(path, std::make_unique<DatabaseWAL>(path)).first;
 	}
-	return *it->second;
+	auto& wal = *it->second;
+	if (_batching && wal.begin_group_commit()) {
+		_batch_wals.push_back(&wal);
+	}
+	return wal;
 }
 
 
@@ -1059,6 +1688,38 @@ DatabaseWALWriterTask::write_remove_spelling(DatabaseWALWriterThread& thread)
 }
 
 
+void
+DatabaseWALWriterTask::write_checkpoint(DatabaseWALWriterThread& thread)
+{
+	L_CALL("DatabaseWALWriterTask::write_checkpoint()");
+
+	L_DATABASE_NOW(start);
+
+	L_DATABASE("write_checkpoint {{path:{}}}", repr(path));
+
+	auto& wal = thread.wal(path);
+	wal.checkpoint();
+
+	L_DATABASE_NOW(end);
+	L_DATABASE("Database WAL writer of {} succeeded after {}", repr(path), string::from_delta(start, end));
+}
+
+
+void
+DatabaseWALWriterTask::write_flush(DatabaseWALWriterThread& thread)
+{
+	L_CALL("DatabaseWALWriterTask::write_flush()");
+
+	// Lines of a path are all written (in order) by the same thread, so
+	// by now the ones before this task are written, they only need a sync.
+	thread.wal(path);
+
+	if (durable && !thread._batching) {
+		thread.sync(*this);
+	}
+}
+
+
 void
 DatabaseWALWriterTask::write_commit(DatabaseWALWriterThread& thread)
 {
@@ -1083,12 +1744,48 @@ DatabaseWALWriterTask::write_replace_document(DatabaseWALWriterThread& thread)
 
 	L_DATABASE_NOW(start);
 
+	auto type = DatabaseWAL::Type::REPLACE_DOCUMENT;
 	auto line = serialise_length(did);
-	line.append(doc.serialise());
+	auto serialised = doc.serialise();
+	if (!delta.empty()) {
+		// Use the delta only when it's smaller than the full document
+		auto data = serialise_string(doc.get_data());
+		if (data.size() + delta.size() < serialised.size()) {
+			type = DatabaseWAL::Type::REPLACE_DOCUMENT_DELTA;
+			line.append(data);
+			line.append(delta);
+		}
+	}
+	if (type == DatabaseWAL::Type::REPLACE_DOCUMENT) {
+		line.append(serialised);
+	}
 	L_DATABASE("write_replace_document {{path:{}, rev:{}}}: {}", repr(path), revision, repr(line));
 
 	auto& wal = thread.wal(path);
-	wal.write_line(uuid, revision, DatabaseWAL::Type::REPLACE_DOCUMENT, line, false);
+	wal.write_line(uuid, revision, type, line, false, dictionary.get());
+
+	L_DATABASE_NOW(end);
+	L_DATABASE("Database WAL writer of {} succeeded after {}", repr(path), string::from_delta(start, end));
+}
+
+
+void
+DatabaseWALWriterTask::write_replace_document_term(DatabaseWALWriterThread& thread)
+{
+	L_CALL("DatabaseWALWriterTask::write_replace_document_term()");
+
+	L_DATABASE_NOW(start);
+
+	auto line = serialise_string(key);  // term
+	line.append(doc.serialise());
+	L_DATABASE("write_replace_document_term {{path:{}, rev:{}}}: {}", repr(path), revision, repr(line));
+
+	auto& wal = thread.wal(path);
+	wal.write_line(uuid, revision, DatabaseWAL::Type::REPLACE_DOCUMENT_TERM, line, false, dictionary.get());
+
+	if (durable && !thread._batching) {
+		thread.sync(*this);
+	}
 
 	L_DATABASE_NOW(end);
 	L_DATABASE("Database WAL writer of {} succeeded after {}", repr(path), string::from_delta(start, end));
@@ -1200,7 +1897,7 @@ DatabaseWALWriter::write_commit(Shard& shard, bool send_update)
 
 
 void
-DatabaseWALWriter::write_replace_document(Shard& shard, Xapian::docid did, Xapian::Document&& doc)
+DatabaseWALWriter::write_replace_document(Shard& shard, Xapian::docid did, Xapian::Document&& doc, std::string&& delta)
 {
 	L_CALL("DatabaseWALWriter::write_replace_document()");
 
@@ -1214,6 +1911,8 @@ DatabaseWALWriter::write_replace_document(Shard& shard, Xapian::docid did, Xapia
 	task.revision = shard.db()->get_revision();
 	task.did = did;
 	task.doc = std::move(doc);
+	task.delta = std::move(delta);
+	task.dictionary = shard.get_dictionary();
 	task.dispatcher = &DatabaseWALWriterTask::write_replace_document;
 
 	if ((shard.flags & DB_SYNCHRONOUS_WAL) == DB_SYNCHRONOUS_WAL) {
@@ -1224,6 +1923,41 @@ DatabaseWALWriter::write_replace_document(Shard& shard, Xapian::docid did, Xapia
 }
 
 
+std::future<void>
+DatabaseWALWriter::write_replace_document_term(Shard& shard, const std::string& term, const Xapian::Document& doc)
+{
+	L_CALL("DatabaseWALWriter::write_replace_document_term()");
+
+	ASSERT(shard.is_wal_active());
+	ASSERT(shard.endpoint.is_local());
+
+	// Unlike the other writes, this one is only done once the returned
+	// future is ready (the line is durable): the document isn't in the
+	// shard yet, the WAL is all there is. Wait for it without holding
+	// the shard.
+	auto durable = std::make_shared<std::promise<void>>();
+	auto written = durable->get_future();
+
+	DatabaseWALWriterTask task;
+	task.path = shard.endpoint.path;
+	task.uuid = UUID(shard.db()->get_uuid());
+	task.revision = shard.db()->get_revision();
+	task.key = term;
+	task.doc = doc;
+	task.dictionary = shard.get_dictionary();
+	task.durable = std::move(durable);
+	task.dispatcher = &DatabaseWALWriterTask::write_replace_document_term;
+
+	if ((shard.flags & DB_SYNCHRONOUS_WAL) == DB_SYNCHRONOUS_WAL) {
+		execute(std::move(task));
+	} else if (!enqueue(std::move(task))) {
+		THROW(Error, "Cannot enqueue WAL line");
+	}
+
+	return written;
+}
+
+
 void
 DatabaseWALWriter::write_delete_document(Shard& shard, Xapian::docid did)
 {
@@ -1295,4 +2029,49 @@ DatabaseWALWriter::write_add_spelling(Shard& shard, const std::string& word, Xap
 	}
 }
 
+
+void
+DatabaseWALWriter::write_checkpoint(Shard& shard)
+{
+	L_CALL("DatabaseWALWriter::write_checkpoint()");
+
+	ASSERT(shard.endpoint.is_local());
+
+	DatabaseWALWriterTask task;
+	task.path = shard.endpoint.path;
+	task.dispatcher = &DatabaseWALWriterTask::write_checkpoint;
+
+	if ((shard.flags & DB_SYNCHRONOUS_WAL) == DB_SYNCHRONOUS_WAL) {
+		execute(std::move(task));
+	} else {
+		enqueue(std::move(task));
+	}
+}
+
+
+
+void
+DatabaseWALWriter::write_flush(Shard& shard)
+{
+	L_CALL("DatabaseWALWriter::write_flush()");
+
+	ASSERT(shard.endpoint.is_local());
+
+	auto durable = std::make_shared<std::promise<void>>();
+	auto written = durable->get_future();
+
+	DatabaseWALWriterTask task;
+	task.path = shard.endpoint.path;
+	task.durable = std::move(durable);
+	task.dispatcher = &DatabaseWALWriterTask::write_flush;
+
+	if ((shard.flags & DB_SYNCHRONOUS_WAL) == DB_SYNCHRONOUS_WAL) {
+		execute(std::move(task));
+	} else if (!enqueue(std::move(task))) {
+		THROW(Error, "Cannot enqueue WAL line");
+	}
+
+	written.get();
+}
+
 #endif
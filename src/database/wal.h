@@ -28,11 +28,14 @@
 
 #include <array>                            // for std::array
 #include <chrono>                           // for std::chrono
+#include <future>                           // for std::promise, std::future
 #include <memory>                           // for std::unique_ptr
 #include <string>                           // for std::string
+#include <string_view>                      // for std::string_view
 #include <sys/types.h>                      // for uint32_t, uint8_t, ssize_t
 #include <unordered_map>                    // for std::unordered_map
 #include <utility>                          // for pair, make_pair
+#include <vector>                           // for std::vector
 
 #include "cassert.h"                        // for ASSERT
 #include "blocking_concurrent_queue.h"      // for BlockingConcurrentQueue
@@ -117,6 +120,14 @@ class DatabaseWAL : Storage<WalHeader, WalBinHeader, WalBinFooter> {
 
 	bool validate_uuid;
 
+	bool group_commit;
+	bool group_commit_update;
+
+	Xapian::rev _retained;
+
+	void commit_line(bool send_update);
+	void retire_volumes();
+
 	MsgPack to_string_document(std::string_view document, bool unserialised);
 	MsgPack to_string_metadata(std::string_view document, bool unserialised);
 	MsgPack to_string_line(std::string_view line, bool unserialised);
@@ -137,9 +148,20 @@ public:
 		SET_METADATA,
 		ADD_SPELLING,
 		REMOVE_SPELLING,
+		REPLACE_DOCUMENT_DELTA,
+		REPLACE_DOCUMENT_TERM,
 		MAX,
 	};
 
+	struct Line {
+		Xapian::rev revision;
+		Type type;
+		std::string data;
+		Xapian::docid did;
+		Xapian::Document document;
+		std::string raw;  // undecoded line, its compression dictionary wasn't known yet
+	};
+
 	UUID _uuid;
 	UUID _uuid_le;
 	Xapian::rev _revision;
@@ -147,6 +169,10 @@ public:
 
 	DatabaseWAL(Shard* shard);
 	DatabaseWAL(std::string_view base_path_);
+	~DatabaseWAL() noexcept;
+
+	void retain(Xapian::rev revision);
+	static Xapian::rev oldest_retained(const std::string& base_path);
 
 	iterator begin();
 	iterator end();
@@ -158,13 +184,23 @@ public:
 	bool init_database();
 	bool execute(bool only_committed, bool unsafe = false);
 	bool execute_line(std::string_view line, bool wal_, bool send_update, bool unsafe);
-	void write_line(const UUID& uuid, Xapian::rev revision, Type type, std::string_view data, bool send_update);
+	static Line decode_line(std::string_view line);
+	static std::string document_delta(Xapian::Database& db, Xapian::docid did, const Xapian::Document& doc);
+	Xapian::Document patch_document(Xapian::docid did, std::string_view delta);
+	bool apply_line(Line& line, bool wal_, bool send_update, bool unsafe);
+	void write_line(const UUID& uuid, Xapian::rev revision, Type type, std::string_view data, bool send_update, const LZ4Dictionary* dictionary = nullptr);
+
+	bool begin_group_commit();
+	void end_group_commit();
+
+	void checkpoint();
+	void sync();
 
 	MsgPack to_string(Xapian::rev start_revision, Xapian::rev end_revision, bool unserialised);
 
 	std::pair<Xapian::rev, uint32_t> locate_revision(Xapian::rev revision);
 	iterator find(Xapian::rev revision);
-	std::string get_current_line(uint32_t end_off);
+	std::string_view get_current_line(uint32_t end_off);
 };
 
 
@@ -172,17 +208,17 @@ class DatabaseWAL::iterator {
 	friend DatabaseWAL;
 
 	DatabaseWAL* wal;
-	std::string line;
+	std::string_view line;
 	uint32_t end_off;
 
 public:
 	using iterator_category = std::forward_iterator_tag;
-	using value_type = std::string;
-	using difference_type = std::string;
-	using pointer = std::string*;
-	using reference = std::string&;
+	using value_type = std::string_view;
+	using difference_type = std::string_view;
+	using pointer = std::string_view*;
+	using reference = std::string_view&;
 
-	iterator(DatabaseWAL* wal_, std::string&& item_, uint32_t end_off_)
+	iterator(DatabaseWAL* wal_, std::string_view item_, uint32_t end_off_)
 		: wal(wal_),
 		  line(item_),
 		  end_off(end_off_) { }
@@ -198,15 +234,15 @@ public:
 		return *this;
 	}
 
-	std::string& operator*() {
+	std::string_view& operator*() {
 		return line;
 	}
 
-	std::string* operator->() {
+	std::string_view* operator->() {
 		return &operator*();
 	}
 
-	std::string& value() {
+	std::string_view& value() {
 		return line;
 	}
 
@@ -256,18 +292,26 @@ class DatabaseWALWriterTask {
 	Xapian::rev revision;
 
 	Xapian::Document doc;
+	std::string delta;
+	std::shared_ptr<const LZ4Dictionary> dictionary;
 	std::string key;
 	std::string term_word_val;
 	Xapian::termcount freq;
 	Xapian::docid did;
 	bool send_update;
 
+	// Set for tasks whose writers wait until their line is durable
+	std::shared_ptr<std::promise<void>> durable;
+
 	void write_commit(DatabaseWALWriterThread& thread);
 	void write_replace_document(DatabaseWALWriterThread& thread);
+	void write_replace_document_term(DatabaseWALWriterThread& thread);
 	void write_delete_document(DatabaseWALWriterThread& thread);
 	void write_set_metadata(DatabaseWALWriterThread& thread);
 	void write_add_spelling(DatabaseWALWriterThread& thread);
 	void write_remove_spelling(DatabaseWALWriterThread& thread);
+	void write_checkpoint(DatabaseWALWriterThread& thread);
+	void write_flush(DatabaseWALWriterThread& thread);
 
 public:
 	DatabaseWALWriterTask() : dispatcher(nullptr) {}
@@ -289,6 +333,7 @@ public:
 
 class DatabaseWALWriterThread : public Thread<DatabaseWALWriterThread, ThreadPolicyType::wal_writer> {
 	friend DatabaseWALWriter;
+	friend DatabaseWALWriterTask;
 
 	DatabaseWALWriter* _wal_writer;
 	std::string _name;
@@ -296,6 +341,13 @@ class DatabaseWALWriterThread : public Thread<DatabaseWALWriterThread, ThreadPol
 
 	lru::LRU<std::string, std::unique_ptr<DatabaseWAL>> lru;
 
+	std::vector<DatabaseWALWriterTask> _batch;
+	std::vector<DatabaseWAL*> _batch_wals;
+	bool _batching;
+
+	void write_batch();
+	void sync(DatabaseWALWriterTask& task);
+
 public:
 	DatabaseWALWriterThread() noexcept;
 	DatabaseWALWriterThread(size_t idx, DatabaseWALWriter* wal_writer) noexcept;
@@ -338,11 +390,16 @@ public:
 	std::size_t running_size();
 
 	void write_commit(Shard& shard, bool send_update);
-	void write_replace_document(Shard& shard, Xapian::docid did, Xapian::Document&& doc);
+	void write_replace_document(Shard& shard, Xapian::docid did, Xapian::Document&& doc, std::string&& delta = std::string());
+	std::future<void> write_replace_document_term(Shard& shard, const std::string& term, const Xapian::Document& doc);
 	void write_delete_document(Shard& shard, Xapian::docid did);
 	void write_set_metadata(Shard& shard, const std::string& key, const std::string& val);
 	void write_add_spelling(Shard& shard, const std::string& word, Xapian::termcount freqinc);
 	void write_remove_spelling(Shard& shard, const std::string& word, Xapian::termcount freqdec);
+	void write_checkpoint(Shard& shard);
+
+	// Returns once every line written for the shard so far is durable
+	void write_flush(Shard& shard);
 };
 
 
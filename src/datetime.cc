@@ -22,6 +22,7 @@
 
 #include "datetime.h"
 
+#include <algorithm>                              // for std::min
 #include <cctype>                                 // for std::isdigit
 #include <cmath>                                  // for ceil
 #include <exception>                              // for exception
@@ -40,8 +41,204 @@
 #include "string.hh"                              // for string::format
 
 
-const std::regex Datetime::date_re(R"(([0-9]{4})([-/ ]?)(0[1-9]|1[0-2])\2(0[0-9]|[12][0-9]|3[01])([T ]?([01]?[0-9]|2[0-3]):([0-5][0-9])(:([0-5][0-9])([.,]([0-9]+))?)?([ ]*[+-]([01]?[0-9]|2[0-3]):([0-5][0-9])|Z)?)?([ ]*\|\|[ ]*([+-/\dyMwdhms]+))?)", std::regex::optimize);
-const std::regex Datetime::date_math_re("([+-]\\d+|\\/{1,2})([dyMwhms])", std::regex::optimize);
+/*
+ * Dates in formats other than the strict ISO 8601 handled by Iso8601Parser,
+ * matched by hand (single pass, no allocations) with the grammar:
+ *
+ *   ([0-9]{4})([-/ ]?)(0[1-9]|1[0-2])\2(0[0-9]|[12][0-9]|3[01])
+ *   ([T ]?([01]?[0-9]|2[0-3]):([0-5][0-9])(:([0-5][0-9])([.,]([0-9]+))?)?
+ *   ([ ]*[+-]([01]?[0-9]|2[0-3]):([0-5][0-9])|Z)?)?
+ *   ([ ]*\|\|[ ]*([+-/\dyMwdhms]+))?
+ */
+struct date_match_t {
+	int year;
+	int mon;
+	int day;
+	bool time;
+	int hour;
+	int min;
+	int sec;
+	std::string_view fsec;
+	char tz;
+	std::string_view tz_hour;
+	std::string_view tz_min;
+	std::string_view date_math;
+};
+
+
+static inline bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+
+static inline int digits_value(std::string_view str, std::size_t pos, std::size_t len) {
+	int value = 0;
+	for (auto end = pos + len; pos != end; ++pos) {
+		value = value * 10 + (str[pos] - '0');
+	}
+	return value;
+}
+
+
+// ([01]?[0-9]|2[0-3]) followed by ':'
+static inline bool match_hour(std::string_view str, std::size_t& pos, std::string_view& hour) {
+	auto size = str.size();
+	auto start = pos;
+	if (pos == size || !is_digit(str[pos])) {
+		return false;
+	}
+	if (pos + 1 != size && is_digit(str[pos + 1])) {
+		if (str[pos] > '2' || (str[pos] == '2' && str[pos + 1] > '3')) {
+			return false;
+		}
+		pos += 2;
+	} else {
+		pos += 1;
+	}
+	if (pos == size || str[pos] != ':') {
+		return false;
+	}
+	hour = str.substr(start, pos - start);
+	++pos;
+	return true;
+}
+
+
+// [0-5][0-9]
+static inline bool match_sexagesimal(std::string_view str, std::size_t pos) {
+	return pos + 1 < str.size() && str[pos] >= '0' && str[pos] <= '5' && is_digit(str[pos + 1]);
+}
+
+
+static bool match_time(std::string_view str, std::size_t& pos, date_match_t& m) {
+	auto size = str.size();
+	if (pos != size && (str[pos] == 'T' || str[pos] == ' ')) {
+		++pos;
+	}
+	std::string_view hour;
+	if (!match_hour(str, pos, hour) || !match_sexagesimal(str, pos)) {
+		return false;
+	}
+	m.hour = digits_value(hour, 0, hour.size());
+	m.min = digits_value(str, pos, 2);
+	pos += 2;
+	m.sec = 0;
+	if (pos != size && str[pos] == ':' && match_sexagesimal(str, pos + 1)) {
+		m.sec = digits_value(str, pos + 1, 2);
+		pos += 3;
+		if (pos + 1 < size && (str[pos] == '.' || str[pos] == ',') && is_digit(str[pos + 1])) {
+			auto start = ++pos;
+			while (pos != size && is_digit(str[pos])) {
+				++pos;
+			}
+			m.fsec = str.substr(start, pos - start);
+		}
+	}
+	auto tz = pos;
+	while (tz != size && str[tz] == ' ') {
+		++tz;
+	}
+	if (tz != size && (str[tz] == '+' || str[tz] == '-')) {
+		auto op = str[tz++];
+		if (match_hour(str, tz, m.tz_hour) && match_sexagesimal(str, tz)) {
+			m.tz = op;
+			m.tz_min = str.substr(tz, 2);
+			pos = tz + 2;
+		}
+	} else if (pos != size && str[pos] == 'Z') {
+		m.tz = 'Z';
+		++pos;
+	}
+	return true;
+}
+
+
+static bool match_date(std::string_view str, date_match_t& m) {
+	auto size = str.size();
+	if (size < 8) {
+		return false;
+	}
+	for (std::size_t i = 0; i != 4; ++i) {
+		if (!is_digit(str[i])) {
+			return false;
+		}
+	}
+	std::size_t pos = 4;
+	char sep = str[pos];
+	if (sep == '-' || sep == '/' || sep == ' ') {
+		++pos;
+		if (size < 10 || str[pos + 2] != sep) {
+			return false;
+		}
+	} else {
+		sep = '\0';
+	}
+	// (0[1-9]|1[0-2])
+	auto mon0 = str[pos], mon1 = str[pos + 1];
+	if (!((mon0 == '0' && mon1 >= '1' && mon1 <= '9') || (mon0 == '1' && mon1 >= '0' && mon1 <= '2'))) {
+		return false;
+	}
+	pos += sep ? 3 : 2;
+	// (0[0-9]|[12][0-9]|3[01])
+	auto day0 = str[pos], day1 = str[pos + 1];
+	if (!(((day0 >= '0' && day0 <= '2') && is_digit(day1)) || (day0 == '3' && (day1 == '0' || day1 == '1')))) {
+		return false;
+	}
+	m.year = digits_value(str, 0, 4);
+	m.mon = (mon0 - '0') * 10 + (mon1 - '0');
+	m.day = (day0 - '0') * 10 + (day1 - '0');
+	pos += 2;
+
+	m.time = false;
+	m.fsec = std::string_view();
+	m.tz = '\0';
+	m.date_math = std::string_view();
+
+	if (pos == size) {
+		return true;
+	}
+
+	auto time = pos;
+	if (match_time(str, time, m)) {
+		m.time = true;
+		pos = time;
+		if (pos == size) {
+			return true;
+		}
+	} else {
+		m.fsec = std::string_view();
+		m.tz = '\0';
+	}
+
+	// ([ ]*\|\|[ ]*([+-/\dyMwdhms]+))
+	while (pos != size && str[pos] == ' ') {
+		++pos;
+	}
+	if (pos + 1 >= size || str[pos] != '|' || str[pos + 1] != '|') {
+		return false;
+	}
+	pos += 2;
+	while (pos != size && str[pos] == ' ') {
+		++pos;
+	}
+	if (pos == size) {
+		return false;
+	}
+	auto start = pos;
+	for (; pos != size; ++pos) {
+		switch (str[pos]) {
+			case '+': case ',': case '-': case '.': case '/':
+			case '0': case '1': case '2': case '3': case '4':
+			case '5': case '6': case '7': case '8': case '9':
+			case 'y': case 'M': case 'w': case 'd': case 'h': case 'm': case 's':
+				break;
+			default:
+				return false;
+		}
+	}
+	m.date_math = str.substr(start);
+	return true;
+}
 
 
 static constexpr int days[2][12] = {
@@ -229,7 +426,7 @@ error_out_of_range:
 Datetime::tm_t
 Datetime::DatetimeParser(std::string_view datetime)
 {
-	std::cmatch m;
+	date_match_t m;
 	tm_t tm;
 	// Check if datetime is ISO 8601.
 	auto pos = datetime.find("||");
@@ -260,51 +457,44 @@ Datetime::DatetimeParser(std::string_view datetime)
 		}
 	}
 
-	int errno_save;
-	if (std::regex_match(datetime.begin(), datetime.end(), m, date_re) && static_cast<std::size_t>(m.length(0)) == datetime.size()) {
-		tm.year = strict_stoi(&errno_save, m.str(1));
-		if (errno_save != 0) { goto error; }
-		tm.mon = strict_stoi(&errno_save, m.str(3));
-		if (errno_save != 0) { goto error; }
-		tm.day = strict_stoi(&errno_save, m.str(4));
-		if (errno_save != 0) { goto error; }
+	if (match_date(datetime, m)) {
+		tm.year = m.year;
+		tm.mon = m.mon;
+		tm.day = m.day;
 		if (!isvalidDate(tm.year, tm.mon, tm.day)) {
 			goto error_out_of_range;
 		}
 
 		// Process time
-		if (m.length(5) == 0) {
+		if (!m.time) {
 			tm.hour = tm.min = tm.sec = 0;
 			tm.fsec = 0.0;
 		} else {
-			tm.hour = strict_stoi(&errno_save, m.str(6));
-			if (errno_save != 0) { goto error; }
-			tm.min = strict_stoi(&errno_save, m.str(7));
-			if (errno_save != 0) { goto error; }
-			if (m.length(8) == 0) {
-				tm.sec = 0;
+			tm.hour = m.hour;
+			tm.min = m.min;
+			tm.sec = m.sec;
+			if (m.fsec.empty()) {
 				tm.fsec = 0.0;
 			} else {
-				tm.sec = strict_stoi(&errno_save, m.str(9));
-				if (errno_save != 0) { goto error; }
-				if (m.length(10) == 0) {
-					tm.fsec = 0.0;
-				} else {
-					auto fs = m.str(11);
-					fs.insert(0, 1, '.');
-					auto fsec = strict_stod(&errno_save, fs);
-					if (errno_save != 0) { goto error; }
-					tm.fsec = normalize_fsec(fsec);
+				// Fractions are kept in microseconds, so the digits after
+				// the first 18 can't change them and are ignored.
+				uint64_t fraction = 0;
+				double scale = 1.0;
+				auto digits = std::min(m.fsec.size(), static_cast<size_t>(18));
+				for (size_t i = 0; i < digits; ++i) {
+					fraction = fraction * 10 + (m.fsec[i] - '0');
+					scale *= 10.0;
 				}
+				tm.fsec = normalize_fsec(fraction / scale);
 			}
-			if (m.length(12) != 0) {
-				computeTimeZone(tm, datetime[m.position(13) - 1], m.str(13), m.str(14));
+			if (m.tz == '+' || m.tz == '-') {
+				computeTimeZone(tm, m.tz, m.tz_hour, m.tz_min);
 			}
 		}
 
 		// Process Datetime Math
-		if (m.length(16) != 0) {
-			processDateMath(m.str(16), tm);
+		if (!m.date_math.empty()) {
+			processDateMath(m.date_math, tm);
 		}
 
 		return tm;
@@ -735,19 +925,47 @@ Datetime::Iso8601Parser(std::string_view datetime)
 void
 Datetime::processDateMath(std::string_view date_math, tm_t& tm)
 {
-	size_t size_match = 0;
-
-	std::cregex_iterator next(date_math.begin(), date_math.end(), date_math_re, std::regex_constants::match_continuous);
-	std::cregex_iterator end;
-	while (next != end) {
-		size_match += next->length(0);
-		computeDateMath(tm, next->str(1), next->str(2)[0]);
-		++next;
+	// Sequence of ([+-]\d+|\/{1,2})([dyMwhms])
+	auto size = date_math.size();
+	std::size_t pos = 0;
+	while (pos != size) {
+		auto start = pos;
+		switch (date_math[pos]) {
+			case '+':
+			case '-':
+				++pos;
+				while (pos != size && is_digit(date_math[pos])) {
+					++pos;
+				}
+				if (pos == start + 1) {
+					goto error;
+				}
+				break;
+			case '/':
+				++pos;
+				if (pos != size && date_math[pos] == '/') {
+					++pos;
+				}
+				break;
+			default:
+				goto error;
+		}
+		if (pos == size) {
+			goto error;
+		}
+		switch (date_math[pos]) {
+			case 'd': case 'y': case 'M': case 'w': case 'h': case 'm': case 's':
+				computeDateMath(tm, date_math.substr(start, pos - start), date_math[pos]);
+				++pos;
+				break;
+			default:
+				goto error;
+		}
 	}
+	return;
 
-	if (date_math.size() != size_match) {
-		THROW(DatetimeError, "Datetime Math ({}) is used incorrectly", date_math);
-	}
+error:
+	THROW(DatetimeError, "Datetime Math ({}) is used incorrectly", date_math);
 }
 
 
@@ -1260,8 +1478,8 @@ Datetime::isDatetime(std::string_view datetime)
 		case Format::VALID:
 			return true;
 		case Format::INVALID: {
-			std::cmatch m;
-			return std::regex_match(datetime.begin(), datetime.end(), m, date_re) && static_cast<std::size_t>(m.length(0)) == datetime.size();
+			date_match_t m;
+			return match_date(datetime, m);
 		}
 		default:
 			return false;
@@ -26,7 +26,6 @@
 #include <cmath>           // for std::round
 #include <ctime>           // for time_t
 #include <iostream>
-#include <regex>           // for regex
 #include <string>          // for string
 #include <string_view>     // for std::string_view
 #include <type_traits>     // for forward
@@ -105,9 +104,6 @@ namespace Datetime {
 		ERROR,
 	};
 
-	extern const std::regex date_re;
-	extern const std::regex date_math_re;
-
 	tm_t DatetimeParser(std::string_view datetime);
 	inline tm_t DatetimeParser(const std::string& datetime) {
 		return DatetimeParser(std::string_view(datetime));
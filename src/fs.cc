@@ -26,7 +26,7 @@
 #include <errno.h>                  // for errno
 #include <fnmatch.h>                // for fnmatch
 #include <stdio.h>                  // for rename
-#include <sys/stat.h>               // for stat, mkdir
+#include <sys/stat.h>               // for stat, fstatat, mkdir
 #include <unistd.h>                 // for rmdir
 #include <vector>                   // for std::vector
 
@@ -144,6 +144,38 @@ void move_files(std::string_view src, std::string_view dst) {
 }
 
 
+size_t files_size(std::string_view path, const std::vector<std::string>& patterns) {
+	L_CALL("files_size({}, <patterns>)", repr(path));
+
+	stringified path_string(path);
+
+	DIR *dirp = ::opendir(path_string.c_str());
+	if (dirp == nullptr) {
+		return 0;
+	}
+
+	size_t size = 0;
+	struct dirent *ent;
+	while ((ent = ::readdir(dirp)) != nullptr) {
+		if (ent->d_type == DT_REG) {
+			const char *n = ent->d_name;
+			if (std::any_of(patterns.cbegin(), patterns.cend(), [&](const std::string& pattern){
+				return ::fnmatch(pattern.c_str(), n, 0) == 0;
+			})) {
+				struct stat buf;
+				if (::fstatat(::dirfd(dirp), n, &buf, 0) == 0) {
+					size += buf.st_size;
+				}
+			}
+		}
+	}
+
+	::closedir(dirp);
+
+	return size;
+}
+
+
 bool exists(std::string_view path) {
 	L_CALL("exists({})", repr(path));
 
@@ -23,6 +23,7 @@
 #pragma once
 
 #include <dirent.h>              // for DIR, readdir, opendir, closedir
+#include <stddef.h>              // for size_t
 #include <string>                // for std::string
 #include <string_view>           // for std::string_view
 #include <vector>                // for std::vector
@@ -40,6 +41,8 @@ void delete_files(std::string_view path, const std::vector<std::string>& pattern
 
 void move_files(std::string_view src, std::string_view dst);
 
+size_t files_size(std::string_view path, const std::vector<std::string>& patterns = {"*"});
+
 bool exists(std::string_view path);
 
 bool mkdir(std::string_view path);
@@ -30,48 +30,56 @@
 #include "utype.hh"          // for toUType
 
 
+constexpr static auto _geometry_types = phf::make_phf({
+	hh("POINT"),
+	hh("CIRCLE"),
+	hh("CONVEX"),
+	hh("POLYGON"),
+	hh("CHULL"),
+	hh("MULTIPOINT"),
+	hh("MULTICIRCLE"),
+	hh("MULTICONVEX"),
+	hh("MULTIPOLYGON"),
+	hh("MULTICHULL"),
+	hh("GEOMETRYCOLLECTION"),
+	hh("GEOMETRYINTERSECTION"),
+});
+
+
+inline bool
+is_geometry_type(std::string_view str_geometry_type)
+{
+	return _geometry_types.fhh(str_geometry_type) != phf::npos;
+}
+
+
 inline Geometry::Type
 get_geometry_type(std::string_view str_geometry_type)
 {
-	constexpr static auto _ = phf::make_phf({
-		hh("POINT"),
-		hh("CIRCLE"),
-		hh("CONVEX"),
-		hh("POLYGON"),
-		hh("CHULL"),
-		hh("MULTIPOINT"),
-		hh("MULTICIRCLE"),
-		hh("MULTICONVEX"),
-		hh("MULTIPOLYGON"),
-		hh("MULTICHULL"),
-		hh("GEOMETRYCOLLECTION"),
-		hh("GEOMETRYINTERSECTION"),
-	});
-
-	switch (_.fhh(str_geometry_type)) {
-		case _.fhh("POINT"):
+	switch (_geometry_types.fhh(str_geometry_type)) {
+		case _geometry_types.fhh("POINT"):
 			return Geometry::Type::POINT;
-		case _.fhh("CIRCLE"):
+		case _geometry_types.fhh("CIRCLE"):
 			return Geometry::Type::CIRCLE;
-		case _.fhh("CONVEX"):
+		case _geometry_types.fhh("CONVEX"):
 			return Geometry::Type::CONVEX;
-		case _.fhh("POLYGON"):
+		case _geometry_types.fhh("POLYGON"):
 			return Geometry::Type::POLYGON;
-		case _.fhh("CHULL"):
+		case _geometry_types.fhh("CHULL"):
 			return Geometry::Type::CHULL;
-		case _.fhh("MULTIPOINT"):
+		case _geometry_types.fhh("MULTIPOINT"):
 			return Geometry::Type::MULTIPOINT;
-		case _.fhh("MULTICIRCLE"):
+		case _geometry_types.fhh("MULTICIRCLE"):
 			return Geometry::Type::MULTICIRCLE;
-		case _.fhh("MULTICONVEX"):
+		case _geometry_types.fhh("MULTICONVEX"):
 			return Geometry::Type::MULTICONVEX;
-		case _.fhh("MULTIPOLYGON"):
+		case _geometry_types.fhh("MULTIPOLYGON"):
 			return Geometry::Type::MULTIPOLYGON;
-		case _.fhh("MULTICHULL"):
+		case _geometry_types.fhh("MULTICHULL"):
 			return Geometry::Type::MULTICHULL;
-		case _.fhh("GEOMETRYCOLLECTION"):
+		case _geometry_types.fhh("GEOMETRYCOLLECTION"):
 			return Geometry::Type::COLLECTION;
-		case _.fhh("GEOMETRYINTERSECTION"):
+		case _geometry_types.fhh("GEOMETRYINTERSECTION"):
 			return Geometry::Type::INTERSECTION;
 		default:
 			throw std::out_of_range("Invalid geometry");
@@ -773,9 +781,7 @@ EWKT::_isEWKT(Iterator first, Iterator last)
 		return false;
 	}
 
-	try {
-		get_geometry_type(std::string_view(_first, first - _first));
-	} catch (const std::out_of_range&) {
+	if (!is_geometry_type(std::string_view(_first, first - _first))) {
 		return false;
 	}
 	switch (*first) {
@@ -787,7 +793,7 @@ EWKT::_isEWKT(Iterator first, Iterator last)
 			return closed_it == (last - 1);
 		}
 		case ' ':
-			return std::string(++first, last).compare("EMPTY") == 0;
+			return std::string_view(first + 1, last - first - 1).compare("EMPTY") == 0;
 		default:
 			return false;
 	}
@@ -928,7 +928,7 @@ reexecute:
         parser->method = (enum http_method) 0;
         parser->index = 1;
         switch (ch) {
-          case 'C': parser->method = HTTP_COUNT; /* or COPY, CONNECT, COMMIT, CLOSE, CHECK */ break;
+          case 'C': parser->method = HTTP_COUNT; /* or COPY, CONNECT, COMMIT, COMPACT, CLOSE, CHECK */ break;
           case 'D': parser->method = HTTP_DUMP; /* or DELETE */ break;
           case 'F': parser->method = HTTP_FLUSH; break;
           case 'G': parser->method = HTTP_GET; break;
@@ -977,6 +977,7 @@ reexecute:
             XX(COUNT,     1, 'L', CLOSE)
             XX(COUNT,     1, 'H', CHECK)
             XX(COUNT,     2, 'M', COMMIT)
+            XX(COMMIT,    3, 'P', COMPACT)
             XX(COUNT,     2, 'N', CONNECT)
             XX(COUNT,     2, 'P', COPY)
             XX(DUMP,      1, 'E', DELETE)
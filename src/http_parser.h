@@ -183,21 +183,22 @@ enum http_status
   XX(12, CHECK,       CHECK)        \
   XX(13, CLOSE,       CLOSE)        \
   XX(14, COMMIT,      COMMIT)       \
-  XX(15, COPY,        COPY)         \
-  XX(16, COUNT,       COUNT)        \
-  XX(17, DUMP,        DUMP)         \
-  XX(18, FLUSH,       FLUSH)        \
-  XX(19, INFO,        INFO)         \
-  XX(20, LOCK,        LOCK)         \
-  XX(21, MERGE,       MERGE)        \
-  XX(22, MOVE,        MOVE)         \
-  XX(23, OPEN,        OPEN)         \
-  XX(24, QUIT,        QUIT)         \
-  XX(25, RESTORE,     RESTORE)      \
-  XX(26, SEARCH,      SEARCH)       \
-  XX(27, STORE,       STORE)        \
-  XX(28, UNLOCK,      UNLOCK)       \
-  XX(29, UPDATE,      UPDATE)       \
+  XX(15, COMPACT,     COMPACT)      \
+  XX(16, COPY,        COPY)         \
+  XX(17, COUNT,       COUNT)        \
+  XX(18, DUMP,        DUMP)         \
+  XX(19, FLUSH,       FLUSH)        \
+  XX(20, INFO,        INFO)         \
+  XX(21, LOCK,        LOCK)         \
+  XX(22, MERGE,       MERGE)        \
+  XX(23, MOVE,        MOVE)         \
+  XX(24, OPEN,        OPEN)         \
+  XX(25, QUIT,        QUIT)         \
+  XX(26, RESTORE,     RESTORE)      \
+  XX(27, SEARCH,      SEARCH)       \
+  XX(28, STORE,       STORE)        \
+  XX(29, UNLOCK,      UNLOCK)       \
+  XX(30, UPDATE,      UPDATE)       \
 
 enum http_method
   {
@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "io_uring.hh"
+
+#include <algorithm>                // for std::max
+#include <condition_variable>       // for std::condition_variable
+#include <errno.h>                  // for errno, EINTR, ENOSYS, EIO, ECANCELED
+#include <string.h>                 // for memset
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>         // for io_uring_params, io_uring_sqe, io_uring_cqe
+#include <sys/mman.h>               // for mmap, munmap
+#include <sys/syscall.h>            // for __NR_io_uring_setup, __NR_io_uring_enter
+#endif
+
+#include "error.hh"                 // for error:name, error::description
+#include "likely.h"                 // for likely, unlikely
+#include "log.h"                    // for L_CALL, L_ERR, L_WARNING, L_WARNING_ONCE
+
+
+// #undef L_DEBUG
+// #define L_DEBUG L_GREY
+// #undef L_CALL
+// #define L_CALL L_STACKED_DIM_GREY
+
+
+#define IO_URING_ENTRIES 256
+
+
+namespace io {
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+struct Uring::Ring {
+	int fd;
+	unsigned entries;
+
+	void* sq_ptr;
+	size_t sq_size;
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+
+	void* cq_ptr;
+	size_t cq_size;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	struct io_uring_cqe* cqes;
+
+	struct io_uring_sqe* sqes;
+	size_t sqes_size;
+
+	// The ring is shared by all storages, everything below (and the state
+	// of the Uring handles) is protected by mtx. Only one thread at a time
+	// blocks in the kernel waiting for completions, the rest wait on cv.
+	std::mutex mtx;
+	std::condition_variable cv;
+	unsigned queued;
+	unsigned inflight;
+	bool reaping;
+
+	Ring() :
+		fd(-1),
+		entries(0),
+		sq_ptr(MAP_FAILED),
+		sq_size(0),
+		cq_ptr(MAP_FAILED),
+		cq_size(0),
+		sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+		sqes_size(0),
+		queued(0),
+		inflight(0),
+		reaping(false) { }
+
+	~Ring() noexcept {
+		if (sqes != MAP_FAILED) {
+			::munmap(sqes, sqes_size);
+		}
+		if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+			::munmap(cq_ptr, cq_size);
+		}
+		if (sq_ptr != MAP_FAILED) {
+			::munmap(sq_ptr, sq_size);
+		}
+		if (fd != -1) {
+			::close(fd);
+		}
+	}
+
+	bool setup(unsigned entries_) {
+		struct io_uring_params p;
+		memset(&p, 0, sizeof(p));
+
+		fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries_, &p));
+		if (fd == -1) {
+			return false;
+		}
+		entries = p.sq_entries;
+
+		sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+		bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+		if (single_mmap) {
+			sq_size = cq_size = std::max(sq_size, cq_size);
+		}
+
+		sq_ptr = ::mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sq_ptr == MAP_FAILED) {
+			return false;
+		}
+		if (single_mmap) {
+			cq_ptr = sq_ptr;
+		} else {
+			cq_ptr = ::mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			if (cq_ptr == MAP_FAILED) {
+				return false;
+			}
+		}
+		sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+		sqes = static_cast<struct io_uring_sqe*>(::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+		if (sqes == MAP_FAILED) {
+			return false;
+		}
+
+		auto sq = static_cast<char*>(sq_ptr);
+		sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+		sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+		sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+		sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+		auto cq = static_cast<char*>(cq_ptr);
+		cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+		cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+		cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+		cqes = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+		return true;
+	}
+
+	// Never have more operations in flight than the completion queue holds.
+	bool has_room(unsigned n) const {
+		return *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) + n <= entries && inflight + n <= entries;
+	}
+
+	struct io_uring_sqe* get_sqe() {
+		unsigned tail = *sq_tail;
+		unsigned index = tail & *sq_mask;
+		auto sqe = &sqes[index];
+		memset(sqe, 0, sizeof(*sqe));
+		sq_array[index] = index;
+		return sqe;
+	}
+
+	void push_sqe() {
+		__atomic_store_n(sq_tail, *sq_tail + 1, __ATOMIC_RELEASE);
+	}
+
+	int enter(unsigned to_submit, unsigned min_complete) {
+		return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+	}
+
+	int submit() {
+		while (queued) {
+			int submitted = enter(queued, 0);
+			if unlikely(submitted == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return -1;
+			}
+			if unlikely(submitted == 0) {
+				break;
+			}
+			queued -= submitted;
+		}
+		return 0;
+	}
+
+	void reap() {
+		unsigned head = *cq_head;
+		while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+			auto& cqe = cqes[head & *cq_mask];
+			auto op = reinterpret_cast<Op*>(cqe.user_data);
+			auto owner = op->owner;
+			if (op->sync) {
+				--owner->inflight_syncs;
+				// A cancelled fsync means its linked write already failed.
+				if unlikely(cqe.res < 0 && cqe.res != -ECANCELED) {
+					L_ERR("io_uring fsync failed: {} ({}): {}", error::name(-cqe.res), -cqe.res, error::description(-cqe.res));
+					if (!owner->error) {
+						owner->error = -cqe.res;
+					}
+				}
+			} else {
+				--owner->inflight_writes;
+				if unlikely(cqe.res != static_cast<int>(op->iov.iov_len)) {
+					int err = cqe.res < 0 ? -cqe.res : EIO;
+					L_ERR("io_uring write failed: {} ({}): {}", error::name(err), err, error::description(err));
+					if (!owner->error) {
+						owner->error = err;
+					}
+				}
+			}
+			op->busy = false;
+			--inflight;
+			++head;
+		}
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+		cv.notify_all();
+	}
+};
+
+
+Uring::Uring(Ring* ring_) :
+	ring(ring_),
+	inflight_writes(0),
+	inflight_syncs(0),
+	error(0)
+{
+	for (auto& op : ops) {
+		op.owner = this;
+		op.sync = false;
+		op.busy = false;
+	}
+}
+
+
+Uring::~Uring() noexcept
+{
+	// The kernel may still be using the buffers, wait for everything.
+	wait();
+}
+
+
+std::unique_ptr<Uring>
+Uring::create()
+{
+	L_CALL("io::Uring::create()");
+
+	// A single ring for the whole process, it's never destroyed as storages
+	// may still be closing during static destruction.
+	static Ring* shared = [] () -> Ring* {
+		auto ring = new Ring();
+		if unlikely(!ring->setup(IO_URING_ENTRIES)) {
+			L_WARNING("io_uring is not available, falling back to synchronous I/O: {} ({}): {}", error::name(errno), errno, error::description(errno));
+			delete ring;
+			return nullptr;
+		}
+		return ring;
+	}();
+
+	if (!shared) {
+		return nullptr;
+	}
+	return std::unique_ptr<Uring>(new Uring(shared));
+}
+
+
+size_t
+Uring::free_ops() const
+{
+	size_t count = 0;
+	for (auto& op : ops) {
+		if (!op.busy) {
+			++count;
+		}
+	}
+	return count;
+}
+
+
+Uring::Op*
+Uring::get_op()
+{
+	for (auto& op : ops) {
+		if (!op.busy) {
+			op.busy = true;
+			return &op;
+		}
+	}
+	return nullptr;
+}
+
+
+int
+Uring::take_error()
+{
+	if unlikely(error) {
+		errno = error;
+		error = 0;
+		return -1;
+	}
+	return 0;
+}
+
+
+template <typename Pred>
+int
+Uring::wait(std::unique_lock<std::mutex>& lk, Pred pred)
+{
+	while (!pred()) {
+		if unlikely(ring->submit() == -1) {
+			return -1;
+		}
+		if (ring->reaping) {
+			ring->cv.wait(lk);
+			continue;
+		}
+		ring->reap();
+		if (pred()) {
+			break;
+		}
+		if unlikely(!ring->inflight) {
+			errno = EIO;
+			return -1;
+		}
+		// Block in the kernel (without holding the lock) until something
+		// completes, threads waiting meanwhile are woken up by reap().
+		ring->reaping = true;
+		lk.unlock();
+		int res;
+		do {
+			res = ring->enter(0, 1);
+		} while (res == -1 && errno == EINTR);
+		int err = errno;
+		lk.lock();
+		ring->reaping = false;
+		ring->reap();
+		if unlikely(res == -1) {
+			errno = err;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+int
+Uring::queue_write(std::unique_lock<std::mutex>& lk, int fd, const void* buf, size_t nbyte, off_t offset, unsigned sqe_flags)
+{
+	if unlikely(wait(lk, [&]{ return free_ops() && ring->has_room(1); }) == -1) {
+		return -1;
+	}
+
+	auto op = get_op();
+	op->sync = false;
+	op->iov.iov_base = const_cast<void*>(buf);
+	op->iov.iov_len = nbyte;
+
+	auto sqe = ring->get_sqe();
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->flags = sqe_flags;
+	sqe->fd = fd;
+	sqe->off = offset;
+	sqe->addr = reinterpret_cast<uint64_t>(&op->iov);
+	sqe->len = 1;
+	sqe->user_data = reinterpret_cast<uint64_t>(op);
+	ring->push_sqe();
+	++ring->queued;
+	++ring->inflight;
+	++inflight_writes;
+
+	return 0;
+}
+
+
+int
+Uring::write(int fd, const void* buf, size_t nbyte, off_t offset)
+{
+	L_CALL("io::Uring::write({}, <buf>, {}, {})", fd, nbyte, offset);
+
+	std::unique_lock<std::mutex> lk(ring->mtx);
+	return queue_write(lk, fd, buf, nbyte, offset, 0);
+}
+
+
+int
+Uring::wait_buffer(const void* buf)
+{
+	L_CALL("io::Uring::wait_buffer(<buf>)");
+
+	std::unique_lock<std::mutex> lk(ring->mtx);
+	return wait(lk, [&]{
+		for (auto& op : ops) {
+			if (op.busy && !op.sync && op.iov.iov_base == buf) {
+				return false;
+			}
+		}
+		return true;
+	});
+}
+
+
+int
+Uring::commit(int fd, const void* buf, size_t nbyte, off_t offset, bool sync, bool full_sync, bool async_sync)
+{
+	L_CALL("io::Uring::commit({}, <buf>, {}, {}, {}, {}, {})", fd, nbyte, offset, sync, full_sync, async_sync);
+
+	std::unique_lock<std::mutex> lk(ring->mtx);
+
+	// Block writes go first, the header is only written once they
+	// succeeded, and the fsync is linked to it.
+	if unlikely(wait(lk, [this]{ return !inflight_writes; }) == -1) {
+		return -1;
+	}
+	if unlikely(take_error() == -1) {
+		return -1;
+	}
+
+	// Both operations are queued together, nobody else can get in between.
+	size_t needed = sync ? 2 : 1;
+	if unlikely(wait(lk, [&]{ return free_ops() >= needed && ring->has_room(needed); }) == -1) {
+		return -1;
+	}
+
+	if unlikely(queue_write(lk, fd, buf, nbyte, offset, sync ? IOSQE_IO_LINK : 0) == -1) {
+		return -1;
+	}
+
+	if (sync) {
+		auto op = get_op();
+		op->sync = true;
+		op->iov.iov_base = nullptr;
+		op->iov.iov_len = 0;
+
+		auto sqe = ring->get_sqe();
+		sqe->opcode = IORING_OP_FSYNC;
+		sqe->fd = fd;
+		// There is no F_FULLFSYNC in Linux, a full fsync also flushes metadata.
+		sqe->fsync_flags = full_sync ? 0 : IORING_FSYNC_DATASYNC;
+		sqe->user_data = reinterpret_cast<uint64_t>(op);
+		ring->push_sqe();
+		++ring->queued;
+		++ring->inflight;
+		++inflight_syncs;
+	}
+
+	if unlikely(wait(lk, [&]{ return !inflight_writes && (!sync || async_sync || !inflight_syncs); }) == -1) {
+		return -1;
+	}
+	return take_error();
+}
+
+
+int
+Uring::wait()
+{
+	L_CALL("io::Uring::wait()");
+
+	std::unique_lock<std::mutex> lk(ring->mtx);
+	if unlikely(wait(lk, [this]{ return !inflight_writes && !inflight_syncs; }) == -1) {
+		return -1;
+	}
+	return take_error();
+}
+
+#else
+
+struct Uring::Ring { };
+
+
+Uring::Uring(Ring* ring_) :
+	ring(ring_),
+	inflight_writes(0),
+	inflight_syncs(0),
+	error(0) { }
+
+
+Uring::~Uring() noexcept { }
+
+
+std::unique_ptr<Uring>
+Uring::create()
+{
+	L_WARNING_ONCE("io_uring is not supported, falling back to synchronous I/O");
+	return nullptr;
+}
+
+
+int
+Uring::write(int, const void*, size_t, off_t)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+
+int
+Uring::wait_buffer(const void*)
+{
+	return 0;
+}
+
+
+int
+Uring::commit(int, const void*, size_t, off_t, bool, bool, bool)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+
+int
+Uring::wait()
+{
+	return 0;
+}
+
+#endif
+
+}  // namespace io
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include "config.h"              // for HAVE_LINUX_IO_URING_H
+
+#include <cstdint>               // for uint64_t
+#include <memory>                // for std::unique_ptr
+#include <mutex>                 // for std::unique_lock, std::mutex
+#include <stddef.h>              // for size_t
+#include <sys/uio.h>             // for iovec
+#include <unistd.h>              // for off_t
+
+
+#define IO_URING_OPS 16
+
+
+namespace io {
+
+/*
+ * Batched write engine based on io_uring.
+ *
+ * All storages share a single ring, each Uring is just a handle with its
+ * own operation slots and error. Writes are queued straight from the
+ * caller's buffer, which must not be touched until wait_buffer() (or a
+ * commit()) returns. They are submitted to the kernel together by commit(),
+ * which then writes the header with the fsync linked to it. commit() waits
+ * for the writes; the fsync can be left to complete asynchronously, its
+ * result is collected by later calls.
+ */
+class Uring {
+	struct Ring;
+
+	struct Op {
+		Uring* owner;
+		struct iovec iov;
+		bool sync;
+		bool busy;
+	};
+
+	Ring* ring;
+
+	Op ops[IO_URING_OPS];
+	size_t inflight_writes;
+	size_t inflight_syncs;
+	int error;
+
+	Uring(Ring* ring_);
+
+	size_t free_ops() const;
+	Op* get_op();
+	int take_error();
+	template <typename Pred>
+	int wait(std::unique_lock<std::mutex>& lk, Pred pred);
+	int queue_write(std::unique_lock<std::mutex>& lk, int fd, const void* buf, size_t nbyte, off_t offset, unsigned sqe_flags);
+
+public:
+	~Uring() noexcept;
+
+	// Returns nullptr (and logs a warning once) when io_uring is not available.
+	static std::unique_ptr<Uring> create();
+
+	int write(int fd, const void* buf, size_t nbyte, off_t offset);
+	int wait_buffer(const void* buf);
+	int commit(int fd, const void* buf, size_t nbyte, off_t offset, bool sync, bool full_sync, bool async_sync);
+	int wait();
+};
+
+}  // namespace io
@@ -75,9 +75,6 @@
 #define FDS_PER_CLIENT    2             // KQUEUE + IPv4
 #define FDS_PER_DATABASE  7             // Writable~=7, Readable~=5
 
-
-opts_t opts;
-
 static const bool is_tty = isatty(STDERR_FILENO) != 0;
 
 
@@ -726,6 +723,10 @@ void setup() {
 			L_INFO("Flush threshold is now {}. (it was originally 10000)", opts.flush_threshold);
 		}
 	}
+	if (opts.flush_memory || opts.flush_memory_total) {
+		// Xapian flushes by memory instead of by flush threshold
+		L_INFO("Flush memory budget is {} per shard and {} in total.", opts.flush_memory ? string::from_bytes(opts.flush_memory * 1024 * 1024) : "unlimited", opts.flush_memory_total ? string::from_bytes(opts.flush_memory_total * 1024 * 1024) : "unlimited");
+	}
 
 	std::vector<std::string> modes;
 	if (opts.strict) {
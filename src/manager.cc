@@ -52,7 +52,7 @@
 #include "cassert.h"                             // for ASSERT
 #include "color_tools.hh"                        // for color
 #include "database/cleanup.h"                    // for DatabaseCleanup
-#include "database/handler.h"                    // for DatabaseHandler, DocPreparer, DocIndexer, committer
+#include "database/handler.h"                    // for DatabaseHandler, DocPreparer, DocIndexer, committer, compactor, freezer, trainer
 #include "database/pool.h"                       // for DatabasePool
 #include "database/schemas_lru.h"                // for SchemasLRU
 #include "database/utils.h"                      // for RESERVED_TYPE
@@ -83,6 +83,8 @@
 #include "storage.h"                             // for Storage
 #include "strict_stox.hh"                        // for strict_stoll
 #include "system.hh"                             // for get_open_files_per_proc, get_max_files_per_proc
+#include "xapian/backends/glass/glass_blockcache.h"  // for GlassBlockCache
+#include "xapian/backends/glass/glass_flushbudget.h"  // for GlassFlushBudget
 
 #ifdef XAPIAND_CLUSTERING
 #include "server/remote_protocol.h"              // for RemoteProtocol
@@ -490,6 +492,12 @@ XapiandManager::init()
 {
 	L_CALL("XapiandManager::init()");
 
+	// Blocks of database tables, shared by all readable shards
+	GlassBlockCache::set_max_size(opts.block_cache_size * 1024 * 1024);
+
+	// Changes buffered by writable shards before getting flushed
+	GlassFlushBudget::set_max_size(opts.flush_memory * 1024 * 1024, opts.flush_memory_total * 1024 * 1024);
+
 	bool snooping = (
 		!opts.dump_documents.empty() ||
 		!opts.restore_documents.empty()
@@ -1144,6 +1152,54 @@ XapiandManager::join()
 		}
 	}
 
+	////////////////////////////////////////////////////////////////////
+	auto& compactor_obj = compactor(false);
+	if (compactor_obj) {
+		L_MANAGER("Finishing storage compactor scheduler!");
+		compactor_obj->finish();
+
+		L_MANAGER("Waiting for {} storage compaction{}...", compactor_obj->running_size(), (compactor_obj->running_size() == 1) ? "" : "s");
+		L_MANAGER_TIMED(1s, "Is taking too long to finish the storage compactor...", "Storage compactor finished!");
+		while (!compactor_obj->join(500ms)) {
+			int sig = atom_sig;
+			if (sig < 0) {
+				throw SystemExit(-sig);
+			}
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////
+	auto& trainer_obj = trainer(false);
+	if (trainer_obj) {
+		L_MANAGER("Finishing compression dictionary trainer scheduler!");
+		trainer_obj->finish();
+
+		L_MANAGER("Waiting for {} compression dictionary trainer{}...", trainer_obj->running_size(), (trainer_obj->running_size() == 1) ? "" : "s");
+		L_MANAGER_TIMED(1s, "Is taking too long to finish the compression dictionary trainer...", "Compression dictionary trainer finished!");
+		while (!trainer_obj->join(500ms)) {
+			int sig = atom_sig;
+			if (sig < 0) {
+				throw SystemExit(-sig);
+			}
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////
+	auto& freezer_obj = freezer(false);
+	if (freezer_obj) {
+		L_MANAGER("Finishing shard freezer scheduler!");
+		freezer_obj->finish();
+
+		L_MANAGER("Waiting for {} shard freez{}...", freezer_obj->running_size(), (freezer_obj->running_size() == 1) ? "e" : "es");
+		L_MANAGER_TIMED(1s, "Is taking too long to finish the shard freezer...", "Shard freezer finished!");
+		while (!freezer_obj->join(500ms)) {
+			int sig = atom_sig;
+			if (sig < 0) {
+				throw SystemExit(-sig);
+			}
+		}
+	}
+
 #if XAPIAND_DATABASE_WAL
 
 	////////////////////////////////////////////////////////////////////
@@ -1199,6 +1255,22 @@ XapiandManager::join()
 		}
 	}
 
+	////////////////////////////////////////////////////////////////////
+	auto& volume_preallocator_obj = volume_preallocator(false);
+	if (volume_preallocator_obj) {
+		L_MANAGER("Finishing volume preallocator threads pool!");
+		volume_preallocator_obj->finish();
+
+		L_MANAGER("Waiting for {} volume preallocation{}...", volume_preallocator_obj->running_size(), (volume_preallocator_obj->running_size() == 1) ? "" : "s");
+		L_MANAGER_TIMED(1s, "Is taking too long to finish the volume preallocator threads...", "Volume preallocator threads finished!");
+		while (!volume_preallocator_obj->join(500ms)) {
+			int sig = atom_sig;
+			if (sig < 0) {
+				throw SystemExit(-sig);
+			}
+		}
+	}
+
 #if XAPIAND_CLUSTERING
 
 	////////////////////////////////////////////////////////////////////
@@ -1268,6 +1340,9 @@ XapiandManager::join()
 	db_updater_obj.reset();
 #endif
 	committer_obj.reset();
+	compactor_obj.reset();
+	trainer_obj.reset();
+	freezer_obj.reset();
 	fsyncher_obj.reset();
 
 	_schemas.reset();
@@ -1917,6 +1992,13 @@ XapiandManager::server_metrics_impl()
 	metrics.xapiand_endpoints.Set(count.first);
 	metrics.xapiand_databases.Set(count.second);
 
+	auto block_cache = GlassBlockCache::stats();
+	auto block_cache_reads = block_cache.hits + block_cache.misses;
+	metrics.xapiand_block_cache_hit_ratio.Set(block_cache_reads ? static_cast<double>(block_cache.hits) / block_cache_reads : 0.0);
+	metrics.xapiand_block_cache_memory_bytes.Set(block_cache.size);
+
+	metrics.xapiand_flush_pending_bytes.Set(GlassFlushBudget::pending());
+
 	return metrics.serialise();
 }
 
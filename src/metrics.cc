@@ -51,6 +51,97 @@ Metrics::Metrics(const std::map<std::string, std::string>& constant_labels_) :
 			constant_labels)
 		.Add({})
 	},
+	xapiand_wal_batch_size{
+		registry.AddHistogram(
+			"xapiand_wal_batch_size",
+			"WAL writes grouped per commit",
+			constant_labels)
+		.Add({}, prometheus::Histogram::BucketBoundaries{1, 2, 4, 8, 16, 32, 64, 128, 256, 512})
+	},
+	xapiand_storage_allocation_stalls{
+		registry.AddHistogram(
+			"xapiand_storage_allocation_stalls",
+			"Seconds spent allocating storage volumes while writing",
+			constant_labels)
+		.Add({}, prometheus::Histogram::BucketBoundaries{0.0001, 0.001, 0.01, 0.1, 1})
+	},
+	xapiand_commit_delay{
+		registry.AddHistogram(
+			"xapiand_commit_delay",
+			"Seconds autocommits were scheduled ahead",
+			constant_labels)
+		.Add({}, prometheus::Histogram::BucketBoundaries{0.001, 0.01, 0.1, 0.5, 1, 5})
+	},
+	xapiand_commit_duration{
+		registry.AddHistogram(
+			"xapiand_commit_duration",
+			"Seconds spent in autocommits",
+			constant_labels)
+		.Add({}, prometheus::Histogram::BucketBoundaries{0.001, 0.01, 0.1, 1, 10})
+	},
+	xapiand_storage_compaction_relocated{
+		registry.AddCounter(
+			"xapiand_storage_compaction_relocated",
+			"Bytes of live data relocated by the storage compactor",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_storage_compaction_reclaimed{
+		registry.AddCounter(
+			"xapiand_storage_compaction_reclaimed",
+			"Bytes reclaimed retiring compacted storage volumes",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_storage_compaction_pending{
+		registry.AddGauge(
+			"xapiand_storage_compaction_pending",
+			"Bytes of live data the storage compactor has yet to relocate",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_shard_compaction_written{
+		registry.AddCounter(
+			"xapiand_shard_compaction_written",
+			"Bytes of items written by shard compactions",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_shard_compaction_reclaimed{
+		registry.AddCounter(
+			"xapiand_shard_compaction_reclaimed",
+			"Bytes reclaimed swapping in compacted shards",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_storage_volumes_cache_hits{
+		registry.AddCounter(
+			"xapiand_storage_volumes_cache_hits",
+			"Stored data reads served by an already open storage volume",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_storage_volumes_cache_misses{
+		registry.AddCounter(
+			"xapiand_storage_volumes_cache_misses",
+			"Stored data reads that had to open a storage volume",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_storage_stored_cache_hits{
+		registry.AddCounter(
+			"xapiand_storage_stored_cache_hits",
+			"Stored blobs served from the decompressed blobs cache",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_storage_stored_cache_misses{
+		registry.AddCounter(
+			"xapiand_storage_stored_cache_misses",
+			"Stored blobs not found in the decompressed blobs cache",
+			constant_labels)
+		.Add({})
+	},
 	xapiand_uptime{
 		registry.AddGauge(
 			"xapiand_uptime",
@@ -430,6 +521,27 @@ Metrics::Metrics(const std::map<std::string, std::string>& constant_labels_) :
 			"Total open databases",
 			constant_labels)
 		.Add({})
+	},
+	xapiand_block_cache_hit_ratio{
+		registry.AddGauge(
+			"xapiand_block_cache_hit_ratio",
+			"Ratio of database blocks read from the shared block cache",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_block_cache_memory_bytes{
+		registry.AddGauge(
+			"xapiand_block_cache_memory_bytes",
+			"Memory used by the shared block cache",
+			constant_labels)
+		.Add({})
+	},
+	xapiand_flush_pending_bytes{
+		registry.AddGauge(
+			"xapiand_flush_pending_bytes",
+			"Memory used by changes buffered in writable shards",
+			constant_labels)
+		.Add({})
 	}
 {
 	xapiand_running.Set(1);
@@ -47,6 +47,19 @@ public:
 
 	// server info
 	prometheus::Counter& xapiand_wal_errors;
+	prometheus::Histogram& xapiand_wal_batch_size;
+	prometheus::Histogram& xapiand_storage_allocation_stalls;
+	prometheus::Histogram& xapiand_commit_delay;
+	prometheus::Histogram& xapiand_commit_duration;
+	prometheus::Counter& xapiand_storage_compaction_relocated;
+	prometheus::Counter& xapiand_storage_compaction_reclaimed;
+	prometheus::Gauge& xapiand_storage_compaction_pending;
+	prometheus::Counter& xapiand_shard_compaction_written;
+	prometheus::Counter& xapiand_shard_compaction_reclaimed;
+	prometheus::Counter& xapiand_storage_volumes_cache_hits;
+	prometheus::Counter& xapiand_storage_volumes_cache_misses;
+	prometheus::Counter& xapiand_storage_stored_cache_hits;
+	prometheus::Counter& xapiand_storage_stored_cache_misses;
 	prometheus::Gauge& xapiand_uptime;
 	prometheus::Gauge& xapiand_running;
 	prometheus::Gauge& xapiand_info;
@@ -128,4 +141,7 @@ public:
 	// databases:
 	prometheus::Gauge& xapiand_endpoints;
 	prometheus::Gauge& xapiand_databases;
+	prometheus::Gauge& xapiand_block_cache_hit_ratio;
+	prometheus::Gauge& xapiand_block_cache_memory_bytes;
+	prometheus::Gauge& xapiand_flush_pending_bytes;
 };
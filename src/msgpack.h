@@ -459,6 +459,7 @@ public:
 	friend msgpack::adaptor::pack<MsgPack>;
 	friend msgpack::adaptor::object<MsgPack>;
 	friend msgpack::adaptor::object_with_zone<MsgPack>;
+	friend class MsgPackView;
 };
 
 
@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>               // for std::size_t
+#include <string>                // for std::string
+#include <string_view>           // for std::string_view
+
+#include "exception.h"           // for THROW
+#include "msgpack.h"             // for MsgPack
+#include "nameof.hh"             // for NAMEOF_ENUM
+
+
+/*
+ * Read-only view of a MsgPack object.
+ *
+ * MsgPackView walks the msgpack::object nodes, which are already laid out
+ * contiguously in the zone the document was unpacked into, without creating
+ * MsgPack bodies, hash maps or reference counts. Map lookups are a linear
+ * scan, which is cheaper than hashing for the short objects documents are
+ * made of. Views never own the data: the MsgPack they were taken from must
+ * outlive them and must not be modified while they are in use. Use
+ * to_msgpack() to get a mutable copy when one is really needed.
+ */
+class MsgPackView {
+	const msgpack::object* _obj;
+
+	static const msgpack::object& _undefined() {
+		static const msgpack::object obj = [] {
+			msgpack::object o;
+			o.type = msgpack::type::EXT;
+			o.via.ext.ptr = ::undefined;
+			o.via.ext.size = 1;
+			return o;
+		}();
+		return obj;
+	}
+
+public:
+	class const_iterator {
+		friend MsgPackView;
+
+		const msgpack::object* _obj;
+		std::size_t _off;
+
+		const_iterator(const msgpack::object* obj, std::size_t off)
+			: _obj(obj),
+			  _off(off) { }
+
+	public:
+		const_iterator& operator++() {
+			++_off;
+			return *this;
+		}
+
+		// Keys for maps, items for arrays (same as MsgPack iterators).
+		MsgPackView operator*() const {
+			if (_obj->type == msgpack::type::MAP) {
+				return MsgPackView(&_obj->via.map.ptr[_off].key);
+			}
+			return MsgPackView(&_obj->via.array.ptr[_off]);
+		}
+
+		MsgPackView value() const {
+			if (_obj->type == msgpack::type::MAP) {
+				return MsgPackView(&_obj->via.map.ptr[_off].val);
+			}
+			return MsgPackView(&_obj->via.array.ptr[_off]);
+		}
+
+		bool operator==(const const_iterator& other) const {
+			return _obj == other._obj && _off == other._off;
+		}
+
+		bool operator!=(const const_iterator& other) const {
+			return !operator==(other);
+		}
+	};
+
+	explicit MsgPackView(const msgpack::object* obj)
+		: _obj(obj) { }
+
+	MsgPackView()
+		: _obj(&_undefined()) { }
+
+	MsgPackView(const MsgPack& obj)
+		: _obj(obj._const_body->_obj) { }
+
+	MsgPack::Type get_type() const noexcept {
+		return _obj->type == msgpack::type::EXT ? (MsgPack::Type)(_obj->via.ext.type() | MSGPACK_EXT_BEGIN) : (MsgPack::Type)_obj->type;
+	}
+
+	bool is_undefined() const noexcept {
+		return get_type() == MsgPack::Type::UNDEFINED;
+	}
+
+	bool is_null() const noexcept {
+		return _obj->type == msgpack::type::NIL;
+	}
+
+	bool is_map() const noexcept {
+		return _obj->type == msgpack::type::MAP;
+	}
+
+	bool is_array() const noexcept {
+		return _obj->type == msgpack::type::ARRAY;
+	}
+
+	bool is_string() const noexcept {
+		return _obj->type == msgpack::type::STR;
+	}
+
+	std::size_t size() const noexcept {
+		switch (_obj->type) {
+			case msgpack::type::MAP:
+				return _obj->via.map.size;
+			case msgpack::type::ARRAY:
+				return _obj->via.array.size;
+			case msgpack::type::STR:
+				return _obj->via.str.size;
+			default:
+				return 0;
+		}
+	}
+
+	bool empty() const noexcept {
+		return size() == 0;
+	}
+
+	const_iterator begin() const {
+		_check_iterable();
+		return const_iterator(_obj, 0);
+	}
+
+	const_iterator end() const {
+		_check_iterable();
+		return const_iterator(_obj, size());
+	}
+
+	const_iterator find(std::string_view key) const {
+		if (_obj->type != msgpack::type::MAP) {
+			THROW(msgpack::type_error, "{} is not a MAP", NAMEOF_ENUM(get_type()));
+		}
+		const auto pbeg = _obj->via.map.ptr;
+		const auto pend = &pbeg[_obj->via.map.size];
+		for (auto p = pbeg; p != pend; ++p) {
+			if (p->key.type == msgpack::type::STR && std::string_view(p->key.via.str.ptr, p->key.via.str.size) == key) {
+				return const_iterator(_obj, p - pbeg);
+			}
+		}
+		return const_iterator(_obj, _obj->via.map.size);
+	}
+
+	MsgPackView at(std::string_view key) const {
+		auto it = find(key);
+		if (it == end()) {
+			THROW(MsgPack::out_of_range, "Key {} not found in MAP", key);
+		}
+		return it.value();
+	}
+
+	MsgPackView at(std::size_t pos) const {
+		if (_obj->type != msgpack::type::ARRAY) {
+			THROW(msgpack::type_error, "{} is not an ARRAY", NAMEOF_ENUM(get_type()));
+		}
+		if (pos >= _obj->via.array.size) {
+			THROW(MsgPack::out_of_range, "Position {} is out of range in ARRAY", pos);
+		}
+		return MsgPackView(&_obj->via.array.ptr[pos]);
+	}
+
+	std::string_view str_view() const {
+		if (_obj->type == msgpack::type::STR) {
+			return std::string_view(_obj->via.str.ptr, _obj->via.str.size);
+		}
+		THROW(msgpack::type_error, "Value of {} is not a valid STR", NAMEOF_ENUM(get_type()));
+	}
+
+	std::string as_str() const {
+		if (_obj->type == msgpack::type::STR) {
+			return std::string(_obj->via.str.ptr, _obj->via.str.size);
+		}
+		return to_msgpack().as_str();
+	}
+
+	// Deep copy into a fresh zone owned by the returned (mutable) object.
+	MsgPack to_msgpack() const {
+		return MsgPack(*_obj);
+	}
+
+private:
+	void _check_iterable() const {
+		switch (get_type()) {
+			case MsgPack::Type::MAP:
+			case MsgPack::Type::ARRAY:
+			case MsgPack::Type::UNDEFINED:
+				return;
+			default:
+				THROW(msgpack::type_error, "{} is not iterable", NAMEOF_ENUM(get_type()));
+		}
+	}
+};
@@ -39,6 +39,16 @@
 #define XAPIAND_LOG_FILE         "xapiand.log"
 
 #define FLUSH_THRESHOLD          100000           // Database flush threshold (default for xapian is 10000)
+#define FLUSH_MEMORY             64               // MiB of changes a shard buffers before flushing
+#define FLUSH_MEMORY_TOTAL       512              // MiB of changes all shards buffer before flushing
+#define COMMIT_FRESHNESS         1000             // Milliseconds changes may wait to be committed
+#define STORAGE_SPARE_VOLUMES    1                // Number of preallocated storage volumes kept ready
+#define STORAGE_COMPACTION_THRESHOLD 0.5          // Live data ratio under which data storage volumes are compacted
+#define STORAGE_COMPACTION_RATE  16               // MiB per second relocated by the storage compactor
+#define SHARD_COMPACTION_RATE    16               // MiB per second written by shard compactions
+#define SHARD_FREEZE_IDLE        86400            // Seconds without commits after which shards are frozen
+#define STORED_CACHE_SIZE        64               // MiB of decompressed stored blobs cached
+#define BLOCK_CACHE_SIZE         128              // MiB of database blocks shared by readers
 #define NUM_SHARDS               5                // Default number of database shards per index
 #define NUM_REPLICAS             1                // Default number of database replicas per index
 
@@ -70,6 +80,13 @@
 #define NUM_ASYNC_WAL_WRITERS        0.5          // Number of database async WAL writers per CPU
 #define MAX_ASYNC_WAL_WRITERS         10
 
+#define WAL_BATCH_SIZE               100          // Maximum number of WAL writes grouped in a single commit
+#define WAL_BATCH_LINGER               0          // Microseconds WAL writers wait for more writes to group
+#define WAL_RETAINED_VOLUMES           0          // Number of WAL volumes kept (0 = all)
+
+#define NUM_WAL_REPLAYERS            1.0          // Number of threads decoding WAL lines during replay per CPU
+#define MAX_WAL_REPLAYERS             20
+
 #define NUM_DOC_PREPARERS            1.0          // Number of threads handling bulk documents preparing per CPU
 #define MAX_DOC_PREPARERS             10
 
@@ -100,6 +117,9 @@
 #define fallback(a, b) (a) ? (a) : (b)
 
 
+opts_t opts;
+
+
 unsigned int
 ev_backend(const std::string& name)
 {
@@ -227,6 +247,10 @@ parseOptions(int argc, char** argv)
 
 #if XAPIAND_DATABASE_WAL
 		ValueArg<std::size_t> num_async_wal_writers("", "writers", "Number of database async wal writers.", false, 0, "writers", cmd);
+		ValueArg<std::size_t> wal_batch_size("", "wal-batch-size", "Maximum number of WAL writes grouped in a single commit.", false, WAL_BATCH_SIZE, "size", cmd);
+		ValueArg<unsigned int> wal_batch_linger("", "wal-batch-linger", "Microseconds to wait for more WAL writes to group.", false, WAL_BATCH_LINGER, "microseconds", cmd);
+		ValueArg<std::size_t> wal_retained_volumes("", "wal-retained-volumes", "Number of WAL volumes kept, older volumes are recycled (0 = keep all).", false, WAL_RETAINED_VOLUMES, "volumes", cmd);
+		ValueArg<std::size_t> num_wal_replayers("", "wal-replayers", "Number of threads decoding WAL lines during replay.", false, 0, "threads", cmd);
 #endif
 #ifdef XAPIAND_CLUSTERING
 		ValueArg<std::size_t> num_replicas("", "replicas", "Default number of database replicas per index.", false, NUM_REPLICAS, "replicas", cmd);
@@ -249,6 +273,25 @@ parseOptions(int argc, char** argv)
 
 		ValueArg<std::size_t> max_files("", "max-files", "Maximum number of files to open.", false, 0, "files", cmd);
 		ValueArg<std::size_t> flush_threshold("", "flush-threshold", "Xapian flush threshold.", false, FLUSH_THRESHOLD, "threshold", cmd);
+		ValueArg<std::size_t> flush_memory("", "flush-memory", "MiB of buffered changes after which a shard gets flushed (0 = unlimited).", false, FLUSH_MEMORY, "MiB", cmd);
+		ValueArg<std::size_t> flush_memory_total("", "flush-memory-total", "MiB of buffered changes shared by all shards (0 = unlimited).", false, FLUSH_MEMORY_TOTAL, "MiB", cmd);
+		ValueArg<unsigned int> commit_freshness("", "commit-freshness", "Maximum milliseconds changes wait before being autocommitted.", false, COMMIT_FRESHNESS, "ms", cmd);
+		ValueArg<std::size_t> storage_spare_volumes("", "storage-spare-volumes", "Number of preallocated storage volumes kept ready.", false, STORAGE_SPARE_VOLUMES, "volumes", cmd);
+		ValueArg<double> storage_compaction_threshold("", "storage-compaction-threshold", "Compact data storage volumes with less than this ratio of live data (0 = never compact).", false, STORAGE_COMPACTION_THRESHOLD, "ratio", cmd);
+		ValueArg<std::size_t> storage_compaction_rate("", "storage-compaction-rate", "MiB per second of live data relocated by the storage compactor (0 = unthrottled).", false, STORAGE_COMPACTION_RATE, "MiB/s", cmd);
+		ValueArg<std::size_t> shard_compaction_rate("", "shard-compaction-rate", "MiB per second written by shard compactions (0 = unthrottled).", false, SHARD_COMPACTION_RATE, "MiB/s", cmd);
+		ValueArg<unsigned int> shard_freeze_idle("", "shard-freeze-idle", "Seconds without commits after which shards get a compact read-only honey copy (0 = never).", false, SHARD_FREEZE_IDLE, "seconds", cmd);
+		ValueArg<std::size_t> stored_cache_size("", "stored-cache-size", "MiB of decompressed stored blobs kept in memory (0 = no cache).", false, STORED_CACHE_SIZE, "MiB", cmd);
+		ValueArg<std::size_t> block_cache_size("", "block-cache-size", "MiB of database blocks cached and shared by all readers (0 = no cache).", false, BLOCK_CACHE_SIZE, "MiB", cmd);
+
+		std::vector<std::string> io_engine_allowed({
+			"sync",
+#ifdef HAVE_LINUX_IO_URING_H
+			"io_uring",
+#endif
+		});
+		ValuesConstraint<std::string> io_engine_constraint(io_engine_allowed);
+		ValueArg<std::string> io_engine("", "io-engine", "I/O engine used for storage writes (falls back to sync if unavailable).", false, "sync", &io_engine_constraint, cmd);
 
 #ifdef XAPIAND_CLUSTERING
 		ValueArg<std::size_t> num_remote_clients("", "remote-clients", "Number of remote protocol client threads.", false, 0, "threads", cmd);
@@ -444,6 +487,10 @@ parseOptions(int argc, char** argv)
 		o.resolver_cache_size = resolver_cache_size.getValue();
 #if XAPIAND_DATABASE_WAL
 		o.num_async_wal_writers = fallback(num_async_wal_writers.getValue(), std::min(MAX_ASYNC_WAL_WRITERS, static_cast<int>(std::ceil(NUM_ASYNC_WAL_WRITERS * o.processors))));
+		o.wal_batch_size = wal_batch_size.getValue();
+		o.wal_batch_linger = wal_batch_linger.getValue();
+		o.wal_retained_volumes = wal_retained_volumes.getValue();
+		o.num_wal_replayers = fallback(num_wal_replayers.getValue(), std::min(MAX_WAL_REPLAYERS, static_cast<int>(std::ceil(NUM_WAL_REPLAYERS * o.processors))));
 #endif
 #ifdef XAPIAND_CLUSTERING
 		o.num_shards = num_shards.getValue();
@@ -460,6 +507,17 @@ parseOptions(int argc, char** argv)
 		o.max_database_readers = max_database_readers.getValue();
 		o.max_files = max_files.getValue();
 		o.flush_threshold = flush_threshold.getValue();
+		o.flush_memory = flush_memory.getValue();
+		o.flush_memory_total = flush_memory_total.getValue();
+		o.commit_freshness = commit_freshness.getValue();
+		o.storage_spare_volumes = storage_spare_volumes.getValue();
+		o.storage_compaction_threshold = storage_compaction_threshold.getValue();
+		o.storage_compaction_rate = storage_compaction_rate.getValue();
+		o.shard_compaction_rate = shard_compaction_rate.getValue();
+		o.shard_freeze_idle = shard_freeze_idle.getValue();
+		o.stored_cache_size = stored_cache_size.getValue();
+		o.block_cache_size = block_cache_size.getValue();
+		o.io_uring = io_engine.getValue() == "io_uring";
 		o.num_http_clients = fallback(num_http_clients.getValue(), std::min(MAX_HTTP_CLIENTS, static_cast<int>(std::ceil(NUM_HTTP_CLIENTS * o.processors))));
 		o.num_http_servers = fallback(num_http_servers.getValue(), std::min(MAX_HTTP_SERVERS, static_cast<int>(std::ceil(NUM_HTTP_SERVERS * o.processors))));
 #ifdef XAPIAND_CLUSTERING
@@ -63,6 +63,10 @@ extern struct opts_t {
 	ssize_t num_replication_servers = 1;
 	ssize_t num_replication_clients = 1;
 	ssize_t num_async_wal_writers = 1;
+	size_t wal_batch_size = 1;
+	unsigned int wal_batch_linger = 0;
+	size_t wal_retained_volumes = 0;
+	ssize_t num_wal_replayers = 1;
 	ssize_t num_doc_preparers = 1;
 	ssize_t num_doc_indexers = 1;
 	ssize_t num_committers = 1;
@@ -79,6 +83,17 @@ extern struct opts_t {
 	size_t num_shards = 1;
 	size_t num_replicas = 0;
 	int flush_threshold = 100000;
+	size_t flush_memory = 0;
+	size_t flush_memory_total = 0;
+	unsigned int commit_freshness = 0;
+	size_t storage_spare_volumes = 0;
+	double storage_compaction_threshold = 0.0;
+	size_t storage_compaction_rate = 0;
+	size_t shard_compaction_rate = 0;
+	unsigned int shard_freeze_idle = 0;
+	size_t stored_cache_size = 0;
+	size_t block_cache_size = 0;
+	bool io_uring = false;
 	unsigned int ev_flags = 0;
 	bool uuid_compact = false;
 	uint32_t uuid_repr = 0;
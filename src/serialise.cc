@@ -140,6 +140,74 @@ Serialise::isUUID(std::string_view field_value) noexcept
 }
 
 
+std::uint8_t
+Serialise::str_candidates(std::string_view field_value) noexcept
+{
+	auto size = field_value.size();
+	if (size == 0) {
+		return 0;
+	}
+
+	// Branchless (so it gets vectorized) scan for the characters the
+	// UUID and EWKT checks would otherwise search the string for.
+	bool separator = false;
+	bool delimiter = false;
+	for (size_t i = 0; i < size; ++i) {
+		const auto c = field_value[i];
+		separator |= c == UUID_SEPARATOR_LIST;
+		delimiter |= (c == '(') | (c == ' ');
+	}
+
+	std::uint8_t candidates = 0;
+
+	if (size > 2) {
+		if (separator) {
+			candidates |= STR_UUID;
+		} else {
+			auto uuid = field_value;
+			if (uuid.front() == '{' && uuid.back() == '}') {
+				uuid = uuid.substr(1, size - 2);
+			} else if (uuid.compare(0, 9, "urn:uuid:") == 0) {
+				uuid = uuid.substr(9);
+			}
+			if (uuid.empty() || uuid.size() == UUID_LENGTH || uuid.front() == '~') {
+				candidates |= STR_UUID;
+			}
+		}
+	}
+
+	if (size == 10 && field_value[4] == '-' && field_value[7] == '-') {
+		candidates |= STR_DATE;
+	}
+
+	if (size >= 8) {
+		switch (field_value[4]) {
+			case '-':
+			case '/':
+			case ' ':
+			case '0':
+			case '1':
+				candidates |= STR_DATETIME;
+				break;
+		}
+	}
+
+	if (size >= 5 && chars::is_digit(field_value[0]) && field_value[2] == ':') {
+		candidates |= STR_TIME;
+	}
+
+	if (size >= 6 && (field_value[0] == '+' || field_value[0] == '-') && field_value[3] == ':') {
+		candidates |= STR_TIMEDELTA;
+	}
+
+	if (delimiter) {
+		candidates |= STR_GEO;
+	}
+
+	return candidates;
+}
+
+
 std::string
 Serialise::MsgPack(const required_spc_t& field_spc, const class MsgPack& field_value)
 {
@@ -801,28 +869,29 @@ Serialise::guess_type(const class MsgPack& field_value)
 
 		case MsgPack::Type::STR: {
 			const auto str_value = field_value.str_view();
+			const auto candidates = str_candidates(str_value);
 
-			if (isUUID(str_value)) {
+			if ((candidates & STR_UUID) && isUUID(str_value)) {
 				return FieldType::uuid;
 			}
 
-			if (Datetime::isDate(str_value)) {
+			if ((candidates & STR_DATE) && Datetime::isDate(str_value)) {
 				return FieldType::date;
 			}
 
-			if (Datetime::isDatetime(str_value)) {
+			if ((candidates & STR_DATETIME) && Datetime::isDatetime(str_value)) {
 				return FieldType::datetime;
 			}
 
-			if (Datetime::isTime(str_value)) {
+			if ((candidates & STR_TIME) && Datetime::isTime(str_value)) {
 				return FieldType::time;
 			}
 
-			if (Datetime::isTimedelta(str_value)) {
+			if ((candidates & STR_TIMEDELTA) && Datetime::isTimedelta(str_value)) {
 				return FieldType::timedelta;
 			}
 
-			if (EWKT::isEWKT(str_value)) {
+			if ((candidates & STR_GEO) && EWKT::isEWKT(str_value)) {
 				return FieldType::geo;
 			}
 
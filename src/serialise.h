@@ -95,6 +95,19 @@ namespace Serialise {
 	bool possiblyUUID(std::string_view field_value) noexcept;
 	bool isUUID(std::string_view field_value) noexcept;
 
+	// Types a string could be detected as.
+	enum StrCandidate : std::uint8_t {
+		STR_UUID       = 1 << 0,
+		STR_DATE       = 1 << 1,
+		STR_DATETIME   = 1 << 2,
+		STR_TIME       = 1 << 3,
+		STR_TIMEDELTA  = 1 << 4,
+		STR_GEO        = 1 << 5,
+	};
+
+	// Returns the StrCandidate types field_value is not ruled out from, in a single scan.
+	std::uint8_t str_candidates(std::string_view field_value) noexcept;
+
 
 	/*
 	 * Serialise field_value according to field_spc.
@@ -125,6 +125,7 @@ static const std::string eol("\r\n");
 	OPTION(CHECK,    "check") \
 	OPTION(CLOSE,    "close") \
 	OPTION(COMMIT,   "commit") \
+	OPTION(COMPACT,  "compact") \
 	OPTION(COPY,     "copy") \
 	OPTION(COUNT,    "count") \
 	OPTION(DUMP,     "dump") \
@@ -1089,6 +1090,30 @@ HttpClient::prepare()
 			}
 			break;
 
+		case HTTP_COMPACT:
+			if (id.empty()) {
+				new_request->view = &HttpClient::compact_database_view;
+			} else {
+				write_status_response(*new_request, HTTP_STATUS_METHOD_NOT_ALLOWED);
+			}
+			break;
+
+		case HTTP_OPEN:
+			if (id.empty()) {
+				new_request->view = &HttpClient::open_database_view;
+			} else {
+				write_status_response(*new_request, HTTP_STATUS_METHOD_NOT_ALLOWED);
+			}
+			break;
+
+		case HTTP_CLOSE:
+			if (id.empty()) {
+				new_request->view = &HttpClient::close_database_view;
+			} else {
+				write_status_response(*new_request, HTTP_STATUS_METHOD_NOT_ALLOWED);
+			}
+			break;
+
 		case HTTP_DUMP:
 			if (id.empty()) {
 				new_request->view = &HttpClient::dump_database_view;
@@ -1436,7 +1461,35 @@ HttpClient::write_document_view(Request& request)
 	request.processing = std::chrono::system_clock::now();
 
 	DatabaseHandler db_handler(endpoints, DB_WRITABLE | DB_CREATE_OR_OPEN);
-	auto indexed = db_handler.index(document_id, query_field.version, false, decoded_body, query_field.commit, request.ct_type);
+	DataType indexed;
+	if (query_field.async && !document_id.empty() && !query_field.version && !query_field.commit) {
+		// Acknowledged once the document is in the WAL, with the revision
+		// reads can wait for (see retrieve_document_view).
+		auto deferred = db_handler.index_async(document_id, false, decoded_body, request.ct_type);
+		auto revision = std::get<0>(deferred);
+		if (revision) {
+			request.ready = std::chrono::system_clock::now();
+
+			write_http_response(request, HTTP_STATUS_ACCEPTED, MsgPack({
+				{ ID_FIELD_NAME, document_id },
+				{ RESPONSE_REVISION, revision },
+			}));
+
+			auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(request.ready - request.processing).count();
+			L_TIME("Indexing (async) took {}", string::from_delta(took));
+
+			Metrics::metrics()
+				.xapiand_operations_summary
+				.Add({
+					{"operation", "index_async"},
+				})
+				.Observe(took / 1e9);
+			return;
+		}
+		indexed = std::make_pair(std::get<1>(deferred), std::move(std::get<2>(deferred)));
+	} else {
+		indexed = db_handler.index(document_id, query_field.version, false, decoded_body, query_field.commit, request.ct_type);
+	}
 
 	request.ready = std::chrono::system_clock::now();
 
@@ -2082,6 +2135,98 @@ HttpClient::commit_database_view(Request& request)
 }
 
 
+void
+HttpClient::compact_database_view(Request& request)
+{
+	L_CALL("HttpClient::compact_database_view()");
+
+	auto query_field = query_field_maker(request, QUERY_FIELD_PRIMARY);
+	resolve_index_endpoints(request, query_field);
+
+	request.processing = std::chrono::system_clock::now();
+
+	DatabaseHandler db_handler{endpoints};
+
+	auto status = db_handler.compact();
+
+	request.ready = std::chrono::system_clock::now();
+
+	write_http_response(request, HTTP_STATUS_OK, status);
+
+	auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(request.ready - request.processing).count();
+	L_TIME("Database compaction took {}", string::from_delta(took));
+
+	Metrics::metrics()
+		.xapiand_operations_summary
+		.Add({
+			{"operation", "db_compact"},
+		})
+		.Observe(took / 1e9);
+}
+
+
+void
+HttpClient::open_database_view(Request& request)
+{
+	L_CALL("HttpClient::open_database_view()");
+
+	auto query_field = query_field_maker(request, QUERY_FIELD_PRIMARY);
+	resolve_index_endpoints(request, query_field);
+
+	request.processing = std::chrono::system_clock::now();
+
+	// Opens a bulk load session
+	DatabaseHandler db_handler{endpoints};
+
+	auto status = db_handler.open_bulk_load();
+
+	request.ready = std::chrono::system_clock::now();
+
+	write_http_response(request, HTTP_STATUS_OK, status);
+
+	auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(request.ready - request.processing).count();
+	L_TIME("Opening bulk load took {}", string::from_delta(took));
+
+	Metrics::metrics()
+		.xapiand_operations_summary
+		.Add({
+			{"operation", "db_open"},
+		})
+		.Observe(took / 1e9);
+}
+
+
+void
+HttpClient::close_database_view(Request& request)
+{
+	L_CALL("HttpClient::close_database_view()");
+
+	auto query_field = query_field_maker(request, QUERY_FIELD_PRIMARY);
+	resolve_index_endpoints(request, query_field);
+
+	request.processing = std::chrono::system_clock::now();
+
+	// Closes the bulk load session, committing what was loaded
+	DatabaseHandler db_handler{endpoints};
+
+	auto status = db_handler.close_bulk_load();
+
+	request.ready = std::chrono::system_clock::now();
+
+	write_http_response(request, HTTP_STATUS_OK, status);
+
+	auto took = std::chrono::duration_cast<std::chrono::nanoseconds>(request.ready - request.processing).count();
+	L_TIME("Closing bulk load took {}", string::from_delta(took));
+
+	Metrics::metrics()
+		.xapiand_operations_summary
+		.Add({
+			{"operation", "db_close"},
+		})
+		.Observe(took / 1e9);
+}
+
+
 void
 HttpClient::dump_document_view(Request& request)
 {
@@ -2364,6 +2509,10 @@ HttpClient::retrieve_document_view(Request& request)
 		db_handler.reset(endpoints, DB_OPEN);
 	}
 
+	if (query_field.revision) {
+		db_handler.wait_revision(id, query_field.revision);
+	}
+
 	// Retrive document ID
 	Xapian::docid did;
 	did = db_handler.get_docid(id);
@@ -2870,6 +3019,16 @@ HttpClient::query_field_maker(Request& request, int flags)
 		if (request.query_parser.next("version") != -1) {
 			query_field.version = strict_stou(nullptr, request.query_parser.get());
 		}
+
+		request.query_parser.rewind();
+		if (request.query_parser.next("async") != -1) {
+			query_field.async = true;
+			if (request.query_parser.len != 0u) {
+				try {
+					query_field.async = Serialise::boolean(request.query_parser.get()) == "t";
+				} catch (const Exception&) { }
+			}
+		}
 	}
 
 	if ((flags & QUERY_FIELD_VOLATILE) != 0) {
@@ -2901,6 +3060,13 @@ HttpClient::query_field_maker(Request& request, int flags)
 		}
 	}
 
+	if ((flags & QUERY_FIELD_ID) != 0) {
+		request.query_parser.rewind();
+		if (request.query_parser.next("revision") != -1) {
+			query_field.revision = strict_stou(nullptr, request.query_parser.get());
+		}
+	}
+
 	if ((flags & QUERY_FIELD_SEARCH) != 0) {
 		request.query_parser.rewind();
 		if (request.query_parser.next("spelling") != -1) {
@@ -3934,7 +4100,8 @@ Request::to_text(bool decode)
 			request_text_color = _request_text_color.c_str();
 			break;
 		}
-		case HTTP_COMMIT: {
+		case HTTP_COMMIT:
+		case HTTP_COMPACT: {
 			// rgb(250, 160, 63)
 			static constexpr auto _request_headers_color = rgba(158, 95, 28, 0.6);
 			request_headers_color = _request_headers_color.c_str();
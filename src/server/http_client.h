@@ -329,6 +329,9 @@ class HttpClient : public MetaBaseClient<HttpClient> {
 
 	void check_database_view(Request& request);
 	void commit_database_view(Request& request);
+	void compact_database_view(Request& request);
+	void open_database_view(Request& request);
+	void close_database_view(Request& request);
 
 	void search_view(Request& request);
 	void count_view(Request& request);
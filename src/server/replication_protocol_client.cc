@@ -45,6 +45,7 @@
 #include "tcp.h"                              // for TCP::connect
 #include "random.hh"                          // for random_int
 #include "repr.hh"                            // for repr
+#include "storage.h"                          // for storage_volumes
 #include "utype.hh"                           // for toUType
 #include "xapian/net/serialise-error.h"       // for serialise_error, unserialise_error
 
@@ -186,7 +187,7 @@ ReplicationProtocolClient::init_replication_protocol(const Endpoint &src_endpoin
 
 
 void
-ReplicationProtocolClient::send_message(ReplicationReplyType type, const std::string& message)
+ReplicationProtocolClient::send_message(ReplicationReplyType type, std::string_view message)
 {
 	L_CALL("ReplicationProtocolClient::send_message({}, <message>)", NAMEOF_ENUM(type));
 
@@ -286,7 +287,18 @@ ReplicationProtocolClient::msg_get_changesets(const std::string& message)
 
 	lock_shard lk_shard(Endpoint{endpoint_path}, DB_WRITABLE, false);
 
-	db = lk_shard.lock()->db();
+	auto shard = lk_shard.lock();
+	if (shard->endpoint.is_bulk_loading()) {
+		// Replicas catch up once the bulk load is over
+		lk_shard.unlock();
+		send_message(ReplicationReplyType::REPLY_FAIL, "Database is being bulk loaded");
+
+		auto ends = std::chrono::system_clock::now();
+		_total_sent_bytes = total_sent_bytes - _total_sent_bytes;
+		L(LOG_NOTICE, rgba(190, 30, 10, 0.6), "MSG_GET_CHANGESETS {} {{db:{}, rev:{}}} -> FAILURE {} {}", repr(endpoint_path), remote_uuid, remote_revision, string::from_bytes(_total_sent_bytes), string::from_delta(begins, ends));
+		return;
+	}
+	db = shard->db();
 	auto uuid = db->get_uuid();
 	auto db_revision = db->get_revision();
 	lk_shard.unlock();
@@ -297,6 +309,8 @@ ReplicationProtocolClient::msg_get_changesets(const std::string& message)
 	}
 
 	wal = std::make_unique<DatabaseWAL>(endpoint_path);
+	// Keep the volumes the replica is catching up from until it's done
+	wal->retain(from_revision);
 	if (from_revision && wal->locate_revision(from_revision).first == DatabaseWAL::max_rev) {
 		from_revision = 0;
 	}
@@ -332,16 +346,15 @@ ReplicationProtocolClient::msg_get_changesets(const std::string& message)
 					}
 				}
 
-				for (size_t volume = 0; true; ++volume) {
+				// Compacted data storage volumes leave gaps in the numbering
+				for (auto volume : storage_volumes(endpoint_path, "docdata.")) {
 					auto filename = string::format("docdata.{}", volume);
 					auto path = string::format("{}/{}", endpoint_path, filename);
 					int fd = io::open(path.c_str());
 					if (fd != -1) {
 						send_message(ReplicationReplyType::REPLY_DB_FILENAME, filename);
 						send_file(ReplicationReplyType::REPLY_DB_FILEDATA, fd);
-						continue;
 					}
-					break;
 				}
 
 				db = lk_shard.lock()->db();
@@ -352,10 +365,12 @@ ReplicationProtocolClient::msg_get_changesets(const std::string& message)
 
 				if (db_revision == final_revision) {
 					to_revision = db_revision;
+					wal->retain(to_revision);
 					break;
 				}
 
 				if (whole_db_copies_left == 0) {
+					wal->retain(DatabaseWAL::max_rev);
 					send_message(ReplicationReplyType::REPLY_FAIL, "Database changing too fast");
 
 					auto ends = std::chrono::system_clock::now();
@@ -379,7 +394,8 @@ ReplicationProtocolClient::msg_get_changesets(const std::string& message)
 		int wal_iterations = 5;
 		do {
 			// Send WAL operations.
-			std::vector<std::string> reply_changesets;
+			// Lines are views into the WAL volume, valid while the iterator is
+			std::vector<std::string_view> reply_changesets;
 			for (auto wal_it = wal->find(to_revision); wal_it != wal->end(); ++wal_it) {
 				auto& line = *wal_it;
 				const char *lp = line.data();
@@ -396,8 +412,9 @@ ReplicationProtocolClient::msg_get_changesets(const std::string& message)
 					send_message(ReplicationReplyType::REPLY_CHANGESET, line);
 					reply_changesets.clear();
 					++to_revision;
+					wal->retain(to_revision);
 				} else {
-					reply_changesets.push_back(std::move(line));
+					reply_changesets.push_back(line);
 				}
 			}
 			db = lk_shard.lock()->db();
@@ -406,6 +423,8 @@ ReplicationProtocolClient::msg_get_changesets(const std::string& message)
 		} while (to_revision < db_revision && --wal_iterations != 0);
 	}
 
+	wal->retain(DatabaseWAL::max_rev);
+
 	send_message(ReplicationReplyType::REPLY_END_OF_CHANGES, "");
 
 	auto ends = std::chrono::system_clock::now();
@@ -531,6 +550,7 @@ ReplicationProtocolClient::reply_end_of_changes(const std::string&)
 
 		// Now we are sure no readers are using the database before moving the files
 		delete_files(shard->endpoint.path, {"*glass", "wal.*"});
+		shard->thaw();
 		move_files(switch_shard_path, shard->endpoint.path);
 
 		// release exclusive lock
@@ -943,7 +963,7 @@ ReplicationProtocolClient::get_message(std::string &result, char max_type)
 
 
 void
-ReplicationProtocolClient::send_message(char type_as_char, const std::string &message)
+ReplicationProtocolClient::send_message(char type_as_char, std::string_view message)
 {
 	L_CALL("ReplicationProtocolClient::send_message(<type_as_char>, <message>)");
 
@@ -30,6 +30,7 @@
 #include <memory>                           // for shared_ptr
 #include <mutex>                            // for std::mutex
 #include <string>                           // for std::string
+#include <string_view>                      // for std::string_view
 #include <vector>                           // for std::vector
 
 #include "base_client.h"                    // for MetaBaseClient
@@ -140,7 +141,7 @@ public:
 
 	bool init_replication_protocol(const Endpoint &src_endpoint, const Endpoint &dst_endpoint) noexcept;
 
-	void send_message(ReplicationReplyType type, const std::string& message);
+	void send_message(ReplicationReplyType type, std::string_view message);
 	void send_file(ReplicationReplyType type, int fd);
 
 	void replication_server(ReplicationMessageType type, const std::string& message);
@@ -158,7 +159,7 @@ public:
 	void reply_changeset(const std::string& message);
 
 	char get_message(std::string &result, char max_type);
-	void send_message(char type_as_char, const std::string& message);
+	void send_message(char type_as_char, std::string_view message);
 	void send_file(char type_as_char, int fd);
 
 	bool init_replication() noexcept;
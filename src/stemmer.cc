@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "stemmer.h"
+
+#include <cstdint>                                // for std::uint32_t
+#include <unordered_map>                          // for std::unordered_map
+
+#include "hashes.hh"                              // for fnv1ah32
+
+
+MemoStemmer::MemoStemmer(const std::string& language, std::size_t max_size)
+	: stemmer(language),
+	  stems(max_size)
+{
+}
+
+
+std::string
+MemoStemmer::operator()(const std::string& word)
+{
+	auto it = stems.find(word);
+	if (it != stems.end()) {
+		return it->second;
+	}
+	auto stem = stemmer(word);
+	stems.emplace(word, stem);
+	return stem;
+}
+
+
+std::string
+MemoStemmer::get_description() const
+{
+	return "MemoStemmer(" + stemmer.get_description() + ")";
+}
+
+
+const Xapian::Stem&
+getStemmer(std::string_view language)
+{
+	static thread_local std::unordered_map<std::uint32_t, Xapian::Stem> stemmers;
+	auto language_hash = hh(language);
+	auto it = stemmers.find(language_hash);
+	if (it != stemmers.end()) {
+		return it->second;
+	}
+	Xapian::Stem stemmer(new MemoStemmer(std::string(language)));
+	return stemmers.emplace(language_hash, std::move(stemmer)).first->second;
+}
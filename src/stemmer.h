@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>                 // for std::size_t
+#include <string>                  // for std::string
+#include <string_view>             // for std::string_view
+
+#include "lru.h"                   // for lru::LRU
+#include "xapian.h"                // for Xapian::Stem, Xapian::StemImplementation
+
+
+#define STEMMER_MEMO_SIZE 10000
+
+
+// Stemmer remembering the stems of the most recently stemmed words,
+// vocabularies are very repetitive and stemming each word is expensive.
+class MemoStemmer : public Xapian::StemImplementation {
+	Xapian::Stem stemmer;
+	lru::LRU<std::string, std::string> stems;
+
+public:
+	MemoStemmer(const std::string& language, std::size_t max_size = STEMMER_MEMO_SIZE);
+
+	std::string operator()(const std::string& word) override;
+
+	std::string get_description() const override;
+};
+
+// Stemmers aren't thread safe, so each thread gets its own (memoizing) stemmer.
+const Xapian::Stem& getStemmer(std::string_view language);
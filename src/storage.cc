@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "storage.h"
+
+#include <fcntl.h>                  // for O_RDWR, O_CREAT, O_EXCL
+#include <mutex>                    // for std::mutex, std::lock_guard
+#include <stdio.h>                  // for rename
+#include <unistd.h>                 // for link
+#include <unordered_map>            // for std::unordered_map
+
+#include "metrics.h"                // for Metrics::metrics
+#include "string.hh"                // for string::format
+
+
+#define L_STORAGE L_NOTHING
+
+
+// #undef L_DEBUG
+// #define L_DEBUG L_GREY
+// #undef L_CALL
+// #define L_CALL L_STACKED_DIM_GREY
+// #undef L_STORAGE
+// #define L_STORAGE L_SLATE_GREY
+
+
+std::string
+storage_spare_prefix(std::string_view base_path, std::string_view relative_path)
+{
+	// Spare volumes for "wal.123" are named "spare.wal.0", "spare.wal.1"...
+	auto pattern = relative_path.substr(0, relative_path.find_last_of('.') + 1);
+	return string::format("{}" STORAGE_SPARE_PATH "{}", base_path, pattern);
+}
+
+
+bool
+storage_take_spare_volume(std::string_view base_path, std::string_view relative_path)
+{
+	L_CALL("storage_take_spare_volume({}, {})", repr(base_path), repr(relative_path));
+
+	auto spare_prefix = storage_spare_prefix(base_path, relative_path);
+	auto path = string::format("{}{}", base_path, relative_path);
+	for (size_t idx = 0; idx < opts.storage_spare_volumes; ++idx) {
+		auto spare_path = string::format("{}{}", spare_prefix, idx);
+		if (::rename(spare_path.c_str(), path.c_str()) == 0) {
+			L_STORAGE("Spare volume {} taken as {}", repr(spare_path), repr(path));
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void
+storage_prepare_spare_volumes(const std::string& spare_prefix)
+{
+	L_CALL("storage_prepare_spare_volumes({})", repr(spare_prefix));
+
+	for (size_t idx = 0; idx < opts.storage_spare_volumes; ++idx) {
+		auto spare_path = string::format("{}{}", spare_prefix, idx);
+		int fd = io::open(spare_path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (fd == -1) {
+			// Either the spare volume is already there or the directory is gone
+			continue;
+		}
+		if unlikely(io::fallocate(fd, 0, 0, STORAGE_SPARE_SIZE) == -1) {
+			L_WARNING_ONCE("Cannot preallocate spare volume: {} ({}): {}", error::name(errno), errno, error::description(errno));
+			io::close(fd);
+			io::unlink(spare_path.c_str());
+			return;
+		}
+		io::close(fd);
+		L_STORAGE("Spare volume {} preallocated", repr(spare_path));
+	}
+}
+
+
+static std::mutex storage_pins_mtx;
+static std::unordered_map<std::string, size_t> storage_pins;
+
+
+void
+storage_pin_volume(const std::string& path)
+{
+	L_CALL("storage_pin_volume({})", repr(path));
+
+	std::lock_guard<std::mutex> lk(storage_pins_mtx);
+	++storage_pins[path];
+}
+
+
+void
+storage_unpin_volume(const std::string& path)
+{
+	L_CALL("storage_unpin_volume({})", repr(path));
+
+	std::lock_guard<std::mutex> lk(storage_pins_mtx);
+	auto it = storage_pins.find(path);
+	if (it != storage_pins.end() && --it->second == 0) {
+		storage_pins.erase(it);
+	}
+}
+
+
+void
+storage_retire_volume(std::string_view base_path, std::string_view relative_path, bool recycle)
+{
+	L_CALL("storage_retire_volume({}, {}, {})", repr(base_path), repr(relative_path), recycle);
+
+	auto spare_prefix = storage_spare_prefix(base_path, relative_path);
+	auto path = string::format("{}{}", base_path, relative_path);
+
+	// Pins are taken under the same lock, so a volume can't get mapped
+	// between the check and the unlink below.
+	std::lock_guard<std::mutex> lk(storage_pins_mtx);
+	if (storage_pins.find(path) != storage_pins.end()) {
+		L_STORAGE("Volume {} is still mapped, not recycled", repr(path));
+		io::unlink(path.c_str());
+		return;
+	}
+	for (size_t idx = 0; recycle && idx < opts.storage_spare_volumes; ++idx) {
+		auto spare_path = string::format("{}{}", spare_prefix, idx);
+		// link() never replaces an existing spare volume
+		if (::link(path.c_str(), spare_path.c_str()) == 0) {
+			L_STORAGE("Volume {} recycled as {}", repr(path), repr(spare_path));
+			break;
+		}
+	}
+	io::unlink(path.c_str());
+}
+
+
+std::vector<unsigned long long>
+storage_volumes(std::string_view base_path, std::string_view pattern)
+{
+	L_CALL("storage_volumes({}, {})", repr(base_path), repr(pattern));
+
+	DIR *dir = opendir(base_path, false);
+	if (dir == nullptr) {
+		L_DEBUG("Could not open the directory {}: {} ({}): {}", repr(base_path), error::name(errno), errno, error::description(errno));
+		throw Xapian::DatabaseNotFoundError("Couldn't open storage file");
+	}
+
+	std::vector<unsigned long long> volumes;
+
+	File_ptr fptr;
+	find_file_dir(dir, fptr, pattern, true);
+
+	while (fptr.ent != nullptr) {
+		std::string_view filename(fptr.ent->d_name);
+		auto found = filename.find_last_of(".");
+		if (found != std::string_view::npos) {
+			int errno_save;
+			unsigned long long file_volume = static_cast<unsigned long long>(strict_stoull(&errno_save, filename.substr(found + 1)));
+			if (errno_save == 0) {
+				volumes.push_back(file_volume);
+			}
+		}
+
+		find_file_dir(dir, fptr, pattern, true);
+	}
+
+	closedir(dir);
+
+	std::sort(volumes.begin(), volumes.end());
+
+	return volumes;
+}
+
+
+void
+storage_allocation_stall(std::chrono::steady_clock::time_point start)
+{
+	auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start);
+	Metrics::metrics()
+		.xapiand_storage_allocation_stalls
+		.Observe(elapsed.count());
+}
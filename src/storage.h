@@ -22,12 +22,17 @@
 
 #pragma once
 
+#include <algorithm>             // for std::sort
 #include <chrono>                // for std::chrono
 #include <errno.h>               // for errno
 #include <limits>                // for std::numeric_limits
 #include <memory>
+#include <string>                // for std::string
 #include <string_view>           // for std::string_view
+#include <sys/mman.h>            // for mmap, munmap, madvise
+#include <sys/stat.h>            // for fstat, stat
 #include <unistd.h>
+#include <vector>                // for std::vector
 
 #include "cassert.h"             // for ASSERT
 #include "compressor_lz4.h"      // for LZ4CompressFile, LZ4CompressData, LZ4...
@@ -35,6 +40,7 @@
 #include "fs.hh"                 // for opendir, find_file_dir, closedir
 #include "error.hh"              // for error:name, error::description
 #include "io.hh"                 // for io::*
+#include "io_uring.hh"           // for io::Uring
 #include "likely.h"              // for likely, unlikely
 #include "logger.h"
 #include "opts.h"                // for opts::*
@@ -62,6 +68,10 @@
 #define STORAGE_BLOCKS_GROWTH_FACTOR 1.3f
 #define STORAGE_BLOCKS_MIN_FREE 4
 
+#define STORAGE_EXTENT_SIZE (1024 * 1024)  // Files are grown in aligned extents of this size
+#define STORAGE_SPARE_PATH "spare."
+#define STORAGE_SPARE_SIZE (8 * STORAGE_EXTENT_SIZE)
+
 #define STORAGE_LAST_BLOCK_OFFSET (static_cast<off_t>(std::numeric_limits<uint32_t>::max()) * STORAGE_ALIGNMENT)
 
 #define STORAGE_START_BLOCK_OFFSET (STORAGE_BLOCK_SIZE / STORAGE_ALIGNMENT)
@@ -77,6 +87,9 @@ constexpr int STORAGE_ASYNC_SYNC       = 0x04;  // fsync (or full_fsync) is asyn
 constexpr int STORAGE_FULL_SYNC        = 0x08;  // Try to ensure changes are really written to disk.
 constexpr int STORAGE_NO_SYNC          = 0x10;  // Don't attempt to ensure changes have hit disk.
 constexpr int STORAGE_COMPRESS         = 0x20;  // Compress data in storage.
+constexpr int STORAGE_DEFERRED_WRITE   = 0x40;  // Partially filled blocks are written on commit.
+constexpr int STORAGE_PREALLOCATE      = 0x80;  // New volumes are taken from preallocated spare volumes.
+constexpr int STORAGE_MMAP             = 0x100; // Read only storage is memory mapped, bins can be read without copying.
 
 constexpr int STORAGE_FLAG_COMPRESSED  = 0x01;
 constexpr int STORAGE_FLAG_DELETED     = 0x02;
@@ -158,6 +171,36 @@ inline auto& fsyncher(bool create = true) {
 }
 
 
+/*
+ * Spare volumes are files preallocated in the background (or retired volumes
+ * being recycled) which get renamed into place when a new volume is created,
+ * so writers don't have to wait for the file system to allocate them.
+ */
+std::string storage_spare_prefix(std::string_view base_path, std::string_view relative_path);
+bool storage_take_spare_volume(std::string_view base_path, std::string_view relative_path);
+void storage_prepare_spare_volumes(const std::string& spare_prefix);
+void storage_retire_volume(std::string_view base_path, std::string_view relative_path, bool recycle = true);
+std::vector<unsigned long long> storage_volumes(std::string_view base_path, std::string_view pattern);
+void storage_allocation_stall(std::chrono::steady_clock::time_point start);
+
+/*
+ * Volumes memory mapped by readers are pinned. Retiring a pinned volume only
+ * unlinks it (its blocks are released once the last reader unmaps it), it's
+ * never recycled as a spare volume that could be overwritten under readers.
+ */
+void storage_pin_volume(const std::string& path);
+void storage_unpin_volume(const std::string& path);
+
+
+inline auto& volume_preallocator(bool create = true) {
+	static auto volume_preallocator = create ? make_unique_debouncer<std::string, 1000, 100, 500, 1000, ThreadPolicyType::fsynchers>("SV--", "SV{:02}", 1, [] (const std::string& spare_prefix) {
+		storage_prepare_spare_volumes(spare_prefix);
+	}) : nullptr;
+	ASSERT(!create || volume_preallocator);
+	return volume_preallocator;
+}
+
+
 struct StorageHeader {
 	struct StorageHeaderHead {
 		// uint32_t magic;
@@ -235,11 +278,15 @@ class Storage {
 	std::string path;
 	int flags;
 	int fd;
+	std::unique_ptr<io::Uring> uring;
 
 	int free_blocks;
 
+	// With io_uring blocks are written straight from these buffers, a third
+	// one lets filling the next block overlap with writing the previous one.
 	char buffer0[STORAGE_BLOCK_SIZE];
 	char buffer1[STORAGE_BLOCK_SIZE];
+	char buffer2[STORAGE_BLOCK_SIZE];
 	char* buffer_curr;
 	uint32_t buffer_offset;
 
@@ -251,6 +298,7 @@ class Storage {
 
 	LZ4CompressData cmpData;
 	LZ4CompressData::iterator cmpData_it;
+	std::shared_ptr<const LZ4Dictionary> dictionary;
 
 	LZ4CompressFile cmpFile;
 	LZ4CompressFile::iterator cmpFile_it;
@@ -258,6 +306,11 @@ class Storage {
 	LZ4DecompressFile decFile;
 	LZ4DecompressFile::iterator decFile_it;
 
+	char* mmap_data;
+	size_t mmap_size;
+	bool mmap_pinned;
+	std::string mmap_fallback;
+
 	XXH32_state_t* xxh_state;
 	uint32_t bin_hash;
 
@@ -275,36 +328,69 @@ class Storage {
 			if (free_blocks <= STORAGE_BLOCKS_MIN_FREE) {
 				int total_blocks = static_cast<int>(file_size / STORAGE_BLOCK_SIZE);
 				total_blocks = total_blocks < STORAGE_BLOCKS_MIN_FREE ? STORAGE_BLOCKS_MIN_FREE : total_blocks * STORAGE_BLOCKS_GROWTH_FACTOR;
-				off_t new_size = total_blocks * STORAGE_BLOCK_SIZE;
+				off_t new_size = static_cast<off_t>(total_blocks) * STORAGE_BLOCK_SIZE;
+				// Grow in whole extents, so files end up in few large extents
+				new_size = ((new_size + STORAGE_EXTENT_SIZE - 1) / STORAGE_EXTENT_SIZE) * STORAGE_EXTENT_SIZE;
 				if (new_size > STORAGE_LAST_BLOCK_OFFSET) {
 					new_size = STORAGE_LAST_BLOCK_OFFSET;
 				}
 				if (new_size > file_size) {
+					auto start = std::chrono::steady_clock::now();
 					if unlikely(io::fallocate(fd, 0, file_size, new_size - file_size) == -1) {
 						L_WARNING_ONCE("Cannot grow storage file: {} ({}): {}", error::name(errno), errno, error::description(errno));
 					}
+					storage_allocation_stall(start);
 				}
 			}
 		}
 	}
 
-	void write_buffer(char** buffer_, uint32_t& buffer_offset_, off_t& block_offset_) {
-		buffer_offset_ = 0;
-		if (*buffer_ == buffer_curr) {
-			*buffer_ = buffer_curr == buffer0 ? buffer1 : buffer0;
-			goto do_update;
-		} else {
-			goto do_write;
+	void write_block(const void* buf, size_t nbyte, off_t offset) {
+		if (uring) {
+			// Queued, gets submitted (together with the rest) on commit()
+			if unlikely(uring->write(fd, buf, nbyte, offset) == -1) {
+				close();
+				L_ERR("IO error in {}: io_uring: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
+				THROW(StorageIOError, error::description(errno));
+			}
+			return;
 		}
-
-	do_write:
-		if unlikely(io::pwrite(fd, *buffer_, STORAGE_BLOCK_SIZE, block_offset_) != STORAGE_BLOCK_SIZE) {
+		if unlikely(io::pwrite(fd, buf, nbyte, offset) != static_cast<ssize_t>(nbyte)) {
 			close();
 			L_ERR("IO error in {}: pwrite: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
 			THROW(StorageIOError, error::description(errno));
 		}
+	}
+
+	void wait_buffer(const char* buffer_) {
+		// The kernel may still be reading the buffer (queued by write_block())
+		if (uring) {
+			if unlikely(uring->wait_buffer(buffer_) == -1) {
+				close();
+				L_ERR("IO error in {}: io_uring: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
+				THROW(StorageIOError, error::description(errno));
+			}
+		}
+	}
+
+	void write_buffer(char** buffer_, uint32_t& buffer_offset_, off_t& block_offset_) {
+		buffer_offset_ = 0;
+		// The first used buffer (buffer_curr) gets written at the end.
+		if (*buffer_ != buffer_curr) {
+			write_block(*buffer_, STORAGE_BLOCK_SIZE, block_offset_);
+		}
+
+		// Continue in a buffer which is neither buffer_curr nor the one just written.
+		char* next = buffer0;
+		if (next == buffer_curr || next == *buffer_) {
+			next = buffer1;
+			if (next == buffer_curr || next == *buffer_) {
+				next = buffer2;
+			}
+		}
+		*buffer_ = next;
+		wait_buffer(next);
 
-	do_update:
 		block_offset_ += STORAGE_BLOCK_SIZE;
 		if (block_offset_ >= STORAGE_LAST_BLOCK_OFFSET) {
 			THROW(StorageEOF, "Storage EOF");
@@ -341,6 +427,9 @@ public:
 		  buffer_offset(0),
 		  bin_offset(0),
 		  bin_size(0),
+		  mmap_data(nullptr),
+		  mmap_size(0),
+		  mmap_pinned(false),
 		  xxh_state(XXH32_createState()),
 		  bin_hash(0),
 		  changed(false),
@@ -396,6 +485,10 @@ public:
 			path = path_;
 			flags = flags_;
 
+			if ((flags & STORAGE_WRITABLE) && opts.io_uring) {
+				uring = io::Uring::create();
+			}
+
 #if STORAGE_BUFFER_CLEAR
 			if (flags & STORAGE_WRITABLE) {
 				memset(buffer_curr, STORAGE_BUFFER_CLEAR_CHAR, STORAGE_BLOCK_SIZE);
@@ -409,6 +502,9 @@ public:
 					fd = -1;
 				}
 				if (flags & STORAGE_CREATE) {
+					bool preallocate = (flags & STORAGE_WRITABLE) && (flags & STORAGE_PREALLOCATE);
+					auto start = std::chrono::steady_clock::now();
+					bool stalled = preallocate && !storage_take_spare_volume(base_path, relative_path);
 					fd = io::open(path.c_str(), (flags & STORAGE_WRITABLE) ? O_RDWR | O_CREAT : O_RDONLY | O_CREAT, 0644);
 					if unlikely(fd == -1) {
 						close();
@@ -417,6 +513,13 @@ public:
 					}
 					initialize_file(args);
 					created = true;
+					if (preallocate) {
+						if (stalled) {
+							storage_allocation_stall(start);
+						}
+						auto spare_prefix = storage_spare_prefix(base_path, relative_path);
+						volume_preallocator()->debounce(spare_prefix, spare_prefix);
+					}
 				}
 				return created;
 			}
@@ -434,6 +537,10 @@ public:
 			THROW(StorageIOError, error::description(errno));
 		}
 
+		if (flags & STORAGE_MMAP) {
+			pin();
+		}
+
 		auto read_size = io::pread(fd, &header, sizeof(header), 0);
 		if unlikely(read_size == -1) {
 			close();
@@ -444,6 +551,10 @@ public:
 		}
 		header.validate(param, args);
 
+		if (flags & STORAGE_MMAP) {
+			map();
+		}
+
 		if (flags & STORAGE_WRITABLE) {
 			buffer_offset = header.head.offset * STORAGE_ALIGNMENT;
 			size_t offset = (buffer_offset / STORAGE_BLOCK_SIZE) * STORAGE_BLOCK_SIZE;
@@ -467,10 +578,15 @@ public:
 		cmpFile.close();
 		decFile.close();
 
+		unmap();
+		unpin();
+
 		if (fd != -1) {
 			if (flags & STORAGE_WRITABLE) {
 				commit();
 			}
+			// Wait for pending (asynchronous) fsyncs before closing.
+			uring.reset();
 			io::close(fd);
 			fd = -1;
 		}
@@ -484,6 +600,64 @@ public:
 		path.clear();
 	}
 
+	void set_dictionary(std::shared_ptr<const LZ4Dictionary> dictionary_) {
+		// Used by bins compressed from now on (STORAGE_COMPRESS)
+		dictionary = std::move(dictionary_);
+	}
+
+	void pin() {
+		L_CALL("Storage::pin()");
+
+		// Pin the volume before reading it, so it's not recycled while it's
+		// mapped, and make sure it wasn't retired since it was opened.
+		if (!mmap_pinned) {
+			storage_pin_volume(path);
+			mmap_pinned = true;
+		}
+		struct stat fd_stat;
+		struct stat path_stat;
+		if unlikely(::fstat(fd, &fd_stat) == -1 || ::stat(path.c_str(), &path_stat) == -1 || fd_stat.st_dev != path_stat.st_dev || fd_stat.st_ino != path_stat.st_ino) {
+			L_DEBUG("IO error in {}: Volume was retired", repr(path.empty() ? base_path : path));
+			close();
+			THROW(StorageIOError, "Volume was retired");
+		}
+	}
+
+	void unpin() {
+		if (mmap_pinned) {
+			storage_unpin_volume(path);
+			mmap_pinned = false;
+		}
+	}
+
+	void map() {
+		L_CALL("Storage::map()");
+
+		ASSERT(!(flags & STORAGE_WRITABLE));
+
+		unmap();
+
+		// Only the committed part of the volume (up to the header offset) is mapped.
+		size_t size = header.head.offset * STORAGE_ALIGNMENT;
+		void* addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		if unlikely(addr == MAP_FAILED) {
+			close();
+			L_ERR("IO error in {}: mmap: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
+			THROW(StorageIOError, error::description(errno));
+		}
+		::madvise(addr, size, MADV_SEQUENTIAL);
+		mmap_data = static_cast<char*>(addr);
+		mmap_size = size;
+	}
+
+	void unmap() {
+		if (mmap_data != nullptr) {
+			::munmap(mmap_data, mmap_size);
+			mmap_data = nullptr;
+			mmap_size = 0;
+		}
+	}
+
 	void seek(uint32_t offset) {
 		L_CALL("Storage::seek()");
 
@@ -493,6 +667,10 @@ public:
 		bin_offset = offset * STORAGE_ALIGNMENT;
 	}
 
+	uint32_t tell() const {
+		return bin_offset / STORAGE_ALIGNMENT;
+	}
+
 	uint32_t write(const char *data, size_t data_size, void* args=nullptr) {
 		L_CALL("Storage::write() [1]");
 
@@ -524,7 +702,7 @@ public:
 		bool compress = (flags & STORAGE_COMPRESS) && data_size > STORAGE_MIN_COMPRESS_SIZE;
 		if (compress) {
 			_bin_header.init(param, args, 0, STORAGE_FLAG_COMPRESSED);
-			cmpData.reset(data, data_size, STORAGE_MAGIC);
+			cmpData.reset(data, data_size, STORAGE_MAGIC, dictionary.get());
 			cmpData_it = cmpData.begin();
 			it_size = cmpData_it.size();
 			data = cmpData_it->data();
@@ -533,6 +711,7 @@ public:
 			it_size = data_size;
 		}
 
+		wait_buffer(buffer_curr);
 		char* buffer = buffer_curr;
 		uint32_t tmp_buffer_offset = buffer_offset;
 		StorageBinHeader* buffer_header = reinterpret_cast<StorageBinHeader*>(buffer + tmp_buffer_offset);
@@ -578,21 +757,17 @@ public:
 				write_buffer(&buffer, tmp_buffer_offset, block_offset);
 				continue;
 			}
-			if unlikely(io::pwrite(fd, buffer, STORAGE_BLOCK_SIZE, block_offset) != STORAGE_BLOCK_SIZE) {
-				close();
-				L_ERR("IO error in {}: pwrite: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
-				THROW(StorageIOError, error::description(errno));
+			if (flags & STORAGE_DEFERRED_WRITE) {
+				// The last (partially filled) block gets written by commit()
+				break;
 			}
+			write_block(buffer, STORAGE_BLOCK_SIZE, block_offset);
 			break;
 		}
 
 		// Write the first used buffer.
 		if (buffer != buffer_curr) {
-			if unlikely(io::pwrite(fd, buffer_curr, STORAGE_BLOCK_SIZE, tmp_block_offset) != STORAGE_BLOCK_SIZE) {
-				close();
-				L_ERR("IO error in {}: pwrite: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
-				THROW(StorageIOError, error::description(errno));
-			}
+			write_block(buffer_curr, STORAGE_BLOCK_SIZE, tmp_block_offset);
 			buffer_curr = buffer;
 		}
 
@@ -665,6 +840,7 @@ public:
 			XXH32_update(xxh_state, data, it_size);
 		}
 
+		wait_buffer(buffer_curr);
 		char* buffer = buffer_curr;
 		uint32_t tmp_buffer_offset = buffer_offset;
 		StorageBinHeader* buffer_header = reinterpret_cast<StorageBinHeader*>(buffer + tmp_buffer_offset);
@@ -729,22 +905,14 @@ public:
 				write_buffer(&buffer, tmp_buffer_offset, block_offset);
 				continue;
 			} else {
-				if unlikely(io::pwrite(fd, buffer, STORAGE_BLOCK_SIZE, block_offset) != STORAGE_BLOCK_SIZE) {
-					close();
-					L_ERR("IO error in {}: pwrite: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
-					THROW(StorageIOError, error::description(errno));
-				}
+				write_block(buffer, STORAGE_BLOCK_SIZE, block_offset);
 				break;
 			}
 		}
 
 		// Write the first used buffer.
 		if (buffer != buffer_curr) {
-			if unlikely(io::pwrite(fd, buffer_curr, STORAGE_BLOCK_SIZE, tmp_block_offset) != STORAGE_BLOCK_SIZE) {
-				close();
-				L_ERR("IO error in {}: pwrite: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
-				THROW(StorageIOError, error::description(errno));
-			}
+			write_block(buffer_curr, STORAGE_BLOCK_SIZE, tmp_block_offset);
 			buffer_curr = buffer;
 		}
 
@@ -859,6 +1027,25 @@ public:
 
 		changed = false;
 
+		if (flags & STORAGE_DEFERRED_WRITE) {
+			if (buffer_offset) {
+				off_t block_offset = ((header.head.offset * STORAGE_ALIGNMENT) / STORAGE_BLOCK_SIZE) * STORAGE_BLOCK_SIZE;
+				write_block(buffer_curr, STORAGE_BLOCK_SIZE, block_offset);
+			}
+		}
+
+		if (uring) {
+			// Queued blocks, the header and its linked fsync are submitted here,
+			// with STORAGE_ASYNC_SYNC the fsync completes in the background.
+			if unlikely(uring->commit(fd, &header, sizeof(header), 0, !(flags & STORAGE_NO_SYNC), flags & STORAGE_FULL_SYNC, flags & STORAGE_ASYNC_SYNC) == -1) {
+				close();
+				L_ERR("IO error in {}: io_uring: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
+				THROW(StorageIOError, error::description(errno));
+			}
+			growfile();
+			return;
+		}
+
 		if unlikely(io::pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
 			close();
 			L_ERR("IO error in {}: pwrite: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
@@ -892,6 +1079,47 @@ public:
 		growfile();
 	}
 
+	void sync() {
+		L_CALL("Storage::sync()");
+
+		// Waits until committed changes have really hit the disk, even
+		// when the storage was opened with STORAGE_ASYNC_SYNC.
+
+		if unlikely(fd == -1) {
+			close();
+			L_DEBUG("IO error in {}: Closed storage", repr(path.empty() ? base_path : path));
+			THROW(StorageClosedError, "Closed storage");
+		}
+
+		if (flags & STORAGE_NO_SYNC) {
+			return;
+		}
+
+		if (uring) {
+			// The fsync linked by commit() might still be in flight.
+			if unlikely(uring->wait() == -1) {
+				close();
+				L_ERR("IO error in {}: io_uring: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
+				THROW(StorageIOError, error::description(errno));
+			}
+			return;
+		}
+
+		if (flags & STORAGE_FULL_SYNC) {
+			if unlikely(io::full_fsync(fd) == -1) {
+				close();
+				L_ERR("IO error in {}: full_fsync: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
+				THROW(StorageIOError, error::description(errno));
+			}
+		} else {
+			if unlikely(io::fsync(fd) == -1) {
+				close();
+				L_ERR("IO error in {}: fsync: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
+				THROW(StorageIOError, error::description(errno));
+			}
+		}
+	}
+
 	uint32_t write(std::string_view data, void* args=nullptr) {
 		L_CALL("Storage::write() [2]");
 
@@ -911,6 +1139,84 @@ public:
 		return ret;
 	}
 
+	std::string_view read_view(uint32_t limit=-1, void* args=nullptr) {
+		L_CALL("Storage::read_view()");
+
+		// The returned view points straight into the memory mapped volume
+		// and it's valid until the storage is closed or opens another volume.
+		// Compressed bins (or storages not opened with STORAGE_MMAP) are read
+		// into an internal buffer, valid until the next read.
+
+		if (mmap_data == nullptr) {
+			mmap_fallback = read(limit, args);
+			return mmap_fallback;
+		}
+
+		if (bin_offset >= header.head.offset * STORAGE_ALIGNMENT || bin_offset >= limit * STORAGE_ALIGNMENT) {
+			THROW(StorageEOF, "Storage EOF");
+		}
+
+		size_t offset = bin_offset;
+		if unlikely(offset + sizeof(StorageBinHeader) > mmap_size) {
+			THROW(StorageCorruptVolume, "Incomplete bin header");
+		}
+		memcpy(&bin_header, mmap_data + offset, sizeof(StorageBinHeader));
+		bin_header.validate(param, args);
+
+		if (bin_header.flags & STORAGE_FLAG_COMPRESSED) {
+			bin_header.size = 0;
+			mmap_fallback = read(limit, args);
+			return mmap_fallback;
+		}
+
+		offset += sizeof(StorageBinHeader);
+		if unlikely(offset + bin_header.size + sizeof(StorageBinFooter) > mmap_size) {
+			THROW(StorageCorruptVolume, "Incomplete bin data");
+		}
+		std::string_view data(mmap_data + offset, bin_header.size);
+		offset += bin_header.size;
+
+		memcpy(&bin_footer, mmap_data + offset, sizeof(StorageBinFooter));
+		offset += sizeof(StorageBinFooter);
+		bin_footer.validate(param, args, XXH32(data.data(), data.size(), STORAGE_MAGIC));
+
+		// Align the bin_offset to the next storage alignment
+		bin_offset = ((offset + STORAGE_ALIGNMENT - 1) / STORAGE_ALIGNMENT) * STORAGE_ALIGNMENT;
+
+		bin_header.size = 0;
+		bin_size = 0;
+
+		return data;
+	}
+
+	size_t bin_space(uint32_t offset) {
+		// Space taken in the volume by the bin at offset (header, data and footer)
+		L_CALL("Storage::bin_space({})", offset);
+
+		if unlikely(fd == -1) {
+			close();
+			L_DEBUG("IO error in {}: Closed storage", repr(path.empty() ? base_path : path));
+			THROW(StorageClosedError, "Closed storage");
+		}
+
+		if (offset >= header.head.offset) {
+			THROW(StorageEOF, "Storage EOF");
+		}
+
+		StorageBinHeader offset_header;
+		auto read_size = io::pread(fd, &offset_header, sizeof(StorageBinHeader), static_cast<off_t>(offset) * STORAGE_ALIGNMENT);
+		if unlikely(read_size == -1) {
+			close();
+			L_ERR("IO error in {}: pread: {} ({}): {}", repr(path.empty() ? base_path : path), error::name(errno), errno, error::description(errno));
+			THROW(StorageIOError, error::description(errno));
+		} else if unlikely(read_size != sizeof(StorageBinHeader)) {
+			THROW(StorageCorruptVolume, "Incomplete bin header");
+		}
+
+		size_t space = sizeof(StorageBinHeader) + offset_header.size + sizeof(StorageBinFooter);
+		return ((space + STORAGE_ALIGNMENT - 1) / STORAGE_ALIGNMENT) * STORAGE_ALIGNMENT;
+	}
+
 	std::pair<unsigned long long, unsigned long long>
 	get_volumes_range(std::string_view pattern, unsigned long long min=0, unsigned long long max=std::numeric_limits<unsigned long long>::max()) {
 		// Figure out highest and lowest volume files available for a given file pattern
@@ -953,6 +1259,14 @@ public:
 		return {first_volume, last_volume};
 	}
 
+	std::vector<unsigned long long>
+	get_volumes(std::string_view pattern) {
+		// List all volume files available for a given file pattern, in order
+		L_CALL("Storage::get_volumes()");
+
+		return storage_volumes(base_path, pattern);
+	}
+
 	bool closed() noexcept {
 		return fd == -1;
 	}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015-2019 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>                         // for std::atomic_size_t
+#include <cstddef>                        // for std::size_t
+#include <cstdint>                        // for int64_t
+
+#include "blocking_concurrent_queue.h"    // for BlockingConcurrentQueue
+
+
+/*
+ * Queue of items written by a single writer at a time.
+ *
+ * Items are counted before they're queued, so the writer never dequeues
+ * more items than were counted, and the count only drops to zero once the
+ * writer has written everything it has to. The producer that takes the
+ * count from zero is the one that starts the (next) writer.
+ */
+template <typename T>
+class WriterQueue {
+	BlockingConcurrentQueue<T> queue;
+	std::atomic_size_t queued;
+
+public:
+	WriterQueue() :
+		queued{0} { }
+
+	// Queues item, returns true if the caller must start a writer.
+	bool enqueue(T&& item) {
+		auto was_queued = queued.fetch_add(1);
+		queue.enqueue(std::move(item));
+		return was_queued == 0;
+	}
+
+	// Dequeues up to count items for the writer. An item counted but not
+	// yet queued is waited for, up to timeout_usecs.
+	template <typename It>
+	std::size_t dequeue(It itemFirst, std::size_t count, int64_t timeout_usecs) {
+		auto dequeued = queue.try_dequeue_bulk(itemFirst, count);
+		if (!dequeued && count) {
+			if (!queue.wait_dequeue_timed(*itemFirst, timeout_usecs)) {
+				return 0;
+			}
+			++itemFirst;
+			dequeued = 1 + queue.try_dequeue_bulk(itemFirst, count - 1);
+		}
+		return dequeued;
+	}
+
+	// Marks count items as written, returns true if the writer is done
+	// (an item queued after this starts a new writer).
+	bool written(std::size_t count) {
+		return queued.fetch_sub(count) == count;
+	}
+
+	std::size_t size() const {
+		return queued.load();
+	}
+};
@@ -90,6 +90,12 @@ Compactor::set_status(const string & table, const string & status)
     (void)status;
 }
 
+void
+Compactor::progress(size_t size)
+{
+    (void)size;
+}
+
 string
 Compactor::resolve_duplicate_metadata(const string & key,
 				      size_t num_tags, const std::string tags[])
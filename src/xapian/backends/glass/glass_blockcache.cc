@@ -0,0 +1,230 @@
+/** @file glass_blockcache.cc
+ * @brief Block cache shared by all readers of glass tables.
+ */
+/* Copyright (C) 2019 Dubalu LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "xapian/backends/glass/glass_blockcache.h"
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "xapian/common/wordaccess.h"
+
+using namespace std;
+
+/// Number of independently locked segments.
+#define SEGMENTS 16
+
+/// Share of each segment's budget blocks read more than once can take.
+#define PROTECTED_RATIO 0.8
+
+/// Approximate per entry overhead (list node, map node and key).
+#define ENTRY_OVERHEAD 128
+
+namespace {
+
+struct Entry {
+    string key;
+    string block;
+    bool is_protected;
+
+    Entry(string && key_, const uint8_t * p, unsigned block_size)
+	: key(std::move(key_)),
+	  block(reinterpret_cast<const char *>(p), block_size),
+	  is_protected(false) { }
+
+    size_t size() const {
+	return key.size() + block.size() + ENTRY_OVERHEAD;
+    }
+};
+
+class Segment {
+    mutex mtx;
+
+    list<Entry> probation;
+    list<Entry> protected_;
+    unordered_map<string, list<Entry>::iterator> entries;
+
+    size_t probation_size = 0;
+    size_t protected_size = 0;
+    size_t max_size = 0;
+
+    void evict() {
+	while (probation_size + protected_size > max_size) {
+	    auto & lst = probation.empty() ? protected_ : probation;
+	    auto & size = probation.empty() ? protected_size : probation_size;
+	    auto & entry = lst.back();
+	    size -= entry.size();
+	    entries.erase(entry.key);
+	    lst.pop_back();
+	}
+    }
+
+  public:
+    void set_max_size(size_t max_size_) {
+	lock_guard<mutex> lk(mtx);
+	max_size = max_size_;
+	evict();
+    }
+
+    bool get(const string & key, uint8_t * p, unsigned block_size) {
+	lock_guard<mutex> lk(mtx);
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+	    return false;
+	}
+	auto & entry = *it->second;
+	if (entry.block.size() != block_size) {
+	    return false;
+	}
+	if (entry.is_protected) {
+	    protected_.splice(protected_.begin(), protected_, it->second);
+	} else {
+	    // Read again, promote it.
+	    entry.is_protected = true;
+	    probation_size -= entry.size();
+	    protected_size += entry.size();
+	    protected_.splice(protected_.begin(), probation, it->second);
+	    size_t max_protected = max_size * PROTECTED_RATIO;
+	    while (protected_size > max_protected && protected_.size() > 1) {
+		// Demote the least recently used protected blocks.
+		auto last = prev(protected_.end());
+		last->is_protected = false;
+		protected_size -= last->size();
+		probation_size += last->size();
+		probation.splice(probation.begin(), protected_, last);
+	    }
+	}
+	memcpy(p, entry.block.data(), block_size);
+	return true;
+    }
+
+    void put(string && key, const uint8_t * p, unsigned block_size) {
+	lock_guard<mutex> lk(mtx);
+	if (entries.find(key) != entries.end()) {
+	    return;
+	}
+	probation.emplace_front(std::move(key), p, block_size);
+	auto & entry = probation.front();
+	if (entry.size() > max_size) {
+	    probation.pop_front();
+	    return;
+	}
+	probation_size += entry.size();
+	entries.emplace(entry.key, probation.begin());
+	evict();
+    }
+
+    size_t size() {
+	lock_guard<mutex> lk(mtx);
+	return probation_size + protected_size;
+    }
+};
+
+struct Cache {
+    Segment segments[SEGMENTS];
+
+    atomic<size_t> max_size{0};
+    atomic<unsigned long long> hits{0};
+    atomic<unsigned long long> misses{0};
+
+    Segment & segment(const string & key) {
+	return segments[hash<string>{}(key) % SEGMENTS];
+    }
+};
+
+Cache &
+cache()
+{
+    static Cache cache;
+    return cache;
+}
+
+string
+make_key(const string & id, glass_revision_number_t rev, uint4 n)
+{
+    string key(id);
+    char buf[8];
+    unaligned_write4(reinterpret_cast<unsigned char *>(buf), rev);
+    unaligned_write4(reinterpret_cast<unsigned char *>(buf) + 4, n);
+    key.append(buf, sizeof(buf));
+    return key;
+}
+
+}
+
+void
+GlassBlockCache::set_max_size(size_t max_size)
+{
+    auto & c = cache();
+    c.max_size = max_size;
+    for (auto & segment : c.segments) {
+	segment.set_max_size(max_size / SEGMENTS);
+    }
+}
+
+bool
+GlassBlockCache::get(const string & id, glass_revision_number_t rev,
+		     uint4 n, uint8_t * p, unsigned block_size)
+{
+    auto & c = cache();
+    if (!c.max_size.load(memory_order_relaxed)) {
+	return false;
+    }
+    auto key = make_key(id, rev, n);
+    if (c.segment(key).get(key, p, block_size)) {
+	++c.hits;
+	return true;
+    }
+    ++c.misses;
+    return false;
+}
+
+void
+GlassBlockCache::put(const string & id, glass_revision_number_t rev,
+		     uint4 n, const uint8_t * p, unsigned block_size)
+{
+    auto & c = cache();
+    if (!c.max_size.load(memory_order_relaxed)) {
+	return;
+    }
+    auto key = make_key(id, rev, n);
+    auto & segment = c.segment(key);
+    segment.put(std::move(key), p, block_size);
+}
+
+GlassBlockCache::Stats
+GlassBlockCache::stats()
+{
+    auto & c = cache();
+    Stats stats;
+    stats.hits = c.hits;
+    stats.misses = c.misses;
+    stats.size = 0;
+    for (auto & segment : c.segments) {
+	stats.size += segment.size();
+    }
+    stats.max_size = c.max_size;
+    return stats;
+}
@@ -0,0 +1,71 @@
+/** @file glass_blockcache.h
+ * @brief Block cache shared by all readers of glass tables.
+ */
+/* Copyright (C) 2019 Dubalu LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef XAPIAN_INCLUDED_GLASS_BLOCKCACHE_H
+#define XAPIAN_INCLUDED_GLASS_BLOCKCACHE_H
+
+#include <cstddef>
+#include <string>
+
+#include "xapian/backends/glass/glass_defs.h"
+
+/** Block cache shared by all (read-only) glass tables in the process.
+ *
+ *  Blocks are keyed by the table identity (database UUID and table name),
+ *  the revision the table is open at and the block number, so readers
+ *  opened at the same revision share blocks, and blocks are never served
+ *  to readers of other revisions (block numbers get reused once freed).
+ *
+ *  Each segment of the cache is a segmented LRU: blocks enter a probation
+ *  list and are only promoted to the protected list when read again, so
+ *  scans (which read most blocks once) can't flush the hot internal blocks
+ *  of the B-trees.
+ */
+class GlassBlockCache {
+  public:
+    struct Stats {
+	unsigned long long hits;
+	unsigned long long misses;
+	std::size_t size;
+	std::size_t max_size;
+    };
+
+    /** Set the memory budget (in bytes) of the cache.
+     *
+     *  Zero disables the cache (and drops any cached blocks).
+     */
+    static void set_max_size(std::size_t max_size);
+
+    /** Copy block @a n of table @a id (at revision @a rev) to @a p.
+     *
+     *  @return true if the block was in the cache.
+     */
+    static bool get(const std::string & id, glass_revision_number_t rev,
+		    uint4 n, uint8_t * p, unsigned block_size);
+
+    /// Add block @a n of table @a id (at revision @a rev) to the cache.
+    static void put(const std::string & id, glass_revision_number_t rev,
+		    uint4 n, const uint8_t * p, unsigned block_size);
+
+    /// Current statistics of the cache.
+    static Stats stats();
+};
+
+#endif // XAPIAN_INCLUDED_GLASS_BLOCKCACHE_H
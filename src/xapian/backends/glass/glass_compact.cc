@@ -328,6 +328,7 @@ merge_postlists(Xapian::Compactor * compactor,
 	if (!is_valuechunk_key(key)) break;
 	Assert(!is_user_metadata_key(key));
 	out->add(key, cur->tag);
+	if (compactor) compactor->progress(key.size() + cur->tag.size());
 	pq.pop();
 	if (cur->next()) {
 	    pq.push(cur);
@@ -355,6 +356,7 @@ merge_postlists(Xapian::Compactor * compactor,
 		tag[0] = (tags.size() == 1) ? '1' : '0';
 		first_tag += tag;
 		out->add(last_key, first_tag);
+		if (compactor) compactor->progress(last_key.size() + first_tag.size());
 
 		string term;
 		if (!is_doclenchunk_key(last_key)) {
@@ -369,6 +371,7 @@ merge_postlists(Xapian::Compactor * compactor,
 		    tag = i->second;
 		    tag[0] = (i + 1 == tags.end()) ? '1' : '0';
 		    out->add(pack_glass_postlist_key(term, i->first), tag);
+		    if (compactor) compactor->progress(last_key.size() + tag.size());
 		}
 	    }
 	    tags.clear();
@@ -700,7 +703,8 @@ class PositionCursorGt {
 };
 
 static void
-merge_positions(GlassTable *out, const vector<const GlassTable*> & inputs,
+merge_positions(Xapian::Compactor * compactor,
+		GlassTable *out, const vector<const GlassTable*> & inputs,
 		const vector<Xapian::docid> & offset)
 {
     priority_queue<PositionCursor *, vector<PositionCursor *>, PositionCursorGt> pq;
@@ -717,7 +721,9 @@ merge_positions(GlassTable *out, const vector<const GlassTable*> & inputs,
     while (!pq.empty()) {
 	PositionCursor * cur = pq.top();
 	pq.pop();
-	out->add(cur->key, cur->get_tag());
+	const string & tag = cur->get_tag();
+	out->add(cur->key, tag);
+	if (compactor) compactor->progress(cur->key.size() + tag.size());
 	if (cur->next()) {
 	    pq.push(cur);
 	} else {
@@ -727,7 +733,8 @@ merge_positions(GlassTable *out, const vector<const GlassTable*> & inputs,
 }
 
 static void
-merge_docid_keyed(GlassTable *out, const vector<const GlassTable*> & inputs,
+merge_docid_keyed(Xapian::Compactor * compactor,
+		  GlassTable *out, const vector<const GlassTable*> & inputs,
 		  const vector<Xapian::docid> & offset)
 {
     for (size_t i = 0; i < inputs.size(); ++i) {
@@ -764,6 +771,7 @@ merge_docid_keyed(GlassTable *out, const vector<const GlassTable*> & inputs,
 	    }
 	    bool compressed = cur.read_tag(true);
 	    out->add(key, cur.current_tag, compressed);
+	    if (compactor) compactor->progress(key.size() + cur.current_tag.size());
 	}
     }
 }
@@ -860,6 +868,15 @@ GlassDatabase::compact(Xapian::Compactor * compactor,
 	version_file_out->merge_stats(db->version_file);
     }
 
+    glass_revision_number_t new_rev = 1;
+    if ((flags & Xapian::DBCOMPACT_KEEP_REVISION) && sources.size() == 1) {
+	// Keep the UUID and revision of the source, so the output can take
+	// its place.
+	auto db = static_cast<const GlassDatabase*>(sources[0]);
+	version_file_out->copy_uuid(db->version_file);
+	new_rev = max(db->version_file.get_revision(), new_rev);
+    }
+
     string fl_serialised;
     if (single_file) {
 	GlassFreeList fl;
@@ -1013,17 +1030,17 @@ GlassDatabase::compact(Xapian::Compactor * compactor,
 		merge_synonyms(out, inputs.begin(), inputs.end());
 		break;
 	    case Glass::POSITION:
-		merge_positions(out, inputs, offset);
+		merge_positions(compactor, out, inputs, offset);
 		break;
 	    default:
 		// DocData, Termlist
-		merge_docid_keyed(out, inputs, offset);
+		merge_docid_keyed(compactor, out, inputs, offset);
 		break;
 	}
 
-	// Commit as revision 1.
+	// Commit as revision new_rev.
 	out->flush_db();
-	out->commit(1, root_info);
+	out->commit(new_rev, root_info);
 	out->sync();
 	if (single_file) fl_serialised = root_info->get_free_list();
 
@@ -1103,12 +1120,12 @@ GlassDatabase::compact(Xapian::Compactor * compactor,
 	}
     }
     version_file_out->set_last_docid(last_docid);
-    string tmpfile = version_file_out->write(1, FLAGS);
+    string tmpfile = version_file_out->write(new_rev, FLAGS);
     for (unsigned j = 0; j != tabs.size(); ++j) {
 	tabs[j]->sync();
     }
-    // Commit with revision 1.
-    version_file_out->sync(tmpfile, 1, FLAGS);
+    // Commit with revision new_rev.
+    version_file_out->sync(tmpfile, new_rev, FLAGS);
     for (unsigned j = 0; j != tabs.size(); ++j) {
 	delete tabs[j];
     }
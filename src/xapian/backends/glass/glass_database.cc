@@ -40,6 +40,7 @@
 #include "xapian/backends/glass/glass_defs.h"
 #include "xapian/backends/glass/glass_docdata.h"
 #include "xapian/backends/glass/glass_document.h"
+#include "xapian/backends/glass/glass_flushbudget.h"
 #include "xapian/backends/flint_lock.h"
 #include "xapian/backends/glass/glass_metadata.h"
 #include "xapian/backends/glass/glass_positionlist.h"
@@ -248,12 +249,13 @@ GlassDatabase::open_tables(int flags)
 	RETURN(false);
     }
 
-    docdata_table.open(flags, version_file.get_root(Glass::DOCDATA), rev);
-    spelling_table.open(flags, version_file.get_root(Glass::SPELLING), rev);
-    synonym_table.open(flags, version_file.get_root(Glass::SYNONYM), rev);
-    termlist_table.open(flags, version_file.get_root(Glass::TERMLIST), rev);
-    position_table.open(flags, version_file.get_root(Glass::POSITION), rev);
-    postlist_table.open(flags, version_file.get_root(Glass::POSTLIST), rev);
+    const char * uuid = version_file.get_uuid();
+    docdata_table.open(flags, version_file.get_root(Glass::DOCDATA), rev, uuid);
+    spelling_table.open(flags, version_file.get_root(Glass::SPELLING), rev, uuid);
+    synonym_table.open(flags, version_file.get_root(Glass::SYNONYM), rev, uuid);
+    termlist_table.open(flags, version_file.get_root(Glass::TERMLIST), rev, uuid);
+    position_table.open(flags, version_file.get_root(Glass::POSITION), rev, uuid);
+    postlist_table.open(flags, version_file.get_root(Glass::POSTLIST), rev, uuid);
 
     Xapian::termcount swfub = version_file.get_spelling_wordfreq_upper_bound();
     spelling_table.set_wordfreq_upper_bound(swfub);
@@ -1043,6 +1045,7 @@ GlassWritableDatabase::GlassWritableDatabase(const string &dir, int flags,
 	: GlassDatabase(dir, flags, block_size),
 	  change_count(0),
 	  flush_threshold(0),
+	  flush_reported(0),
 	  modify_shortcut_document(NULL),
 	  modify_shortcut_docid(0)
 {
@@ -1059,6 +1062,7 @@ GlassWritableDatabase::~GlassWritableDatabase()
 {
     LOGCALL_DTOR(DB, "GlassWritableDatabase");
     dtor_called();
+    GlassFlushBudget::release(flush_reported);
 }
 
 void
@@ -1073,10 +1077,16 @@ GlassWritableDatabase::commit()
 void
 GlassWritableDatabase::check_flush_threshold()
 {
-    // FIXME: this should be done by checking memory usage, not the number of
-    // changes.  We could also look at the amount of data the inverter object
-    // currently holds.
-    if (++change_count >= flush_threshold) {
+    ++change_count;
+    bool flush;
+    if (GlassFlushBudget::enabled()) {
+	// Flush based on the memory the inverter holds.
+	flush = GlassFlushBudget::update(flush_reported,
+					 inverter.memory_used());
+    } else {
+	flush = change_count >= flush_threshold;
+    }
+    if (flush) {
 	flush_postlist_changes();
 	if (!transaction_active()) apply();
     }
@@ -1088,6 +1098,7 @@ GlassWritableDatabase::flush_postlist_changes() const
     version_file.set_oldest_changeset(changes.get_oldest_changeset());
     inverter.flush(postlist_table);
     inverter.flush_pos_lists(position_table);
+    GlassFlushBudget::release(flush_reported);
 
     change_count = 0;
 }
@@ -1609,6 +1620,7 @@ GlassWritableDatabase::cancel()
 {
     GlassDatabase::cancel();
     inverter.clear();
+    GlassFlushBudget::release(flush_reported);
     value_stats.clear();
     change_count = 0;
 }
@@ -344,6 +344,9 @@ class GlassWritableDatabase : public GlassDatabase {
 	/// If change_count reaches this threshold we automatically flush.
 	Xapian::doccount flush_threshold;
 
+	/// Memory used by the inverter, as last reported to GlassFlushBudget.
+	mutable size_t flush_reported;
+
 	/** A pointer to the last document which was returned by
 	 *  open_document(), or NULL if there is no such valid document.  This
 	 *  is used purely for comparing with a supplied document to help with
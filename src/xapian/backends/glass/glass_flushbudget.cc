@@ -0,0 +1,112 @@
+/** @file glass_flushbudget.cc
+ * @brief Memory budget for the buffered changes of writable glass databases.
+ */
+/* Copyright (C) 2019 Dubalu LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "config.h"
+
+#include "xapian/backends/glass/glass_flushbudget.h"
+
+#include <atomic>
+
+using namespace std;
+
+namespace {
+
+struct Budget {
+    atomic<size_t> max_size{0};
+    atomic<size_t> total_max_size{0};
+
+    /// Memory used by all writable databases.
+    atomic<size_t> total{0};
+
+    /// Number of writable databases holding changes.
+    atomic<size_t> holders{0};
+};
+
+Budget &
+budget()
+{
+    static Budget budget;
+    return budget;
+}
+
+}
+
+void
+GlassFlushBudget::set_max_size(size_t max_size, size_t total_max_size)
+{
+    auto & b = budget();
+    b.max_size = max_size;
+    b.total_max_size = total_max_size;
+}
+
+bool
+GlassFlushBudget::enabled()
+{
+    auto & b = budget();
+    return b.max_size.load(memory_order_relaxed) ||
+	   b.total_max_size.load(memory_order_relaxed);
+}
+
+bool
+GlassFlushBudget::update(size_t & reported, size_t size)
+{
+    auto & b = budget();
+    size_t total;
+    if (size >= reported) {
+	total = b.total.fetch_add(size - reported) + (size - reported);
+    } else {
+	total = b.total.fetch_sub(reported - size) - (reported - size);
+    }
+    if (!reported && size) {
+	++b.holders;
+    } else if (reported && !size) {
+	--b.holders;
+    }
+    reported = size;
+
+    auto max_size = b.max_size.load(memory_order_relaxed);
+    if (max_size && size >= max_size) {
+	return true;
+    }
+    auto total_max_size = b.total_max_size.load(memory_order_relaxed);
+    if (total_max_size && total > total_max_size) {
+	// Over the total budget, flush if holding at least a fair share.
+	auto holders = b.holders.load(memory_order_relaxed);
+	return size >= total / (holders ? holders : 1);
+    }
+    return false;
+}
+
+void
+GlassFlushBudget::release(size_t & reported)
+{
+    if (reported) {
+	auto & b = budget();
+	b.total.fetch_sub(reported);
+	--b.holders;
+	reported = 0;
+    }
+}
+
+size_t
+GlassFlushBudget::pending()
+{
+    return budget().total.load(memory_order_relaxed);
+}
@@ -0,0 +1,64 @@
+/** @file glass_flushbudget.h
+ * @brief Memory budget for the buffered changes of writable glass databases.
+ */
+/* Copyright (C) 2019 Dubalu LLC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef XAPIAN_INCLUDED_GLASS_FLUSHBUDGET_H
+#define XAPIAN_INCLUDED_GLASS_FLUSHBUDGET_H
+
+#include <cstddef>
+
+/** Memory budget for the changes buffered by writable glass databases.
+ *
+ *  Each writable database flushes once its inverter holds more than the
+ *  per database budget.  On top of that, all writable databases in the
+ *  process share a total budget: once it's exceeded, writers holding at
+ *  least their fair share of the pending changes flush too.
+ *
+ *  When no budget is set, writable databases flush after a number of
+ *  changed documents (XAPIAN_FLUSH_THRESHOLD) instead.
+ */
+class GlassFlushBudget {
+  public:
+    /** Set the memory budgets (in bytes).
+     *
+     *  Zero disables the corresponding budget.
+     */
+    static void set_max_size(std::size_t max_size,
+			     std::size_t total_max_size);
+
+    /// Whether any budget is set.
+    static bool enabled();
+
+    /** Account the memory currently used by a database.
+     *
+     *  @param reported	 The memory last reported by this database (updated).
+     *  @param size	 The memory currently used by it.
+     *
+     *  @return true if the database should flush its changes.
+     */
+    static bool update(std::size_t & reported, std::size_t size);
+
+    /// Release the memory last reported by a database (after a flush).
+    static void release(std::size_t & reported);
+
+    /// Memory used by changes pending to be flushed, in all databases.
+    static std::size_t pending();
+};
+
+#endif // XAPIAN_INCLUDED_GLASS_FLUSHBUDGET_H
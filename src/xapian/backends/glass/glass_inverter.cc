@@ -48,6 +48,8 @@ Inverter::store_positions(const GlassPositionListTable & position_table,
 	    auto j = m.find(did);
 	    if (j != m.end()) {
 		// Update existing entry.
+		positions_memory += s.size();
+		positions_memory -= j->second.size();
 		swap(j->second, s);
 		return;
 	    }
@@ -98,8 +100,20 @@ Inverter::set_positionlist(Xapian::docid did,
 			   const string & term,
 			   const string & s)
 {
-    pos_changes.insert(make_pair(term, map<Xapian::docid, string>()))
-	.first->second[did] = s;
+    auto i = pos_changes.find(term);
+    if (i == pos_changes.end()) {
+	i = pos_changes.insert(make_pair(term, map<Xapian::docid, string>()))
+	    .first;
+	positions_memory += term.size() + ENTRY_OVERHEAD;
+    }
+    auto r = i->second.insert(make_pair(did, s));
+    if (r.second) {
+	positions_memory += s.size() + ENTRY_OVERHEAD;
+    } else {
+	positions_memory += s.size();
+	positions_memory -= r.first->second.size();
+	r.first->second = s;
+    }
 }
 
 void
@@ -164,6 +178,7 @@ Inverter::flush_post_list(GlassPostListTable & table, const string & term)
 
     // Flush buffered changes for just this term's postlist.
     table.merge_changes(term, i->second);
+    postlist_memory -= i->second.memory_used(term);
     postlist_changes.erase(i);
 }
 
@@ -175,6 +190,7 @@ Inverter::flush_all_post_lists(GlassPostListTable & table)
 	table.merge_changes(i->first, i->second);
     }
     postlist_changes.clear();
+    postlist_memory = 0;
 }
 
 void
@@ -201,6 +217,7 @@ Inverter::flush_post_lists(GlassPostListTable & table, const string & pfx)
 
     for (i = begin; i != end; ++i) {
 	table.merge_changes(i->first, i->second);
+	postlist_memory -= i->second.memory_used(i->first);
     }
 
     // Erase all the entries in one go, as that's:
@@ -231,4 +248,5 @@ Inverter::flush_pos_lists(GlassPositionListTable & table)
 	}
     }
     pos_changes.clear();
+    positions_memory = 0;
 }
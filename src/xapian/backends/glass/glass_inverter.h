@@ -83,27 +83,32 @@ class Inverter {
 	    pl_changes.insert(std::make_pair(did, new_wdf));
 	}
 
-	/// Add a posting.
-	void add_posting(Xapian::docid did, Xapian::termcount wdf) {
+	/// Add a posting (returns true if it's a new entry).
+	bool add_posting(Xapian::docid did, Xapian::termcount wdf) {
 	    ++tf_delta;
 	    cf_delta += wdf;
 	    // Add did to term's postlist
-	    pl_changes[did] = wdf;
+	    return pl_changes.insert_or_assign(did, wdf).second;
 	}
 
-	/// Remove a posting.
-	void remove_posting(Xapian::docid did, Xapian::termcount wdf) {
+	/// Remove a posting (returns true if it's a new entry).
+	bool remove_posting(Xapian::docid did, Xapian::termcount wdf) {
 	    --tf_delta;
 	    cf_delta -= wdf;
 	    // Remove did from term's postlist.
-	    pl_changes[did] = DELETED_POSTING;
+	    return pl_changes.insert_or_assign(did, DELETED_POSTING).second;
 	}
 
-	/// Update a posting.
-	void update_posting(Xapian::docid did, Xapian::termcount old_wdf,
+	/// Update a posting (returns true if it's a new entry).
+	bool update_posting(Xapian::docid did, Xapian::termcount old_wdf,
 			    Xapian::termcount new_wdf) {
 	    cf_delta += new_wdf - old_wdf;
-	    pl_changes[did] = new_wdf;
+	    return pl_changes.insert_or_assign(did, new_wdf).second;
+	}
+
+	/// Approximate memory used by the changes for @a term.
+	size_t memory_used(const std::string & term) const {
+	    return term.size() + (pl_changes.size() + 1) * ENTRY_OVERHEAD;
 	}
 
 	/// Get the term frequency delta.
@@ -119,6 +124,15 @@ class Inverter {
     /// Buffered changes to positional data.
     std::map<std::string, std::map<Xapian::docid, std::string>> pos_changes;
 
+    /// Approximate per entry overhead of the buffered changes.
+    static constexpr size_t ENTRY_OVERHEAD = 64;
+
+    /// Approximate memory used by the buffered postlist changes.
+    size_t postlist_memory = 0;
+
+    /// Approximate memory used by the buffered positional data changes.
+    size_t positions_memory = 0;
+
     void store_positions(const GlassPositionListTable & position_table,
 			 Xapian::docid did,
 			 const std::string & tname,
@@ -141,8 +155,9 @@ class Inverter {
 	if (i == postlist_changes.end()) {
 	    postlist_changes.insert(
 		std::make_pair(term, PostingChanges(did, wdf)));
-	} else {
-	    i->second.add_posting(did, wdf);
+	    postlist_memory += term.size() + 2 * ENTRY_OVERHEAD;
+	} else if (i->second.add_posting(did, wdf)) {
+	    postlist_memory += ENTRY_OVERHEAD;
 	}
     }
 
@@ -153,8 +168,9 @@ class Inverter {
 	if (i == postlist_changes.end()) {
 	    postlist_changes.insert(
 		std::make_pair(term, PostingChanges(did, wdf, false)));
-	} else {
-	    i->second.remove_posting(did, wdf);
+	    postlist_memory += term.size() + 2 * ENTRY_OVERHEAD;
+	} else if (i->second.remove_posting(did, wdf)) {
+	    postlist_memory += ENTRY_OVERHEAD;
 	}
     }
 
@@ -166,8 +182,9 @@ class Inverter {
 	if (i == postlist_changes.end()) {
 	    postlist_changes.insert(
 		std::make_pair(term, PostingChanges(did, old_wdf, new_wdf)));
-	} else {
-	    i->second.update_posting(did, old_wdf, new_wdf);
+	    postlist_memory += term.size() + 2 * ENTRY_OVERHEAD;
+	} else if (i->second.update_posting(did, old_wdf, new_wdf)) {
+	    postlist_memory += ENTRY_OVERHEAD;
 	}
     }
 
@@ -190,6 +207,19 @@ class Inverter {
 	doclen_changes.clear();
 	postlist_changes.clear();
 	pos_changes.clear();
+	postlist_memory = 0;
+	positions_memory = 0;
+    }
+
+    /** Approximate memory used by all the buffered changes.
+     *
+     *  It's an estimate (node overheads aren't exact), but it's cheap to
+     *  keep and it grows with what's really held, unlike the number of
+     *  changed documents.
+     */
+    size_t memory_used() const {
+	return postlist_memory + positions_memory +
+	       doclen_changes.size() * ENTRY_OVERHEAD;
     }
 
     void set_doclength(Xapian::docid did, Xapian::termcount doclen, bool add) {
@@ -80,9 +80,9 @@ class GlassPostListTable : public GlassTable {
 	{ }
 
 	void open(int flags_, const RootInfo & root_info,
-		  glass_revision_number_t rev) {
+		  glass_revision_number_t rev, const char * uuid = NULL) {
 	    doclen_pl.reset(0);
-	    GlassTable::open(flags_, root_info, rev);
+	    GlassTable::open(flags_, root_info, rev, uuid);
 	}
 
 	/// Merge changes for a term.
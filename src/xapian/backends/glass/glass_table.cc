@@ -40,6 +40,7 @@
 #include <climits>   /* for CHAR_BIT */
 
 #include "xapian/backends/glass/glass_freelist.h"
+#include "xapian/backends/glass/glass_blockcache.h"
 #include "xapian/backends/glass/glass_changes.h"
 #include "xapian/backends/glass/glass_cursor.h"
 #include "xapian/backends/glass/glass_defs.h"
@@ -49,6 +50,7 @@
 #include "xapian/common/filetests.h"
 #include "xapian/common/io_utils.h"
 #include "xapian/common/pack.h"
+#include "xapian/common/safesysstat.h"
 #include "xapian/common/wordaccess.h"
 
 #include <algorithm>  // for std::min()
@@ -165,6 +167,14 @@ GlassTable::read_block(uint4 n, uint8_t * p) const
 	GlassTable::throw_database_closed();
     AssertRel(n,<,free_list.get_first_unused_block());
 
+    // Blocks of read-only tables are shared by all the readers of the same
+    // revision (writable tables modify blocks in place before committing).
+    bool cached = !writable && !cache_id.empty();
+    if (cached &&
+	GlassBlockCache::get(cache_id, revision_number, n, p, block_size)) {
+	return;
+    }
+
     io_read_block(handle, reinterpret_cast<char *>(p), block_size, n, offset);
 
     if (GET_LEVEL(p) != LEVEL_FREELIST) {
@@ -175,6 +185,10 @@ GlassTable::read_block(uint4 n, uint8_t * p) const
 	    throw Xapian::DatabaseCorruptError(msg);
 	}
     }
+
+    if (cached) {
+	GlassBlockCache::put(cache_id, revision_number, n, p, block_size);
+    }
 }
 
 /** write_block(n, p, appending) writes block n in the DB file from address p.
@@ -1997,6 +2011,20 @@ GlassTable::do_open_to_read(const RootInfo * root_info,
 	}
     }
 
+    if (!cache_id.empty()) {
+	// The file identity keeps cached blocks of copies of the database
+	// (which share the UUID) apart.
+	struct stat statbuf;
+	if (fstat(handle, &statbuf) == 0) {
+	    cache_id.append(reinterpret_cast<const char *>(&statbuf.st_dev),
+			    sizeof(statbuf.st_dev));
+	    cache_id.append(reinterpret_cast<const char *>(&statbuf.st_ino),
+			    sizeof(statbuf.st_ino));
+	} else {
+	    cache_id.clear();
+	}
+    }
+
     basic_open(root_info, rev);
 
     read_root();
@@ -2004,15 +2032,21 @@ GlassTable::do_open_to_read(const RootInfo * root_info,
 
 void
 GlassTable::open(int flags_, const RootInfo & root_info,
-		 glass_revision_number_t rev)
+		 glass_revision_number_t rev, const char * uuid)
 {
-    LOGCALL_VOID(DB, "GlassTable::open", flags_|root_info|rev);
+    LOGCALL_VOID(DB, "GlassTable::open", flags_|root_info|rev|uuid);
     close();
 
     flags = flags_;
     block_size = root_info.get_blocksize();
     root = root_info.get_root();
 
+    cache_id.clear();
+    if (uuid) {
+	cache_id.assign(uuid, Uuid::BINARY_SIZE);
+	cache_id += tablename;
+    }
+
     if (!writable) {
 	do_open_to_read(&root_info, rev);
 	return;
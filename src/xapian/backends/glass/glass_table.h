@@ -498,9 +498,13 @@ class GlassTable {
 	 *  @exception Xapian::DatabaseOpeningError will be thrown if the table
 	 *	cannot be opened (but is not corrupt - eg, permission problems,
 	 *	not present, etc).
+	 *
+	 *  @param uuid	UUID of the database (Uuid::BINARY_SIZE bytes), when
+	 *		given, blocks of read-only tables are shared with other
+	 *		readers through the GlassBlockCache.
 	 */
 	void open(int flags_, const RootInfo & root_info,
-		  glass_revision_number_t rev);
+		  glass_revision_number_t rev, const char * uuid = NULL);
 
 	/** Return true if this table is open.
 	 *
@@ -905,6 +909,12 @@ class GlassTable {
 	/// offset to start of table in file.
 	off_t offset;
 
+	/** Identity of the table in the GlassBlockCache.
+	 *
+	 *  Empty if blocks of this table aren't cached.
+	 */
+	std::string cache_id;
+
 	/* Debugging methods */
 //	void report_block_full(int m, int n, const uint8_t * p);
 };
@@ -171,6 +171,9 @@ class GlassVersion {
     /** Create the version file. */
     void create(unsigned blocksize);
 
+    /// Use the UUID of @a other (for a compacted copy to take its place).
+    void copy_uuid(const GlassVersion & other) { uuid = other.uuid; }
+
     void set_changes(GlassChanges * changes_) { changes = changes_; }
 
     /** Read the version file and check it's a version we understand.
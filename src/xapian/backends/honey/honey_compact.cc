@@ -757,6 +757,7 @@ merge_postlists(Xapian::Compactor * compactor,
 	const string & key = cur->key;
 	if (key_type(key) != Honey::KEY_VALUE_CHUNK) break;
 	out->add(key, cur->tag);
+	if (compactor) compactor->progress(key.size() + cur->tag.size());
 	pq.pop();
 	if (cur->next()) {
 	    pq.push(cur);
@@ -833,6 +834,7 @@ merge_postlists(Xapian::Compactor * compactor,
 	    }
 	}
 	out->add(Honey::make_doclenchunk_key(chunk_lastdid), tag);
+	if (compactor) compactor->progress(tag.size());
     }
 
     Xapian::termcount tf = 0, cf = 0; // Initialise to avoid warnings.
@@ -961,6 +963,7 @@ merge_postlists(Xapian::Compactor * compactor,
 		    }
 		}
 		out->add(last_key, first_tag);
+		if (compactor) compactor->progress(last_key.size() + first_tag.size());
 
 		// If tf == 2, the data could be split over two tags when
 		// merging, but we only output an initial tag in this case.
@@ -1007,6 +1010,7 @@ merge_postlists(Xapian::Compactor * compactor,
 			}
 
 			out->add(pack_honey_postlist_key(term, last_did), tag);
+			if (compactor) compactor->progress(last_key.size() + tag.size());
 		    }
 		}
 	    }
@@ -1660,7 +1664,8 @@ class PositionCursorGt {
 };
 
 template<typename T, typename U> void
-merge_positions(T* out, const vector<U*> & inputs,
+merge_positions(Xapian::Compactor * compactor,
+		T* out, const vector<U*> & inputs,
 		const vector<Xapian::docid> & offset)
 {
     typedef decltype(*inputs[0]) table_type; // E.g. HoneyTable
@@ -1681,7 +1686,9 @@ merge_positions(T* out, const vector<U*> & inputs,
     while (!pq.empty()) {
 	cursor_type * cur = pq.top();
 	pq.pop();
-	out->add(cur->key, cur->get_tag());
+	const string & tag = cur->get_tag();
+	out->add(cur->key, tag);
+	if (compactor) compactor->progress(cur->key.size() + tag.size());
 	if (cur->next()) {
 	    pq.push(cur);
 	} else {
@@ -1691,7 +1698,8 @@ merge_positions(T* out, const vector<U*> & inputs,
 }
 
 template<typename T, typename U> void
-merge_docid_keyed(T *out, const vector<U*> & inputs,
+merge_docid_keyed(Xapian::Compactor * compactor,
+		  T *out, const vector<U*> & inputs,
 		  const vector<Xapian::docid> & offset,
 		  int = 0)
 {
@@ -1727,13 +1735,15 @@ merge_docid_keyed(T *out, const vector<U*> & inputs,
 	    }
 	    bool compressed = cur.read_tag(true);
 	    out->add(key, cur.current_tag, compressed);
+	    if (compactor) compactor->progress(key.size() + cur.current_tag.size());
 	}
     }
 }
 
 #ifdef XAPIAN_HAS_GLASS_BACKEND
 template<typename T> void
-merge_docid_keyed(T *out, const vector<const GlassTable*> & inputs,
+merge_docid_keyed(Xapian::Compactor * compactor,
+		  T *out, const vector<const GlassTable*> & inputs,
 		  const vector<Xapian::docid> & offset,
 		  Xapian::termcount & ut_lb, Xapian::termcount & ut_ub,
 		  int table_type = 0)
@@ -1915,13 +1925,16 @@ next_without_next:
 				      current_term.end());
 		    }
 		}
-		if (!newtag.empty())
+		if (!newtag.empty()) {
 		    out->add(key, newtag);
+		    if (compactor) compactor->progress(key.size() + newtag.size());
+		}
 		if (!next_result) break;
 		if (next_already_done) goto next_without_next;
 	    } else {
 		bool compressed = cur.read_tag(true);
 		out->add(key, cur.current_tag, compressed);
+		if (compactor) compactor->progress(key.size() + cur.current_tag.size());
 	    }
 	}
     }
@@ -2073,6 +2086,23 @@ HoneyDatabase::compact(Xapian::Compactor* compactor,
 	}
     }
 
+    honey_revision_number_t new_rev = 1;
+    if ((flags & Xapian::DBCOMPACT_KEEP_REVISION) && sources.size() == 1) {
+	// Keep the UUID and revision of the source, so the output can take
+	// its place.
+	if (source_backend == Xapian::DB_BACKEND_GLASS) {
+#ifdef XAPIAN_HAS_GLASS_BACKEND
+	    auto db = static_cast<const GlassDatabase*>(sources[0]);
+	    version_file_out->set_uuid(db->version_file.get_uuid());
+	    new_rev = max(db->version_file.get_revision(), new_rev);
+#endif
+	} else {
+	    auto db = static_cast<const HoneyDatabase*>(sources[0]);
+	    version_file_out->set_uuid(db->version_file.get_uuid());
+	    new_rev = max(db->version_file.get_revision(), new_rev);
+	}
+    }
+
     string fl_serialised;
 #if 0
     if (single_file) {
@@ -2247,23 +2277,23 @@ if (source_backend == Xapian::DB_BACKEND_GLASS) {
 		merge_synonyms(out, inputs.begin(), inputs.end());
 		break;
 	    case Honey::POSITION:
-		merge_positions(out, inputs, offset);
+		merge_positions(compactor, out, inputs, offset);
 		break;
 	    default: {
 		// DocData, Termlist
 		auto & v_out = version_file_out;
 		auto ut_lb = v_out->get_unique_terms_lower_bound();
 		auto ut_ub = v_out->get_unique_terms_upper_bound();
-		merge_docid_keyed(out, inputs, offset, ut_lb, ut_ub, t->type);
+		merge_docid_keyed(compactor, out, inputs, offset, ut_lb, ut_ub, t->type);
 		version_file_out->set_unique_terms_lower_bound(ut_lb);
 		version_file_out->set_unique_terms_upper_bound(ut_ub);
 		break;
 	    }
 	}
 
-	// Commit as revision 1.
+	// Commit as revision new_rev.
 	out->flush_db();
-	out->commit(1, root_info);
+	out->commit(new_rev, root_info);
 	out->sync();
 	if (single_file) fl_serialised = root_info->get_free_list();
 
@@ -2351,7 +2381,7 @@ if (source_backend == Xapian::DB_BACKEND_GLASS) {
 	}
     }
     version_file_out->set_last_docid(last_docid);
-    string tmpfile = version_file_out->write(1, FLAGS);
+    string tmpfile = version_file_out->write(new_rev, FLAGS);
     if (single_file) {
 	off_t version_file_size = lseek(fd, 0, SEEK_CUR);
 	if (version_file_size < 0) {
@@ -2365,8 +2395,8 @@ if (source_backend == Xapian::DB_BACKEND_GLASS) {
     for (unsigned j = 0; j != tabs.size(); ++j) {
 	tabs[j]->sync();
     }
-    // Commit with revision 1.
-    version_file_out->sync(tmpfile, 1, FLAGS);
+    // Commit with revision new_rev.
+    version_file_out->sync(tmpfile, new_rev, FLAGS);
     for (unsigned j = 0; j != tabs.size(); ++j) {
 	delete tabs[j];
     }
@@ -2532,17 +2562,17 @@ if (source_backend == Xapian::DB_BACKEND_GLASS) {
 		merge_synonyms(out, inputs.begin(), inputs.end());
 		break;
 	    case Honey::POSITION:
-		merge_positions(out, inputs, offset);
+		merge_positions(compactor, out, inputs, offset);
 		break;
 	    default:
 		// DocData, Termlist
-		merge_docid_keyed(out, inputs, offset);
+		merge_docid_keyed(compactor, out, inputs, offset);
 		break;
 	}
 
-	// Commit as revision 1.
+	// Commit as revision new_rev.
 	out->flush_db();
-	out->commit(1, root_info);
+	out->commit(new_rev, root_info);
 	out->sync();
 	if (single_file) fl_serialised = root_info->get_free_list();
 
@@ -2630,12 +2660,12 @@ if (source_backend == Xapian::DB_BACKEND_GLASS) {
 	}
     }
     version_file_out->set_last_docid(last_docid);
-    string tmpfile = version_file_out->write(1, FLAGS);
+    string tmpfile = version_file_out->write(new_rev, FLAGS);
     for (unsigned j = 0; j != tabs.size(); ++j) {
 	tabs[j]->sync();
     }
-    // Commit with revision 1.
-    version_file_out->sync(tmpfile, 1, FLAGS);
+    // Commit with revision new_rev.
+    version_file_out->sync(tmpfile, new_rev, FLAGS);
     for (unsigned j = 0; j != tabs.size(); ++j) {
 	delete tabs[j];
     }
@@ -163,6 +163,9 @@ class HoneyVersion {
     /** Create the version file. */
     void create();
 
+    /// Use the 16 byte UUID @a data (for a compacted copy to take the place of its source).
+    void set_uuid(const char * data) { uuid.assign(data); }
+
     /** Read the version file and check it's a version we understand.
      *
      *  On failure, an exception is thrown.
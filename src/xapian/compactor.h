@@ -68,6 +68,19 @@ class XAPIAN_VISIBILITY_DEFAULT Compactor {
     virtual void
     set_status(const std::string & table, const std::string & status);
 
+    /** Report output written.
+     *
+     *  Called as items are added to the output tables, with the size of
+     *  each item, so subclasses can report progress or throttle the
+     *  compaction.
+     *
+     *  The default implementation does nothing.
+     *
+     *  @param size	Size (in bytes) of the item added.
+     */
+    virtual void
+    progress(size_t size);
+
     /** Resolve multiple user metadata entries with the same key.
      *
      *  When merging, if the same user metadata key is set in more than one
@@ -274,6 +274,14 @@ const int DBCOMPACT_MULTIPASS = 8;
  */
 const int DBCOMPACT_SINGLE_FILE = 16;
 
+/** Keep the UUID and revision of the source database.
+ *
+ *  Only used when compacting a single database, so the output can take the
+ *  place of the source (e.g. keeping changesets or logs keyed on them
+ *  valid).  Supported by the glass and honey backends.
+ */
+const int DBCOMPACT_KEEP_REVISION = 32;
+
 /** Assume document id is valid.
  *
  *  By default, Database::get_document() checks that the document id passed is
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2015-2018 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+
+#include <string>                   // for std::string
+#include <vector>                   // for std::vector
+
+#include "compressor_lz4.h"         // for compress_lz4, decompress_lz4, LZ4Dictionary
+
+
+static std::string
+sample_data(int count)
+{
+	std::string data;
+	for (int i = 0; i < count; ++i) {
+		data += "{\"id\":" + std::to_string(i) + ",\"name\":\"document " + std::to_string(i * 7 % 13) + "\",\"tags\":[\"alpha\",\"beta\"]}\n";
+	}
+	return data;
+}
+
+
+// sample_data(40) compressed before dictionaries were supported
+static const char legacy_bytes[] =
+	"\x8c\x01\xf2\x26\x7b\x22\x69\x64\x22\x3a\x30\x2c\x22\x6e\x61\x6d\x65\x22\x3a\x22"
+	"\x64\x6f\x63\x75\x6d\x65\x6e\x74\x20\x30\x22\x2c\x22\x74\x61\x67\x73\x22\x3a\x5b"
+	"\x22\x61\x6c\x70\x68\x61\x22\x2c\x22\x62\x65\x74\x61\x22\x5d\x7d\x0a\x35\x00\x1e"
+	"\x31\x35\x00\x1f\x37\x35\x00\x0e\x1e\x32\x35\x00\x1f\x31\x35\x00\x0e\x1e\x33\x35"
+	"\x00\x1f\x38\x35\x00\x0e\x1e\x34\x35\x00\x1f\x32\x35\x00\x0e\x1e\x35\x35\x00\x1f"
+	"\x39\x35\x00\x0e\x1e\x36\x35\x00\x1f\x33\x35\x00\x0e\x1e\x37\x35\x00\x1f\x31\x74"
+	"\x01\x0f\x1e\x38\x36\x00\x1f\x34\x6b\x00\x0e\x1e\x39\x35\x00\x1f\x31\x75\x01\x0f"
+	"\x1f\x31\x15\x02\x00\x1f\x35\x6c\x00\x0e\x1f\x31\x16\x02\x00\x1f\x31\x78\x01\x0f"
+	"\x1f\x31\x18\x02\x00\x1f\x36\x6d\x00\x0f\x0f\x19\x02\x00\x0f\x44\x01\x0f\x1f\x31"
+	"\x1a\x02\x00\x0f\xb9\x02\x0f\x1f\x31\x1b\x02\x00\x0f\x45\x01\x10\x0f\x1c\x02\x00"
+	"\x0f\xbb\x02\x0f\x1f\x31\x1d\x02\x00\x0f\x44\x01\x10\x0f\x1d\x02\x00\x0f\xbd\x02"
+	"\x0f\x1f\x31\x1e\x02\x00\x0f\xbe\x02\x0f\x1f\x32\x1d\x02\x00\x0f\xbf\x02\x10\x1f"
+	"\x32\x1e\x02\x00\x0f\xc0\x02\x0f\x1f\x32\x1d\x02\x00\x0f\xc1\x02\x10\x1f\x32\x1e"
+	"\x02\x00\x0f\xc1\x02\x0f\x1f\x32\x1e\x02\x00\x0f\xc1\x02\x10\x1f\x32\x1f\x02\x00"
+	"\x0f\xc1\x02\x0f\x1f\x32\x1f\x02\x00\x0f\xc1\x02\x0f\x1f\x32\x1f\x02\x00\x0f\xc1"
+	"\x02\x0f\x1f\x32\x1f\x02\x00\x0f\xc1\x02\x0f\x1f\x32\x1f\x02\x00\x0f\xc1\x02\x0f"
+	"\x1f\x33\x1f\x02\x00\x0f\xc1\x02\x0f\x1f\x33\x1e\x02\x00\x0f\xc1\x02\x0f\x1f\x33"
+	"\x1e\x02\x00\x0f\xc1\x02\x0f\x1f\x33\x1d\x02\x00\x0f\xc1\x02\x10\x1f\x33\x1e\x02"
+	"\x00\x0f\xc1\x02\x0f\x1f\x33\x1d\x02\x00\x0f\xc1\x02\x10\x1f\x33\x1e\x02\x00\x0f"
+	"\xc1\x02\x0f\x1f\x33\x1e\x02\x00\x0f\xc1\x02\x02\x50\x62\x65\x74\x61\x22\x1b\x00"
+	"\x05\xce\x07\x1f\x33\x1f\x02\x00\x0f\xc1\x02\x0f\x1f\x33\x1f\x02\x00\x0f\xc1\x02"
+	"\x04\x50\x61\x22\x5d\x7d\x0a";
+static const std::string legacy_compressed(legacy_bytes, sizeof(legacy_bytes) - 1);
+
+
+TEST(LZ4DictionaryTest, LegacyData) {
+	EXPECT_EQ(LZ4Dictionary::used_by(legacy_compressed), 0u);
+	EXPECT_EQ(decompress_lz4(legacy_compressed), sample_data(40));
+	EXPECT_EQ(compress_lz4(sample_data(40)), legacy_compressed);
+}
+
+
+TEST(LZ4DictionaryTest, RoundTrip) {
+	std::vector<std::string> samples;
+	for (int i = 1; i <= 100; ++i) {
+		samples.push_back(sample_data(i % 10 + 1));
+	}
+	auto data = sample_data(40);
+
+	// Written before the dictionary is trained
+	auto before = compress_lz4(data);
+	EXPECT_EQ(LZ4Dictionary::used_by(before), 0u);
+
+	auto trained = LZ4Dictionary::train(samples);
+	ASSERT_FALSE(trained.empty());
+	auto dictionary = LZ4Dictionary::add(std::string(trained));
+
+	// Written after it
+	auto after = compress_lz4(data, dictionary.get());
+	EXPECT_EQ(LZ4Dictionary::used_by(after), dictionary->id());
+	EXPECT_LT(after.size(), before.size());
+	EXPECT_EQ(decompress_lz4(before), data);
+	EXPECT_EQ(decompress_lz4(after), data);
+
+	// Loaded again (as shards do when reopened), it's the same one
+	auto reloaded = LZ4Dictionary::add(std::string(trained));
+	EXPECT_EQ(reloaded->id(), dictionary->id());
+	EXPECT_EQ(LZ4Dictionary::get(dictionary->id()), reloaded);
+	EXPECT_EQ(decompress_lz4(after), data);
+	EXPECT_EQ(decompress_lz4(legacy_compressed), sample_data(40));
+}
+
+
+TEST(LZ4DictionaryTest, UnknownDictionary) {
+	LZ4Dictionary unregistered(sample_data(10) + "unregistered");
+	auto compressed = compress_lz4(sample_data(40), &unregistered);
+	EXPECT_EQ(LZ4Dictionary::used_by(compressed), unregistered.id());
+	EXPECT_THROW(decompress_lz4(compressed), LZ4DictionaryNotFound);
+}
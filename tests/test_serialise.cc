@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2015-2018 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+
+#include <random>                   // for std::mt19937
+#include <string>                   // for std::string
+#include <vector>                   // for std::vector
+
+#include "database/schema.h"        // for FieldType
+#include "datetime.h"               // for Datetime
+#include "geospatial/ewkt.h"        // for EWKT
+#include "msgpack.h"                // for MsgPack
+#include "nameof.hh"                // for NAMEOF_ENUM
+#include "repr.hh"                  // for repr
+#include "serialise.h"              // for Serialise
+
+
+// The string types guess_type detects, checked without the str_candidates
+// pre-filter (FieldType::empty when it's none of them).
+static FieldType
+unfiltered_str_type(std::string_view str_value)
+{
+	if (Serialise::isUUID(str_value)) {
+		return FieldType::uuid;
+	}
+	if (Datetime::isDate(str_value)) {
+		return FieldType::date;
+	}
+	if (Datetime::isDatetime(str_value)) {
+		return FieldType::datetime;
+	}
+	if (Datetime::isTime(str_value)) {
+		return FieldType::time;
+	}
+	if (Datetime::isTimedelta(str_value)) {
+		return FieldType::timedelta;
+	}
+	if (EWKT::isEWKT(str_value)) {
+		return FieldType::geo;
+	}
+	return FieldType::empty;
+}
+
+
+static ::testing::AssertionResult
+same_guess(const std::string& str_value)
+{
+	auto expected = unfiltered_str_type(str_value);
+	auto guessed = Serialise::guess_type(MsgPack(str_value));
+	switch (guessed) {
+		case FieldType::uuid:
+		case FieldType::date:
+		case FieldType::datetime:
+		case FieldType::time:
+		case FieldType::timedelta:
+		case FieldType::geo:
+			break;
+		default:
+			// Not a string type, so both fall through to the same checks
+			guessed = FieldType::empty;
+			break;
+	}
+	if (guessed == expected) {
+		return ::testing::AssertionSuccess();
+	}
+	return ::testing::AssertionFailure() << repr(str_value) << " guessed as " << NAMEOF_ENUM(guessed) << ", expected " << NAMEOF_ENUM(expected);
+}
+
+
+static const std::vector<std::string> strings = {
+	// UUID
+	"5759b016-10c3-4526-a981-47d6a51a4a4e",
+	"{5759b016-10c3-4526-a981-47d6a51a4a4e}",
+	"urn:uuid:5759b016-10c3-4526-a981-47d6a51a4a4e",
+	"5759b016-10c3-4526-a981-47d6a51a4a4e;e8b13d1b-665f-4f4c-aa83-76fa782b030a",
+	"{5759b016-10c3-4526-a981-47d6a51a4a4e;e8b13d1b-665f-4f4c-aa83-76fa782b030a}",
+	"5759b01610c34526a98147d6a51a4a4e",
+	"~SsQg5tB5ufaNpsGLsdS5Ck",
+	"{}",
+	"{ }",
+	"urn:uuid:",
+	"urn:uuid:{}",
+	"{",
+	"}",
+	"~",
+	// Date and datetime
+	"2015-08-10",
+	"2015-8-10",
+	"2015/08/10",
+	"20150810",
+	"2015-08-10T10:12:12",
+	"2015-08-10T10:12:12.123Z",
+	"2015-08-10 10:12:12.123+05:30",
+	"2015 08 10T1:02:03,5 -2:30 || +1d/M",
+	"2015-08-10||+1y",
+	"0001-01-01",
+	"9999-12-31T23:59:59.999999",
+	// Time
+	"10:12",
+	"1:02",
+	"10:12:12",
+	"10:12:12.5",
+	"10:12:12+05:30",
+	"23:59:59.999-02:00",
+	"24:00",
+	// Timedelta
+	"+10:12",
+	"-10:12:12.5",
+	"+1:02",
+	"-00:00:00",
+	// EWKT
+	"POINT(10 20)",
+	"POINT (10 20)",
+	"SRID=4326;POINT(10 20)",
+	"CIRCLE(10 20, 1000)",
+	"MULTIPOINT(10 20, 30 40)",
+	"POLYGON((0 0, 1 1, 1 0))",
+	"GEOMETRYCOLLECTION(POINT(10 20), CIRCLE(10 20, 1000))",
+	"point(10 20)",
+	// Neither
+	"",
+	"a",
+	"Hello world",
+	"12",
+	"-12",
+	"1.5",
+	"1e10",
+	"--",
+	"::",
+	"+:",
+	"()",
+	"2015",
+};
+
+
+TEST(SerialiseTest, GuessTypeFiltered) {
+	for (const auto& str : strings) {
+		EXPECT_TRUE(same_guess(str));
+	}
+}
+
+
+TEST(SerialiseTest, GuessTypeFilteredMutations) {
+	// Single character mutations of the strings, to look for values the
+	// pre-filter rules out but a full check would accept.
+	static const char alphabet[] = "0123456789abcdef-/ T:.,+Z|;{}()~=";
+	std::mt19937 rng(0);
+	for (size_t i = 0; i < 100000; ++i) {
+		auto str = strings[rng() % strings.size()];
+		auto pos = str.empty() ? 0 : rng() % str.size();
+		auto chr = alphabet[rng() % (sizeof(alphabet) - 1)];
+		switch (str.empty() ? 1 : rng() % 3) {
+			case 0:
+				str[pos] = chr;
+				break;
+			case 1:
+				str.insert(pos, 1, chr);
+				break;
+			default:
+				str.erase(pos, 1);
+				break;
+		}
+		ASSERT_TRUE(same_guess(str));
+	}
+}
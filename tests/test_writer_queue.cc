@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2015-2018 Dubalu LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gtest/gtest.h"
+
+#include <atomic>                   // for std::atomic_int
+#include <mutex>                    // for std::mutex
+#include <thread>                   // for std::thread
+#include <utility>                  // for std::pair
+#include <vector>                   // for std::vector
+
+#include "writer_queue.h"           // for WriterQueue
+
+
+#define TEST_WRITER_QUEUE_SHARDS     2
+#define TEST_WRITER_QUEUE_PRODUCERS  8
+#define TEST_WRITER_QUEUE_ITEMS      20000
+
+
+TEST(WriterQueueTest, OneWriterInOrder) {
+	// Items are (producer, sequence) pairs, every producer writes to every
+	// shard in order, so each shard must see each producer's items in order.
+	using Item = std::pair<int, int>;
+
+	struct Shard {
+		WriterQueue<Item> queue;
+		std::atomic_int writing{0};
+		std::atomic_int overlaps{0};
+		std::atomic_int writers{0};
+		std::atomic_int wrapped{0};
+		std::vector<int> last;
+		int out_of_order = 0;
+		int written = 0;
+
+		Shard() : last(TEST_WRITER_QUEUE_PRODUCERS, -1) { }
+	} shards[TEST_WRITER_QUEUE_SHARDS];
+
+	std::mutex writers_mtx;
+	std::vector<std::thread> writers;
+
+	auto writer = [&](Shard& shard) {
+		shard.writers.fetch_add(1);
+		std::vector<Item> batch(64);
+		while (true) {
+			auto count = shard.queue.dequeue(batch.begin(), batch.size(), 1000);
+			if (count) {
+				if (shard.writing.fetch_add(1) != 0) {
+					shard.overlaps.fetch_add(1);
+				}
+				for (size_t i = 0; i < count; ++i) {
+					auto& item = batch[i];
+					if (shard.last[item.first] + 1 != item.second) {
+						++shard.out_of_order;
+					}
+					shard.last[item.first] = item.second;
+					++shard.written;
+				}
+				shard.writing.fetch_sub(1);
+				if (shard.queue.written(count)) {
+					break;
+				}
+				if (shard.queue.size() > TEST_WRITER_QUEUE_PRODUCERS * TEST_WRITER_QUEUE_ITEMS) {
+					// The count went below zero, this writer would never finish
+					shard.wrapped.fetch_add(1);
+					break;
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> producers;
+	for (int p = 0; p < TEST_WRITER_QUEUE_PRODUCERS; ++p) {
+		producers.emplace_back([&, p] {
+			for (int i = 0; i < TEST_WRITER_QUEUE_ITEMS; ++i) {
+				for (auto& shard : shards) {
+					if (shard.queue.enqueue(Item(p, i))) {
+						std::lock_guard<std::mutex> lk(writers_mtx);
+						writers.emplace_back(writer, std::ref(shard));
+					}
+				}
+			}
+		});
+	}
+	for (auto& producer : producers) {
+		producer.join();
+	}
+
+	// Writers started while joining can only be started by producers,
+	// which are all done by now.
+	{
+		std::lock_guard<std::mutex> lk(writers_mtx);
+		for (auto& thread : writers) {
+			thread.join();
+		}
+	}
+
+	for (auto& shard : shards) {
+		EXPECT_EQ(shard.wrapped.load(), 0);
+		EXPECT_EQ(shard.overlaps.load(), 0);
+		EXPECT_EQ(shard.out_of_order, 0);
+		EXPECT_EQ(shard.written, TEST_WRITER_QUEUE_PRODUCERS * TEST_WRITER_QUEUE_ITEMS);
+		EXPECT_EQ(shard.queue.size(), 0u);
+		EXPECT_GE(shard.writers.load(), 1);
+	}
+}